@@ -0,0 +1,117 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     abr.c
+* \ingroup  g_applspec
+* \brief    Implementation of the Abr class, adaptive bitrate control driven by RTCP reports.
+* \author   Milos Ladicorbic
+*
+* Loss based control in the spirit of the GCC sender side: more than 10 % loss cuts the bitrate in
+* proportion to the loss, less than 2 % lets it grow by 8 % per report, in between it holds. Over
+* the default TCP transport the network loses no packets and congestion shows up as a growing RTT
+* instead: an RTT well above the lowest one seen means the uplink queue is filling and is treated
+* like loss. The lowest RTT is taken over the last two windows of reports, a route that got longer
+* for good becomes the new base instead of reading as congestion forever. Below the minimum bitrate
+* the frame rate is halved, and restored first on the way up.
+*/
+
+#include "abr.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#define ABR_LOSS_HIGH           26                             /* fraction lost > 10 %, of 256 */
+#define ABR_LOSS_LOW            5                               /* fraction lost < 2 %, of 256 */
+#define ABR_QUEUE_DELAY_MS      200               /* RTT above baseRtt that counts as congestion */
+#define ABR_RTT_BACKOFF         85                     /* % of the bitrate kept on RTT congestion */
+#define ABR_INCREASE            108                      /* % of the bitrate after one increase */
+#define ABR_HOLD_REPORTS        3                    /* quiet reports after a decrease, ~15 s */
+#define ABR_RTT_WINDOW_REPORTS  12                         /* reports per baseRtt window, ~60 s */
+
+
+void Abr_initialize (Abr_t *pThis, uint32_t minBitrate, uint32_t maxBitrate, uint32_t bitrate,
+                     uint32_t maxDecimation) {
+
+    assert(pThis != NULL);
+    assert(minBitrate > 0 && minBitrate <= maxBitrate);
+
+    pThis->minBitrate = minBitrate;
+    pThis->maxBitrate = maxBitrate;
+    pThis->bitrate = (bitrate < minBitrate) ? minBitrate :
+                     (bitrate > maxBitrate) ? maxBitrate : bitrate;
+    pThis->maxDecimation = maxDecimation;
+    pThis->decimation = 0;
+    pThis->baseRtt = UINT32_MAX;
+    pThis->windowRtt = UINT32_MAX;
+    pThis->windowReports = 0;
+    pThis->holdReports = 0;
+    pThis->decreases = 0;
+    pThis->increases = 0;
+}
+
+AbrDecision_t Abr_update (Abr_t *pThis, const AbrReport_t *pReport) {
+    uint32_t bitrate;
+    bool_t   congested;
+
+    assert(pThis != NULL && pReport != NULL);
+
+    /* 0 is a report without a round trip measured yet. The base is the lowest RTT of the running
+     * and the previous window, so an old minimum ages out after one to two windows */
+    if (pReport->rtt != 0) {
+        if (pReport->rtt < pThis->windowRtt) {
+            pThis->windowRtt = pReport->rtt;
+        }
+        if (pReport->rtt < pThis->baseRtt) {
+            pThis->baseRtt = pReport->rtt;
+        }
+        if (++pThis->windowReports == ABR_RTT_WINDOW_REPORTS) {
+            pThis->baseRtt = pThis->windowRtt;
+            pThis->windowRtt = UINT32_MAX;
+            pThis->windowReports = 0;
+        }
+    }
+    congested = ((pReport->fractionLost > ABR_LOSS_HIGH) ||
+                 ((pReport->rtt != 0) &&
+                  (pReport->rtt > pThis->baseRtt + ABR_QUEUE_DELAY_MS))) ? TRUE : FALSE;
+
+    if (congested == TRUE) {
+        pThis->holdReports = ABR_HOLD_REPORTS;
+        if (pThis->bitrate > pThis->minBitrate) {
+            if (pReport->fractionLost > ABR_LOSS_HIGH) {
+                /* rate * (1 - 0.5 * loss), loss in 1/256 */
+                bitrate = (uint32_t)(((uint64_t)pThis->bitrate * (512 - pReport->fractionLost)) /
+                                     512);
+            } else {
+                bitrate = (pThis->bitrate * ABR_RTT_BACKOFF) / 100;
+            }
+            pThis->bitrate = (bitrate < pThis->minBitrate) ? pThis->minBitrate : bitrate;
+        } else if (pThis->decimation < pThis->maxDecimation) {
+            pThis->decimation++;                 /* no bitrate left to give, halve the frame rate */
+        } else {
+            return ABR_DECISION_HOLD;
+        }
+        pThis->decreases++;
+        return ABR_DECISION_DECREASE;
+    }
+
+    if ((pReport->fractionLost >= ABR_LOSS_LOW) || (pThis->holdReports > 0)) {
+        if (pThis->holdReports > 0) {
+            pThis->holdReports--;
+        }
+        return ABR_DECISION_HOLD;
+    }
+
+    if (pThis->decimation > 0) {
+        pThis->decimation--;                                 /* frame rate first, then bitrate */
+    } else if (pThis->bitrate < pThis->maxBitrate) {
+        bitrate = (pThis->bitrate * ABR_INCREASE) / 100 + 1;
+        pThis->bitrate = (bitrate > pThis->maxBitrate) ? pThis->maxBitrate : bitrate;
+    } else {
+        return ABR_DECISION_HOLD;
+    }
+    pThis->increases++;
+    return ABR_DECISION_INCREASE;
+}
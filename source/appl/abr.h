@@ -0,0 +1,60 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef ABR_H
+#define ABR_H
+
+/**
+* \file     abr.h
+* \ingroup  g_applspec
+* \brief    API for the Abr class, adaptive bitrate control driven by RTCP receiver reports.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "firestreamer.h"                                                               /* bool_t */
+
+/* one RTCP receiver report block about our stream */
+typedef struct AbrReportTag {
+    uint32_t                fractionLost;              /* 0..255, lost since the previous report */
+    uint32_t                jitter;                                       /* interarrival, in us */
+    uint32_t                rtt;                                             /* round trip, in ms */
+} AbrReport_t;
+
+/* what Abr_update() did with the report */
+typedef enum {
+    ABR_DECISION_HOLD = 0,
+    ABR_DECISION_DECREASE,                               /* lower bitrate or lower frame rate */
+    ABR_DECISION_INCREASE                                 /* higher frame rate or higher bitrate */
+} AbrDecision_t;
+
+/* the Abr object's data structure, embedded by the owner */
+typedef struct AbrTag {
+    uint32_t                minBitrate;                                                 /* kbit/s */
+    uint32_t                maxBitrate;                                                 /* kbit/s */
+    uint32_t                bitrate;                                /* current target, kbit/s */
+    uint32_t                maxDecimation;                       /* frame rate steps below min */
+    uint32_t                decimation;                   /* 1 of 2^decimation frames is kept */
+    uint32_t                baseRtt;       /* lowest RTT of the last windows, empty queue delay */
+    uint32_t                windowRtt;                        /* lowest RTT of the running window */
+    uint32_t                windowReports;                      /* reports in the running window */
+    uint32_t                holdReports;          /* reports to wait before the next increase */
+    uint32_t                decreases;
+    uint32_t                increases;
+} Abr_t;
+
+/* Abr - API */
+void Abr_initialize(Abr_t *pThis, uint32_t minBitrate, uint32_t maxBitrate, uint32_t bitrate,
+                    uint32_t maxDecimation);
+AbrDecision_t Abr_update(Abr_t *pThis, const AbrReport_t *pReport);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                                   /* ABR_H */
@@ -0,0 +1,652 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     capture.c
+* \ingroup  g_applspec
+* \brief    Implementation of the Capture class, epoll driven V4L2 capture from several devices.
+* \author   Milos Ladicorbic
+*
+* All devices share one epoll set and are served by the thread calling Capture_run(). A failing
+* device (ioctl error, hangup, no frames for CAPTURE_STALL_MS) is stopped, waits until the pipeline
+* has given back every buffer it holds, is closed and reopened with an exponential backoff. The
+* other devices keep streaming meanwhile. A device with all its buffers held by the consumer is
+* taken out of the epoll set, V4L2 reports EPOLLERR when no buffer is queued.
+*/
+
+#include "capture.h"
+#include "threads.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include "libv4l2.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define CAPTURE_STALL_MS        2000           /* no frame for this long, the device is restarted */
+#define CAPTURE_BACKOFF_MIN_MS  100                                     /* first reopen attempt */
+#define CAPTURE_BACKOFF_MAX_MS  5000                     /* doubled per failed attempt up to this */
+#define CAPTURE_MAX_EVENTS      (CAPTURE_MAX_DEVICES + 1)                       /* + the wake fd */
+
+typedef enum {
+    CAPTURE_STATE_READY = 0,                             /* opened, streams from Capture_run() on */
+    CAPTURE_STATE_STREAMING,
+    CAPTURE_STATE_DRAINING,          /* stopped on an error, waiting for the buffers to come back */
+    CAPTURE_STATE_CLOSED                                        /* closed, waiting to be reopened */
+} CaptureState_t;
+
+/* one mmap buffer, the handle given to the consumer with every frame */
+typedef struct CaptureBufferTag {
+    CaptureDevice_t         *pDevice;
+    void                    *start;
+    size_t                  length;
+    uint32_t                index;                                           /* V4L2 buffer index */
+    int                     dmabufFd;                    /* exported (VIDIOC_EXPBUF) buffer or -1 */
+} CaptureBuffer_t;
+
+/* the Capture device object's data structure */
+struct CaptureDeviceTag {
+    bool_t                  inUse;                                /* slot taken by Capture_open() */
+    CaptureConfig_t         config;
+    CaptureFormat_t         format;
+    bool_t                  formatValid;                  /* a reopen must get the same format */
+    Capture_frame_t         frame;
+    void                    *pUserData;
+    int                     fd;                                              /* -1 while closed */
+    CaptureState_t          state;
+    CaptureBuffer_t         buffers[CAPTURE_MAX_BUFFERS];
+    uint32_t                nBuffers;
+    uint32_t                nInFlight;             /* dequeued and not given back by the consumer */
+    bool_t                  polled;                                   /* fd is in the epoll set */
+    bool_t                  failed;               /* re-queueing failed in Capture_releaseFrame() */
+    int64_t                 deadlineUs;            /* stall watchdog or the next reopen attempt */
+    uint32_t                backoffMs;
+    uint32_t                sequenceBase;                    /* added to the driver's sequence */
+    uint32_t                sequenceNext;                      /* one past the last one delivered */
+    pthread_mutex_t         mutex;                     /* buffers are given back from gst threads */
+    pthread_cond_t          released;
+    CaptureStats_t          stats;
+};
+
+/* shared by all the devices */
+typedef struct CaptureSharedTag {
+    pthread_mutex_t         mutex;                                             /* device slots */
+    uint32_t                nDevices;
+    int                     epollFd;
+    int                     wakeFd;                   /* eventfd, interrupts Capture_run()'s wait */
+    _Atomic bool_t          stop;                          /* set by Capture_stop(), signal safe */
+} CaptureShared_t;
+
+static CaptureShared_t l_shared = { .mutex = PTHREAD_MUTEX_INITIALIZER, .epollFd = -1,
+                                    .wakeFd = -1 };
+static CaptureDevice_t l_devices[CAPTURE_MAX_DEVICES];                /* no dynamic memory, slots */
+
+/* private function declarations */
+static int Capture_ioctl__(int fd, unsigned long request, void *arg);
+static int64_t Capture_getTimeUs__(void);
+static void Capture_wake__(void);
+static bool_t Capture_openDevice__(CaptureDevice_t *pThis);
+static void Capture_closeDevice__(CaptureDevice_t *pThis);
+static bool_t Capture_queueBuffer__(CaptureDevice_t *pThis, uint32_t index);
+static bool_t Capture_streamOn__(CaptureDevice_t *pThis);
+static void Capture_setPolled__(CaptureDevice_t *pThis, bool_t polled);
+static void Capture_fail__(CaptureDevice_t *pThis, const char *pWhat, int error);
+static void Capture_readFrame__(CaptureDevice_t *pThis, uint32_t events);
+static void Capture_service__(CaptureDevice_t *pThis, int64_t nowUs);
+static int Capture_getTimeout__(int64_t nowUs);
+
+
+CaptureDevice_t* Capture_open (const CaptureConfig_t *pConfig, Capture_frame_t frame,
+                               void *pUserData) {
+    CaptureDevice_t     *pThis = NULL;
+    struct epoll_event  event;
+    uint32_t            i;
+
+    assert(pConfig != NULL && pConfig->path != NULL && frame != NULL);
+    assert(pConfig->buffers >= 2 && pConfig->buffers <= CAPTURE_MAX_BUFFERS);
+
+    pthread_mutex_lock(&l_shared.mutex);
+    for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+        if (l_devices[i].inUse != TRUE) {
+            pThis = &l_devices[i];
+            break;
+        }
+    }
+    if (pThis == NULL) {
+        pthread_mutex_unlock(&l_shared.mutex);
+        fprintf(stderr, "ERROR: %s: all %d capture slots are taken\n", pConfig->path,
+                CAPTURE_MAX_DEVICES);
+        return NULL;
+    }
+    if (l_shared.nDevices == 0) {
+        l_shared.epollFd = epoll_create1(EPOLL_CLOEXEC);
+        l_shared.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        CLEAR(event);
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        if ((l_shared.epollFd < 0) || (l_shared.wakeFd < 0) ||
+            (epoll_ctl(l_shared.epollFd, EPOLL_CTL_ADD, l_shared.wakeFd, &event) != 0)) {
+            perror("epoll");
+            if (l_shared.epollFd >= 0) {
+                close(l_shared.epollFd);
+            }
+            if (l_shared.wakeFd >= 0) {
+                close(l_shared.wakeFd);
+            }
+            l_shared.epollFd = -1;
+            l_shared.wakeFd = -1;
+            pthread_mutex_unlock(&l_shared.mutex);
+            return NULL;
+        }
+    }
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->inUse = TRUE;
+    l_shared.nDevices++;
+    pthread_mutex_unlock(&l_shared.mutex);
+
+    pThis->config = *pConfig;
+    pThis->frame = frame;
+    pThis->pUserData = pUserData;
+    pThis->fd = -1;
+    pThis->state = CAPTURE_STATE_READY;
+    pThis->backoffMs = CAPTURE_BACKOFF_MIN_MS;
+    pthread_mutex_init(&pThis->mutex, NULL);
+    pthread_cond_init(&pThis->released, NULL);
+
+    if (Capture_openDevice__(pThis) != TRUE) {
+        Capture_close(pThis);
+        return NULL;
+    }
+
+    return pThis;
+}
+
+void Capture_close (CaptureDevice_t *pThis) {
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    assert(pThis != NULL && pThis->inUse == TRUE);
+
+    pthread_mutex_lock(&pThis->mutex);
+    Capture_setPolled__(pThis, FALSE);
+    if (pThis->state == CAPTURE_STATE_STREAMING) {
+        Capture_ioctl__(pThis->fd, VIDIOC_STREAMOFF, &type);
+    }
+    pThis->state = CAPTURE_STATE_DRAINING;                   /* released buffers aren't re-queued */
+
+    /* wait for the consumer to release all buffers before unmapping them */
+    while (pThis->nInFlight > 0) {
+        pthread_cond_wait(&pThis->released, &pThis->mutex);
+    }
+    Capture_closeDevice__(pThis);
+    pthread_mutex_unlock(&pThis->mutex);
+    pthread_cond_destroy(&pThis->released);
+    pthread_mutex_destroy(&pThis->mutex);
+
+    pthread_mutex_lock(&l_shared.mutex);
+    pThis->inUse = FALSE;
+    assert(l_shared.nDevices > 0);
+    l_shared.nDevices--;
+    if (l_shared.nDevices == 0) {
+        close(l_shared.wakeFd);
+        close(l_shared.epollFd);
+        l_shared.wakeFd = -1;
+        l_shared.epollFd = -1;
+    }
+    pthread_mutex_unlock(&l_shared.mutex);
+}
+
+void Capture_getFormat (CaptureDevice_t *pThis, CaptureFormat_t *pFormat) {
+
+    assert(pThis != NULL && pFormat != NULL);
+
+    pthread_mutex_lock(&pThis->mutex);
+    *pFormat = pThis->format;
+    pthread_mutex_unlock(&pThis->mutex);
+}
+
+void Capture_getStats (CaptureDevice_t *pThis, CaptureStats_t *pStats) {
+
+    assert(pThis != NULL && pStats != NULL);
+
+    pthread_mutex_lock(&pThis->mutex);
+    *pStats = pThis->stats;
+    pthread_mutex_unlock(&pThis->mutex);
+}
+
+void Capture_releaseFrame (void *pBuffer) {
+    CaptureBuffer_t *pBuf = (CaptureBuffer_t*)pBuffer;
+    CaptureDevice_t *pThis;
+
+    assert(pBuf != NULL && pBuf->pDevice != NULL);
+    pThis = pBuf->pDevice;
+
+    pthread_mutex_lock(&pThis->mutex);
+    assert(pThis->nInFlight > 0);
+    pThis->nInFlight--;
+    if (pThis->state == CAPTURE_STATE_STREAMING) {
+        if (Capture_queueBuffer__(pThis, pBuf->index) == TRUE) {
+            if (pThis->polled != TRUE) {
+                /* the driver has a buffer again, the time it had none doesn't count as a stall */
+                pThis->deadlineUs = Capture_getTimeUs__() + CAPTURE_STALL_MS * 1000;
+                Capture_setPolled__(pThis, TRUE);
+            }
+        } else {
+            pThis->failed = TRUE;                      /* Capture_run() restarts the device */
+            Capture_wake__();
+        }
+    } else if ((pThis->state == CAPTURE_STATE_DRAINING) && (pThis->nInFlight == 0)) {
+        Capture_wake__();                                          /* the device can be closed */
+    }
+    pthread_cond_signal(&pThis->released);
+    pthread_mutex_unlock(&pThis->mutex);
+}
+
+bool_t Capture_run (void) {
+    struct epoll_event  events[CAPTURE_MAX_EVENTS];
+    CaptureDevice_t     *pThis;
+    uint64_t            value;
+    int64_t             nowUs;
+    int                 n, i;
+
+    assert(l_shared.epollFd >= 0);
+
+    /* NOTE: devices must not be opened or closed while Capture_run() is running */
+    for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+        pThis = &l_devices[i];
+        if ((pThis->inUse == TRUE) && (pThis->state == CAPTURE_STATE_READY)) {
+            pthread_mutex_lock(&pThis->mutex);
+            if (Capture_streamOn__(pThis) != TRUE) {
+                Capture_fail__(pThis, "VIDIOC_STREAMON", errno);
+            }
+            pthread_mutex_unlock(&pThis->mutex);
+        }
+    }
+
+    while (atomic_load(&l_shared.stop) != TRUE) {
+        n = epoll_wait(l_shared.epollFd, events, CAPTURE_MAX_EVENTS,
+                       Capture_getTimeout__(Capture_getTimeUs__()));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            return FALSE;
+        }
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                if (read(l_shared.wakeFd, &value, sizeof(value)) < 0) {
+                    /* EAGAIN, another wake-up consumed it already */
+                }
+            } else {
+                Capture_readFrame__((CaptureDevice_t*)events[i].data.ptr, events[i].events);
+            }
+        }
+        nowUs = Capture_getTimeUs__();
+        for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+            if (l_devices[i].inUse == TRUE) {
+                Capture_service__(&l_devices[i], nowUs);
+            }
+        }
+    }
+    atomic_store(&l_shared.stop, FALSE);
+
+    return TRUE;
+}
+
+void Capture_stop (void) {
+
+    /* async-signal-safe, may be called from a signal handler */
+    atomic_store(&l_shared.stop, TRUE);
+    Capture_wake__();
+}
+
+
+/* private function definition */
+static int Capture_ioctl__ (int fd, unsigned long request, void *arg) {
+    int r;
+
+    do {
+        r = v4l2_ioctl(fd, request, arg);
+    } while ((r == -1) && (errno == EINTR));
+
+    return r;
+}
+
+static int64_t Capture_getTimeUs__ (void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void Capture_wake__ (void) {
+    uint64_t one = 1;
+    int      savedErrno = errno;
+
+    if ((l_shared.wakeFd >= 0) && (write(l_shared.wakeFd, &one, sizeof(one)) < 0)) {
+        /* counter saturated, Capture_run() wakes up anyway */
+    }
+    errno = savedErrno;
+}
+
+static bool_t Capture_openDevice__ (CaptureDevice_t *pThis) {
+    struct v4l2_format          fmt;
+    struct v4l2_streamparm      parm;
+    struct v4l2_requestbuffers  req;
+    struct v4l2_buffer          buf;
+    struct v4l2_exportbuffer    expbuf;
+    CaptureBuffer_t             *pBuf;
+    uint32_t                    i;
+
+    pThis->fd = v4l2_open(pThis->config.path, O_RDWR | O_NONBLOCK, 0);
+    if (pThis->fd < 0) {
+        fprintf(stderr, "ERROR: %s: cannot open device, %s\n", pThis->config.path,
+                strerror(errno));
+        return FALSE;
+    }
+
+    CLEAR(fmt);
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = pThis->config.width;
+    fmt.fmt.pix.height = pThis->config.height;
+    fmt.fmt.pix.pixelformat = pThis->config.pixelFormat;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (Capture_ioctl__(pThis->fd, VIDIOC_S_FMT, &fmt) != 0) {
+        fprintf(stderr, "ERROR: %s: VIDIOC_S_FMT, %s\n", pThis->config.path, strerror(errno));
+        Capture_closeDevice__(pThis);
+        return FALSE;
+    }
+    if (fmt.fmt.pix.pixelformat != pThis->config.pixelFormat) {
+        fprintf(stderr, "ERROR: %s: driver didn't accept the pixel format\n", pThis->config.path);
+        Capture_closeDevice__(pThis);
+        return FALSE;
+    }
+    if ((pThis->formatValid == TRUE) &&
+        ((fmt.fmt.pix.width != pThis->format.width) ||
+         (fmt.fmt.pix.height != pThis->format.height) ||
+         (fmt.fmt.pix.bytesperline != pThis->format.stride))) {
+        fprintf(stderr, "ERROR: %s: format changed to %ux%u after reopening\n",
+                pThis->config.path, fmt.fmt.pix.width, fmt.fmt.pix.height);
+        Capture_closeDevice__(pThis);
+        return FALSE;
+    }
+
+    CLEAR(req);
+    req.count = pThis->config.buffers;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if ((Capture_ioctl__(pThis->fd, VIDIOC_REQBUFS, &req) != 0) || (req.count < 2)) {
+        fprintf(stderr, "ERROR: %s: VIDIOC_REQBUFS, %s\n", pThis->config.path, strerror(errno));
+        Capture_closeDevice__(pThis);
+        return FALSE;
+    }
+
+    pThis->format.dmabuf = pThis->config.dmabuf;
+    pThis->nBuffers = 0;
+    for (i = 0; (i < req.count) && (i < CAPTURE_MAX_BUFFERS); i++) {
+        pBuf = &pThis->buffers[i];
+        CLEAR(buf);
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (Capture_ioctl__(pThis->fd, VIDIOC_QUERYBUF, &buf) != 0) {
+            fprintf(stderr, "ERROR: %s: VIDIOC_QUERYBUF, %s\n", pThis->config.path,
+                    strerror(errno));
+            Capture_closeDevice__(pThis);
+            return FALSE;
+        }
+        pBuf->pDevice = pThis;
+        pBuf->index = i;
+        pBuf->length = buf.length;
+        pBuf->dmabufFd = -1;
+        pBuf->start = v4l2_mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, pThis->fd,
+                                buf.m.offset);
+        if (pBuf->start == MAP_FAILED) {
+            fprintf(stderr, "ERROR: %s: mmap, %s\n", pThis->config.path, strerror(errno));
+            Capture_closeDevice__(pThis);
+            return FALSE;
+        }
+        pThis->nBuffers++;
+
+        /* export buffer so the encoder can import it without touching the pixels */
+        if (pThis->format.dmabuf == TRUE) {
+            CLEAR(expbuf);
+            expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            expbuf.index = i;
+            expbuf.flags = O_RDWR | O_CLOEXEC;
+            if (Capture_ioctl__(pThis->fd, VIDIOC_EXPBUF, &expbuf) == 0) {
+                pBuf->dmabufFd = expbuf.fd;
+            } else {
+                fprintf(stderr, "%s: VIDIOC_EXPBUF, %s\n", pThis->config.path, strerror(errno));
+                pThis->format.dmabuf = FALSE;
+            }
+        }
+    }
+    for (i = 0; (pThis->format.dmabuf != TRUE) && (i < pThis->nBuffers); i++) {
+        if (pThis->buffers[i].dmabufFd >= 0) {                 /* export failed, use mmap buffers */
+            close(pThis->buffers[i].dmabufFd);
+            pThis->buffers[i].dmabufFd = -1;
+        }
+    }
+
+    for (i = 0; i < pThis->nBuffers; i++) {
+        if (Capture_queueBuffer__(pThis, i) != TRUE) {
+            fprintf(stderr, "ERROR: %s: VIDIOC_QBUF, %s\n", pThis->config.path, strerror(errno));
+            Capture_closeDevice__(pThis);
+            return FALSE;
+        }
+    }
+
+    pThis->format.width = fmt.fmt.pix.width;
+    pThis->format.height = fmt.fmt.pix.height;
+    pThis->format.stride = fmt.fmt.pix.bytesperline;
+    pThis->format.pixelFormat = fmt.fmt.pix.pixelformat;
+    pThis->format.buffers = pThis->nBuffers;
+
+    /* frame rate the driver runs at, rounded to whole frames. Not every driver reports it */
+    pThis->format.fps = 0;
+    CLEAR(parm);
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if ((Capture_ioctl__(pThis->fd, VIDIOC_G_PARM, &parm) == 0) &&
+        (parm.parm.capture.timeperframe.numerator != 0)) {
+        pThis->format.fps = (parm.parm.capture.timeperframe.denominator +
+                             parm.parm.capture.timeperframe.numerator / 2) /
+                            parm.parm.capture.timeperframe.numerator;
+    }
+    pThis->formatValid = TRUE;
+    pThis->sequenceBase = pThis->sequenceNext;      /* the driver counts from 0 again on reopen */
+
+    return TRUE;
+}
+
+static void Capture_closeDevice__ (CaptureDevice_t *pThis) {
+    uint32_t i;
+
+    for (i = 0; i < pThis->nBuffers; i++) {
+        if (pThis->buffers[i].dmabufFd >= 0) {
+            close(pThis->buffers[i].dmabufFd);
+        }
+        v4l2_munmap(pThis->buffers[i].start, pThis->buffers[i].length);
+    }
+    pThis->nBuffers = 0;
+    if (pThis->fd >= 0) {
+        v4l2_close(pThis->fd);
+        pThis->fd = -1;
+    }
+}
+
+static bool_t Capture_queueBuffer__ (CaptureDevice_t *pThis, uint32_t index) {
+    struct v4l2_buffer buf;
+
+    CLEAR(buf);
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+
+    return (Capture_ioctl__(pThis->fd, VIDIOC_QBUF, &buf) == 0) ? TRUE : FALSE;
+}
+
+static bool_t Capture_streamOn__ (CaptureDevice_t *pThis) {
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (Capture_ioctl__(pThis->fd, VIDIOC_STREAMON, &type) != 0) {
+        return FALSE;
+    }
+    pThis->state = CAPTURE_STATE_STREAMING;
+    pThis->failed = FALSE;
+    pThis->deadlineUs = Capture_getTimeUs__() + CAPTURE_STALL_MS * 1000;
+    Capture_setPolled__(pThis, TRUE);
+
+    return TRUE;
+}
+
+static void Capture_setPolled__ (CaptureDevice_t *pThis, bool_t polled) {
+    struct epoll_event event;
+
+    if (pThis->polled == polled) {
+        return;
+    }
+    CLEAR(event);
+    event.events = EPOLLIN;
+    event.data.ptr = pThis;
+    if (epoll_ctl(l_shared.epollFd, (polled == TRUE) ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, pThis->fd,
+                  &event) == 0) {
+        pThis->polled = polled;
+    }
+}
+
+static void Capture_fail__ (CaptureDevice_t *pThis, const char *pWhat, int error) {
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    /* called with the mutex held, buffers still held by the consumer are not re-queued */
+    fprintf(stderr, "ERROR: %s: %s%s%s, restarting the device\n", pThis->config.path, pWhat,
+            (error != 0) ? ", " : "", (error != 0) ? strerror(error) : "");
+    pThis->stats.errors++;
+    Capture_setPolled__(pThis, FALSE);
+    if (pThis->state == CAPTURE_STATE_STREAMING) {
+        Capture_ioctl__(pThis->fd, VIDIOC_STREAMOFF, &type);
+    }
+    pThis->state = CAPTURE_STATE_DRAINING;
+}
+
+static void Capture_readFrame__ (CaptureDevice_t *pThis, uint32_t events) {
+    struct v4l2_buffer  buf;
+    CaptureFrame_t      frame;
+    CaptureBuffer_t     *pBuf;
+
+    pthread_mutex_lock(&pThis->mutex);
+    if (pThis->state != CAPTURE_STATE_STREAMING) {
+        pthread_mutex_unlock(&pThis->mutex);
+        return;
+    }
+    if ((events & EPOLLIN) == 0) {
+        Capture_fail__(pThis, (events & EPOLLHUP) ? "device hung up" : "poll error", 0);
+        pthread_mutex_unlock(&pThis->mutex);
+        return;
+    }
+
+    CLEAR(buf);
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (Capture_ioctl__(pThis->fd, VIDIOC_DQBUF, &buf) != 0) {
+        if (errno != EAGAIN) {
+            Capture_fail__(pThis, "VIDIOC_DQBUF", errno);
+        }
+        pthread_mutex_unlock(&pThis->mutex);
+        return;
+    }
+    pBuf = &pThis->buffers[buf.index];
+    pThis->nInFlight++;
+    if (pThis->nInFlight >= pThis->nBuffers) {
+        Capture_setPolled__(pThis, FALSE);       /* all buffers are held by the consumer for now */
+    }
+    pThis->stats.frames++;
+    pThis->backoffMs = CAPTURE_BACKOFF_MIN_MS;                          /* the device works again */
+
+    frame.pData = pBuf->start;
+    frame.size = buf.bytesused;
+    frame.dmabufFd = pBuf->dmabufFd;
+    frame.pBuffer = pBuf;
+    frame.info.dequeueUs = Capture_getTimeUs__();
+    frame.info.sequence = pThis->sequenceBase + buf.sequence;
+    frame.info.captureUs = 0;                   /* wall clock timestamps, dequeue time is used */
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        frame.info.captureUs = (int64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+        Threads_recordWake(THREADS_ROLE_CAPTURE, frame.info.dequeueUs - frame.info.captureUs);
+    }
+    pThis->sequenceNext = frame.info.sequence + 1;
+    pThis->deadlineUs = frame.info.dequeueUs + CAPTURE_STALL_MS * 1000;
+    pthread_mutex_unlock(&pThis->mutex);
+
+    /* unlocked, the consumer may release the frame before returning */
+    pThis->frame(pThis, &frame, pThis->pUserData);
+}
+
+static void Capture_service__ (CaptureDevice_t *pThis, int64_t nowUs) {
+
+    pthread_mutex_lock(&pThis->mutex);
+    if (pThis->state == CAPTURE_STATE_STREAMING) {
+        if (pThis->failed == TRUE) {
+            Capture_fail__(pThis, "VIDIOC_QBUF", 0);
+        } else if ((nowUs >= pThis->deadlineUs) && (pThis->polled == TRUE)) {
+            Capture_fail__(pThis, "no frames", 0);          /* a starved driver is not stalled */
+        }
+    }
+    if ((pThis->state == CAPTURE_STATE_DRAINING) && (pThis->nInFlight == 0)) {
+        Capture_closeDevice__(pThis);
+        pThis->state = CAPTURE_STATE_CLOSED;
+        pThis->deadlineUs = nowUs + (int64_t)pThis->backoffMs * 1000;
+    } else if ((pThis->state == CAPTURE_STATE_CLOSED) && (nowUs >= pThis->deadlineUs)) {
+        if ((Capture_openDevice__(pThis) == TRUE) && (Capture_streamOn__(pThis) == TRUE)) {
+            pThis->stats.restarts++;
+            printf("%s: capture restarted\n", pThis->config.path);
+        } else {
+            Capture_closeDevice__(pThis);
+            pThis->backoffMs = (pThis->backoffMs * 2 > CAPTURE_BACKOFF_MAX_MS) ?
+                               CAPTURE_BACKOFF_MAX_MS : pThis->backoffMs * 2;
+            pThis->deadlineUs = nowUs + (int64_t)pThis->backoffMs * 1000;
+        }
+    }
+    pthread_mutex_unlock(&pThis->mutex);
+}
+
+static int Capture_getTimeout__ (int64_t nowUs) {
+    CaptureDevice_t *pThis;
+    int64_t         deadlineUs = INT64_MAX;
+    int64_t         timeoutMs;
+    int             i;
+
+    /* sleep until the closest stall watchdog or reopen attempt. Draining devices and devices with
+     * all buffers held by the consumer wake us up from Capture_releaseFrame() */
+    for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+        pThis = &l_devices[i];
+        if (pThis->inUse != TRUE) {
+            continue;
+        }
+        pthread_mutex_lock(&pThis->mutex);
+        if ((((pThis->state == CAPTURE_STATE_STREAMING) && (pThis->polled == TRUE)) ||
+             (pThis->state == CAPTURE_STATE_CLOSED)) && (pThis->deadlineUs < deadlineUs)) {
+            deadlineUs = pThis->deadlineUs;
+        }
+        pthread_mutex_unlock(&pThis->mutex);
+    }
+    if (deadlineUs == INT64_MAX) {
+        return -1;
+    }
+    timeoutMs = (deadlineUs - nowUs + 999) / 1000;
+
+    return (timeoutMs < 0) ? 0 : (int)timeoutMs;
+}
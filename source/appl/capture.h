@@ -0,0 +1,83 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/**
+* \file     capture.h
+* \ingroup  g_applspec
+* \brief    API for the Capture class, epoll driven V4L2 capture from several devices.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "firestreamer.h"                                             /* bool_t, FrameInfo_t */
+
+#define CAPTURE_MAX_DEVICES     8                  /* NOTE: devices are static slots, no malloc */
+#define CAPTURE_MAX_BUFFERS     16                                     /* mmap buffers per device */
+
+/* the Capture device object, opaque */
+typedef struct CaptureDeviceTag CaptureDevice_t;
+
+/* what to open and how, the strings must stay valid until Capture_close() */
+typedef struct CaptureConfigTag {
+    const char              *path;                                           /* e.g. /dev/video0 */
+    uint32_t                width;                            /* requested, the driver may adjust */
+    uint32_t                height;
+    uint32_t                pixelFormat;                  /* V4L2 fourcc, the driver must take it */
+    uint32_t                buffers;                       /* 2..CAPTURE_MAX_BUFFERS mmap buffers */
+    bool_t                  dmabuf;                    /* export the buffers, see CaptureFormat_t */
+} CaptureConfig_t;
+
+/* format agreed with the driver */
+typedef struct CaptureFormatTag {
+    uint32_t                width;
+    uint32_t                height;
+    uint32_t                stride;                                            /* bytes per line */
+    uint32_t                pixelFormat;
+    uint32_t                fps;                         /* from VIDIOC_G_PARM, 0 if not reported */
+    uint32_t                buffers;                               /* granted by the driver */
+    bool_t                  dmabuf;                    /* FALSE if the driver can't export them */
+} CaptureFormat_t;
+
+/* one dequeued frame, owned by the consumer until it calls Capture_releaseFrame(pBuffer) */
+typedef struct CaptureFrameTag {
+    void                    *pData;                                         /* mmap'ed buffer */
+    uint32_t                size;                                              /* bytes used */
+    int                     dmabufFd;                                       /* exported or -1 */
+    void                    *pBuffer;                    /* handle for Capture_releaseFrame() */
+    FireStreamerFrameInfo_t info;       /* sequence keeps counting across device restarts */
+} CaptureFrame_t;
+
+/* Capture counters, every one of them only grows */
+typedef struct CaptureStatsTag {
+    uint32_t                frames;                                            /* dequeued frames */
+    uint32_t                errors;                 /* failed ioctls, hangups and stalled streams */
+    uint32_t                restarts;                                 /* successful reopens */
+} CaptureStats_t;
+
+/* called from Capture_run() for every dequeued frame */
+typedef void (*Capture_frame_t)(CaptureDevice_t *pDevice, const CaptureFrame_t *pFrame,
+                                void *pUserData);
+
+/* Capture - API */
+CaptureDevice_t* Capture_open(const CaptureConfig_t *pConfig, Capture_frame_t frame,
+                              void *pUserData);
+void Capture_close(CaptureDevice_t *pThis);
+void Capture_getFormat(CaptureDevice_t *pThis, CaptureFormat_t *pFormat);
+void Capture_getStats(CaptureDevice_t *pThis, CaptureStats_t *pStats);
+void Capture_releaseFrame(void *pBuffer);                          /* FireStreamer_releaseFrame_t */
+bool_t Capture_run(void);
+void Capture_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                               /* CAPTURE_H */
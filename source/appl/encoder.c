@@ -0,0 +1,337 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     encoder.c
+* \ingroup  g_applspec
+* \brief    Implementation of the Encoder module, maps h.264 settings onto GStreamer encoders.
+* \author   Milos Ladicorbic
+*
+* Every backend gets the same knobs: bitrate, GOP length, profile, rate control and zero-latency
+* tuning. B-frames are always off, a live stream can't wait for future frames. Properties are set
+* through gst_util_set_object_arg() so enum and flag values are given by nick, which keeps this
+* file working across plugin versions. A knob the installed plugin doesn't know is reported and
+* skipped.
+*/
+
+#include "encoder.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+/* encoder element factory names, AUTO prefers the hardware encoder */
+static const char* const l_factoryName[] = {
+    [FIRESTREAMER_ENCODER_AUTO]     = NULL,
+    [FIRESTREAMER_ENCODER_V4L2]     = "v4l2h264enc",
+    [FIRESTREAMER_ENCODER_X264]     = "x264enc",
+    [FIRESTREAMER_ENCODER_OPENH264] = "openh264enc",
+};
+static const FireStreamerEncoder_t l_autoOrder[] = {
+    FIRESTREAMER_ENCODER_V4L2, FIRESTREAMER_ENCODER_X264, FIRESTREAMER_ENCODER_OPENH264
+};
+static const char* const l_profileName[] = {
+    [FIRESTREAMER_PROFILE_BASELINE] = "constrained-baseline",
+    [FIRESTREAMER_PROFILE_MAIN]     = "main",
+    [FIRESTREAMER_PROFILE_HIGH]     = "high",
+};
+
+/* private function declarations */
+static void Encoder_setArg__(GstElement *encoder, const char *pProperty, const char *pValue);
+static void Encoder_setUint__(GstElement *encoder, const char *pProperty, uint32_t value);
+static void Encoder_configureV4l2__(GstElement *encoder, const EncoderSettings_t *pSettings);
+static void Encoder_configureX264__(GstElement *encoder, const EncoderSettings_t *pSettings);
+static void Encoder_configureOpenh264__(GstElement *encoder, const EncoderSettings_t *pSettings);
+
+
+bool_t Encoder_isAvailable (FireStreamerEncoder_t backend) {
+    GstElementFactory *factory;
+
+    assert(backend < FIRESTREAMER_ENCODER_COUNT);
+
+    if (backend == FIRESTREAMER_ENCODER_AUTO) {
+        return (Encoder_resolve(backend) != FIRESTREAMER_ENCODER_AUTO) ? TRUE : FALSE;
+    }
+    factory = gst_element_factory_find(l_factoryName[backend]);
+    if (factory == NULL) {
+        return FALSE;
+    }
+    gst_object_unref(factory);
+    return TRUE;
+}
+
+FireStreamerEncoder_t Encoder_resolve (FireStreamerEncoder_t backend) {
+    uint32_t i;
+
+    assert(backend < FIRESTREAMER_ENCODER_COUNT);
+
+    if (backend != FIRESTREAMER_ENCODER_AUTO) {
+        return backend;
+    }
+    for (i = 0; i < sizeof(l_autoOrder) / sizeof(l_autoOrder[0]); i++) {
+        if (Encoder_isAvailable(l_autoOrder[i]) == TRUE) {
+            return l_autoOrder[i];
+        }
+    }
+    return FIRESTREAMER_ENCODER_AUTO;                                  /* no h.264 encoder at all */
+}
+
+const char* Encoder_getFactoryName (FireStreamerEncoder_t backend) {
+
+    assert(backend < FIRESTREAMER_ENCODER_COUNT);
+    return (backend == FIRESTREAMER_ENCODER_AUTO) ? "auto" : l_factoryName[backend];
+}
+
+GstElement* Encoder_create (const EncoderSettings_t *pSettings, const char *pName) {
+    FireStreamerEncoder_t backend;
+    GstElement *encoder;
+
+    assert(pSettings != NULL);
+
+    backend = Encoder_resolve(pSettings->backend);
+    if (backend == FIRESTREAMER_ENCODER_AUTO) {
+        g_printerr ("ERROR: no h.264 encoder element is installed.\n");
+        return NULL;
+    }
+    encoder = gst_element_factory_make(l_factoryName[backend], pName);
+    if (encoder == NULL) {
+        return NULL;
+    }
+
+    switch (backend) {
+        case FIRESTREAMER_ENCODER_V4L2: {
+            Encoder_configureV4l2__(encoder, pSettings);
+            break;
+        }
+        case FIRESTREAMER_ENCODER_X264: {
+            Encoder_configureX264__(encoder, pSettings);
+            break;
+        }
+        case FIRESTREAMER_ENCODER_OPENH264: {
+            Encoder_configureOpenh264__(encoder, pSettings);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+    printf("encoder %s, %u kbit/s, gop %u, %s, %s%s\n", l_factoryName[backend], pSettings->bitrate,
+           pSettings->gop, l_profileName[pSettings->profile],
+           (pSettings->rateControl == FIRESTREAMER_RATECONTROL_CBR) ? "cbr" :
+           (pSettings->rateControl == FIRESTREAMER_RATECONTROL_VBR) ? "vbr" : "cqp",
+           (pSettings->zeroLatency == TRUE) ? ", zero-latency" : "");
+
+    return encoder;
+}
+
+GstCaps* Encoder_getOutputCaps (FireStreamerEncoder_t backend, FireStreamerProfile_t profile) {
+    GstCaps *caps;
+
+    assert(backend < FIRESTREAMER_ENCODER_COUNT);
+    assert(profile < FIRESTREAMER_PROFILE_COUNT);
+
+    backend = Encoder_resolve(backend);
+    if ((backend == FIRESTREAMER_ENCODER_OPENH264) && (profile != FIRESTREAMER_PROFILE_BASELINE)) {
+        printf("openh264enc encodes constrained-baseline only, %s profile is not used!\n",
+               l_profileName[profile]);
+        profile = FIRESTREAMER_PROFILE_BASELINE;
+    }
+    /* byte-stream with whole access units, what the payloader and a raw .h264 file both take */
+    caps = gst_caps_new_simple("video/x-h264", "profile", G_TYPE_STRING, l_profileName[profile],
+                               "stream-format", G_TYPE_STRING, "byte-stream",
+                               "alignment", G_TYPE_STRING, "au", NULL);
+    if (backend == FIRESTREAMER_ENCODER_V4L2) {
+        /* v4l2 encoders take the level from the caps, software encoders pick it themselves */
+        gst_caps_set_simple(caps, "level", G_TYPE_STRING, "4", NULL);
+    }
+
+    return caps;
+}
+
+bool_t Encoder_acceptsCaps (GstElement *encoder, const GstCaps *caps) {
+    GstPad *pad;
+    GstCaps *sinkCaps;
+    gboolean accepts = FALSE;
+
+    assert(encoder != NULL && caps != NULL);
+
+    /* ask the element, not its template: a v4l2 encoder lists the formats of its device once it
+     * is open. A device that can't be opened leaves the template caps, it fails later anyway */
+    gst_element_set_state(encoder, GST_STATE_READY);
+    pad = gst_element_get_static_pad(encoder, "sink");
+    if (pad != NULL) {
+        sinkCaps = gst_pad_query_caps(pad, NULL);
+        accepts = gst_caps_can_intersect(sinkCaps, caps);
+        gst_caps_unref(sinkCaps);
+        gst_object_unref(pad);
+    }
+    gst_element_set_state(encoder, GST_STATE_NULL);
+
+    return (accepts == TRUE) ? TRUE : FALSE;
+}
+
+void Encoder_setBitrate (GstElement *encoder, FireStreamerEncoder_t backend, uint32_t bitrate) {
+    GstStructure *controls = NULL;
+
+    assert(encoder != NULL);
+
+    /* all three backends take a new bitrate while PLAYING, no restart and no key frame needed */
+    switch (Encoder_resolve(backend)) {
+        case FIRESTREAMER_ENCODER_V4L2: {
+            /* extra-controls is applied to the open device when set, keep the other controls */
+            g_object_get(G_OBJECT(encoder), "extra-controls", &controls, NULL);      /* a copy */
+            if (controls == NULL) {
+                controls = gst_structure_new_empty("controls");
+            }
+            gst_structure_set(controls, "video_bitrate", G_TYPE_INT, (gint)(bitrate * 1000), NULL);
+            g_object_set(G_OBJECT(encoder), "extra-controls", controls, NULL);
+            gst_structure_free(controls);
+            break;
+        }
+        case FIRESTREAMER_ENCODER_X264: {
+            Encoder_setUint__(encoder, "bitrate", bitrate);
+            break;
+        }
+        case FIRESTREAMER_ENCODER_OPENH264: {
+            Encoder_setUint__(encoder, "bitrate", bitrate * 1000);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+bool_t Encoder_setGop (GstElement *encoder, FireStreamerEncoder_t backend, uint32_t gop) {
+    GstStructure *controls = NULL;
+    GParamSpec   *pSpec;
+    const char   *pProperty;
+
+    assert(encoder != NULL);
+    assert(gop >= 1);
+
+    backend = Encoder_resolve(backend);
+    if (backend == FIRESTREAMER_ENCODER_V4L2) {
+        /* the driver takes the period at the next key frame, keep the other controls */
+        g_object_get(G_OBJECT(encoder), "extra-controls", &controls, NULL);             /* a copy */
+        if (controls == NULL) {
+            controls = gst_structure_new_empty("controls");
+        }
+        gst_structure_set(controls, "h264_i_frame_period", G_TYPE_INT, (gint)gop, NULL);
+        g_object_set(G_OBJECT(encoder), "extra-controls", controls, NULL);
+        gst_structure_free(controls);
+        return TRUE;
+    }
+    /* software encoders read the GOP when they are configured, only a mutable one is set */
+    pProperty = (backend == FIRESTREAMER_ENCODER_X264) ? "key-int-max" : "gop-size";
+    pSpec = g_object_class_find_property(G_OBJECT_GET_CLASS(encoder), pProperty);
+    if ((pSpec == NULL) || ((pSpec->flags & GST_PARAM_MUTABLE_PLAYING) == 0)) {
+        return FALSE;
+    }
+    Encoder_setUint__(encoder, pProperty, gop);
+    return TRUE;
+}
+
+
+/* private function definition */
+static void Encoder_setArg__ (GstElement *encoder, const char *pProperty, const char *pValue) {
+
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(encoder), pProperty) == NULL) {
+        printf("%s has no '%s' property, '%s' is not set!\n", GST_ELEMENT_NAME(encoder), pProperty,
+               pValue);
+        return;
+    }
+    gst_util_set_object_arg(G_OBJECT(encoder), pProperty, pValue);
+}
+
+static void Encoder_setUint__ (GstElement *encoder, const char *pProperty, uint32_t value) {
+    char valueStr[16];
+
+    snprintf(valueStr, sizeof(valueStr), "%u", value);
+    Encoder_setArg__(encoder, pProperty, valueStr);
+}
+
+static void Encoder_configureV4l2__ (GstElement *encoder, const EncoderSettings_t *pSettings) {
+    GstStructure *controls;
+
+    /* V4L2 controls, the profile is negotiated through the caps. Codec drivers never reorder
+     * frames without video_b_frames, zero-latency has nothing more to switch off */
+    controls = gst_structure_new("controls",
+                                 "video_b_frames", G_TYPE_INT, 0,
+                                 "h264_i_frame_period", G_TYPE_INT, (gint)pSettings->gop,
+                                 "repeat_sequence_header", G_TYPE_INT, 1,
+                                 NULL);
+    if (pSettings->rateControl == FIRESTREAMER_RATECONTROL_CQP) {
+        gst_structure_set(controls,
+                          "frame_level_rate_control_enable", G_TYPE_INT, 0,
+                          "h264_i_frame_qp_value", G_TYPE_INT, (gint)pSettings->qp,
+                          "h264_p_frame_qp_value", G_TYPE_INT, (gint)pSettings->qp,
+                          NULL);
+    } else {
+        gst_structure_set(controls,
+                          "video_bitrate", G_TYPE_INT, (gint)(pSettings->bitrate * 1000),
+                          "video_bitrate_mode", G_TYPE_INT,
+                          (pSettings->rateControl == FIRESTREAMER_RATECONTROL_CBR) ? 1 : 0,
+                          NULL);
+    }
+    g_object_set(G_OBJECT(encoder), "extra-controls", controls, NULL);
+    gst_structure_free(controls);
+}
+
+static void Encoder_configureX264__ (GstElement *encoder, const EncoderSettings_t *pSettings) {
+
+    Encoder_setUint__(encoder, "key-int-max", pSettings->gop);
+    Encoder_setUint__(encoder, "bframes", 0);
+    if (pSettings->zeroLatency == TRUE) {
+        Encoder_setArg__(encoder, "tune", "zerolatency");   /* no look-ahead, sliced threads */
+        Encoder_setArg__(encoder, "speed-preset", "ultrafast");
+    }
+    switch (pSettings->rateControl) {
+        case FIRESTREAMER_RATECONTROL_CBR: {
+            Encoder_setArg__(encoder, "pass", "cbr");
+            Encoder_setUint__(encoder, "bitrate", pSettings->bitrate);
+            Encoder_setUint__(encoder, "vbv-buf-capacity", 300);     /* ms, keeps frames small */
+            break;
+        }
+        case FIRESTREAMER_RATECONTROL_VBR: {
+            Encoder_setArg__(encoder, "pass", "qual");
+            Encoder_setUint__(encoder, "quantizer", pSettings->qp);
+            Encoder_setUint__(encoder, "bitrate", pSettings->bitrate);          /* upper limit */
+            break;
+        }
+        default: {
+            Encoder_setArg__(encoder, "pass", "quant");
+            Encoder_setUint__(encoder, "quantizer", pSettings->qp);
+            break;
+        }
+    }
+}
+
+static void Encoder_configureOpenh264__ (GstElement *encoder, const EncoderSettings_t *pSettings) {
+
+    /* openh264 never produces B-frames */
+    Encoder_setUint__(encoder, "gop-size", pSettings->gop);
+    Encoder_setArg__(encoder, "usage-type", "camera");
+    if (pSettings->zeroLatency == TRUE) {
+        Encoder_setArg__(encoder, "complexity", "low");
+    }
+    switch (pSettings->rateControl) {
+        case FIRESTREAMER_RATECONTROL_CBR: {
+            Encoder_setArg__(encoder, "rate-control", "bitrate");
+            Encoder_setUint__(encoder, "bitrate", pSettings->bitrate * 1000);            /* bit/s */
+            break;
+        }
+        case FIRESTREAMER_RATECONTROL_VBR: {
+            Encoder_setArg__(encoder, "rate-control", "quality");
+            Encoder_setUint__(encoder, "bitrate", pSettings->bitrate * 1000);
+            break;
+        }
+        default: {
+            Encoder_setArg__(encoder, "rate-control", "off");
+            Encoder_setUint__(encoder, "qp-min", pSettings->qp);
+            Encoder_setUint__(encoder, "qp-max", pSettings->qp);
+            break;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef ENCODER_H
+#define ENCODER_H
+
+/**
+* \file     encoder.h
+* \ingroup  g_applspec
+* \brief    API for the Encoder module, maps common h.264 settings onto GStreamer encoders.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "firestreamer.h"                           /* bool_t, FireStreamerEncoder_t and friends */
+#include <gst/gst.h>
+
+/* backend independent encoder settings */
+typedef struct EncoderSettingsTag {
+    FireStreamerEncoder_t       backend;             /* FIRESTREAMER_ENCODER_AUTO picks the first */
+    uint32_t                    bitrate;                                                /* kbit/s */
+    uint32_t                    gop;                                 /* frames between key frames */
+    FireStreamerProfile_t       profile;
+    FireStreamerRateControl_t   rateControl;
+    uint32_t                    qp;                     /* quantizer for CQP, quality target VBR */
+    bool_t                      zeroLatency;            /* no look-ahead, no frame reordering */
+} EncoderSettings_t;
+
+/* Encoder - API */
+bool_t Encoder_isAvailable(FireStreamerEncoder_t backend);
+FireStreamerEncoder_t Encoder_resolve(FireStreamerEncoder_t backend);
+const char* Encoder_getFactoryName(FireStreamerEncoder_t backend);
+GstElement* Encoder_create(const EncoderSettings_t *pSettings, const char *pName);
+GstCaps* Encoder_getOutputCaps(FireStreamerEncoder_t backend, FireStreamerProfile_t profile);
+bool_t Encoder_acceptsCaps(GstElement *encoder, const GstCaps *caps);
+void Encoder_setBitrate(GstElement *encoder, FireStreamerEncoder_t backend, uint32_t bitrate);
+bool_t Encoder_setGop(GstElement *encoder, FireStreamerEncoder_t backend, uint32_t gop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                               /* ENCODER_H */
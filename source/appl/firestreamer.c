@@ -15,6 +15,15 @@
 #endif
 
 #include "firestreamer.h"
+#include "pixelconv.h"
+#include "framering.h"
+#include "encoder.h"
+#include "abr.h"
+#include "histogram.h"
+#include "prebuffer.h"
+#include "motion.h"
+#include "threads.h"
+#include "statsshm.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -25,115 +34,581 @@
 #include <gst/app/gstappsink.h>
 #include <gst/gstbuffer.h>
 #include <gst/gstmemory.h>
+#include <gst/allocators/allocators.h>
 #include <pthread.h>
 
 #define CHAR_PARAM      128   /* NOTE: we want to simplify application, do not use dynamic memory */
 
+#define DECIMATION_STEP_UP_US       250000       /* min time between two steps down in frame rate */
+#define DECIMATION_RECOVER_US       2000000   /* back-pressure free time before one step back up */
+#define ABR_POLL_MS                 1000      /* RTP session poll period, reports come every ~5 s */
+#define RTP_CLOCK_RATE              90000                                /* h.264 RTP clock, Hz */
+#define TRACE_SLOTS                 512       /* traced frames in flight at most, 2^n, 4 s at 120 */
+#define TRACE_SEQ_NONE              G_MAXUINT               /* slot being rewritten, matches none */
+#define RECORDER_EOS_TIMEOUT        (2 * GST_SECOND)       /* destroy waits this long for the mux */
+#define OUTPUT_EOS_TIMEOUT_MS       2000           /* a removed output gets this long to finish */
+#define RECONNECT_MIN_MS            250                  /* first retry after an RTSP outage */
+#define RECONNECT_MAX_MS            8000                 /* the backoff doubles up to this */
+#define RECONNECT_TCP_TIMEOUT_US    2000000        /* rtspclientsink connect and send timeout */
+#define RECONNECT_STABLE_US         10000000     /* connected this long, the backoff starts over */
+#define READY_PLAYING               0x01                             /* bits of readyFlags */
+#define READY_NEED_DATA             0x02
+#define READY_ALL                   (READY_PLAYING | READY_NEED_DATA)
+#define MOTION_ROW_STEP             2             /* the detector compares every second line only */
+#define RTSP_PROTOCOLS_TCP          0x00000024                    /* GstRTSPLowerTrans, TCP | TLS */
+#define RTSP_PROTOCOLS_UDP          0x00000021                    /* GstRTSPLowerTrans, UDP | TLS */
+#define RAW_PLANES                  3                                       /* Y, U and V at most */
+#define PATH_TRIALS                 3                /* conversions timed at startup, best counts */
+#define SNAPSHOT_TIMEOUT_US         2000000          /* next frame and its JPEG, 1 fps while idle */
+
+/* stage stamps of one traced frame, stampUs[stage] is the start of the stage, the last one is the
+ * end of FIRESTREAMER_STAGE_SEND. The frame is found by buffer offset up to the appsrc, by PTS
+ * after it (encoders keep the PTS, not the offset). The pushing thread rewrites a slot between
+ * seq = TRACE_SEQ_NONE and the new seq, the streaming threads check seq again after every access */
+typedef struct FrameTraceTag {
+    _Atomic guint   seq;                                           /* frame number, buffer offset */
+    _Atomic guint64 pts;                                      /* set when the frame leaves appsrc */
+    _Atomic gint64  stampUs[FIRESTREAMER_STAGE_TOTAL + 1];                      /* monotonic time */
+} FrameTrace_t;
+
+/* what a latency profile sets, see FireStreamerLatencyProfile_t. Every profile leaks downstream, a
+ * full output queue drops its oldest frame and never holds up the tee and the other outputs */
+typedef struct LatencySettingsTag {
+    uint32_t        queueFrames;                    /* per output queue, 0 = limited by time only */
+    uint32_t        queueMs;                      /* per output queue, 0 = limited by frames only */
+    gint            leaky;                       /* GstQueueLeaky, 0 no, 1 upstream, 2 downstream */
+    uint32_t        appsrcFrames;           /* appsrc max-bytes in pushed frames, 0 = its default */
+    uint32_t        sinkLatencyMs;                                      /* rtspclientsink latency */
+    FireStreamerTransport_t transport;
+    uint32_t        gopMs;                             /* key frame period, 0 = gop of the config */
+    uint32_t        gop;                                   /* frames, resolved for the frame rate */
+} LatencySettings_t;
+
+/* raw video handed to the encoder, the cheapest one it takes is negotiated in create */
+typedef enum {
+    RAW_YUY2 = 0,                                  /* the pushed or demosaiced frames as they are */
+    RAW_NV12,                                            /* one planar pass, Y and interleaved UV */
+    RAW_I420,                                                      /* one planar pass, Y, U and V */
+    RAW_COUNT
+} RawFormat_t;
+
+static const char* const l_rawFormatName[RAW_COUNT] = { "YUY2", "NV12", "I420" };
+
+/* the CUSTOM row is taken from the config of each FireStreamer */
+static const LatencySettings_t l_latencyProfiles[FIRESTREAMER_LATENCY_COUNT] = {
+    [FIRESTREAMER_LATENCY_ULTRA_LOW] = {
+        .queueFrames = 2, .queueMs = 0, .leaky = 2, .appsrcFrames = 1, .sinkLatencyMs = 50,
+        .transport = FIRESTREAMER_TRANSPORT_UDP, .gopMs = 500 },
+    [FIRESTREAMER_LATENCY_BALANCED] = {
+        .queueFrames = 10, .queueMs = 500, .leaky = 2, .appsrcFrames = 2, .sinkLatencyMs = 200,
+        .transport = FIRESTREAMER_TRANSPORT_TCP, .gopMs = 1000 },
+    [FIRESTREAMER_LATENCY_RESILIENT] = {
+        .queueFrames = 0, .queueMs = 3000, .leaky = 2, .appsrcFrames = 4, .sinkLatencyMs = 2000,
+        .transport = FIRESTREAMER_TRANSPORT_TCP, .gopMs = 2000 },
+};
+static const char* const l_latencyProfileName[FIRESTREAMER_LATENCY_COUNT] = {
+    [FIRESTREAMER_LATENCY_CUSTOM]    = "custom",
+    [FIRESTREAMER_LATENCY_ULTRA_LOW] = "ultra-low-latency",
+    [FIRESTREAMER_LATENCY_BALANCED]  = "balanced",
+    [FIRESTREAMER_LATENCY_RESILIENT] = "resilient-uplink",
+};
+
+/* one tee branch, a GstBin "output<n>" of queue ! (h264parse !) sink. Output 0 is the url of the
+ * config, its queue and sink are the videoqueue and videoSink the Abr and the tracing follow */
+typedef struct OutputTag {
+    FireStreamer_t *pThis;
+    bool_t          inUse;                                       /* slot taken, until finished */
+    bool_t          removing;                           /* unlinked, waiting for EOS or timeout */
+    bool_t          reconnecting;              /* RTSP outage, built again once torn down */
+    bool_t          restarting;              /* reconnecting for new sink settings, not an outage */
+    bool_t          restarted;                   /* built again for them, key unit once PLAYING */
+    uint32_t        retries;                             /* connects since the backoff start */
+    gint64          connectedUs;                /* sink PLAYING after a connect, 0 = waiting */
+    gint            failed;                           /* sink posted an error, drop (atomic) */
+    FireStreamerSink_t type;
+    char            url[CHAR_PARAM];
+    GstElement     *bin;
+    GstElement     *queue;                                      /* leaky, drops the oldest frame */
+    GstElement     *sink;
+    GstPad         *queuePad;                          /* src of the queue, its flow return */
+    GstPad         *teePad;                                         /* request pad of the tee */
+    GSource        *eosTimer;                                 /* removal timeout, bus thread */
+    GSource        *retryTimer;                            /* next connect after an outage */
+} Output_t;
+
 /* the FireStreamer object's data structure */
-typedef struct FireStreamerTag {
+struct FireStreamerTag {
+    bool_t          inUse;                               /* slot taken by FireStreamer_create() */
     /* video parameters */
-    uint32_t        width;
+    uint32_t        width;                                                  /* encoded video size */
     uint32_t        height;
-    uint8_t         fps;
-    uint8_t         quality;
+    uint32_t        inWidth;                                                 /* pushed frame size */
+    uint32_t        inHeight;
+    uint32_t        stride;                                        /* pushed frame bytes per line */
+    FireStreamerFormat_t format;                                         /* pushed frame format */
+    bool_t          binning;                                    /* 2x2 binning while demosaicing */
+    PixelConvKernel_t kernel;                          /* demosaic/grayscale kernel for this CPU */
+    uint32_t        fps;
+    uint32_t        quality;                                   /* 0..100, maps to the quantizer */
     bool_t          grayscale;                                      /* convert video to grayscale */
     /* stream parameters */
     char            url[CHAR_PARAM];
+    FireStreamerSink_t sinkType;
     char            username[CHAR_PARAM];
     char            password[CHAR_PARAM];
+    /* encoder parameters */
+    EncoderSettings_t encSettings;                              /* backend resolved in create */
+    FireStreamerMemory_t memory;                                         /* requested memory mode */
+    /* copy path */
+    uint32_t        frameSize;                                     /* size of one frame in bytes */
+    bool_t          converting;               /* frames go through convert__(), never as they are */
+    RawFormat_t     rawFormat;                                       /* what the encoder is given */
+    uint32_t        planeStride[RAW_PLANES];                    /* of rawFormat, GStreamer layout */
+    uint32_t        planeOffset[RAW_PLANES];
+    void           *pConvertMemory;            /* YUY2 frame in front of the planar pass, or NULL */
+    uint32_t        poolBuffers;                                /* number of pooled frame buffers */
+    GstBufferPool  *pool;                                  /* frame buffers reused by pushFrame() */
+    guint           poolExhausted;         /* frames dropped because all pool buffers were in use */
     /* gst - GStreamer */
-    GMainLoop      *pMainLoop;                 /* gstreamer main loop needed for gst messages bus */
     GstPipeline    *pipeline;                                                    /* main pipeline */
     GstState        state;                                       /* current state of the pipeline */
     GstBus         *bus;                                                             /* bus watch */
-    guint           bus_watch_id;                                                 /* bus watch ID */
+    GSource        *busWatch;                       /* bus watch, attached to the shared context */
     GstMessage     *msg;
     GstAppSrc      *appsrc;                                              /* application feed data */
     GstElement     *sourceFilter;
+    GstElement     *encConvert;              /* only when the encoder takes no raw format of ours */
     GstElement     *h264Enc;
     GstElement     *encFilter;
-    GstElement     *videoqueue;                                                    /* video queue */
-    GstElement     *rtspClientSink;
-    pthread_t       gstThreadId;                               /* ID returned by pthread_create() */
-    GstElement     *vcYuvToGs;
-    GstElement     *vcYuvToGsCaps;
-    GstElement     *vcGsToYuv;
-    GstElement     *vcGsToYuvCaps;
-    bool_t          feedData;                 /* feed pipeline with input data or skip input data */
+    GstElement     *outputTee;                                  /* encoded once, sent to all */
+    GstElement     *videoqueue;                                   /* queue of output 0 (url) */
+    GstElement     *videoSink;                                     /* sink of output 0 (url) */
+    Output_t        outputs[FIRESTREAMER_MAX_OUTPUTS];
+    pthread_mutex_t outMutex;                                /* guards the output slots */
+    bool_t          outputsClosed;                      /* free__ runs, no more output teardown */
+    uint32_t        segmentSeconds;
+    /* latency profile, the settings and the active time are guarded by outMutex */
+    gint            latencyProfile;                       /* FireStreamerLatencyProfile_t, atomic */
+    LatencySettings_t latencySettings;                                   /* of the profile in use */
+    LatencySettings_t customLatency;                                           /* from the config */
+    guint64         appsrcDefaultBytes;                              /* max-bytes of a new appsrc */
+    gint64          profileUs;                          /* monotonic time the profile was applied */
+    gint64          profileActiveUs[FIRESTREAMER_LATENCY_COUNT];              /* before profileUs */
+    Histogram_t     profileLatency[FIRESTREAMER_LATENCY_COUNT];             /* total, per profile */
+    _Atomic uint64_t appsrcMark[FIRESTREAMER_LATENCY_COUNT];           /* high-water marks, bytes */
+    _Atomic uint64_t queueMark[FIRESTREAMER_LATENCY_COUNT];
+    gint            feedData;      /* feed pipeline or skip input data (atomic, set by appsrc) */
+    /* back-pressure, frame admission runs on the pushing (capture) thread only */
+    FireStreamerBackpressure_t backpressure;
+    gint            decimation;                    /* 1 of 2^decimation frames is kept (atomic) */
+    uint32_t        frameCounter;                   /* frames offered since the last level change */
+    gint64          levelChangedUs;                    /* monotonic time of the last level change */
+    gint64          saturatedUs;                  /* monotonic time back-pressure was last seen */
+    guint           skipped;                    /* frames skipped by back-pressure (atomic) */
+    /* adaptive bitrate, the Abr object runs on the shared bus thread */
+    bool_t          abrEnabled;
+    Abr_t           abr;
+    GSource        *abrTimer;                     /* polls the RTP session, on the shared context */
+    GstElement     *rtpManager;                        /* rtpbin of the rtspclientsink (atomic) */
+    guint           lastReportSeq;                 /* highest sequence of the last report handled */
+    gint            abrDecimation;                  /* frame rate floor set by the Abr (atomic) */
+    FireStreamerAbrStats_t abrStats;
+    pthread_mutex_t abrMutex;            /* guards abrStats, the abrTimer and statsTimer teardown */
+    /* live stats, written to the shared stats segment by the bus thread */
+    GSource        *statsTimer;                                 /* on the shared context, or NULL */
+    gint64          statsUs;                                  /* monotonic time of the last write */
+    guint           statsFrames;                               /* framesEncoded at the last write */
+    guint64         statsBytes;                                 /* bytesEncoded at the last write */
+    /* latency tracing, every stage is stamped and recorded by the one thread that runs it */
+    bool_t          tracing;
+    FrameTrace_t    traces[TRACE_SLOTS];                           /* indexed by the frame number */
+    guint           traceSeq;                         /* number of the next traced frame (atomic) */
+    Histogram_t     latency[FIRESTREAMER_STAGE_COUNT];
+    guint           framesEncoded;                                                    /* atomic */
+    _Atomic uint64_t bytesEncoded;
+    guint           framesSent;                                                       /* atomic */
+    guint           reconnects;                                                       /* atomic */
+    /* startup */
+    FireStreamer_ready_t ready;
+    void           *pReadyData;
+    guint           readyFlags;                                    /* READY_ bits, atomic */
+    gint64          createUs;                             /* monotonic start of create() */
+    guint           readyUs;                                                          /* atomic */
+    guint           firstFrameUs;                                                     /* atomic */
+    /* pre-event recording, encoded access units are tapped behind the encoder filter */
+    Prebuffer_t     prebuffer;                         /* last seconds of the stream, GOP aligned */
+    void           *pPrebufferMemory;                        /* allocated once in create or NULL */
+    pthread_mutex_t recMutex;                          /* guards the prebuffer and the recorder */
+    GstElement     *recorder;                    /* appsrc ! h264parse ! mux ! filesink or NULL */
+    GstAppSrc      *recSrc;
+    GSource        *recWatch;                           /* recorder bus, on the shared context */
+    char            recPath[CHAR_PARAM];
+    GstClockTime    recBase;                        /* DTS of the first recorded unit, becomes 0 */
+    bool_t          recWaitKey;              /* a live unit missed the ring, skip to a key frame */
+    uint8_t         recHeader[PREBUFFER_HEADER_MAX];      /* SPS and PPS in front of the file */
+    GstClockTime    recStop;                          /* live units are recorded up to this PTS */
+    GstClockTime    recPost;                                 /* recorded after the trigger, ns */
+    bool_t          recEos;                                /* end of stream sent to the recorder */
+    bool_t          recStarting;               /* a trigger is building the recorder pipeline */
+    bool_t          recPending;               /* a trigger came while the last file was finishing */
+    char            recPendingPath[CHAR_PARAM];
+    uint32_t        recPendingSeconds;
+    GstClockTime    encodedPts;                              /* PTS of the newest encoded unit */
+    /* motion gating, the detector runs on the pushing (capture) thread */
+    Motion_t        motion;
+    void           *pMotionMemory;           /* reference lines, allocated once in create or NULL */
+    pthread_mutex_t motionMutex;                           /* guards the detector for getMotion() */
+    gint64          motionUs;                                /* monotonic time of the last motion */
+    gint64          keepAliveUs;                     /* monotonic time of the last admitted still */
+    gint64          motionHoldUs;
+    gint64          idleIntervalUs;                              /* between two keep-alive frames */
+    guint           motionSkipped;                                                      /* atomic */
+    /* snapshots, a JPEG pipeline fed one raw frame per request from the sourceFilter probe */
+    pthread_mutex_t snapMutex;                   /* one request at a time, guards the cached JPEG */
+    GstElement     *snapshot;            /* appsrc ! convert ! scale ! jpegenc ! appsink, or NULL */
+    GstAppSrc      *snapSrc;
+    GstElement     *snapFilter;                                     /* size of the requested JPEG */
+    GstElement     *snapEnc;
+    GstAppSink     *snapSink;
+    gint            snapRequest;         /* number of the request the next frame is for, 0 = none */
+    gint            snapSequence;                              /* of the last request, under lock */
+    gint64          snapTtlUs;
+    void           *pSnapMemory;                                           /* cached JPEG or NULL */
+    uint32_t        snapCapacity;
+    uint32_t        snapSize;                                               /* 0 = nothing cached */
+    uint32_t        snapWidth;                                              /* of the cached JPEG */
+    uint32_t        snapHeight;
+    uint32_t        snapQuality;
+    gint64          snapUs;                               /* monotonic time of the cached request */
+    /* simulcast, a rendition is a FireStreamer of its own fed by pushFrame() of the main one */
+    FireStreamer_t *renditions[FIRESTREAMER_MAX_RENDITIONS];                  /* as in the config */
+    uint32_t        nRenditions;
+    uint32_t        renditionScale;                            /* of a rendition, 0 in a main one */
+    void           *pScaleMemory;                    /* half size frame for a scale of 4, or NULL */
+    /* push queue, decouples the capture thread from gst_app_src_push_buffer() */
+    FrameRing_t     ring;                                   /* GstBuffers waiting for the appsrc */
+    bool_t          ringReady;                                         /* ring has been created */
+    pthread_t       pushThreadId;                              /* ID returned by pthread_create() */
+    guint           pushed;                                /* buffers accepted by appsrc (atomic) */
+    /* timestamps, the capture time of a frame becomes its PTS */
+    guint32         lastSequence;                        /* capture sequence of the last frame */
+    bool_t          sequenceValid;
+    guint           sensorDropped;                         /* sequence gaps, in frames (atomic) */
+    GstClockTime    lastPts;                            /* written by the push thread only */
+    guint           ptsClamped;                                                       /* atomic */
+    GstAllocator   *dmabufAllocator;                            /* wraps exported capture buffers */
+    gint            dmabufActive;         /* encoder imports dmabuf (atomic, may fall back later) */
+    GQuark          releaseQuark;                     /* qdata key of the buffer release callback */
     /* helper */
     GstElement     *fakesink;                                     /* fake sink for testing stream */
     GstElement     *identity;                                           /* helper identity plugin */
     uint32_t        debugCounter;
-} FireStreamer_t;
+};
+
+/* GStreamer and the bus thread are set up by the first FireStreamer and shared by all of them */
+typedef struct FireStreamerSharedTag {
+    pthread_mutex_t mutex;                               /* guards this structure and the slots */
+    uint32_t        nFireStreamers;                  /* number of FireStreamer objects created */
+    GMainContext   *pContext;                        /* main context of all pipeline bus watches */
+    GMainLoop      *pMainLoop;                 /* gstreamer main loop needed for gst messages bus */
+    pthread_t       gstThreadId;                               /* ID returned by pthread_create() */
+    StatsShm_t      stats;                       /* live stats segment, slot = FireStreamer index */
+    GstCaps        *pWakeCaps;             /* reference of the hand-over stamps, see stampWake() */
+    GQuark          postedQuark;                /* qdata key of the posting time, see syncCall() */
+} FireStreamerShared_t;
 
-static FireStreamer_t l_fireSteramer;               /* single instance of the FireStreamer object */
-FireStreamer_t *pThis = &l_fireSteramer;                                 /* global object pointer */
+static FireStreamerShared_t l_shared = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+static FireStreamer_t l_fireStreamers[FIRESTREAMER_MAX_INSTANCES];  /* no dynamic memory, slots */
 
 /* private function declarations */
 static gboolean FireStreamer_gst_busCall__(GstBus *bus, GstMessage *msg, FireStreamer_t *pPipeline);
+static GstBusSyncReply FireStreamer_gst_syncCall__(GstBus *bus, GstMessage *msg,
+                                                   gpointer pUserData);
+static GstPadProbeReturn FireStreamer_gst_wakeProbe__(GstPad *pad, GstPadProbeInfo *info,
+                                                      gpointer pUserData);
+static void FireStreamer_gst_stampWake__(GstBuffer *buffer);
+static gint64 FireStreamer_gst_getWakeLatency__(GstBuffer *buffer);
 static void* FireStreamer_gst_mainLoop__(void *pArgument);
-static void FireStreamer_gst_startFeeding__(void);
-static void FireStreamer_gst_stopFeeding__(void);
-static void FireStreamer_gst_free__(void);
+static FireStreamer_t* FireStreamer_gst_attach__(const FireStreamerConfig_t *pConfig);
+static void FireStreamer_gst_detach__(FireStreamer_t *pThis);
+static void FireStreamer_gst_unrefElement__(GstElement **ppElement);
+static void* FireStreamer_gst_pushLoop__(void *pArgument);
+static void FireStreamer_gst_checkSequence__(FireStreamer_t *pThis,
+                                             const FireStreamerFrameInfo_t *pInfo);
+static void FireStreamer_gst_setTimestamp__(FireStreamer_t *pThis, GstBuffer *buffer);
+static void FireStreamer_gst_dropBuffer__(void *pEntry);
+static bool_t FireStreamer_gst_admitFrame__(FireStreamer_t *pThis);
+static bool_t FireStreamer_gst_createMotion__(FireStreamer_t *pThis,
+                                              const FireStreamerConfig_t *pConfig);
+static bool_t FireStreamer_gst_gateMotion__(FireStreamer_t *pThis, const void *pData,
+                                            uint32_t size);
+static bool_t FireStreamer_gst_createRenditions__(FireStreamer_t *pThis,
+                                                  const FireStreamerConfig_t *pConfig);
+static void FireStreamer_gst_pushRenditions__(FireStreamer_t *pThis, const uint8_t *pSrc,
+                                              uint32_t srcStride, GstBuffer *buffer,
+                                              gint64 pushUs, const FireStreamerFrameInfo_t *pInfo);
+static bool_t FireStreamer_gst_createPool__(FireStreamer_t *pThis, GstCaps *caps);
+static GstBuffer* FireStreamer_gst_acquireBuffer__(FireStreamer_t *pThis);
+static bool_t FireStreamer_gst_isFrameComplete__(FireStreamer_t *pThis, uint32_t size);
+static GstBuffer* FireStreamer_gst_convert__(FireStreamer_t *pThis, const void *pData,
+                                             uint32_t size, const uint8_t **ppYuy2,
+                                             uint32_t *pYuy2Stride);
+static void FireStreamer_gst_toPlanar__(FireStreamer_t *pThis, const uint8_t *pSrc,
+                                        uint32_t srcStride, uint8_t *pDst, uint32_t flags);
+static void FireStreamer_gst_setRawFormat__(FireStreamer_t *pThis, RawFormat_t format);
+static GstCaps* FireStreamer_gst_getRawCaps__(FireStreamer_t *pThis, RawFormat_t format);
+static GstCaps* FireStreamer_gst_negotiate__(FireStreamer_t *pThis, bool_t *pGeneric);
+static void FireStreamer_gst_printPath__(FireStreamer_t *pThis);
+static void FireStreamer_gst_startFeeding__(GstAppSrc *appsrc, guint length, FireStreamer_t *pThis);
+static void FireStreamer_gst_stopFeeding__(GstAppSrc *appsrc, FireStreamer_t *pThis);
+static void FireStreamer_gst_setIoMode__(FireStreamer_t *pThis, const char *ioMode);
+static void FireStreamer_gst_dmabufFallback__(FireStreamer_t *pThis);
+static bool_t FireStreamer_gst_isImportError__(FireStreamer_t *pThis, GstMessage *msg,
+                                               const GError *error, const gchar *debug);
+static void FireStreamer_gst_newManager__(GstElement *sink, GstElement *manager,
+                                          FireStreamer_t *pThis);
+static gboolean FireStreamer_gst_abrTick__(gpointer pUserData);
+static gboolean FireStreamer_gst_statsTick__(gpointer pUserData);
+static void FireStreamer_gst_queueFrame__(FireStreamer_t *pThis, GstBuffer *buffer, gint64 pushUs,
+                                          const FireStreamerFrameInfo_t *pInfo);
+static void FireStreamer_gst_addTraceProbe__(FireStreamer_t *pThis, GstElement *element);
+static GstPadProbeReturn FireStreamer_gst_traceProbe__(GstPad *pad, GstPadProbeInfo *info,
+                                                       gpointer pUserData);
+static FrameTrace_t* FireStreamer_gst_findTrace__(FireStreamer_t *pThis, GstClockTime pts,
+                                                  guint *pSeq);
+static bool_t FireStreamer_gst_isTraceValid__(FrameTrace_t *pTrace, guint seq);
+static void FireStreamer_gst_free__(FireStreamer_t *pThis);
+static FireStreamerSink_t FireStreamer_gst_getSinkType__(const char *pUrl);
+static bool_t FireStreamer_gst_createPrebuffer__(FireStreamer_t *pThis,
+                                                 const FireStreamerConfig_t *pConfig);
+static GstPadProbeReturn FireStreamer_gst_prebufferProbe__(GstPad *pad, GstPadProbeInfo *info,
+                                                           gpointer pUserData);
+static void FireStreamer_gst_recordUnit__(FireStreamer_t *pThis, uint32_t index);
+static GstElement* FireStreamer_gst_createRecorder__(FireStreamer_t *pThis, const char *pPath,
+                                                    GstAppSrc **ppSource, GSource **ppWatch);
+static gboolean FireStreamer_gst_recorderBusCall__(GstBus *bus, GstMessage *msg,
+                                                   gpointer pUserData);
+static void FireStreamer_gst_stopRecorder__(FireStreamer_t *pThis);
+static bool_t FireStreamer_gst_createSnapshot__(FireStreamer_t *pThis);
+static GstPadProbeReturn FireStreamer_gst_snapshotProbe__(GstPad *pad, GstPadProbeInfo *info,
+                                                          gpointer pUserData);
+static uint32_t FireStreamer_gst_encodeSnapshot__(FireStreamer_t *pThis, uint32_t width,
+                                                  uint32_t height, uint32_t quality);
+static int32_t FireStreamer_gst_addOutput__(FireStreamer_t *pThis, const char *pUrl);
+static bool_t FireStreamer_gst_buildOutput__(Output_t *pOutput);
+static void FireStreamer_gst_forceKeyUnit__(GstPad *pad);
+static Output_t* FireStreamer_gst_findOutput__(FireStreamer_t *pThis, GstObject *object);
+static GstPadProbeReturn FireStreamer_gst_outputProbe__(GstPad *pad, GstPadProbeInfo *info,
+                                                        gpointer pUserData);
+static GstPadProbeReturn FireStreamer_gst_unlinkOutput__(GstPad *pad, GstPadProbeInfo *info,
+                                                         gpointer pUserData);
+static gboolean FireStreamer_gst_outputTimeout__(gpointer pUserData);
+static void FireStreamer_gst_finishOutput__(Output_t *pOutput);
+static void FireStreamer_gst_clearOutput__(Output_t *pOutput);
+static void FireStreamer_gst_reconnectOutput__(Output_t *pOutput, bool_t restart);
+static void FireStreamer_gst_outputPlaying__(FireStreamer_t *pThis, GstObject *object);
+static void FireStreamer_gst_scheduleRetry__(Output_t *pOutput);
+static gboolean FireStreamer_gst_retryOutput__(gpointer pUserData);
+static void FireStreamer_gst_setReady__(FireStreamer_t *pThis, guint flag);
+static GstPadProbeReturn FireStreamer_gst_firstFrameProbe__(GstPad *pad, GstPadProbeInfo *info,
+                                                            gpointer pUserData);
+static void FireStreamer_gst_getLatencySettings__(FireStreamer_t *pThis,
+                                                  FireStreamerLatencyProfile_t profile,
+                                                  LatencySettings_t *pSettings);
+static void FireStreamer_gst_setQueueLimits__(FireStreamer_t *pThis, GstElement *queue);
+static guint64 FireStreamer_gst_getAppsrcBytes__(FireStreamer_t *pThis);
+static void FireStreamer_gst_printLatency__(FireStreamer_t *pThis);
+static void FireStreamer_gst_raiseMark__(_Atomic uint64_t *pMark, uint64_t value);
 
 
-bool_t FireStreamer_initialize (char *url, char *username, char * password, uint32_t width,
-                                uint32_t height, bool_t grayscale) {
-    static uint8_t nFireStreamers = 0;         /* number of FireStreamer objects allocated so far */
-    unsigned int major, minor, micro, nano;
+void FireStreamer_getDefaultConfig (FireStreamerConfig_t *pConfig) {
+
+    assert(pConfig != NULL);
+
+    memset(pConfig, 0, sizeof(*pConfig));
+    pConfig->width = 384;
+    pConfig->height = 288;
+    pConfig->stride = 0;
+    pConfig->format = FIRESTREAMER_FORMAT_YUY2;
+    pConfig->binning = FALSE;
+    pConfig->grayscale = FALSE;
+    pConfig->fps = 30;
+    pConfig->quality = 70;
+    pConfig->encoder = FIRESTREAMER_ENCODER_AUTO;
+    pConfig->bitrate = 2000;
+    pConfig->gop = 30;                                                /* one key frame per second */
+    pConfig->profile = FIRESTREAMER_PROFILE_HIGH;
+    pConfig->rateControl = FIRESTREAMER_RATECONTROL_CBR;
+    pConfig->zeroLatency = TRUE;
+    pConfig->abr = TRUE;
+    pConfig->minBitrate = 300;
+    pConfig->maxBitrate = 4000;
+    pConfig->memory = FIRESTREAMER_MEMORY_SYSTEM;
+    pConfig->poolBuffers = 6;
+    pConfig->queueSize = 4;
+    pConfig->overflow = FIRESTREAMER_OVERFLOW_DROP_OLDEST;
+    pConfig->backpressure = FIRESTREAMER_BACKPRESSURE_DECIMATE;
+    pConfig->tracing = TRUE;
+    pConfig->outputQueue = 30;
+    pConfig->segmentSeconds = 60;
+    pConfig->sinkLatencyMs = 1000;
+    pConfig->transport = FIRESTREAMER_TRANSPORT_TCP;
+    pConfig->latencyProfile = FIRESTREAMER_LATENCY_CUSTOM;
+    pConfig->motion = FALSE;
+    pConfig->motionThreshold = 12;
+    pConfig->motionHoldMs = 2000;
+    pConfig->idleFps = 1;
+    pConfig->snapshotTtlMs = 1000;
+    pConfig->statsIntervalMs = 500;
+    pConfig->updateRegistry = FALSE;
+}
+
+FireStreamer_t* FireStreamer_create (const FireStreamerConfig_t *pConfig) {
+    FireStreamer_t *pThis = NULL;
     bool_t success = TRUE;
-    int retVal;
     GstStateChangeReturn gstRet;
-
-    assert(nFireStreamers < 1);                  /* only one FireStreamer object can be allocated */
-    memset(&l_fireSteramer, 0, sizeof(l_fireSteramer));
+    gint64 createUs = g_get_monotonic_time();
+    GstPad *pad;
+    GstCaps *caps;
+    uint32_t i;
+    bool_t simulcast = FALSE;
+    bool_t generic = FALSE;
 
     /* check input parameters */
-    assert(url != NULL);
-    assert(strlen(url) < sizeof(pThis->url));
-    assert(width >= 32 && width <= 1920);
-    assert(height >= 32 && height <= 1080);
+    assert(pConfig != NULL);
+    assert(pConfig->url != NULL);
+    assert(strlen(pConfig->url) < sizeof(pThis->url));
+    assert((pConfig->binning == FALSE) || (pConfig->format == FIRESTREAMER_FORMAT_SRGGB8));
+    assert(pConfig->width % ((pConfig->binning == TRUE) ? 4 : 2) == 0);
+    assert(pConfig->height % 2 == 0);
+    assert(pConfig->fps >= 1 && pConfig->fps <= 120);
+    assert(pConfig->quality <= 100);
+    assert(pConfig->encoder < FIRESTREAMER_ENCODER_COUNT);
+    assert(pConfig->profile < FIRESTREAMER_PROFILE_COUNT);
+    assert(pConfig->gop >= 1);
+    assert((pConfig->abr == FALSE) ||
+           (pConfig->minBitrate > 0 && pConfig->minBitrate <= pConfig->maxBitrate));
+    assert(pConfig->poolBuffers >= 2);
+    assert(pConfig->queueSize >= 2 && pConfig->queueSize <= FRAMERING_MAX_SIZE);
+    assert(pConfig->outputQueue >= 1);
+    assert(pConfig->latencyProfile < FIRESTREAMER_LATENCY_COUNT);
+    assert(pConfig->statsIntervalMs >= 1);
+
+    /* take a free slot, the first FireStreamer initializes GStreamer and starts the bus thread */
+    pThis = FireStreamer_gst_attach__(pConfig);
+    if (pThis == NULL) {
+        return NULL;
+    }
+    pThis->createUs = createUs;
+    pThis->ready = pConfig->ready;
+    pThis->pReadyData = pConfig->pReadyData;
+    pthread_mutex_init(&pThis->abrMutex, NULL);
+    pthread_mutex_init(&pThis->recMutex, NULL);
+    pthread_mutex_init(&pThis->outMutex, NULL);
+    pthread_mutex_init(&pThis->motionMutex, NULL);
+    pthread_mutex_init(&pThis->snapMutex, NULL);
+    pThis->snapTtlUs = (gint64)pConfig->snapshotTtlMs * 1000;
+    for (i = 0; i < FIRESTREAMER_MAX_OUTPUTS; i++) {
+        pThis->outputs[i].pThis = pThis;
+    }
+
+    /* overflow policies are listed in the same order in both modules */
+    if (FrameRing_initialize(&pThis->ring, pConfig->queueSize, (FrameRingPolicy_t)pConfig->overflow,
+                             FireStreamer_gst_dropBuffer__) != TRUE) {
+        g_printerr ("ERROR: push queue of %u frames could not be created.\n", pConfig->queueSize);
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+    pThis->ringReady = TRUE;
 
     /* save stream parameters */
-    snprintf(pThis->url, sizeof(pThis->url), "%s", url);
-    if (username != NULL) {
-        assert(strlen(username) < sizeof(pThis->username));
-        snprintf(pThis->username, sizeof(pThis->username), "%s", username);
-    }
-    if (password != NULL) {
-        assert(strlen(password) < sizeof(pThis->password));
-        snprintf(pThis->password, sizeof(pThis->password), "%s", password);
-    }
-    pThis->width = width;
-    pThis->height = height;
-    pThis->grayscale = grayscale;
-
-    /* Initialize GStreamer */
-    gst_init(NULL, NULL);
-    pThis->pMainLoop = g_main_loop_new (NULL, FALSE);
-    gst_version(&major, &minor, &micro, &nano);
-    gst_update_registry();
-
-    /* start main loop thread to get message bus working */
-    retVal = pthread_create(&pThis->gstThreadId, NULL, &FireStreamer_gst_mainLoop__,
-                            pThis);
-    assert(retVal == 0);                             /* pthread_create() must return with success */
-    pthread_setname_np(pThis->gstThreadId, "gstMsgBus");
+    snprintf(pThis->url, sizeof(pThis->url), "%s", pConfig->url);
+    pThis->sinkType = FireStreamer_gst_getSinkType__(pThis->url);
+    if (pConfig->username != NULL) {
+        assert(strlen(pConfig->username) < sizeof(pThis->username));
+        snprintf(pThis->username, sizeof(pThis->username), "%s", pConfig->username);
+    }
+    if (pConfig->password != NULL) {
+        assert(strlen(pConfig->password) < sizeof(pThis->password));
+        snprintf(pThis->password, sizeof(pThis->password), "%s", pConfig->password);
+    }
+    pThis->inWidth = pConfig->width;
+    pThis->inHeight = pConfig->height;
+    pThis->format = pConfig->format;
+    pThis->binning = pConfig->binning;
+    pThis->width = (pThis->binning == TRUE) ? pThis->inWidth / 2 : pThis->inWidth;
+    pThis->height = (pThis->binning == TRUE) ? pThis->inHeight / 2 : pThis->inHeight;
+    assert(pThis->width >= 32 && pThis->width <= 1920);
+    assert(pThis->height >= 32 && pThis->height <= 1080);
+    if (pConfig->stride != 0) {
+        pThis->stride = pConfig->stride;
+    } else {
+        pThis->stride = (pThis->format == FIRESTREAMER_FORMAT_YUY2) ? pThis->inWidth * 2 :
+                                                                      pThis->inWidth;
+    }
+    pThis->grayscale = pConfig->grayscale;
+    pThis->fps = pConfig->fps;
+    pThis->quality = pConfig->quality;
+    pThis->encSettings.backend = Encoder_resolve(pConfig->encoder);
+    pThis->encSettings.bitrate = pConfig->bitrate;
+    pThis->encSettings.gop = pConfig->gop;
+    pThis->encSettings.profile = pConfig->profile;
+    pThis->encSettings.rateControl = pConfig->rateControl;
+    pThis->encSettings.qp = 51 - (pThis->quality * 41) / 100;      /* quality 0..100 -> qp 51..10 */
+    pThis->encSettings.zeroLatency = pConfig->zeroLatency;
+    pThis->abrStats.bitrate = pConfig->bitrate;
+    if ((pConfig->abr == TRUE) && (pConfig->rateControl != FIRESTREAMER_RATECONTROL_CQP)) {
+        Abr_initialize(&pThis->abr, pConfig->minBitrate, pConfig->maxBitrate, pConfig->bitrate,
+                       FIRESTREAMER_DECIMATION_MAX);
+        pThis->encSettings.bitrate = pThis->abr.bitrate;
+        pThis->abrStats.bitrate = pThis->abr.bitrate;
+        pThis->abrEnabled = TRUE;
+    }
+    pThis->memory = pConfig->memory;
+    pThis->poolBuffers = pConfig->poolBuffers;
+    pThis->backpressure = pConfig->backpressure;
+    pThis->tracing = pConfig->tracing;
+    pThis->segmentSeconds = pConfig->segmentSeconds;
+    /* the latency profile sets the output queues, the sinks and the GOP as one set */
+    pThis->customLatency.queueFrames = pConfig->outputQueue;
+    pThis->customLatency.leaky = 2;                             /* a slow output drops its oldest */
+    pThis->customLatency.sinkLatencyMs = pConfig->sinkLatencyMs;
+    pThis->customLatency.transport = pConfig->transport;
+    pThis->customLatency.gop = pConfig->gop;
+    FireStreamer_gst_getLatencySettings__(pThis, pConfig->latencyProfile, &pThis->latencySettings);
+    pThis->latencyProfile = (gint)pConfig->latencyProfile;
+    pThis->profileUs = createUs;
+    pThis->encSettings.gop = pThis->latencySettings.gop;
+    pThis->encodedPts = GST_CLOCK_TIME_NONE;
+    if ((pConfig->prebufferSeconds > 0) &&
+        (FireStreamer_gst_createPrebuffer__(pThis, pConfig) != TRUE)) {
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+    pThis->lastPts = GST_CLOCK_TIME_NONE;
+    for (i = 0; i < FIRESTREAMER_STAGE_COUNT; i++) {
+        Histogram_reset(&pThis->latency[i]);
+    }
+    for (i = 0; i < FIRESTREAMER_LATENCY_COUNT; i++) {
+        Histogram_reset(&pThis->profileLatency[i]);
+    }
+    pThis->releaseQuark = g_quark_from_static_string("firestreamer-release-frame");
+    pThis->kernel = PixelConv_getKernel(PIXELCONV_KERNEL_AUTO);
+    if ((pConfig->motion == TRUE) && (FireStreamer_gst_createMotion__(pThis, pConfig) != TRUE)) {
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+    for (i = 0; i < FIRESTREAMER_MAX_RENDITIONS; i++) {
+        simulcast = (pConfig->renditions[i].url != NULL) ? TRUE : simulcast;
+    }
 
     /* Create gstreamer elements */
     pThis->pipeline = (GstPipeline*)gst_pipeline_new ("firestreamer");
     pThis->appsrc   = (GstAppSrc*)gst_element_factory_make("appsrc", "videoSource");
     pThis->sourceFilter = gst_element_factory_make("capsfilter", "sourceFilter");
-    pThis->h264Enc = gst_element_factory_make("v4l2h264enc", "h264Encoder");
+    pThis->h264Enc = Encoder_create(&pThis->encSettings, "h264Encoder");
     pThis->encFilter = gst_element_factory_make("capsfilter", "encoderFilter");
-    pThis->videoqueue = gst_element_factory_make("queue", "videoqueue");
-    pThis->rtspClientSink = gst_element_factory_make("rtspclientsink", "videosink");
-    if (pThis->grayscale == TRUE) {
-        pThis->vcYuvToGs = gst_element_factory_make("videoconvert", "vcYuvToGs");
-        pThis->vcYuvToGsCaps = gst_element_factory_make("capsfilter", "vcYuvToGsCaps");
-        pThis->vcGsToYuv = gst_element_factory_make("videoconvert", "vcGsToYuv");
-        pThis->vcGsToYuvCaps = gst_element_factory_make("capsfilter", "vcGsToYuvCaps");
-    }
+    pThis->outputTee = gst_element_factory_make("tee", "outputTee");
 
     if (!pThis->pipeline) {
         g_printerr ("ERROR: 'pipeline' main could be created.\n");
@@ -148,221 +623,763 @@ bool_t FireStreamer_initialize (char *url, char *username, char * password, uint
         success = FALSE;
     }
     if (!pThis->h264Enc) {
-        g_printerr ("ERROR: 'v4l2h264enc' element could be created.\n");
-        success = FALSE;
-    }
-    if (!pThis->videoqueue) {
-        g_printerr ("ERROR: 'queue' element could be created.\n");
-        success = FALSE;
-    }
-    if (!pThis->rtspClientSink) {
-        g_printerr ("ERROR: 'rtspclientsink' element could be created.\n");
+        g_printerr ("ERROR: '%s' element could be created.\n",
+                    Encoder_getFactoryName(pThis->encSettings.backend));
         success = FALSE;
     }
-    if ((pThis->grayscale == TRUE) && (!pThis->vcYuvToGs || !pThis->vcGsToYuv)) {
-        g_printerr ("ERROR: 'videoconvert' element could be created.\n");
+    if (!pThis->outputTee) {
+        g_printerr ("ERROR: 'tee' element could be created.\n");
         success = FALSE;
     }
 
     if (success != TRUE) {
         g_printerr ("ERROR: Not all elements could be created.\n");
-        FireStreamer_gst_free__();
-        return FALSE;
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+
+    /* the raw format decides the frame size and if the frames are converted at all */
+    caps = FireStreamer_gst_negotiate__(pThis, &generic);
+    pThis->converting = (pThis->rawFormat != RAW_YUY2) ? TRUE : FALSE;
+    if ((pThis->format == FIRESTREAMER_FORMAT_SRGGB8) || (pThis->grayscale == TRUE)) {
+        pThis->converting = TRUE;                                   /* demosaic or grayscale pass */
+    }
+    if ((pThis->converting == TRUE) || (pThis->pMotionMemory != NULL) || (simulcast == TRUE)) {
+        if (pThis->memory == FIRESTREAMER_MEMORY_DMABUF) {
+            printf("frames are read by the CPU, dmabuf import is not used!\n");
+            pThis->memory = FIRESTREAMER_MEMORY_SYSTEM;
+        }
+    }
+    if ((pThis->rawFormat != RAW_YUY2) &&
+        ((pThis->format == FIRESTREAMER_FORMAT_SRGGB8) || (pThis->grayscale == TRUE))) {
+        pThis->pConvertMemory = g_try_malloc(pThis->width * pThis->height * 2);
+        if (pThis->pConvertMemory == NULL) {
+            g_printerr ("ERROR: YUY2 frame in front of the %s pass could not be allocated.\n",
+                        l_rawFormatName[pThis->rawFormat]);
+            gst_caps_unref(caps);
+            FireStreamer_gst_free__(pThis);
+            return NULL;
+        }
     }
 
     /* set element properties */
-    g_object_set(G_OBJECT(pThis->appsrc), "do-timestamp", TRUE, NULL);
+    /* buffers carry the capture time as PTS, stamping them when pushed adds scheduling jitter */
+    g_object_set(G_OBJECT(pThis->appsrc), "do-timestamp", FALSE, NULL);
+    g_object_set(G_OBJECT(pThis->appsrc), "min-latency", (gint64)(GST_SECOND / pThis->fps), NULL);
     g_object_set(G_OBJECT(pThis->appsrc), "is-live", TRUE, NULL);
     g_object_set(G_OBJECT(pThis->appsrc), "format", GST_FORMAT_TIME, NULL);
-    g_object_set(G_OBJECT(pThis->rtspClientSink), "latency", 1000, NULL);
-
-    gchar       *capsstr;
-    GstCaps     *caps;
+    g_object_get(G_OBJECT(pThis->appsrc), "max-bytes", &pThis->appsrcDefaultBytes, NULL);
+    g_object_set(G_OBJECT(pThis->appsrc), "max-bytes", FireStreamer_gst_getAppsrcBytes__(pThis),
+                 NULL);
+    FireStreamer_gst_printLatency__(pThis);
 
-    capsstr = g_strdup_printf("video/x-raw,width=%d, height=%d, framerate=30/1, format=(string)YUY2,"
-                              "interlace-mode=(string)progressive, colorimetry=(string)bt601",
-                               pThis->width, pThis->height);
-    caps = gst_caps_from_string(capsstr);
     g_object_set(G_OBJECT(pThis->sourceFilter), "caps", caps, NULL);     /* caps for sourceFilter */
-    g_free(capsstr);
+    success = FireStreamer_gst_createPool__(pThis, caps);
+    if (generic == TRUE) {
+        /* none of our raw formats is taken, convert right in front of the encoder */
+        pThis->encConvert = gst_element_factory_make("videoconvert", "encoderConvert");
+        if (!pThis->encConvert) {
+            g_printerr ("ERROR: 'videoconvert' element could be created.\n");
+            success = FALSE;
+        }
+    }
     gst_caps_unref(caps);
-    capsstr = g_strdup_printf("video/x-h264, profile=high, level=(string)4");
-    caps = gst_caps_from_string(capsstr);
+    if (success != TRUE) {
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+    FireStreamer_gst_printPath__(pThis);
+    caps = Encoder_getOutputCaps(pThis->encSettings.backend, pThis->encSettings.profile);
     g_object_set(G_OBJECT(pThis->encFilter), "caps", caps, NULL);       /* caps for h.264 encoder */
-    g_free(capsstr);
     gst_caps_unref(caps);
-    if (pThis->grayscale) {
-        capsstr = g_strdup_printf("video/x-raw,format=(string)GRAY8");
-        caps = gst_caps_from_string(capsstr);
-        g_object_set(G_OBJECT(pThis->vcYuvToGsCaps), "caps", caps, NULL);
-        g_free(capsstr);
-        gst_caps_unref(caps);
-        capsstr = g_strdup_printf("video/x-raw,format=(string)YUY2");
-        caps = gst_caps_from_string(capsstr);
-        g_object_set(G_OBJECT(pThis->vcGsToYuvCaps), "caps", caps, NULL);
-        g_free(capsstr);
-        gst_caps_unref(caps);
-    }
 
-    g_object_set(G_OBJECT(pThis->rtspClientSink), "location", pThis->url, NULL);
-    g_object_set(G_OBJECT(pThis->rtspClientSink), "user-id", pThis->username, NULL);
-    g_object_set(G_OBJECT(pThis->rtspClientSink), "user-pw", pThis->password, NULL);
-    g_object_set(G_OBJECT(pThis->rtspClientSink), "protocols", 0x00000024, NULL);
-    g_object_set(G_OBJECT(pThis->rtspClientSink), "tls-validation-flags", 0, NULL);
+    /* a slow output must not hold up the encoder or the other outputs */
+    g_object_set(G_OBJECT(pThis->outputTee), "allow-not-linked", TRUE, NULL);
+    /* EOS of a removed output is only seen on the bus as a forwarded message */
+    g_object_set(G_OBJECT(pThis->pipeline), "message-forward", TRUE, NULL);
 
-    /* add list of elements to a bin */
-    if (pThis->grayscale) {
-        gst_bin_add_many(GST_BIN(pThis->pipeline), (GstElement*)pThis->appsrc,
-                         pThis->sourceFilter, pThis->vcYuvToGs, pThis->vcYuvToGsCaps,
-                         pThis->vcGsToYuv, pThis->vcGsToYuvCaps,
-                         pThis->h264Enc, pThis->encFilter, pThis->videoqueue,
-                         pThis->rtspClientSink, NULL);
-    } else {
-        gst_bin_add_many(GST_BIN(pThis->pipeline), (GstElement*)pThis->appsrc,
-                         pThis->sourceFilter, pThis->h264Enc, pThis->encFilter, pThis->videoqueue,
-                         pThis->rtspClientSink, NULL);
+    /* let the encoder import exported capture buffers, v4l2 encoders need to be told so. Software
+     * encoders simply map the dmabuf memory */
+    if (pThis->memory == FIRESTREAMER_MEMORY_DMABUF) {
+        pThis->dmabufAllocator = gst_dmabuf_allocator_new();
+        FireStreamer_gst_setIoMode__(pThis, "dmabuf-import");
+        g_atomic_int_set(&pThis->dmabufActive, TRUE);
     }
 
-    if (pThis->grayscale) {
-        if(!gst_element_link_many((GstElement*)pThis->appsrc, pThis->sourceFilter,
-                pThis->vcYuvToGs, pThis->vcYuvToGsCaps, pThis->vcGsToYuv, pThis->vcGsToYuvCaps,
-                pThis->h264Enc, pThis->encFilter, pThis->videoqueue, pThis->rtspClientSink, NULL)) {
-            g_printerr ("ERROR: Elements could not be linked.\n");
-            FireStreamer_gst_free__();
-            return FALSE;
-        }
+    /* add list of elements to a bin, grayscale is done by the pushFrame() conversion kernels */
+    gst_bin_add_many(GST_BIN(pThis->pipeline), (GstElement*)pThis->appsrc,
+                     pThis->sourceFilter, pThis->h264Enc, pThis->encFilter, pThis->outputTee,
+                     NULL);
+    if (pThis->encConvert != NULL) {
+        gst_bin_add(GST_BIN(pThis->pipeline), pThis->encConvert);
+        success = gst_element_link_many((GstElement*)pThis->appsrc, pThis->sourceFilter,
+                                        pThis->encConvert, pThis->h264Enc, NULL);
     } else {
-        if(!gst_element_link_many((GstElement*)pThis->appsrc, pThis->sourceFilter, pThis->h264Enc,
-                                   pThis->encFilter, pThis->videoqueue, pThis->rtspClientSink, NULL)) {
-            g_printerr ("ERROR: Elements could not be linked.\n");
-            FireStreamer_gst_free__();
-            return FALSE;
-        }
+        success = gst_element_link_many((GstElement*)pThis->appsrc, pThis->sourceFilter,
+                                        pThis->h264Enc, NULL);
+    }
+
+    if(!success || !gst_element_link_many(pThis->h264Enc, pThis->encFilter, pThis->outputTee,
+                                          NULL)) {
+        g_printerr ("ERROR: Elements could not be linked.\n");
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+
+    /* the url is output 0, more can be added and removed while streaming */
+    if (FireStreamer_gst_addOutput__(pThis, pThis->url) != 0) {
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+
+    /* wake-up latency of the appsrc streaming thread */
+    pad = gst_element_get_static_pad((GstElement*)pThis->appsrc, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, FireStreamer_gst_wakeProbe__, pThis, NULL);
+    gst_object_unref(pad);
+
+    /* time to first frame, the first one out of the queue in front of the video sink */
+    pad = gst_element_get_static_pad(pThis->videoqueue, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, FireStreamer_gst_firstFrameProbe__, pThis,
+                      NULL);
+    gst_object_unref(pad);
+
+    /* stamp frames leaving the appsrc, the encoder and the queue in front of the video sink,
+     * the last one is added with output 0 */
+    if (pThis->tracing == TRUE) {
+        FireStreamer_gst_addTraceProbe__(pThis, (GstElement*)pThis->appsrc);
+        FireStreamer_gst_addTraceProbe__(pThis, pThis->h264Enc);
+    }
+
+    /* keep the encoded stream for FireStreamer_triggerRecording() */
+    if (pThis->pPrebufferMemory != NULL) {
+        pad = gst_element_get_static_pad(pThis->encFilter, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, FireStreamer_gst_prebufferProbe__, pThis,
+                          NULL);
+        gst_object_unref(pad);
     }
 
-    /* add a BUS message handler to HTTP pipeline */
+    /* add a BUS message handler to HTTP pipeline, dispatched by the shared bus thread */
     pThis->bus = gst_pipeline_get_bus (GST_PIPELINE (pThis->pipeline));
-    pThis->bus_watch_id = gst_bus_add_watch (pThis->bus, (GstBusFunc)FireStreamer_gst_busCall__,
-                                             (gpointer)pThis);
+    gst_bus_set_sync_handler(pThis->bus, FireStreamer_gst_syncCall__, NULL, NULL);
+    pThis->busWatch = gst_bus_create_watch(pThis->bus);
+    g_source_set_callback(pThis->busWatch, (GSourceFunc)(GCallback)FireStreamer_gst_busCall__,
+                          pThis, NULL);
+    g_source_attach(pThis->busWatch, l_shared.pContext);
 
     /* configure the appsrc, we will push data into the appsrc from the FireStreamer_pushFrame(). */
-    g_signal_connect (pThis->appsrc, "need-data", G_CALLBACK (FireStreamer_gst_startFeeding__), pThis);
-    g_signal_connect (pThis->appsrc, "enough-data", G_CALLBACK (FireStreamer_gst_stopFeeding__), pThis);
+    g_signal_connect (pThis->appsrc, "need-data", G_CALLBACK (FireStreamer_gst_startFeeding__),
+                      pThis);
+    g_signal_connect (pThis->appsrc, "enough-data", G_CALLBACK (FireStreamer_gst_stopFeeding__),
+                      pThis);
 
     /* start streamer */
     gstRet = gst_element_set_state ((GstElement*)pThis->pipeline, GST_STATE_PLAYING);
+    if ((gstRet == GST_STATE_CHANGE_FAILURE) && (g_atomic_int_get(&pThis->dmabufActive) == TRUE)) {
+        g_printerr ("ERROR: Unable to start the pipeline with dmabuf import, using copy path.\n");
+        FireStreamer_gst_dmabufFallback__(pThis);
+        gstRet = gst_element_set_state ((GstElement*)pThis->pipeline, GST_STATE_PLAYING);
+    }
     if (gstRet == GST_STATE_CHANGE_FAILURE) {
          g_printerr ("ERROR: Unable to set the pipeline to the playing state.\n");
-         FireStreamer_gst_free__();
-         return FALSE;
+         FireStreamer_gst_free__(pThis);
+         return NULL;
     }
-    nFireStreamers++;                                 /* number of allocated FireStreamer objects */
 
-    g_usleep(1000000);         /* give a chance to gstreamer start pipeline before we push frames */
-    return TRUE;
+    /* start push thread, it feeds the appsrc from the ring */
+    if (pthread_create(&pThis->pushThreadId, NULL, &FireStreamer_gst_pushLoop__, pThis) != 0) {
+        g_printerr ("ERROR: push thread could not be created.\n");
+        pThis->pushThreadId = 0;
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+
+    /* adaptive bitrate, follows the RTCP receiver reports on the bus thread */
+    if (pThis->abrEnabled == TRUE) {
+        pThis->abrTimer = g_timeout_source_new(ABR_POLL_MS);
+        g_source_set_callback(pThis->abrTimer, FireStreamer_gst_abrTick__, pThis, NULL);
+        g_source_attach(pThis->abrTimer, l_shared.pContext);
+    }
+
+    /* live stats, the segment is open while any FireStreamer that found it open runs */
+    if (StatsShm_isOpen(&l_shared.stats) == TRUE) {
+        pThis->statsUs = g_get_monotonic_time();
+        pThis->statsTimer = g_timeout_source_new(pConfig->statsIntervalMs);
+        g_source_set_callback(pThis->statsTimer, FireStreamer_gst_statsTick__, pThis, NULL);
+        g_source_attach(pThis->statsTimer, l_shared.pContext);
+    }
+
+    /* substreams scaled from the frames of this one, each with its own pipeline */
+    if ((simulcast == TRUE) && (FireStreamer_gst_createRenditions__(pThis, pConfig) != TRUE)) {
+        FireStreamer_gst_free__(pThis);
+        return NULL;
+    }
+
+    /* no waiting for the pipeline, frames are skipped until the ready callback */
+    return pThis;
+}
+
+void FireStreamer_destroy (FireStreamer_t *pThis) {
+
+    assert(pThis != NULL && pThis->inUse == TRUE);
+
+    FireStreamer_gst_free__(pThis);                        /* releases the slot as the last step */
 }
 
-uint32_t FireStreamer_pushFrame (void *pData, uint32_t size) {
+uint32_t FireStreamer_pushFrame (FireStreamer_t *pThis, void *pData, uint32_t size,
+                                 const FireStreamerFrameInfo_t *pInfo) {
 
     GstBuffer      *buffer;
+    const uint8_t  *pYuy2 = NULL;        /* the renditions are scaled from it, NULL = from buffer */
+    uint32_t        yuy2Stride = 0;
     uint32_t        nWritten = 0;
-    GstFlowReturn   ret;
+    gint64          pushUs = g_get_monotonic_time();
 
-    assert(pThis->appsrc != NULL);
+    assert(pThis != NULL && pThis->appsrc != NULL);
 
-    if (pThis->feedData == TRUE) {
-        buffer = gst_buffer_new_and_alloc(size);
-        nWritten = gst_buffer_fill(buffer, 0, pData, size);
-
-        /* push data to appsrc */
-        ret = gst_app_src_push_buffer(GST_APP_SRC(pThis->appsrc), buffer);
-        if (ret != GST_FLOW_OK) {
-            g_printerr ("ERROR: -EINVAL GST_FLOW!\n");
+    FireStreamer_gst_checkSequence__(pThis, pInfo);
+    if ((FireStreamer_gst_gateMotion__(pThis, pData, size) == TRUE) &&
+        (FireStreamer_gst_admitFrame__(pThis) == TRUE)) {
+        if (pThis->converting == TRUE) {
+            buffer = FireStreamer_gst_convert__(pThis, pData, size, &pYuy2, &yuy2Stride);
+            if (buffer == NULL) {
+                return 0;
+            }
+            nWritten = size;
+        } else {
+            if (size <= pThis->frameSize) {
+                buffer = FireStreamer_gst_acquireBuffer__(pThis);
+                if (buffer == NULL) {
+                    return 0;
+                }
+                gst_buffer_set_size(buffer, size);        /* pool restores full size on release */
+            } else {
+                buffer = gst_buffer_new_and_alloc(size);           /* frame does not fit the pool */
+            }
+            nWritten = gst_buffer_fill(buffer, 0, pData, size);
+            pYuy2 = (const uint8_t*)pData;
+            yuy2Stride = pThis->stride;
         }
+        if ((pThis->nRenditions > 0) &&
+            ((pYuy2 != pData) || (FireStreamer_gst_isFrameComplete__(pThis, size) == TRUE))) {
+            FireStreamer_gst_pushRenditions__(pThis, pYuy2, yuy2Stride, buffer, pushUs, pInfo);
+        }
+
+        /* hand the buffer to the push thread, a dropped buffer goes back to the pool */
+        FireStreamer_gst_queueFrame__(pThis, buffer, pushUs, pInfo);
     }
 
     return nWritten;
 }
 
+uint32_t FireStreamer_getPoolExhaustedCount (FireStreamer_t *pThis) {
+
+    assert(pThis != NULL);
+    return g_atomic_int_get(&pThis->poolExhausted);
+}
+
+uint32_t FireStreamer_pushFrameZeroCopy (FireStreamer_t *pThis, void *pData, uint32_t size,
+                                         FireStreamer_releaseFrame_t releaseFrame,
+                                         void *pUserData, const FireStreamerFrameInfo_t *pInfo) {
+
+    GstBuffer      *buffer;
+    gint64          pushUs = g_get_monotonic_time();
+
+    assert(pThis != NULL && pThis->appsrc != NULL);
+    assert(releaseFrame != NULL);
+
+    /* frame has to be converted anyway, convert it into a pool buffer and release it right away */
+    if (pThis->converting == TRUE) {
+        if (FireStreamer_pushFrame(pThis, pData, size, pInfo) == 0) {
+            return 0;
+        }
+        releaseFrame(pUserData);
+        return size;
+    }
+
+    FireStreamer_gst_checkSequence__(pThis, pInfo);
+    if ((FireStreamer_gst_gateMotion__(pThis, pData, size) != TRUE) ||
+        (FireStreamer_gst_admitFrame__(pThis) != TRUE)) {
+        releaseFrame(pUserData);                             /* skipped, give the frame back now */
+        return size;
+    }
+    if ((pThis->nRenditions > 0) && (FireStreamer_gst_isFrameComplete__(pThis, size) == TRUE)) {
+        FireStreamer_gst_pushRenditions__(pThis, (const uint8_t*)pData, pThis->stride, NULL,
+                                          pushUs, pInfo);
+    }
+
+    /* wrap the capture buffer without copying, releaseFrame() is called on the last unref. Memory
+     * is read-only so any element that wants to write gets its own copy */
+    buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, pData, size, 0, size, pUserData,
+                                         (GDestroyNotify)releaseFrame);
+
+    /* hand the buffer to the push thread, the frame is released even if the ring drops it */
+    FireStreamer_gst_queueFrame__(pThis, buffer, pushUs, pInfo);
+
+    return size;
+}
+
+uint32_t FireStreamer_pushFrameDmabuf (FireStreamer_t *pThis, int dmabufFd, uint32_t size,
+                                       FireStreamer_releaseFrame_t releaseFrame, void *pUserData,
+                                       const FireStreamerFrameInfo_t *pInfo) {
+
+    GstBuffer      *buffer;
+    GstMemory      *memory;
+    gint64          pushUs = g_get_monotonic_time();
+
+    assert(pThis != NULL && pThis->appsrc != NULL);
+    assert(dmabufFd >= 0);
+    assert(releaseFrame != NULL);
+
+    /* dmabuf not requested or negotiation failed, caller uses the system memory path */
+    if (g_atomic_int_get(&pThis->dmabufActive) != TRUE) {
+        return 0;
+    }
+
+    /* the capture device owns the fd, GstMemory must not close it. Allocated before the frame is
+     * counted, a failure leaves it untouched for the other path */
+    memory = gst_dmabuf_allocator_alloc_with_flags(pThis->dmabufAllocator, dmabufFd, size,
+                                                   GST_FD_MEMORY_FLAG_DONT_CLOSE);
+    if (memory == NULL) {
+        return 0;
+    }
+    FireStreamer_gst_checkSequence__(pThis, pInfo);
+    if (FireStreamer_gst_admitFrame__(pThis) != TRUE) {
+        gst_memory_unref(memory);
+        releaseFrame(pUserData);   /* skipped, taken so the caller does not try another path */
+        return size;
+    }
+    GST_MINI_OBJECT_FLAG_SET(memory, GST_MEMORY_FLAG_READONLY);
+    buffer = gst_buffer_new();
+    gst_buffer_append_memory(buffer, memory);
+    /* qdata is destroyed together with the buffer, that is when releaseFrame() is called */
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer), pThis->releaseQuark, pUserData,
+                              (GDestroyNotify)releaseFrame);
+
+    /* hand the buffer to the push thread, the frame is released even if the ring drops it */
+    FireStreamer_gst_queueFrame__(pThis, buffer, pushUs, pInfo);
+
+    return size;
+}
+
+void FireStreamer_getQueueStats (FireStreamer_t *pThis, FireStreamerQueueStats_t *pStats) {
+    FrameRingStats_t ringStats;
+
+    assert(pThis != NULL && pStats != NULL);
+
+    FrameRing_getStats(&pThis->ring, &ringStats);
+    pStats->enqueued = ringStats.enqueued;
+    pStats->pushed = g_atomic_int_get(&pThis->pushed);
+    pStats->dropped = ringStats.dropped;
+    pStats->skipped = g_atomic_int_get(&pThis->skipped);
+    pStats->sensorDropped = g_atomic_int_get(&pThis->sensorDropped);
+    pStats->ptsClamped = g_atomic_int_get(&pThis->ptsClamped);
+}
+
+uint32_t FireStreamer_getDecimationLevel (FireStreamer_t *pThis) {
+
+    assert(pThis != NULL);
+    return g_atomic_int_get(&pThis->decimation);
+}
+
+void FireStreamer_getStats (FireStreamer_t *pThis, FireStreamerStats_t *pStats) {
+    Histogram_t *pHistogram;
+    uint32_t i;
+
+    assert(pThis != NULL && pStats != NULL);
+
+    for (i = 0; i < FIRESTREAMER_STAGE_COUNT; i++) {
+        pHistogram = &pThis->latency[i];
+        pStats->latency[i].count = Histogram_getCount(pHistogram);
+        pStats->latency[i].p50 = Histogram_getPercentile(pHistogram, 50);
+        pStats->latency[i].p99 = Histogram_getPercentile(pHistogram, 99);
+        pStats->latency[i].max = Histogram_getMax(pHistogram);
+    }
+    pStats->framesPushed = g_atomic_int_get(&pThis->traceSeq);
+    pStats->framesEncoded = g_atomic_int_get(&pThis->framesEncoded);
+    pStats->bytesEncoded = atomic_load_explicit(&pThis->bytesEncoded, memory_order_relaxed);
+    pStats->framesSent = g_atomic_int_get(&pThis->framesSent);
+    pStats->reconnects = g_atomic_int_get(&pThis->reconnects);
+    pStats->readyUs = g_atomic_int_get(&pThis->readyUs);
+    pStats->firstFrameUs = g_atomic_int_get(&pThis->firstFrameUs);
+}
+
+void FireStreamer_getAbrStats (FireStreamer_t *pThis, FireStreamerAbrStats_t *pStats) {
+
+    assert(pThis != NULL && pStats != NULL);
+
+    pthread_mutex_lock(&pThis->abrMutex);
+    *pStats = pThis->abrStats;
+    pthread_mutex_unlock(&pThis->abrMutex);
+}
+
+bool_t FireStreamer_triggerRecording (FireStreamer_t *pThis, const char *pPath,
+                                      uint32_t postSeconds) {
+    GstElement             *recorder;
+    GstAppSrc              *recSrc;
+    GSource                *recWatch;
+    uint32_t               i;
+
+    assert(pThis != NULL && pThis->inUse == TRUE && pPath != NULL);
+    assert(strlen(pPath) < sizeof(pThis->recPath));
+
+    if (pThis->pPrebufferMemory == NULL) {
+        g_printerr ("ERROR: recording needs a prebuffer, set prebufferSeconds.\n");
+        return FALSE;
+    }
+
+    /* an alarm during a recording makes the running one longer, one file per event */
+    pthread_mutex_lock(&pThis->recMutex);
+    if (pThis->recStarting == TRUE) {
+        pthread_mutex_unlock(&pThis->recMutex);
+        return TRUE;                                  /* the same event, triggered twice at once */
+    }
+    if ((pThis->recorder != NULL) && (pThis->recEos == TRUE)) {
+        /* the file is being finished, the event gets a new one as soon as it is done */
+        pThis->recPending = TRUE;
+        snprintf(pThis->recPendingPath, sizeof(pThis->recPendingPath), "%s", pPath);
+        pThis->recPendingSeconds = postSeconds;
+        pthread_mutex_unlock(&pThis->recMutex);
+        printf("recording to '%s' starts once '%s' is done\n", pPath, pThis->recPath);
+        return TRUE;
+    }
+    if (pThis->recorder != NULL) {
+        if ((pThis->encodedPts != GST_CLOCK_TIME_NONE) &&
+            ((pThis->recStop == GST_CLOCK_TIME_NONE) ||
+             (pThis->encodedPts + postSeconds * GST_SECOND > pThis->recStop))) {
+            pThis->recStop = pThis->encodedPts + postSeconds * GST_SECOND;
+        }
+        pthread_mutex_unlock(&pThis->recMutex);
+        printf("recording to '%s' extended by %u s\n", pThis->recPath, postSeconds);
+        return TRUE;
+    }
+    pThis->recStarting = TRUE;
+    pthread_mutex_unlock(&pThis->recMutex);
+
+    /* built unlocked, the encoder thread keeps filling the prebuffer meanwhile */
+    recorder = FireStreamer_gst_createRecorder__(pThis, pPath, &recSrc, &recWatch);
+
+    /* the window before the trigger goes out at once, the encoder probe appends the rest */
+    pthread_mutex_lock(&pThis->recMutex);
+    pThis->recStarting = FALSE;
+    if (recorder == NULL) {
+        pthread_mutex_unlock(&pThis->recMutex);
+        return FALSE;
+    }
+    pThis->recorder = recorder;
+    pThis->recSrc = recSrc;
+    pThis->recWatch = recWatch;
+    snprintf(pThis->recPath, sizeof(pThis->recPath), "%s", pPath);
+    pThis->recBase = GST_CLOCK_TIME_NONE;
+    pThis->recWaitKey = FALSE;
+    pThis->recPost = postSeconds * GST_SECOND;
+    pThis->recStop = (pThis->encodedPts != GST_CLOCK_TIME_NONE) ?
+                     pThis->encodedPts + pThis->recPost : GST_CLOCK_TIME_NONE;
+    pThis->recEos = FALSE;
+    for (i = 0; i < Prebuffer_getCount(&pThis->prebuffer); i++) {
+        FireStreamer_gst_recordUnit__(pThis, i);
+    }
+    printf("recording to '%s', %u frames before the trigger and %u s after it\n", pPath,
+           Prebuffer_getCount(&pThis->prebuffer), postSeconds);
+    pthread_mutex_unlock(&pThis->recMutex);
+
+    return TRUE;
+}
+
+int32_t FireStreamer_addOutput (FireStreamer_t *pThis, const char *pUrl) {
+
+    assert(pThis != NULL && pThis->inUse == TRUE && pUrl != NULL);
+    assert(strlen(pUrl) < CHAR_PARAM);
+
+    return FireStreamer_gst_addOutput__(pThis, pUrl);
+}
+
+bool_t FireStreamer_removeOutput (FireStreamer_t *pThis, int32_t output) {
+    Output_t *pOutput;
+
+    assert(pThis != NULL && pThis->inUse == TRUE);
+    assert(output >= 0 && output < FIRESTREAMER_MAX_OUTPUTS);
+
+    /* output 0 carries the Abr and the tracing, it lives as long as the FireStreamer */
+    if (output == 0) {
+        g_printerr ("ERROR: output 0 is '%s', it can't be removed.\n", pThis->url);
+        return FALSE;
+    }
+    pOutput = &pThis->outputs[output];
+    pthread_mutex_lock(&pThis->outMutex);
+    if ((pOutput->inUse != TRUE) || ((pOutput->removing == TRUE) &&
+                                     (pOutput->reconnecting != TRUE))) {
+        pthread_mutex_unlock(&pThis->outMutex);
+        return FALSE;
+    }
+    if (pOutput->removing == TRUE) {
+        pOutput->reconnecting = FALSE;              /* torn down for a reconnect, not built again */
+        pthread_mutex_unlock(&pThis->outMutex);
+        return TRUE;
+    }
+    if (pOutput->retryTimer != NULL) {
+        g_source_destroy(pOutput->retryTimer);               /* waiting for a reconnect, no bin */
+        g_source_unref(pOutput->retryTimer);
+        printf("output %d '%s' removed\n", output, pOutput->url);
+        FireStreamer_gst_clearOutput__(pOutput);
+        pthread_mutex_unlock(&pThis->outMutex);
+        return TRUE;
+    }
+    pOutput->removing = TRUE;
+    pthread_mutex_unlock(&pThis->outMutex);
+
+    /* unlinked between two buffers, the tee and the other outputs don't stop */
+    gst_pad_add_probe(pOutput->teePad, GST_PAD_PROBE_TYPE_IDLE, FireStreamer_gst_unlinkOutput__,
+                      pOutput, NULL);
+    return TRUE;
+}
+
+FireStreamer_t* FireStreamer_getRendition (FireStreamer_t *pThis, uint32_t rendition) {
+
+    assert(pThis != NULL && pThis->inUse == TRUE);
+    assert(rendition < FIRESTREAMER_MAX_RENDITIONS);
+
+    return pThis->renditions[rendition];                      /* owned by pThis, NULL if not used */
+}
+
+void FireStreamer_getMotion (FireStreamer_t *pThis, FireStreamerMotion_t *pMotion) {
+
+    assert(pThis != NULL && pMotion != NULL);
+
+    memset(pMotion, 0, sizeof(*pMotion));
+    pMotion->skipped = g_atomic_int_get(&pThis->motionSkipped);
+    if (pThis->pMotionMemory == NULL) {
+        return;                                                           /* motion gating is off */
+    }
+    pthread_mutex_lock(&pThis->motionMutex);
+    pMotion->activeBlocks = Motion_getActiveBlocks(&pThis->motion);
+    pMotion->moving = (pMotion->activeBlocks > 0) ? TRUE : FALSE;
+    memcpy(pMotion->scores, Motion_getScores(&pThis->motion), sizeof(pMotion->scores));
+    pthread_mutex_unlock(&pThis->motionMutex);
+}
+
+void FireStreamer_setLatencyProfile (FireStreamer_t *pThis, FireStreamerLatencyProfile_t profile) {
+    LatencySettings_t   settings;
+    Output_t            *restart[FIRESTREAMER_MAX_OUTPUTS];
+    Output_t            *pOutput;
+    uint32_t            nRestart = 0;
+    uint32_t            i;
+    gint                old;
+    gint64              now = g_get_monotonic_time();
+    bool_t              sinkChanged;
+
+    assert(pThis != NULL && pThis->inUse == TRUE);
+    assert(profile < FIRESTREAMER_LATENCY_COUNT);
+
+    /* the renditions follow the main stream */
+    for (i = 0; i < FIRESTREAMER_MAX_RENDITIONS; i++) {
+        if (pThis->renditions[i] != NULL) {
+            FireStreamer_setLatencyProfile(pThis->renditions[i], profile);
+        }
+    }
+
+    FireStreamer_gst_getLatencySettings__(pThis, profile, &settings);
+    pthread_mutex_lock(&pThis->outMutex);
+    old = g_atomic_int_get(&pThis->latencyProfile);
+    if ((old == (gint)profile) || (pThis->outputsClosed == TRUE)) {
+        pthread_mutex_unlock(&pThis->outMutex);
+        return;
+    }
+    pThis->profileActiveUs[old] += now - pThis->profileUs;
+    pThis->profileUs = now;
+    sinkChanged = ((settings.sinkLatencyMs != pThis->latencySettings.sinkLatencyMs) ||
+                   (settings.transport != pThis->latencySettings.transport)) ? TRUE : FALSE;
+    pThis->latencySettings = settings;
+    g_atomic_int_set(&pThis->latencyProfile, (gint)profile);
+
+    /* queue limits take effect at once, an RTSP session keeps its transport until it reconnects */
+    for (i = 0; i < FIRESTREAMER_MAX_OUTPUTS; i++) {
+        pOutput = &pThis->outputs[i];
+        if ((pOutput->inUse != TRUE) || (pOutput->removing == TRUE) || (pOutput->queue == NULL)) {
+            continue;
+        }
+        FireStreamer_gst_setQueueLimits__(pThis, pOutput->queue);
+        if ((sinkChanged == TRUE) && (pOutput->type == FIRESTREAMER_SINK_RTSP)) {
+            restart[nRestart++] = pOutput;
+        }
+    }
+    pthread_mutex_unlock(&pThis->outMutex);
+
+    g_object_set(G_OBJECT(pThis->appsrc), "max-bytes", FireStreamer_gst_getAppsrcBytes__(pThis),
+                 NULL);
+    if (settings.gop != pThis->encSettings.gop) {
+        pthread_mutex_lock(&pThis->abrMutex);                /* the Abr sets encoder controls too */
+        pThis->encSettings.gop = settings.gop;
+        if (Encoder_setGop(pThis->h264Enc, pThis->encSettings.backend, settings.gop) != TRUE) {
+            printf("%s keeps its gop while playing, %u frames from the next start\n",
+                   Encoder_getFactoryName(pThis->encSettings.backend), settings.gop);
+        }
+        pthread_mutex_unlock(&pThis->abrMutex);
+    }
+    FireStreamer_gst_printLatency__(pThis);
+    for (i = 0; i < nRestart; i++) {
+        FireStreamer_gst_reconnectOutput__(restart[i], TRUE);
+    }
+}
+
+FireStreamerLatencyProfile_t FireStreamer_getLatencyProfile (FireStreamer_t *pThis) {
+
+    assert(pThis != NULL);
+    return (FireStreamerLatencyProfile_t)g_atomic_int_get(&pThis->latencyProfile);
+}
+
+void FireStreamer_getProfileStats (FireStreamer_t *pThis, FireStreamerLatencyProfile_t profile,
+                                   FireStreamerProfileStats_t *pStats) {
+    Histogram_t *pHistogram;
+    gint64      activeUs;
+
+    assert(pThis != NULL && pStats != NULL);
+    assert(profile < FIRESTREAMER_LATENCY_COUNT);
+
+    pHistogram = &pThis->profileLatency[profile];
+    pStats->latency.count = Histogram_getCount(pHistogram);
+    pStats->latency.p50 = Histogram_getPercentile(pHistogram, 50);
+    pStats->latency.p99 = Histogram_getPercentile(pHistogram, 99);
+    pStats->latency.max = Histogram_getMax(pHistogram);
+    pthread_mutex_lock(&pThis->outMutex);
+    activeUs = pThis->profileActiveUs[profile];
+    if (g_atomic_int_get(&pThis->latencyProfile) == (gint)profile) {
+        activeUs += g_get_monotonic_time() - pThis->profileUs;
+    }
+    pthread_mutex_unlock(&pThis->outMutex);
+    pStats->activeMs = (uint32_t)(activeUs / 1000);
+    pStats->appsrcBytes = atomic_load_explicit(&pThis->appsrcMark[profile], memory_order_relaxed);
+    pStats->queueBytes = atomic_load_explicit(&pThis->queueMark[profile], memory_order_relaxed);
+}
+
+uint32_t FireStreamer_getSnapshot (FireStreamer_t *pThis, uint32_t width, uint32_t height,
+                                   uint32_t quality, void *pJpeg, uint32_t maxSize) {
+    gint64      now;
+    uint32_t    size = 0;
+
+    assert(pThis != NULL && pThis->inUse == TRUE && pJpeg != NULL);
+    assert(quality <= 100);
+
+    /* 0 takes the stream size, a single 0 follows the aspect ratio of the stream */
+    if ((width == 0) && (height == 0)) {
+        width = pThis->width;
+        height = pThis->height;
+    } else if (width == 0) {
+        width = MAX((uint32_t)((guint64)pThis->width * height / pThis->height) & ~1u, 2);
+    } else if (height == 0) {
+        height = MAX((uint32_t)((guint64)pThis->height * width / pThis->width) & ~1u, 2);
+    }
+
+    /* concurrent requests wait here and take the JPEG of the first one, one encode per TTL */
+    pthread_mutex_lock(&pThis->snapMutex);
+    now = g_get_monotonic_time();
+    if ((pThis->snapSize == 0) || (now - pThis->snapUs >= pThis->snapTtlUs) ||
+        (pThis->snapWidth != width) || (pThis->snapHeight != height) ||
+        (pThis->snapQuality != quality)) {
+        pThis->snapWidth = width;
+        pThis->snapHeight = height;
+        pThis->snapQuality = quality;
+        pThis->snapUs = now;
+        FireStreamer_gst_encodeSnapshot__(pThis, width, height, quality);
+    }
+    if (pThis->snapSize > maxSize) {
+        g_printerr ("ERROR: snapshot of %u bytes doesn't fit into %u bytes.\n", pThis->snapSize,
+                    maxSize);
+    } else if (pThis->snapSize > 0) {
+        memcpy(pJpeg, pThis->pSnapMemory, pThis->snapSize);
+        size = pThis->snapSize;
+    }
+    pthread_mutex_unlock(&pThis->snapMutex);
+
+    return size;
+}
+
 
 /* private function definition */
 static gboolean FireStreamer_gst_busCall__ (GstBus *bus, GstMessage *msg,
                                             FireStreamer_t *pPipeline) {
     FireStreamer_t *pThis = pPipeline;
+    gpointer        posted;
     UNUSED_ARGUMENT(bus);
-    UNUSED_ARGUMENT(pThis);
+
+    /* posting time, stamped by syncCall(). The 32 bits wrap, the difference doesn't */
+    posted = gst_mini_object_get_qdata(GST_MINI_OBJECT(msg), l_shared.postedQuark);
+    if (posted != NULL) {
+        Threads_recordWake(THREADS_ROLE_BUS,
+                           (guint32)g_get_monotonic_time() - GPOINTER_TO_UINT(posted));
+    }
 
     switch (GST_MESSAGE_TYPE(msg)) {
 
         case GST_MESSAGE_EOS: {
+            /* every sink is done, an output ending on its own is handled as GstBinForwarded */
             printf("GST_MESSAGE_EOS\n");
-            //TODO handle this properly
+            break;
+        }
+        case GST_MESSAGE_ELEMENT: {
+            const GstStructure *structure = gst_message_get_structure(msg);
+            GstMessage         *forwarded = NULL;
+            Output_t           *pOutput;
+
+            /* an output bin forwards the EOS of its sink, the removed output is drained. An EOS
+             * nobody asked for is an RTSP server that ended the session */
+            if ((structure == NULL) || !gst_structure_has_name(structure, "GstBinForwarded")) {
+                break;
+            }
+            gst_structure_get(structure, "message", GST_TYPE_MESSAGE, &forwarded, NULL);
+            if (forwarded == NULL) {
+                break;
+            }
+            if (GST_MESSAGE_TYPE(forwarded) == GST_MESSAGE_EOS) {
+                pOutput = FireStreamer_gst_findOutput__(pThis, GST_MESSAGE_SRC(msg));
+                if ((pOutput != NULL) && (pOutput->removing == TRUE)) {
+                    FireStreamer_gst_finishOutput__(pOutput);
+                } else if ((pOutput != NULL) && (pOutput->type == FIRESTREAMER_SINK_RTSP)) {
+                    FireStreamer_gst_reconnectOutput__(pOutput, FALSE);
+                }
+            }
+            gst_message_unref(forwarded);
             break;
         }
         case GST_MESSAGE_ERROR: {
-            gchar  *debug;
-            GError *error;
+            gchar    *debug;
+            GError   *error;
+            Output_t *pOutput;
 
             if (pPipeline->state == GST_STATE_NULL) {
                 return TRUE;
             }
 
+            /* a lost RTSP server is connected again, a failed extra output is dropped. The
+             * capture, the encoder and the other outputs go on */
+            pOutput = FireStreamer_gst_findOutput__(pThis, GST_MESSAGE_SRC(msg));
+            if ((pOutput != NULL) && ((pOutput->type == FIRESTREAMER_SINK_RTSP) ||
+                                      (pOutput != &pThis->outputs[0]))) {
+                gst_message_parse_error(msg, &error, &debug);
+                g_printerr ("ERROR: output '%s' failed, %s: %s\n", pOutput->url,
+                            GST_OBJECT_NAME(msg->src), error->message);
+                g_free (debug);
+                g_error_free (error);
+                if (pOutput->type == FIRESTREAMER_SINK_RTSP) {
+                    FireStreamer_gst_reconnectOutput__(pOutput, FALSE);
+                } else {
+                    g_atomic_int_set(&pOutput->failed, 1);
+                    FireStreamer_removeOutput(pThis, (int32_t)(pOutput - pThis->outputs));
+                }
+                return TRUE;
+            }
+
             printf("GST_MESSAGE_ERROR!\n");
             gst_message_parse_error(msg, &error, &debug);
             printf("Error received from element %s: %s\n", GST_OBJECT_NAME (msg->src), error->message);
             printf("Debugging information: %s\n", debug ? debug : "none");
 
-            if ((strcmp(GST_OBJECT_NAME(msg->src), "videoSource") == 0) ||
-                    (strcmp(GST_OBJECT_NAME(msg->src), "h264Encoder") == 0) ||
-                    (strcmp(GST_OBJECT_NAME(msg->src), "videosink") == 0)) {
-                if ((strcmp(error->message, "Could not open resource for reading and writing.") == 0) ||
-                        strcmp(error->message, "Could not establish connection to server.") == 0) {
-//                    CriticalSection_enter(pThis->pCriticalSection);
-//                    if (pPipeline->fed != TRUE) {
-//                        pPipeline->fed = TRUE;
-//                        pPipeline->statusCode = URLSNAPSHOT_STATUS_400_ERROR__;
-//                        strcpy(pPipeline->statusMessage, "Bad Request");
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                        UrlSnapshot_passEvent_catchFinishing__(pPipeline);
-//                    } else {
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                    }
-                } else if ((strcmp(error->message, "Not authorized to access resource.") == 0) ||
-                        (strcmp(error->message, "Unauthorized") == 0)) {
-//                    CriticalSection_enter(pThis->pCriticalSection);
-//                    if (pPipeline->fed != TRUE) {
-//                        pPipeline->fed = TRUE;
-//                        pPipeline->statusCode = URLSNAPSHOT_STATUS_401_ERROR__;
-//                        strcpy(pPipeline->statusMessage, "Unauthorized");
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                        UrlSnapshot_passEvent_catchFinishing__(pPipeline);
-//                    } else {
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                    }
-                } else if (strcmp(error->message, "Could not open resource for reading.") == 0) {
-//                    CriticalSection_enter(pThis->pCriticalSection);
-//                    if (pPipeline->fed != TRUE) {
-//                        pPipeline->fed = TRUE;
-//                        pPipeline->statusCode = URLSNAPSHOT_STATUS_404_ERROR__;
-//                        strcpy(pPipeline->statusMessage, "Not Found");
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                        UrlSnapshot_passEvent_catchFinishing__(pPipeline);
-//                    } else {
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                    }
-                } else {
-//                    CriticalSection_enter(pThis->pCriticalSection);
-//                    if (pPipeline->fed != TRUE) {
-//                        pPipeline->fed = TRUE;
-//                        pPipeline->statusCode = URLSNAPSHOT_STATUS_404_ERROR__;
-//                        strcpy(pPipeline->statusMessage, "Not Found");
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                        UrlSnapshot_passEvent_catchFinishing__(pPipeline);
-//                    } else {
-//                        CriticalSection_exit(pThis->pCriticalSection);
-//                    }
-                }
+            /* encoder could not import dmabuf memory, restart pipeline with the copy path */
+            if (FireStreamer_gst_isImportError__(pThis, msg, error, debug) == TRUE) {
+                printf("dmabuf import failed, falling back to copy path!\n");
+                FireStreamer_gst_dmabufFallback__(pThis);
+                gst_element_set_state ((GstElement*)pThis->pipeline, GST_STATE_PLAYING);
             }
+
             g_free (debug);
             g_error_free (error);
             break;
@@ -375,6 +1392,11 @@ static gboolean FireStreamer_gst_busCall__ (GstBus *bus, GstMessage *msg,
                 pPipeline->state = new_state;
                 printf("State set from %s to %s\n",
                 gst_element_state_get_name(old_state), gst_element_state_get_name(new_state));
+                if (new_state == GST_STATE_PLAYING) {
+                    FireStreamer_gst_setReady__(pThis, READY_PLAYING);
+                }
+            } else if (new_state == GST_STATE_PLAYING) {
+                FireStreamer_gst_outputPlaying__(pThis, GST_MESSAGE_SRC(msg));
             }
             break;
         }
@@ -386,70 +1408,2241 @@ static gboolean FireStreamer_gst_busCall__ (GstBus *bus, GstMessage *msg,
     return TRUE;
 }
 
+static GstBusSyncReply FireStreamer_gst_syncCall__ (GstBus *bus, GstMessage *msg,
+                                                    gpointer pUserData) {
+    GstStreamStatusType type;
+    GstElement         *owner;
+    UNUSED_ARGUMENT(bus);
+    UNUSED_ARGUMENT(pUserData);
+
+    /* runs in the posting thread. ENTER is posted by a new streaming thread before its loop */
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS) {
+        gst_message_parse_stream_status(msg, &type, &owner);
+        if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+            Threads_apply(THREADS_ROLE_STREAMING, GST_ELEMENT_NAME(owner));
+        }
+    }
+
+    /* for busCall(), the message timestamp belongs to the poster. Odd, never NULL */
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(msg), l_shared.postedQuark,
+                              GUINT_TO_POINTER((guint32)g_get_monotonic_time() | 1), NULL);
+    return GST_BUS_PASS;
+}
+
 static void* FireStreamer_gst_mainLoop__ (void *pArgument) {
-    FireStreamer_t *pThis = (FireStreamer_t*)pArgument;
+    GMainLoop *pMainLoop = (GMainLoop*)pArgument;
 
-    g_main_loop_run (pThis->pMainLoop);
+    Threads_apply(THREADS_ROLE_BUS, "gstMsgBus");
+    g_main_loop_run (pMainLoop);                         /* quits when the last object is freed */
 
-    printf("%s EXIT\n", __func__);                                    /* this should never happen */
     return (void*) 0;
 }
 
-static void FireStreamer_gst_startFeeding__ (void) {
-    /* set feedData to true */                                      //todo add critical section here
-    if (pThis->feedData != TRUE) {
-        printf("start feeding!\n");
-        pThis->feedData = TRUE;
+static FireStreamer_t* FireStreamer_gst_attach__ (const FireStreamerConfig_t *pConfig) {
+    FireStreamer_t *pThis = NULL;
+    unsigned int major, minor, micro, nano;
+    uint32_t i;
+    int retVal;
+
+    pthread_mutex_lock(&l_shared.mutex);
+    for (i = 0; i < FIRESTREAMER_MAX_INSTANCES; i++) {
+        if (l_fireStreamers[i].inUse != TRUE) {
+            pThis = &l_fireStreamers[i];
+            break;
+        }
+    }
+    if (pThis == NULL) {
+        pthread_mutex_unlock(&l_shared.mutex);
+        g_printerr ("ERROR: all %d FireStreamer objects are in use.\n", FIRESTREAMER_MAX_INSTANCES);
+        return NULL;
     }
-}
 
-static void FireStreamer_gst_stopFeeding__ (void) {
-    if (pThis->feedData != FALSE) {
-        printf("stop feeding!\n");
-        pThis->feedData = FALSE;
+    if (l_shared.nFireStreamers == 0) {
+        /* Initialize GStreamer, done once per process. gst_init() reads the registry cache and
+         * rescans only changed plugins, a prebuilt cache skips even that check. A missing one is
+         * written there by the first scan */
+        if (pConfig->registry != NULL) {
+            if (g_file_test(pConfig->registry, G_FILE_TEST_IS_REGULAR) == TRUE) {
+                g_setenv("GST_REGISTRY_UPDATE", "no", TRUE);
+            }
+            g_setenv("GST_REGISTRY", pConfig->registry, TRUE);
+        }
+        gst_init(NULL, NULL);
+        gst_version(&major, &minor, &micro, &nano);
+        l_shared.pWakeCaps = gst_caps_new_empty_simple("timestamp/x-firestreamer-wake");
+        l_shared.postedQuark = g_quark_from_static_string("firestreamer-posted");
+        if (pConfig->updateRegistry == TRUE) {
+            gst_update_registry();
+        }
+
+        /* start main loop thread to get message bus working, one for all pipelines */
+        l_shared.pContext = g_main_context_new();
+        l_shared.pMainLoop = g_main_loop_new (l_shared.pContext, FALSE);
+        retVal = pthread_create(&l_shared.gstThreadId, NULL, &FireStreamer_gst_mainLoop__,
+                                l_shared.pMainLoop);
+        assert(retVal == 0);                         /* pthread_create() must return with success */
+
+        /* live stats of all FireStreamers of the process, streaming goes on without them */
+        if (pConfig->statsName != NULL) {
+            StatsShm_create(&l_shared.stats, pConfig->statsName);
+        }
     }
+    l_shared.nFireStreamers++;
+
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->inUse = TRUE;
+    pthread_mutex_unlock(&l_shared.mutex);
+
+    return pThis;
 }
 
-static void FireStreamer_gst_free__ (void) {
+static void FireStreamer_gst_detach__ (FireStreamer_t *pThis) {
 
-    if (pThis->gstThreadId != 0) {
-        pthread_cancel(pThis->gstThreadId);
-        pThis->gstThreadId = 0;
+    pthread_mutex_lock(&l_shared.mutex);
+    memset(pThis, 0, sizeof(*pThis));                                  /* slot can be taken again */
+    assert(l_shared.nFireStreamers > 0);
+    l_shared.nFireStreamers--;
+    if (l_shared.nFireStreamers == 0) {
+        /* last FireStreamer, stop the bus thread. GStreamer itself stays initialized */
+        g_main_loop_quit(l_shared.pMainLoop);
+        pthread_join(l_shared.gstThreadId, NULL);
+        g_main_loop_unref(l_shared.pMainLoop);
+        g_main_context_unref(l_shared.pContext);
+        l_shared.pMainLoop = NULL;
+        l_shared.pContext = NULL;
+        l_shared.gstThreadId = 0;
+        StatsShm_close(&l_shared.stats);
+        gst_caps_unref(l_shared.pWakeCaps);
+        l_shared.pWakeCaps = NULL;
     }
+    pthread_mutex_unlock(&l_shared.mutex);
+}
+
+static void* FireStreamer_gst_pushLoop__ (void *pArgument) {
+    FireStreamer_t *pThis = (FireStreamer_t*)pArgument;
+    GstBuffer      *buffer;
+    GstFlowReturn   ret;
+    gint            profile;
+
+    Threads_apply(THREADS_ROLE_PUSH, "fstrPush");
+
+    /* a stall inside the appsrc blocks this thread only, the capture thread keeps going. The
+     * buffer carries the monotonic time of the hand-over to the next thread, see stampWake() */
+    while ((buffer = FrameRing_wait(&pThis->ring)) != NULL) {
+        Threads_recordWake(THREADS_ROLE_PUSH, FireStreamer_gst_getWakeLatency__(buffer));
+        FireStreamer_gst_setTimestamp__(pThis, buffer);
+        FireStreamer_gst_stampWake__(buffer);
+        ret = gst_app_src_push_buffer(pThis->appsrc, buffer);  /* takes buffer even on failure */
+        if (ret != GST_FLOW_OK) {
+            g_printerr ("ERROR: -EINVAL GST_FLOW!\n");
+        } else {
+            g_atomic_int_inc(&pThis->pushed);
+            profile = g_atomic_int_get(&pThis->latencyProfile);
+            FireStreamer_gst_raiseMark__(&pThis->appsrcMark[profile],
+                                         gst_app_src_get_current_level_bytes(pThis->appsrc));
+        }
+    }
+
+    return (void*) 0;
+}
+
+static void FireStreamer_gst_checkSequence__ (FireStreamer_t *pThis,
+                                              const FireStreamerFrameInfo_t *pInfo) {
+    gint32 step;
+
+    if ((pInfo == NULL) || (pInfo->captureUs == 0)) {
+        return;
+    }
+    /* the same frame offered again (dmabuf falling back to zero-copy) is not a gap */
+    step = (gint32)(pInfo->sequence - pThis->lastSequence);
+    if ((pThis->sequenceValid == TRUE) && (step > 1)) {
+        g_atomic_int_add(&pThis->sensorDropped, step - 1);
+    }
+    if ((pThis->sequenceValid != TRUE) || (step > 0)) {
+        pThis->lastSequence = pInfo->sequence;
+        pThis->sequenceValid = TRUE;
+    }
+}
+
+static void FireStreamer_gst_setTimestamp__ (FireStreamer_t *pThis, GstBuffer *buffer) {
+    GstClock       *clock;
+    GstClockTime    pts = GST_CLOCK_TIME_NONE;
+    GstClockTime    baseTime;
+    gint64          clockOffset;
+
+    /* PTS holds the monotonic capture time, map it onto the pipeline clock and make it running
+     * time. Both clocks are read back to back, the offset between them is exact to a few us */
+    clock = gst_element_get_clock((GstElement*)pThis->appsrc);
+    if (clock != NULL) {
+        clockOffset = (gint64)gst_clock_get_time(clock) - g_get_monotonic_time() * 1000;
+        baseTime = gst_element_get_base_time((GstElement*)pThis->appsrc);
+        gst_object_unref(clock);
+        if ((gint64)GST_BUFFER_PTS(buffer) + clockOffset > (gint64)baseTime) {
+            pts = (GstClockTime)((gint64)GST_BUFFER_PTS(buffer) + clockOffset) - baseTime;
+        } else {
+            pts = 0;                               /* captured before the pipeline was started */
+        }
+    }
+
+    /* a frame captured before the previous one, or no clock yet: keep the timeline monotonic */
+    if ((pThis->lastPts != GST_CLOCK_TIME_NONE) &&
+        ((pts == GST_CLOCK_TIME_NONE) || (pts <= pThis->lastPts))) {
+        pts = pThis->lastPts + 1;
+        g_atomic_int_inc(&pThis->ptsClamped);
+    }
+    if (pts == GST_CLOCK_TIME_NONE) {
+        pts = 0;
+    }
+    pThis->lastPts = pts;
+    GST_BUFFER_PTS(buffer) = pts;
+    GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DURATION(buffer) = GST_SECOND / pThis->fps;
+}
+
+static bool_t FireStreamer_gst_admitFrame__ (FireStreamer_t *pThis) {
+    gint64  now = g_get_monotonic_time();
+    gint    level = g_atomic_int_get(&pThis->decimation);
+    gint    abrFloor = g_atomic_int_get(&pThis->abrDecimation);
+    bool_t  saturated = (g_atomic_int_get(&pThis->feedData) != TRUE) ? TRUE : FALSE;
+    bool_t  keep;
+
+    /* feedData is FALSE until the appsrc asks for data the first time, frames offered before the
+     * pipeline is ready are skipped without being taken for back-pressure */
+    if ((guint)g_atomic_int_get(&pThis->readyFlags) != READY_ALL) {
+        g_atomic_int_inc(&pThis->skipped);
+        return FALSE;
+    }
+    if (pThis->backpressure == FIRESTREAMER_BACKPRESSURE_GATE) {
+        if (saturated == TRUE) {
+            g_atomic_int_inc(&pThis->skipped);
+            return FALSE;
+        }
+        if (abrFloor == 0) {
+            return TRUE;
+        }
+    } else if (saturated == TRUE) {
+        /* hysteresis: step down quickly while saturated, step back up only after a quiet period */
+        pThis->saturatedUs = now;
+        if ((level < FIRESTREAMER_DECIMATION_MAX) &&
+                (now - pThis->levelChangedUs >= DECIMATION_STEP_UP_US)) {
+            level++;
+            pThis->levelChangedUs = now;
+            pThis->frameCounter = 0;
+            g_atomic_int_set(&pThis->decimation, level);
+            printf("back-pressure, decimation level %d (1/%d of input frames)\n", level,
+                   1 << level);
+        }
+    } else if ((level > 0) && (now - pThis->saturatedUs >= DECIMATION_RECOVER_US) &&
+               (now - pThis->levelChangedUs >= DECIMATION_RECOVER_US)) {
+        level--;
+        pThis->levelChangedUs = now;
+        pThis->frameCounter = 0;
+        g_atomic_int_set(&pThis->decimation, level);
+        printf("recovered, decimation level %d (1/%d of input frames)\n", level, 1 << level);
+    }
+    if (level < abrFloor) {
+        level = abrFloor;                 /* the Abr ran out of bitrate and asks for fewer frames */
+    }
+
+    /* keep every 2^level-th frame, evenly spaced. At the last level the appsrc is still full, skip
+     * until it drains instead of queueing more */
+    keep = ((pThis->frameCounter & ((1u << level) - 1)) == 0) ? TRUE : FALSE;
+    pThis->frameCounter++;
+    if ((saturated == TRUE) && (level == FIRESTREAMER_DECIMATION_MAX)) {
+        keep = FALSE;
+    }
+    if (keep != TRUE) {
+        g_atomic_int_inc(&pThis->skipped);
+    }
+
+    return keep;
+}
+
+static bool_t FireStreamer_gst_createMotion__ (FireStreamer_t *pThis,
+                                               const FireStreamerConfig_t *pConfig) {
+    uint32_t lineBytes;
+    uint32_t memorySize;
+
+    assert(pConfig->motionThreshold >= 1 && pConfig->motionThreshold <= 255);
+    assert(pConfig->idleFps >= 1 && pConfig->idleFps <= pThis->fps);
+
+    /* raw bytes of the pushed frame are compared, before any conversion */
+    lineBytes = (pThis->format == FIRESTREAMER_FORMAT_YUY2) ? pThis->inWidth * 2 : pThis->inWidth;
+    memorySize = Motion_getMemorySize(lineBytes, pThis->inHeight, MOTION_ROW_STEP);
+    pThis->pMotionMemory = g_try_malloc(memorySize);
+    if (pThis->pMotionMemory == NULL) {
+        g_printerr ("ERROR: motion reference of %u KiB could not be allocated.\n",
+                    memorySize / 1024);
+        return FALSE;
+    }
+    Motion_initialize(&pThis->motion, pThis->pMotionMemory, lineBytes, pThis->inHeight,
+                      MOTION_ROW_STEP, FIRESTREAMER_MOTION_BLOCKS_X, FIRESTREAMER_MOTION_BLOCKS_Y,
+                      pConfig->motionThreshold, pThis->kernel);
+    pThis->motionHoldUs = (gint64)pConfig->motionHoldMs * 1000;
+    pThis->idleIntervalUs = 1000000 / pConfig->idleFps;
+    printf("motion gating, threshold %u, %u fps without motion, %s kernel\n",
+           pConfig->motionThreshold, pConfig->idleFps, PixelConv_getKernelName(pThis->kernel));
+    return TRUE;
+}
+
+static bool_t FireStreamer_gst_createRenditions__ (FireStreamer_t *pThis,
+                                                   const FireStreamerConfig_t *pConfig) {
+    const FireStreamerRendition_t *pRendition;
+    FireStreamerConfig_t    config;
+    FireStreamer_t         *pRenditionThis;
+    uint32_t                area;
+    uint32_t                i;
+
+    for (i = 0; i < FIRESTREAMER_MAX_RENDITIONS; i++) {
+        pRendition = &pConfig->renditions[i];
+        if (pRendition->url == NULL) {
+            continue;
+        }
+        assert(pRendition->scale == 2 || pRendition->scale == 4);
+        assert((pThis->width % (2 * pRendition->scale)) == 0);        /* YUY2 pairs after scaling */
+        assert((pThis->height % pRendition->scale) == 0);
+
+        /* the main stream settings at a smaller size, frames come as YUY2 from pushFrame() */
+        area = pRendition->scale * pRendition->scale;
+        config = *pConfig;
+        config.url = pRendition->url;
+        config.width = pThis->width / pRendition->scale;
+        config.height = pThis->height / pRendition->scale;
+        config.stride = 0;
+        config.format = FIRESTREAMER_FORMAT_YUY2;
+        config.binning = FALSE;
+        config.grayscale = FALSE;                              /* already done by the main stream */
+        config.encoder = pRendition->encoder;
+        config.profile = pRendition->profile;
+        config.bitrate = (pRendition->bitrate != 0) ? pRendition->bitrate :
+                                                      MAX(pConfig->bitrate / area, 1);
+        config.gop = (pRendition->gop != 0) ? pRendition->gop : pConfig->gop;
+        config.minBitrate = MIN(config.bitrate, MAX(pConfig->minBitrate / area, 1));
+        config.maxBitrate = MAX(config.bitrate, pConfig->maxBitrate / area);
+        config.memory = FIRESTREAMER_MEMORY_SYSTEM;
+        config.prebufferSeconds = 0;
+        config.motion = FALSE;                               /* the main stream gates all of them */
+        config.ready = NULL;
+        config.pReadyData = NULL;
+        memset(config.renditions, 0, sizeof(config.renditions));
+
+        pRenditionThis = FireStreamer_create(&config);
+        if (pRenditionThis == NULL) {
+            g_printerr ("ERROR: rendition %u '%s' could not be created.\n", i, pRendition->url);
+            return FALSE;
+        }
+        pThis->renditions[i] = pRenditionThis;
+        pRenditionThis->renditionScale = pRendition->scale;
+        if (pRendition->scale == 4) {
+            pRenditionThis->pScaleMemory = g_try_malloc(pThis->width * pThis->height / 2);
+            if (pRenditionThis->pScaleMemory == NULL) {
+                g_printerr ("ERROR: rendition %u could not allocate its half size frame.\n", i);
+                return FALSE;
+            }
+        }
+        if (pRenditionThis->rawFormat != RAW_YUY2) {
+            /* scaled as YUY2 first, then split for its encoder */
+            pRenditionThis->pConvertMemory = g_try_malloc(config.width * config.height * 2);
+            if (pRenditionThis->pConvertMemory == NULL) {
+                g_printerr ("ERROR: rendition %u could not allocate its YUY2 frame.\n", i);
+                return FALSE;
+            }
+        }
+        pThis->nRenditions++;
+        printf("rendition %u %ux%u, %u kbit/s to '%s'\n", i, config.width, config.height,
+               config.bitrate, config.url);
+    }
+    return TRUE;
+}
+
+static void FireStreamer_gst_pushRenditions__ (FireStreamer_t *pThis, const uint8_t *pSrc,
+                                               uint32_t srcStride, GstBuffer *buffer,
+                                               gint64 pushUs,
+                                               const FireStreamerFrameInfo_t *pInfo) {
+    GstBuffer      *scaled[FIRESTREAMER_MAX_RENDITIONS] = { NULL };
+    GstMapInfo      maps[FIRESTREAMER_MAX_RENDITIONS];
+    GstMapInfo      source;
+    FireStreamer_t *pRendition;
+    const uint8_t  *pHalf = NULL;
+    uint8_t        *pDst;
+    uint32_t        scale;
+    uint32_t        i;
+
+    /* scaled from the YUY2 frame the main encoder gets: pushed, converted in place or converted
+     * into the buffer. A NULL pSrc means the buffer */
+    if (pSrc == NULL) {
+        if (!gst_buffer_map(buffer, &source, GST_MAP_READ)) {
+            return;
+        }
+        pSrc = source.data;
+        srcStride = pThis->width * 2;
+    } else {
+        buffer = NULL;                                                        /* nothing to unmap */
+    }
+
+    /* halves first, a quarter is the first half size frame halved once more */
+    for (scale = 2; scale <= 4; scale *= 2) {
+        for (i = 0; i < FIRESTREAMER_MAX_RENDITIONS; i++) {
+            pRendition = pThis->renditions[i];
+            if ((pRendition == NULL) || (pRendition->renditionScale != scale)) {
+                continue;
+            }
+            FireStreamer_gst_checkSequence__(pRendition, pInfo);
+            if (FireStreamer_gst_admitFrame__(pRendition) != TRUE) {
+                continue;
+            }
+            scaled[i] = FireStreamer_gst_acquireBuffer__(pRendition);
+            if (scaled[i] == NULL) {
+                continue;
+            }
+            if (!gst_buffer_map(scaled[i], &maps[i], GST_MAP_WRITE)) {
+                gst_buffer_unref(scaled[i]);
+                scaled[i] = NULL;
+                continue;
+            }
+            /* a planar encoder gets the scaled YUY2 frame split once more */
+            pDst = (pRendition->rawFormat == RAW_YUY2) ? maps[i].data :
+                                                         (uint8_t*)pRendition->pConvertMemory;
+            if (scale == 2) {
+                PixelConv_yuy2Halve(pThis->kernel, pSrc, srcStride, pThis->width, pThis->height,
+                                    pDst, pRendition->width * 2);
+                pHalf = (pHalf == NULL) ? pDst : pHalf;
+            } else {
+                if (pHalf == NULL) {
+                    PixelConv_yuy2Halve(pThis->kernel, pSrc, srcStride, pThis->width,
+                                        pThis->height, pRendition->pScaleMemory, pThis->width);
+                    pHalf = pRendition->pScaleMemory;
+                }
+                PixelConv_yuy2Halve(pThis->kernel, pHalf, pThis->width, pThis->width / 2,
+                                    pThis->height / 2, pDst, pRendition->width * 2);
+            }
+            if (pRendition->rawFormat != RAW_YUY2) {
+                FireStreamer_gst_toPlanar__(pRendition, pDst, pRendition->width * 2, maps[i].data,
+                                            0);
+            }
+        }
+    }
+
+    /* queued once nothing reads them any more */
+    for (i = 0; i < FIRESTREAMER_MAX_RENDITIONS; i++) {
+        if (scaled[i] != NULL) {
+            gst_buffer_unmap(scaled[i], &maps[i]);
+            FireStreamer_gst_queueFrame__(pThis->renditions[i], scaled[i], pushUs, pInfo);
+        }
+    }
+    if (buffer != NULL) {
+        gst_buffer_unmap(buffer, &source);
+    }
+}
+
+static bool_t FireStreamer_gst_gateMotion__ (FireStreamer_t *pThis, const void *pData,
+                                             uint32_t size) {
+    gint64  now;
+    bool_t  moving;
+
+    if ((pThis->pMotionMemory == NULL) ||
+        (size < pThis->stride * (pThis->inHeight - 1) + pThis->motion.lineBytes)) {
+        return TRUE;                                   /* off, or a short frame that isn't judged */
+    }
+
+    pthread_mutex_lock(&pThis->motionMutex);
+    moving = Motion_update(&pThis->motion, (const uint8_t*)pData, pThis->stride);
+    pthread_mutex_unlock(&pThis->motionMutex);
+
+    /* a moving frame is encoded at once, full rate continues for the hold time after it. A still
+     * scene only sends a keep-alive frame now and then, so the decoder and the clients stay up */
+    now = g_get_monotonic_time();
+    if (moving == TRUE) {
+        pThis->motionUs = now;
+    }
+    if ((now - pThis->motionUs < pThis->motionHoldUs) ||
+        (now - pThis->keepAliveUs >= pThis->idleIntervalUs)) {
+        pThis->keepAliveUs = now;
+        return TRUE;
+    }
+    g_atomic_int_inc(&pThis->motionSkipped);
+    return FALSE;
+}
+
+static void FireStreamer_gst_dropBuffer__ (void *pEntry) {
+
+    gst_buffer_unref((GstBuffer*)pEntry);          /* back to the pool or releaseFrame() called */
+}
+
+static void FireStreamer_gst_unrefElement__ (GstElement **ppElement) {
+
+    /* elements added to the pipeline are owned by it, only loose ones are unreferenced here */
+    if ((*ppElement != NULL) && (GST_OBJECT_PARENT(*ppElement) == NULL)) {
+        gst_object_unref(*ppElement);
+    }
+    *ppElement = NULL;
+}
+
+static bool_t FireStreamer_gst_createPool__ (FireStreamer_t *pThis, GstCaps *caps) {
+    GstStructure   *config;
+
+    /* fixed number of buffers, all of them allocated when the pool is activated */
+    pThis->pool = gst_buffer_pool_new();
+    config = gst_buffer_pool_get_config(pThis->pool);
+    gst_buffer_pool_config_set_params(config, caps, pThis->frameSize, pThis->poolBuffers,
+                                      pThis->poolBuffers);
+    if (!gst_buffer_pool_set_config(pThis->pool, config)) {
+        g_printerr ("ERROR: buffer pool could not be configured.\n");
+        return FALSE;
+    }
+    if (!gst_buffer_pool_set_active(pThis->pool, TRUE)) {
+        g_printerr ("ERROR: buffer pool could not be activated.\n");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static GstBuffer* FireStreamer_gst_acquireBuffer__ (FireStreamer_t *pThis) {
+    /* never wait for a free buffer, capture thread must not block */
+    GstBufferPoolAcquireParams  params = { .flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT };
+    GstBuffer                   *buffer;
+
+    if (gst_buffer_pool_acquire_buffer(pThis->pool, &buffer, &params) != GST_FLOW_OK) {
+        g_atomic_int_inc(&pThis->poolExhausted);
+        return NULL;
+    }
+    return buffer;
+}
+
+static bool_t FireStreamer_gst_isFrameComplete__ (FireStreamer_t *pThis, uint32_t size) {
+    uint32_t lineSize;
+
+    /* the last line doesn't need its stride padding */
+    lineSize = (pThis->format == FIRESTREAMER_FORMAT_SRGGB8) ? pThis->inWidth : pThis->inWidth * 2;
+    return (size >= pThis->stride * (pThis->inHeight - 1) + lineSize) ? TRUE : FALSE;
+}
+
+static GstBuffer* FireStreamer_gst_convert__ (FireStreamer_t *pThis, const void *pData,
+                                              uint32_t size, const uint8_t **ppYuy2,
+                                              uint32_t *pYuy2Stride) {
+    GstBuffer      *buffer;
+    GstMapInfo      map;
+    const uint8_t  *pSrc = (const uint8_t*)pData;
+    uint32_t        srcStride = pThis->stride;
+    uint8_t        *pDst;
+    uint32_t        flags = 0;
+
+    if (FireStreamer_gst_isFrameComplete__(pThis, size) != TRUE) {
+        g_printerr ("ERROR: frame is too short (%u bytes)!\n", size);
+        return NULL;
+    }
+    buffer = FireStreamer_gst_acquireBuffer__(pThis);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    if (!gst_buffer_map(buffer, &map, GST_MAP_WRITE)) {
+        gst_buffer_unref(buffer);
+        return NULL;
+    }
+    /* YUY2 for the encoder, or in front of the planar pass for a planar one */
+    pDst = (pThis->rawFormat == RAW_YUY2) ? map.data : (uint8_t*)pThis->pConvertMemory;
+    flags |= (pThis->grayscale == TRUE) ? PIXELCONV_FLAG_GRAYSCALE : 0;
+    if (pThis->format == FIRESTREAMER_FORMAT_SRGGB8) {
+        flags |= (pThis->binning == TRUE) ? PIXELCONV_FLAG_BINNING : 0;
+        PixelConv_srggb8ToYuy2(pThis->kernel, pSrc, srcStride, pThis->inWidth, pThis->inHeight,
+                               pDst, pThis->width * 2, flags);
+        pSrc = pDst;
+        srcStride = pThis->width * 2;
+        flags = 0;
+    } else if ((pThis->grayscale == TRUE) &&
+               ((pThis->rawFormat == RAW_YUY2) || (pThis->nRenditions > 0))) {
+        /* YUY2 grayscale, one pass that keeps luma and neutralises chroma. Without renditions
+         * to scale from it a planar encoder gets the gray frame straight from the planar pass */
+        PixelConv_yuy2ToGray(pThis->kernel, pSrc, srcStride, pThis->width, pThis->height, pDst,
+                             pThis->width * 2);
+        pSrc = pDst;
+        srcStride = pThis->width * 2;
+        flags = 0;
+    }
+    if (pThis->rawFormat != RAW_YUY2) {
+        FireStreamer_gst_toPlanar__(pThis, pSrc, srcStride, map.data, flags);
+    }
+    gst_buffer_unmap(buffer, &map);
+
+    *ppYuy2 = (pThis->rawFormat != RAW_YUY2) ? pSrc : NULL;            /* NULL, it is the buffer */
+    *pYuy2Stride = srcStride;
+    return buffer;
+}
+
+static void FireStreamer_gst_toPlanar__ (FireStreamer_t *pThis, const uint8_t *pSrc,
+                                         uint32_t srcStride, uint8_t *pDst, uint32_t flags) {
+
+    if (pThis->rawFormat == RAW_NV12) {
+        PixelConv_yuy2ToNv12(pThis->kernel, pSrc, srcStride, pThis->width, pThis->height,
+                             pDst + pThis->planeOffset[0], pThis->planeStride[0],
+                             pDst + pThis->planeOffset[1], pThis->planeStride[1], flags);
+    } else {
+        PixelConv_yuy2ToI420(pThis->kernel, pSrc, srcStride, pThis->width, pThis->height,
+                             pDst + pThis->planeOffset[0], pThis->planeStride[0],
+                             pDst + pThis->planeOffset[1], pDst + pThis->planeOffset[2],
+                             pThis->planeStride[1], flags);
+    }
+}
+
+static void FireStreamer_gst_setRawFormat__ (FireStreamer_t *pThis, RawFormat_t format) {
+    uint32_t lumaSize;
+    uint32_t chromaSize;
+
+    /* planes are laid out like GstVideoInfo does it, lines rounded up to 4 bytes */
+    memset(pThis->planeStride, 0, sizeof(pThis->planeStride));
+    memset(pThis->planeOffset, 0, sizeof(pThis->planeOffset));
+    pThis->rawFormat = format;
+    if (format == RAW_YUY2) {
+        pThis->planeStride[0] = pThis->width * 2;
+        pThis->frameSize = pThis->width * pThis->height * 2;                 /* 2 bytes per pixel */
+        return;
+    }
+    pThis->planeStride[0] = GST_ROUND_UP_4(pThis->width);
+    lumaSize = pThis->planeStride[0] * pThis->height;
+    pThis->planeOffset[1] = lumaSize;
+    if (format == RAW_NV12) {
+        pThis->planeStride[1] = pThis->planeStride[0];                     /* U and V interleaved */
+        pThis->frameSize = lumaSize + pThis->planeStride[1] * (pThis->height / 2);
+        return;
+    }
+    pThis->planeStride[1] = GST_ROUND_UP_4(pThis->width / 2);
+    pThis->planeStride[2] = pThis->planeStride[1];
+    chromaSize = pThis->planeStride[1] * (pThis->height / 2);
+    pThis->planeOffset[2] = lumaSize + chromaSize;
+    pThis->frameSize = lumaSize + 2 * chromaSize;
+}
+
+static GstCaps* FireStreamer_gst_getRawCaps__ (FireStreamer_t *pThis, RawFormat_t format) {
+
+    /* size and rate of what is pushed, after binning, as the driver negotiated them */
+    return gst_caps_new_simple("video/x-raw",
+                               "format", G_TYPE_STRING, l_rawFormatName[format],
+                               "width", G_TYPE_INT, (gint)pThis->width,
+                               "height", G_TYPE_INT, (gint)pThis->height,
+                               "framerate", GST_TYPE_FRACTION, (gint)pThis->fps, 1,
+                               "interlace-mode", G_TYPE_STRING, "progressive",
+                               "colorimetry", G_TYPE_STRING, "bt601",
+                               NULL);
+}
+
+static GstCaps* FireStreamer_gst_negotiate__ (FireStreamer_t *pThis, bool_t *pGeneric) {
+    GstCaps     *caps;
+    RawFormat_t format;
+
+    /* cheapest first: the frames as they are, one planar pass, videoconvert in the pipeline */
+    *pGeneric = FALSE;
+    for (format = RAW_YUY2; format < RAW_COUNT; format++) {
+        if ((format != RAW_YUY2) && ((pThis->height % 2) != 0)) {
+            break;                                          /* 4:2:0 needs pairs of lines, binned */
+        }
+        caps = FireStreamer_gst_getRawCaps__(pThis, format);
+        if (Encoder_acceptsCaps(pThis->h264Enc, caps) == TRUE) {
+            FireStreamer_gst_setRawFormat__(pThis, format);
+            return caps;
+        }
+        gst_caps_unref(caps);
+    }
+    *pGeneric = TRUE;
+    FireStreamer_gst_setRawFormat__(pThis, RAW_YUY2);
+    return FireStreamer_gst_getRawCaps__(pThis, RAW_YUY2);
+}
+
+static void FireStreamer_gst_printPath__ (FireStreamer_t *pThis) {
+    const char     *pFactory = Encoder_getFactoryName(pThis->encSettings.backend);
+    const char     *pSource;
+    const char     *pPasses;
+    const uint8_t  *pYuy2;
+    GstBuffer      *buffer;
+    void           *pFrame;
+    uint32_t        frameBytes;
+    uint32_t        stride;
+    gint64          startUs;
+    gint64          costUs = G_MAXINT64;
+    uint32_t        i;
+
+    pSource = (pThis->format == FIRESTREAMER_FORMAT_SRGGB8) ? "Bayer" : "YUY2";
+    if (pThis->encConvert != NULL) {
+        printf("%s %ux%u@%u -> %s: no raw format taken, generic videoconvert, cost not measured\n",
+               pSource, pThis->inWidth, pThis->inHeight, pThis->fps, pFactory);
+        return;
+    }
+    if (pThis->converting != TRUE) {
+        printf("%s %ux%u@%u -> %s: passthrough, no conversion\n", pSource, pThis->width,
+               pThis->height, pThis->fps, pFactory);
+        return;
+    }
+
+    /* the kernels don't depend on the pixel values, a blank frame costs as much as a real one */
+    frameBytes = pThis->stride * pThis->inHeight;
+    pFrame = g_try_malloc0(frameBytes);
+    for (i = 0; (pFrame != NULL) && (i < PATH_TRIALS); i++) {
+        startUs = g_get_monotonic_time();
+        buffer = FireStreamer_gst_convert__(pThis, pFrame, frameBytes, &pYuy2, &stride);
+        costUs = MIN(costUs, g_get_monotonic_time() - startUs);
+        if (buffer != NULL) {
+            gst_buffer_unref(buffer);                                         /* back to the pool */
+        }
+    }
+    g_free(pFrame);
+    if (pThis->format == FIRESTREAMER_FORMAT_SRGGB8) {
+        pPasses = (pThis->rawFormat == RAW_YUY2) ? "demosaic" : "demosaic and planar split";
+    } else {
+        pPasses = (pThis->rawFormat == RAW_YUY2) ? "gray pass" : "planar split";
+    }
+    printf("%s %ux%u@%u -> %s%s %ux%u -> %s: %s, %s kernel, ", pSource, pThis->inWidth,
+           pThis->inHeight, pThis->fps, l_rawFormatName[pThis->rawFormat],
+           (pThis->grayscale == TRUE) ? " gray" : "", pThis->width, pThis->height, pFactory,
+           pPasses, PixelConv_getKernelName(pThis->kernel));
+    if (costUs == G_MAXINT64) {
+        printf("cost not measured\n");
+    } else {
+        printf("%" G_GINT64_FORMAT " us per frame, %.1f%% of the frame time\n", costUs,
+               (double)costUs * pThis->fps / 10000.0);
+    }
+}
+
+static void FireStreamer_gst_startFeeding__ (GstAppSrc *appsrc, guint length,
+                                             FireStreamer_t *pThis) {
+    UNUSED_ARGUMENT(appsrc);
+    UNUSED_ARGUMENT(length);
+
+    /* set feedData to true, read by the capture thread and published by the stats tick */
+    g_atomic_int_set(&pThis->feedData, TRUE);
+    FireStreamer_gst_setReady__(pThis, READY_NEED_DATA);
+}
+
+static void FireStreamer_gst_stopFeeding__ (GstAppSrc *appsrc, FireStreamer_t *pThis) {
+    UNUSED_ARGUMENT(appsrc);
+
+    g_atomic_int_set(&pThis->feedData, FALSE);
+}
+
+static void FireStreamer_gst_setIoMode__ (FireStreamer_t *pThis, const char *ioMode) {
+
+    /* only v4l2 encoders have io modes */
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(pThis->h264Enc),
+                                     "output-io-mode") != NULL) {
+        gst_util_set_object_arg(G_OBJECT(pThis->h264Enc), "output-io-mode", ioMode);
+    }
+}
+
+static void FireStreamer_gst_dmabufFallback__ (FireStreamer_t *pThis) {
+
+    /* stop taking dmabuf frames first, io mode can be changed only in READY state */
+    g_atomic_int_set(&pThis->dmabufActive, FALSE);
+    gst_element_set_state ((GstElement*)pThis->pipeline, GST_STATE_READY);
+    FireStreamer_gst_setIoMode__(pThis, "auto");
+}
+
+static bool_t FireStreamer_gst_isImportError__ (FireStreamer_t *pThis, GstMessage *msg,
+                                                const GError *error, const gchar *debug) {
+
+    /* only before the first frame made it through the encoder, later errors are not the import */
+    if ((g_atomic_int_get(&pThis->dmabufActive) != TRUE) ||
+        (g_atomic_int_get(&pThis->firstFrameUs) != 0)) {
+        return FALSE;
+    }
+    if ((strcmp(GST_OBJECT_NAME(msg->src), "videoSource") != 0) &&
+        (strcmp(GST_OBJECT_NAME(msg->src), "h264Encoder") != 0)) {
+        return FALSE;
+    }
+
+    /* caps or memory the encoder can't take, a not-negotiated flow ends as a generic error */
+    if (g_error_matches(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FORMAT) ||
+        g_error_matches(error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION) ||
+        g_error_matches(error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NO_SPACE_LEFT)) {
+        return TRUE;
+    }
+    return (g_error_matches(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED) &&
+            (debug != NULL) && (strstr(debug, "not-negotiated") != NULL)) ? TRUE : FALSE;
+}
+
+static void FireStreamer_gst_newManager__ (GstElement *sink, GstElement *manager,
+                                           FireStreamer_t *pThis) {
+    UNUSED_ARGUMENT(sink);
+
+    /* the rtpbin lives as long as the sink, it is only read by the Abr tick */
+    g_atomic_pointer_set(&pThis->rtpManager, manager);
+}
+
+static gboolean FireStreamer_gst_abrTick__ (gpointer pUserData) {
+    FireStreamer_t *pThis = pUserData;
+    GstElement     *manager;
+    GObject        *session = NULL;
+    GObject        *source = NULL;
+    GstStructure   *stats = NULL;
+    gboolean        haveReport = FALSE;
+    guint           fractionLost = 0, jitter = 0, rtt = 0, seq = 0;
+    AbrReport_t     report;
+    AbrDecision_t   decision;
+
+    /* the free() destroys the timer under the mutex, a tick already waiting for it quits */
+    pthread_mutex_lock(&pThis->abrMutex);
+    if (g_source_is_destroyed(g_main_current_source()) == TRUE) {
+        pthread_mutex_unlock(&pThis->abrMutex);
+        return G_SOURCE_REMOVE;
+    }
+    manager = g_atomic_pointer_get(&pThis->rtpManager);
+    if (manager == NULL) {
+        pthread_mutex_unlock(&pThis->abrMutex);
+        return G_SOURCE_CONTINUE;                                       /* not connected yet */
+    }
+
+    /* our sender source of the video session holds the last report block about our stream */
+    g_signal_emit_by_name(manager, "get-internal-session", 0, &session);
+    if (session != NULL) {
+        g_object_get(session, "internal-source", &source, NULL);
+        g_object_unref(session);
+    }
+    if (source != NULL) {
+        g_object_get(source, "stats", &stats, NULL);
+        g_object_unref(source);
+    }
+    if (stats != NULL) {
+        if (gst_structure_get(stats, "have-rb", G_TYPE_BOOLEAN, &haveReport,
+                              "rb-fractionlost", G_TYPE_UINT, &fractionLost,
+                              "rb-jitter", G_TYPE_UINT, &jitter,
+                              "rb-round-trip", G_TYPE_UINT, &rtt,
+                              "rb-exthighestseq", G_TYPE_UINT, &seq, NULL) != TRUE) {
+            haveReport = FALSE;
+        }
+        gst_structure_free(stats);
+    }
+    if ((haveReport != TRUE) || (seq == pThis->lastReportSeq)) {
+        pthread_mutex_unlock(&pThis->abrMutex);
+        return G_SOURCE_CONTINUE;                                             /* no new report */
+    }
+    pThis->lastReportSeq = seq;
+
+    report.fractionLost = fractionLost;
+    report.jitter = (uint32_t)(((guint64)jitter * 1000000) / RTP_CLOCK_RATE);
+    report.rtt = (uint32_t)(((guint64)rtt * 1000) >> 16);                       /* 16.16 seconds */
+    decision = Abr_update(&pThis->abr, &report);
+    if (decision != ABR_DECISION_HOLD) {
+        Encoder_setBitrate(pThis->h264Enc, pThis->encSettings.backend, pThis->abr.bitrate);
+        g_atomic_int_set(&pThis->abrDecimation, pThis->abr.decimation);
+        printf("abr: loss %u/256, rtt %u ms, jitter %u us, %s to %u kbit/s, 1/%u frames\n",
+               report.fractionLost, report.rtt, report.jitter,
+               (decision == ABR_DECISION_DECREASE) ? "down" : "up", pThis->abr.bitrate,
+               1u << pThis->abr.decimation);
+    }
+    pThis->abrStats.bitrate = pThis->abr.bitrate;
+    pThis->abrStats.decimation = pThis->abr.decimation;
+    pThis->abrStats.fractionLost = report.fractionLost;
+    pThis->abrStats.jitter = report.jitter;
+    pThis->abrStats.rtt = report.rtt;
+    pThis->abrStats.reports++;
+    pThis->abrStats.decreases = pThis->abr.decreases;
+    pThis->abrStats.increases = pThis->abr.increases;
+    pthread_mutex_unlock(&pThis->abrMutex);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean FireStreamer_gst_statsTick__ (gpointer pUserData) {
+    FireStreamer_t *pThis = pUserData;
+    StatsShmValues_t values;
+    FrameRingStats_t ringStats;
+    gint64          now = g_get_monotonic_time();
+    gint64          elapsedUs;
+    guint           frames;
+    guint64         bytes;
+
+    /* the free() destroys the timer under the mutex, a tick already waiting for it quits */
+    pthread_mutex_lock(&pThis->abrMutex);
+    if (g_source_is_destroyed(g_main_current_source()) == TRUE) {
+        pthread_mutex_unlock(&pThis->abrMutex);
+        return G_SOURCE_REMOVE;
+    }
+
+    /* rates cover the time since the last write, the counters only grow */
+    elapsedUs = MAX(now - pThis->statsUs, 1);
+    frames = g_atomic_int_get(&pThis->framesEncoded);
+    bytes = atomic_load_explicit(&pThis->bytesEncoded, memory_order_relaxed);
+    FrameRing_getStats(&pThis->ring, &ringStats);
+
+    memset(&values, 0, sizeof(values));
+    g_strlcpy(values.name, pThis->url, sizeof(values.name));                    /* may be cut */
+    values.updatedNs = (uint64_t)now * 1000;
+    values.captured = (uint64_t)ringStats.enqueued + g_atomic_int_get(&pThis->skipped) +
+                      g_atomic_int_get(&pThis->motionSkipped) +
+                      g_atomic_int_get(&pThis->poolExhausted);
+    values.pushed = g_atomic_int_get(&pThis->pushed);
+    values.dropped = (uint64_t)ringStats.dropped + g_atomic_int_get(&pThis->poolExhausted);
+    values.skipped = (uint64_t)g_atomic_int_get(&pThis->skipped) +
+                     g_atomic_int_get(&pThis->motionSkipped);
+    values.sensorDropped = g_atomic_int_get(&pThis->sensorDropped);
+    values.encoded = frames;
+    values.sent = g_atomic_int_get(&pThis->framesSent);
+    values.bytesEncoded = bytes;
+    values.bitrate = (uint32_t)((bytes - pThis->statsBytes) * 8000 / (guint64)elapsedUs);
+    values.targetBitrate = pThis->abrStats.bitrate;
+    values.fpsMilli = (uint32_t)((guint64)(frames - pThis->statsFrames) * 1000000000 /
+                                 (guint64)elapsedUs);
+    values.state = (uint32_t)pThis->state;                         /* written on this thread only */
+    values.feeding = (g_atomic_int_get(&pThis->feedData) == TRUE) ? 1 : 0;
+    values.reconnects = g_atomic_int_get(&pThis->reconnects);
+    values.decimation = g_atomic_int_get(&pThis->decimation);
+    StatsShm_publish(&l_shared.stats, (uint32_t)(pThis - l_fireStreamers), &values);
+
+    pThis->statsUs = now;
+    pThis->statsFrames = frames;
+    pThis->statsBytes = bytes;
+    pthread_mutex_unlock(&pThis->abrMutex);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void FireStreamer_gst_queueFrame__ (FireStreamer_t *pThis, GstBuffer *buffer, gint64 pushUs,
+                                           const FireStreamerFrameInfo_t *pInfo) {
+    FrameTrace_t   *pTrace;
+    guint           seq;
+    gint64          now;
+    gint64          captureUs = pushUs;
+    gint64          captureStartUs;
+    uint32_t        stage;
+
+    /* the push thread turns the monotonic capture time into the PTS, see setTimestamp() */
+    if ((pInfo != NULL) && (pInfo->captureUs != 0)) {
+        captureUs = pInfo->captureUs;
+    } else if ((pInfo != NULL) && (pInfo->dequeueUs != 0)) {
+        captureUs = pInfo->dequeueUs;
+    }
+    GST_BUFFER_PTS(buffer) = (GstClockTime)captureUs * 1000;
+
+    if (pThis->tracing == TRUE) {
+        /* only the pushing thread writes the sequence, readers see the slot once it is published */
+        now = g_get_monotonic_time();
+        seq = g_atomic_int_get(&pThis->traceSeq);
+        pTrace = &pThis->traces[seq & (TRACE_SLOTS - 1)];
+        atomic_store_explicit(&pTrace->seq, TRACE_SEQ_NONE, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);     /* a frame still in flight sees NONE first */
+        atomic_store_explicit(&pTrace->pts, GST_CLOCK_TIME_NONE, memory_order_relaxed);
+        for (stage = FIRESTREAMER_STAGE_CAPTURE; stage <= FIRESTREAMER_STAGE_TOTAL; stage++) {
+            atomic_store_explicit(&pTrace->stampUs[stage], 0, memory_order_relaxed);
+        }
+        captureStartUs = pushUs;
+        if ((pInfo != NULL) && (pInfo->dequeueUs != 0) && (pInfo->dequeueUs <= pushUs)) {
+            captureStartUs = pInfo->dequeueUs;
+            Histogram_record(&pThis->latency[FIRESTREAMER_STAGE_CAPTURE],
+                             (uint32_t)(pushUs - pInfo->dequeueUs));
+        }
+        atomic_store_explicit(&pTrace->stampUs[FIRESTREAMER_STAGE_CAPTURE], captureStartUs,
+                              memory_order_relaxed);
+        atomic_store_explicit(&pTrace->stampUs[FIRESTREAMER_STAGE_CONVERT], pushUs,
+                              memory_order_relaxed);
+        atomic_store_explicit(&pTrace->stampUs[FIRESTREAMER_STAGE_QUEUE], now,
+                              memory_order_relaxed);
+        atomic_store_explicit(&pTrace->seq, seq, memory_order_release);
+        Histogram_record(&pThis->latency[FIRESTREAMER_STAGE_CONVERT], (uint32_t)(now - pushUs));
+        GST_BUFFER_OFFSET(buffer) = seq;
+        g_atomic_int_set(&pThis->traceSeq, seq + 1);
+    }
+
+    FireStreamer_gst_stampWake__(buffer);
+    FrameRing_push(&pThis->ring, buffer);
+}
+
+static void FireStreamer_gst_addTraceProbe__ (FireStreamer_t *pThis, GstElement *element) {
+    GstPad *pad;
+
+    pad = gst_element_get_static_pad(element, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, FireStreamer_gst_traceProbe__, pThis, NULL);
+    gst_object_unref(pad);
+}
+
+static GstPadProbeReturn FireStreamer_gst_traceProbe__ (GstPad *pad, GstPadProbeInfo *info,
+                                                        gpointer pUserData) {
+    FireStreamer_t *pThis = pUserData;
+    GstBuffer      *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstObject      *parent = GST_OBJECT_PARENT(pad);
+    gint64          now = g_get_monotonic_time();
+    FrameTrace_t   *pTrace;
+    FireStreamerStage_t stage;
+    guint           seq;
+    gint64          startUs;
+    gint64          captureUs;
+    gint64          unset = 0;
+    guint64         pts = GST_BUFFER_PTS(buffer);
+
+    if (parent == (GstObject*)pThis->appsrc) {
+        seq = (guint)GST_BUFFER_OFFSET(buffer);
+        pTrace = &pThis->traces[seq & (TRACE_SLOTS - 1)];
+        if (atomic_load_explicit(&pTrace->seq, memory_order_acquire) != seq) {
+            return GST_PAD_PROBE_OK;                                 /* overwritten, too late */
+        }
+        atomic_store_explicit(&pTrace->pts, pts, memory_order_relaxed);   /* found by the PTS now */
+        if (FireStreamer_gst_isTraceValid__(pTrace, seq) != TRUE) {
+            atomic_compare_exchange_strong(&pTrace->pts, &pts, GST_CLOCK_TIME_NONE);
+            return GST_PAD_PROBE_OK;
+        }
+        stage = FIRESTREAMER_STAGE_QUEUE;
+    } else if (parent == (GstObject*)pThis->h264Enc) {
+        g_atomic_int_inc(&pThis->framesEncoded);
+        atomic_fetch_add_explicit(&pThis->bytesEncoded, gst_buffer_get_size(buffer),
+                                  memory_order_relaxed);
+        pTrace = FireStreamer_gst_findTrace__(pThis, pts, &seq);
+        stage = FIRESTREAMER_STAGE_ENCODE;
+    } else {
+        g_atomic_int_inc(&pThis->framesSent);
+        pTrace = FireStreamer_gst_findTrace__(pThis, pts, &seq);
+        stage = FIRESTREAMER_STAGE_SEND;
+    }
+    if (pTrace == NULL) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    /* a stage is recorded once per frame, codec headers may come with the frame's PTS. The slot
+     * may be rewritten for a new frame meanwhile, the stamps count only if seq is still the same */
+    startUs = atomic_load_explicit(&pTrace->stampUs[stage], memory_order_relaxed);
+    captureUs = atomic_load_explicit(&pTrace->stampUs[FIRESTREAMER_STAGE_CAPTURE],
+                                     memory_order_relaxed);
+    if ((startUs == 0) ||
+        !atomic_compare_exchange_strong(&pTrace->stampUs[stage + 1], &unset, now)) {
+        return GST_PAD_PROBE_OK;
+    }
+    if (FireStreamer_gst_isTraceValid__(pTrace, seq) != TRUE) {
+        atomic_compare_exchange_strong(&pTrace->stampUs[stage + 1], &now, 0);    /* not our frame */
+        return GST_PAD_PROBE_OK;
+    }
+    Histogram_record(&pThis->latency[stage], (uint32_t)(now - startUs));
+    if (stage == FIRESTREAMER_STAGE_SEND) {
+        Histogram_record(&pThis->latency[FIRESTREAMER_STAGE_TOTAL], (uint32_t)(now - captureUs));
+        Histogram_record(&pThis->profileLatency[g_atomic_int_get(&pThis->latencyProfile)],
+                         (uint32_t)(now - captureUs));
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static FrameTrace_t* FireStreamer_gst_findTrace__ (FireStreamer_t *pThis, GstClockTime pts,
+                                                   guint *pSeq) {
+    guint seq = g_atomic_int_get(&pThis->traceSeq);
+    FrameTrace_t *pTrace;
+    uint32_t i;
+
+    if (pts == GST_CLOCK_TIME_NONE) {
+        return NULL;
+    }
+    /* newest first, the frame we look for has just been encoded */
+    for (i = 1; i <= TRACE_SLOTS; i++) {
+        pTrace = &pThis->traces[(seq - i) & (TRACE_SLOTS - 1)];
+        *pSeq = atomic_load_explicit(&pTrace->seq, memory_order_acquire);
+        if ((*pSeq != TRACE_SEQ_NONE) &&
+            (atomic_load_explicit(&pTrace->pts, memory_order_relaxed) == pts) &&
+            (FireStreamer_gst_isTraceValid__(pTrace, *pSeq) == TRUE)) {
+            return pTrace;
+        }
+    }
+    return NULL;
+}
+
+static bool_t FireStreamer_gst_isTraceValid__ (FrameTrace_t *pTrace, guint seq) {
+
+    /* the loads before are done before the check, a rewrite of the slot changes seq first */
+    atomic_thread_fence(memory_order_acquire);
+    return (atomic_load_explicit(&pTrace->seq, memory_order_relaxed) == seq) ? TRUE : FALSE;
+}
+
+static FireStreamerSink_t FireStreamer_gst_getSinkType__ (const char *pUrl) {
+
+    if (strncmp(pUrl, "file://", strlen("file://")) == 0) {
+        return FIRESTREAMER_SINK_FILE;
+    }
+    if (strncmp(pUrl, "fake://", strlen("fake://")) == 0) {
+        return FIRESTREAMER_SINK_FAKE;
+    }
+    if (strncmp(pUrl, "mp4://", strlen("mp4://")) == 0) {
+        return FIRESTREAMER_SINK_MP4;
+    }
+    if (strncmp(pUrl, "shm://", strlen("shm://")) == 0) {
+        return FIRESTREAMER_SINK_SHM;
+    }
+    return FIRESTREAMER_SINK_RTSP;
+}
+
+static void FireStreamer_gst_free__ (FireStreamer_t *pThis) {
+    uint32_t i;
+
+    /* renditions are fed by this FireStreamer, they go first */
+    for (i = 0; i < FIRESTREAMER_MAX_RENDITIONS; i++) {
+        if (pThis->renditions[i] != NULL) {
+            FireStreamer_gst_free__(pThis->renditions[i]);
+            pThis->renditions[i] = NULL;
+        }
+    }
+    pThis->nRenditions = 0;
+
+    /* outputs still being removed are left to the pipeline, their timeouts must not fire */
+    pthread_mutex_lock(&pThis->outMutex);
+    pThis->outputsClosed = TRUE;
+    for (i = 0; i < FIRESTREAMER_MAX_OUTPUTS; i++) {
+        if (pThis->outputs[i].eosTimer != NULL) {
+            g_source_destroy(pThis->outputs[i].eosTimer);
+            g_source_unref(pThis->outputs[i].eosTimer);
+            pThis->outputs[i].eosTimer = NULL;
+        }
+        if (pThis->outputs[i].retryTimer != NULL) {
+            g_source_destroy(pThis->outputs[i].retryTimer);
+            g_source_unref(pThis->outputs[i].retryTimer);
+            pThis->outputs[i].retryTimer = NULL;
+        }
+    }
+    pthread_mutex_unlock(&pThis->outMutex);
+
+    /* stop the Abr first, it uses the encoder and the rtpbin, the stats tick reads them too */
+    pthread_mutex_lock(&pThis->abrMutex);
+    if (pThis->abrTimer != NULL) {
+        g_source_destroy(pThis->abrTimer);
+    }
+    if (pThis->statsTimer != NULL) {
+        g_source_destroy(pThis->statsTimer);
+    }
+    pthread_mutex_unlock(&pThis->abrMutex);
+    if (pThis->abrTimer != NULL) {
+        g_source_unref(pThis->abrTimer);
+        pThis->abrTimer = NULL;
+    }
+    if (pThis->statsTimer != NULL) {
+        g_source_unref(pThis->statsTimer);
+        pThis->statsTimer = NULL;
+        StatsShm_release(&l_shared.stats, (uint32_t)(pThis - l_fireStreamers));
+    }
+
+    /* the push thread pushes what is still queued and quits, the rest is dropped by the ring */
+    if (pThis->pushThreadId != 0) {
+        FrameRing_close(&pThis->ring);
+        pthread_join(pThis->pushThreadId, NULL);
+        pThis->pushThreadId = 0;
+    }
+    if (pThis->ringReady == TRUE) {
+        FrameRing_destroy(&pThis->ring);
+        pThis->ringReady = FALSE;
+    }
+
+    /* stop the pipeline first, it gives back all pool buffers and pushed frames */
     if (pThis->pipeline != NULL) {
-        gst_object_unref(pThis->pipeline);
+        gst_element_set_state((GstElement*)pThis->pipeline, GST_STATE_NULL);
+    }
+    for (i = 0; i < FIRESTREAMER_MAX_OUTPUTS; i++) {
+        if (pThis->outputs[i].teePad != NULL) {
+            gst_object_unref(pThis->outputs[i].teePad);
+        }
+        if (pThis->outputs[i].queuePad != NULL) {
+            gst_object_unref(pThis->outputs[i].queuePad);
+        }
+    }
+    FireStreamer_gst_stopRecorder__(pThis);
+    if (pThis->snapshot != NULL) {
+        gst_element_set_state(pThis->snapshot, GST_STATE_NULL);
+        gst_object_unref(pThis->snapshot);                       /* frees all elements of the bin */
+        pThis->snapshot = NULL;
+    }
+    if (pThis->pSnapMemory != NULL) {
+        g_free(pThis->pSnapMemory);
+        pThis->pSnapMemory = NULL;
+    }
+    if (pThis->pPrebufferMemory != NULL) {
+        g_free(pThis->pPrebufferMemory);
+        pThis->pPrebufferMemory = NULL;
+    }
+    if (pThis->pMotionMemory != NULL) {
+        g_free(pThis->pMotionMemory);
+        pThis->pMotionMemory = NULL;
+    }
+    if (pThis->pScaleMemory != NULL) {
+        g_free(pThis->pScaleMemory);
+        pThis->pScaleMemory = NULL;
+    }
+    if (pThis->pConvertMemory != NULL) {
+        g_free(pThis->pConvertMemory);
+        pThis->pConvertMemory = NULL;
+    }
+    if (pThis->busWatch != NULL) {
+        g_source_destroy(pThis->busWatch);
+        g_source_unref(pThis->busWatch);
+        pThis->busWatch = NULL;
+    }
+    if (pThis->msg != NULL) {
+        gst_message_unref (pThis->msg);
+        pThis->msg = NULL;
+    }
+    if (pThis->bus != NULL) {
+        gst_object_unref (pThis->bus);
+        pThis->bus = NULL;
+    }
+    FireStreamer_gst_unrefElement__((GstElement**)&pThis->appsrc);
+    FireStreamer_gst_unrefElement__(&pThis->sourceFilter);
+    FireStreamer_gst_unrefElement__(&pThis->encConvert);
+    FireStreamer_gst_unrefElement__(&pThis->h264Enc);
+    FireStreamer_gst_unrefElement__(&pThis->encFilter);
+    FireStreamer_gst_unrefElement__(&pThis->outputTee);
+    pThis->videoqueue = NULL;                                  /* in the bin of output 0 */
+    pThis->videoSink = NULL;
+    if (pThis->pipeline != NULL) {
+        gst_object_unref(pThis->pipeline);                       /* frees all elements of the bin */
+        pThis->pipeline = NULL;
+    }
+    if (pThis->dmabufAllocator != NULL) {
+        gst_object_unref(pThis->dmabufAllocator);
+        pThis->dmabufAllocator = NULL;
     }
-    if (pThis->msg != NULL) {
-        gst_message_unref (pThis->msg);
+    if (pThis->pool != NULL) {
+        gst_buffer_pool_set_active(pThis->pool, FALSE);
+        gst_object_unref(pThis->pool);
+        pThis->pool = NULL;
     }
-    if (pThis->bus != NULL) {
-        gst_object_unref (pThis->bus);
+    pthread_mutex_destroy(&pThis->abrMutex);
+    pthread_mutex_destroy(&pThis->recMutex);
+    pthread_mutex_destroy(&pThis->outMutex);
+    pthread_mutex_destroy(&pThis->motionMutex);
+    pthread_mutex_destroy(&pThis->snapMutex);
+    FireStreamer_gst_detach__(pThis);
+}
+
+static bool_t FireStreamer_gst_createPrebuffer__ (FireStreamer_t *pThis,
+                                                  const FireStreamerConfig_t *pConfig) {
+    uint32_t maxBitrate;
+    uint32_t dataSize;
+    uint32_t maxUnits;
+
+    /* the window plus the GOP being written, the oldest GOP is dropped when a new one starts */
+    maxBitrate = ((pThis->abrEnabled == TRUE) && (pConfig->maxBitrate > pConfig->bitrate)) ?
+                 pConfig->maxBitrate : pConfig->bitrate;
+    if (pConfig->prebufferSize != 0) {
+        dataSize = pConfig->prebufferSize * 1024;
+    } else {
+        dataSize = (maxBitrate * 1000 / 8) *
+                   (pConfig->prebufferSeconds + (2 * pConfig->gop + pThis->fps - 1) / pThis->fps);
+    }
+    maxUnits = pThis->fps * pConfig->prebufferSeconds + 2 * pConfig->gop;
+
+    pThis->pPrebufferMemory = g_try_malloc(Prebuffer_getMemorySize(dataSize, maxUnits));
+    if (pThis->pPrebufferMemory == NULL) {
+        g_printerr ("ERROR: prebuffer of %u KiB could not be allocated.\n", dataSize / 1024);
+        return FALSE;
+    }
+    Prebuffer_initialize(&pThis->prebuffer, pThis->pPrebufferMemory, dataSize, maxUnits,
+                         pConfig->prebufferSeconds * GST_SECOND);
+    printf("prebuffer %u s, %u KiB for %u frames\n", pConfig->prebufferSeconds,
+           Prebuffer_getMemorySize(dataSize, maxUnits) / 1024, maxUnits);
+
+    return TRUE;
+}
+
+static GstPadProbeReturn FireStreamer_gst_prebufferProbe__ (GstPad *pad, GstPadProbeInfo *info,
+                                                            gpointer pUserData) {
+    FireStreamer_t  *pThis = pUserData;
+    GstBuffer       *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    PrebufferUnit_t unit;
+    GstMapInfo      map;
+    bool_t          written;
+    UNUSED_ARGUMENT(pad);
+
+    if (gst_buffer_map(buffer, &map, GST_MAP_READ) != TRUE) {
+        return GST_PAD_PROBE_OK;
+    }
+    unit.size = (uint32_t)map.size;
+    unit.pts = GST_BUFFER_PTS(buffer);
+    unit.dts = GST_BUFFER_DTS(buffer);
+    unit.duration = GST_BUFFER_DURATION(buffer);
+    unit.keyframe = GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) ? FALSE : TRUE;
+    unit.hasHeader = FALSE;                     /* a repeated SPS and PPS in front doesn't hurt */
+
+    /* encoder streaming thread, the copy into the ring is the only work per frame. A recording
+     * reads the unit from there too */
+    pthread_mutex_lock(&pThis->recMutex);
+    written = Prebuffer_write(&pThis->prebuffer, map.data, unit.size, unit.pts, unit.dts,
+                              unit.duration, unit.keyframe);
+    if (unit.pts != GST_CLOCK_TIME_NONE) {
+        pThis->encodedPts = unit.pts;
+    }
+    if ((pThis->recorder != NULL) && (pThis->recEos != TRUE)) {
+        if (written == TRUE) {
+            FireStreamer_gst_recordUnit__(pThis, Prebuffer_getCount(&pThis->prebuffer) - 1);
+        } else {
+            pThis->recWaitKey = TRUE;      /* the recorder holds the ring, the file skips a GOP */
+        }
+        if ((pThis->recStop != GST_CLOCK_TIME_NONE) && (unit.pts != GST_CLOCK_TIME_NONE) &&
+            (unit.pts >= pThis->recStop)) {
+            gst_app_src_end_of_stream(pThis->recSrc);      /* the muxer finishes the file on EOS */
+            pThis->recEos = TRUE;
+        }
+    }
+    pthread_mutex_unlock(&pThis->recMutex);
+    gst_buffer_unmap(buffer, &map);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void FireStreamer_gst_recordUnit__ (FireStreamer_t *pThis, uint32_t index) {
+    GstBuffer               *buffer;
+    const PrebufferUnit_t   *pUnit;
+    PrebufferUnit_t         *pPinned;
+    const uint8_t           *pData;
+    const uint8_t           *pHeader;
+    uint32_t                headerSize = 0;
+
+    /* called with recMutex held. The file starts on a key frame with its SPS and PPS, the
+     * timestamps are rebased so that it starts at 0 */
+    pUnit = Prebuffer_getUnit(&pThis->prebuffer, index, &pData);
+    if ((pThis->recBase == GST_CLOCK_TIME_NONE) || (pThis->recWaitKey == TRUE)) {
+        if (pUnit->keyframe != TRUE) {
+            return;
+        }
+        pThis->recWaitKey = FALSE;
+    }
+    if (pThis->recBase == GST_CLOCK_TIME_NONE) {
+        pThis->recBase = (pUnit->dts != GST_CLOCK_TIME_NONE) ? pUnit->dts : pUnit->pts;
+        if (pThis->recBase == GST_CLOCK_TIME_NONE) {
+            pThis->recBase = 0;
+        }
+        if ((pThis->recStop == GST_CLOCK_TIME_NONE) && (pUnit->pts != GST_CLOCK_TIME_NONE)) {
+            pThis->recStop = pUnit->pts + pThis->recPost;
+        }
+        if (pUnit->hasHeader != TRUE) {
+            headerSize = Prebuffer_getHeader(&pThis->prebuffer, &pHeader);
+            memcpy(pThis->recHeader, pHeader, headerSize);   /* a later key frame may replace it */
+        }
+    }
+
+    /* no copy per unit, the buffer wraps the ring bytes and the unit stays pinned until the
+     * recorder releases it. The header copy lives as long as the recorder */
+    buffer = gst_buffer_new();
+    if (headerSize > 0) {
+        gst_buffer_append_memory(buffer, gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY,
+                                                                pThis->recHeader, headerSize, 0,
+                                                                headerSize, NULL, NULL));
+    }
+    pPinned = Prebuffer_pin(&pThis->prebuffer, index, &pData);
+    gst_buffer_append_memory(buffer, gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY,
+                                                            (gpointer)pData, pUnit->size, 0,
+                                                            pUnit->size, pPinned,
+                                                            (GDestroyNotify)Prebuffer_unpin));
+    GST_BUFFER_PTS(buffer) = ((pUnit->pts != GST_CLOCK_TIME_NONE) &&
+                              (pUnit->pts >= pThis->recBase)) ?
+                             pUnit->pts - pThis->recBase : GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DTS(buffer) = ((pUnit->dts != GST_CLOCK_TIME_NONE) &&
+                              (pUnit->dts >= pThis->recBase)) ?
+                             pUnit->dts - pThis->recBase : GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DURATION(buffer) = pUnit->duration;
+    if (pUnit->keyframe != TRUE) {
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+    gst_app_src_push_buffer(pThis->recSrc, buffer);                    /* takes the reference */
+}
+
+static GstElement* FireStreamer_gst_createRecorder__ (FireStreamer_t *pThis, const char *pPath,
+                                                     GstAppSrc **ppSource, GSource **ppWatch) {
+    GstElement *recorder = gst_pipeline_new("recorder");
+    GstElement *source = gst_element_factory_make("appsrc", "recordSource");
+    GstElement *parser = gst_element_factory_make("h264parse", "recordParser");
+    GstElement *muxer;
+    GstElement *sink = gst_element_factory_make("filesink", "recordSink");
+    GSource    *watch;
+    GstCaps    *caps;
+    GstBus     *bus;
+    size_t     length = strlen(pPath);
+
+    /* the container follows the file name, MP4 unless it ends with .mkv */
+    if ((length > 4) && (g_ascii_strcasecmp(pPath + length - 4, ".mkv") == 0)) {
+        muxer = gst_element_factory_make("matroskamux", "recordMuxer");
+    } else {
+        muxer = gst_element_factory_make("mp4mux", "recordMuxer");
+    }
+    if (!recorder || !source || !parser || !muxer || !sink) {
+        g_printerr ("ERROR: recorder elements for '%s' could not be created.\n", pPath);
+        FireStreamer_gst_unrefElement__(&recorder);
+        FireStreamer_gst_unrefElement__(&source);
+        FireStreamer_gst_unrefElement__(&parser);
+        FireStreamer_gst_unrefElement__(&muxer);
+        FireStreamer_gst_unrefElement__(&sink);
+        return NULL;
+    }
+
+    /* the whole prebuffer is pushed at once. Queued units are pinned in the ring, the appsrc
+     * never holds more than the ring and the header */
+    caps = gst_caps_new_simple("video/x-h264", "stream-format", G_TYPE_STRING, "byte-stream",
+                               "alignment", G_TYPE_STRING, "au", NULL);
+    g_object_set(G_OBJECT(source), "caps", caps, NULL);
+    gst_caps_unref(caps);
+    g_object_set(G_OBJECT(source), "format", GST_FORMAT_TIME, NULL);
+    g_object_set(G_OBJECT(source), "max-bytes",
+                 (guint64)(Prebuffer_getDataSize(&pThis->prebuffer) + PREBUFFER_HEADER_MAX), NULL);
+    g_object_set(G_OBJECT(sink), "location", pPath, NULL);
+    g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+
+    gst_bin_add_many(GST_BIN(recorder), source, parser, muxer, sink, NULL);
+    if (!gst_element_link_many(source, parser, muxer, sink, NULL)) {
+        g_printerr ("ERROR: recorder elements could not be linked.\n");
+        gst_object_unref(recorder);
+        return NULL;
+    }
+
+    bus = gst_pipeline_get_bus(GST_PIPELINE(recorder));
+    gst_bus_set_sync_handler(bus, FireStreamer_gst_syncCall__, NULL, NULL);
+    watch = gst_bus_create_watch(bus);
+    gst_object_unref(bus);
+    g_source_set_callback(watch, (GSourceFunc)(GCallback)FireStreamer_gst_recorderBusCall__,
+                          pThis, NULL);
+    g_source_attach(watch, l_shared.pContext);
+
+    if (gst_element_set_state(recorder, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr ("ERROR: Unable to start the recorder for '%s'.\n", pPath);
+        g_source_destroy(watch);
+        g_source_unref(watch);
+        gst_element_set_state(recorder, GST_STATE_NULL);
+        gst_object_unref(recorder);
+        return NULL;
+    }
+    *ppSource = (GstAppSrc*)source;
+    *ppWatch = watch;
+
+    return recorder;
+}
+
+static gboolean FireStreamer_gst_recorderBusCall__ (GstBus *bus, GstMessage *msg,
+                                                    gpointer pUserData) {
+    FireStreamer_t *pThis = pUserData;
+    GstElement     *recorder = NULL;
+    GSource        *recWatch = NULL;
+    gchar          *debug;
+    GError         *error;
+    bool_t         pending = FALSE;
+    char           path[CHAR_PARAM];
+    uint32_t       postSeconds = 0;
+    UNUSED_ARGUMENT(bus);
+
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_EOS:
+            printf("recording to '%s' done\n", pThis->recPath);
+            break;
+        case GST_MESSAGE_ERROR:
+            gst_message_parse_error(msg, &error, &debug);
+            g_printerr ("ERROR: recording to '%s' failed, %s: %s\n", pThis->recPath,
+                        GST_OBJECT_NAME(msg->src), error->message);
+            g_free(debug);
+            g_error_free(error);
+            break;
+        default:
+            return TRUE;
+    }
+
+    /* done with this file, stopping the recorder from the bus thread doesn't block any stream.
+     * A watch of a recorder already stopped by FireStreamer_gst_stopRecorder__() is left alone */
+    pthread_mutex_lock(&pThis->recMutex);
+    if ((pThis->recorder != NULL) && (pThis->recWatch == g_main_current_source())) {
+        recorder = pThis->recorder;
+        recWatch = pThis->recWatch;
+        pThis->recorder = NULL;
+        pThis->recSrc = NULL;
+        pThis->recWatch = NULL;
+        pending = pThis->recPending;
+        snprintf(path, sizeof(path), "%s", pThis->recPendingPath);
+        postSeconds = pThis->recPendingSeconds;
+        pThis->recPending = FALSE;
+    }
+    pthread_mutex_unlock(&pThis->recMutex);
+    if (recorder == NULL) {
+        return TRUE;
+    }
+    gst_element_set_state(recorder, GST_STATE_NULL);
+    gst_object_unref(recorder);
+    g_source_unref(recWatch);
+
+    /* an event that came during the drain, its file starts with the prebuffer as it is now */
+    if (pending == TRUE) {
+        FireStreamer_triggerRecording(pThis, path, postSeconds);
+    }
+
+    return FALSE;                                                    /* removes the bus watch */
+}
+
+static void FireStreamer_gst_stopRecorder__ (FireStreamer_t *pThis) {
+    GstElement *recorder;
+    GSource    *recWatch;
+    GstAppSrc  *recSrc;
+    GstMessage *msg;
+    GstBus     *bus;
+    bool_t     eos;
+
+    /* the encoder is stopped, finish the file so that it can be played */
+    pthread_mutex_lock(&pThis->recMutex);
+    recorder = pThis->recorder;
+    recWatch = pThis->recWatch;
+    recSrc = pThis->recSrc;
+    eos = pThis->recEos;
+    pThis->recorder = NULL;
+    pThis->recSrc = NULL;
+    pThis->recWatch = NULL;
+    pThis->recPending = FALSE;                                        /* the encoder is gone, too */
+    pthread_mutex_unlock(&pThis->recMutex);
+    if (recorder == NULL) {
+        return;
+    }
+
+    g_source_destroy(recWatch);
+    g_source_unref(recWatch);
+    if (eos != TRUE) {
+        gst_app_src_end_of_stream(recSrc);
+    }
+    bus = gst_pipeline_get_bus(GST_PIPELINE(recorder));
+    msg = gst_bus_timed_pop_filtered(bus, RECORDER_EOS_TIMEOUT,
+                                     GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    if (msg != NULL) {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    gst_element_set_state(recorder, GST_STATE_NULL);
+    gst_object_unref(recorder);
+    printf("recording to '%s' stopped\n", pThis->recPath);
+}
+
+static bool_t FireStreamer_gst_createSnapshot__ (FireStreamer_t *pThis) {
+    GstElement *snapshot = gst_pipeline_new("snapshot");
+    GstElement *source = gst_element_factory_make("appsrc", "snapshotSource");
+    GstElement *convert = gst_element_factory_make("videoconvert", "snapshotConvert");
+    GstElement *scale = gst_element_factory_make("videoscale", "snapshotScale");
+    GstElement *filter = gst_element_factory_make("capsfilter", "snapshotFilter");
+    GstElement *encoder = gst_element_factory_make("jpegenc", "snapshotEncoder");
+    GstElement *sink = gst_element_factory_make("appsink", "snapshotSink");
+    GstCaps    *caps = NULL;
+    GstBus     *bus;
+    GstPad     *pad;
+
+    if (!snapshot || !source || !convert || !scale || !filter || !encoder || !sink) {
+        g_printerr ("ERROR: snapshot elements could not be created, jpegenc is in good plugins.\n");
+        FireStreamer_gst_unrefElement__(&snapshot);
+        FireStreamer_gst_unrefElement__(&source);
+        FireStreamer_gst_unrefElement__(&convert);
+        FireStreamer_gst_unrefElement__(&scale);
+        FireStreamer_gst_unrefElement__(&filter);
+        FireStreamer_gst_unrefElement__(&encoder);
+        FireStreamer_gst_unrefElement__(&sink);
+        return FALSE;
+    }
+
+    /* frames come as the encoder gets them. Live, so it runs without a preroll frame, and the
+     * appsink keeps the newest JPEG only */
+    g_object_get(G_OBJECT(pThis->sourceFilter), "caps", &caps, NULL);
+    g_object_set(G_OBJECT(source), "caps", caps, NULL);
+    gst_caps_unref(caps);
+    g_object_set(G_OBJECT(source), "format", GST_FORMAT_TIME, NULL);
+    g_object_set(G_OBJECT(source), "is-live", TRUE, NULL);
+    g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+    g_object_set(G_OBJECT(sink), "max-buffers", 1, NULL);
+    g_object_set(G_OBJECT(sink), "drop", TRUE, NULL);
+    g_object_set(G_OBJECT(sink), "enable-last-sample", FALSE, NULL);
+
+    gst_bin_add_many(GST_BIN(snapshot), source, convert, scale, filter, encoder, sink, NULL);
+    if (!gst_element_link_many(source, convert, scale, filter, encoder, sink, NULL)) {
+        g_printerr ("ERROR: snapshot elements could not be linked.\n");
+        gst_object_unref(snapshot);
+        return FALSE;
+    }
+
+    /* no bus watch, the messages are read after every request */
+    bus = gst_pipeline_get_bus(GST_PIPELINE(snapshot));
+    gst_bus_set_sync_handler(bus, FireStreamer_gst_syncCall__, NULL, NULL);
+    gst_object_unref(bus);
+    if (gst_element_set_state(snapshot, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr ("ERROR: Unable to start the snapshot pipeline.\n");
+        gst_element_set_state(snapshot, GST_STATE_NULL);
+        gst_object_unref(snapshot);
+        return FALSE;
+    }
+    pThis->snapshot = snapshot;
+    pThis->snapSrc = (GstAppSrc*)source;
+    pThis->snapFilter = filter;
+    pThis->snapEnc = encoder;
+    pThis->snapSink = (GstAppSink*)sink;
+
+    /* raw frames as the encoder gets them, the probe stays idle until a request is made */
+    pad = gst_element_get_static_pad(pThis->sourceFilter, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, FireStreamer_gst_snapshotProbe__, pThis,
+                      NULL);
+    gst_object_unref(pad);
+
+    return TRUE;
+}
+
+static GstPadProbeReturn FireStreamer_gst_snapshotProbe__ (GstPad *pad, GstPadProbeInfo *info,
+                                                           gpointer pUserData) {
+    FireStreamer_t  *pThis = pUserData;
+    GstBuffer       *copy;
+    gint            request;
+    UNUSED_ARGUMENT(pad);
+
+    /* one load per frame while nobody asks. The frame is copied, a zero-copy capture buffer goes
+     * back to the driver as soon as the encoder is done with it */
+    request = g_atomic_int_get(&pThis->snapRequest);
+    if ((request == 0) ||
+        (g_atomic_int_compare_and_exchange(&pThis->snapRequest, request, 0) != TRUE)) {
+        return GST_PAD_PROBE_OK;
+    }
+    copy = gst_buffer_copy_deep(GST_PAD_PROBE_INFO_BUFFER(info));
+    GST_BUFFER_PTS(copy) = (GstClockTime)request * GST_MSECOND;      /* jpegenc keeps it, no sync */
+    GST_BUFFER_DTS(copy) = GST_CLOCK_TIME_NONE;
+    gst_app_src_push_buffer(pThis->snapSrc, copy);                              /* takes the copy */
+
+    return GST_PAD_PROBE_OK;
+}
+
+static uint32_t FireStreamer_gst_encodeSnapshot__ (FireStreamer_t *pThis, uint32_t width,
+                                                   uint32_t height, uint32_t quality) {
+    GstSample      *sample = NULL;
+    GstCaps        *caps;
+    GstMapInfo      map;
+    GstMessage     *msg;
+    GstBus         *bus;
+    GError         *error;
+    gchar          *debug;
+    gint            request;
+    gint64          deadline = g_get_monotonic_time() + SNAPSHOT_TIMEOUT_US;
+    gint64          now;
+
+    /* called with the snapMutex held, the pipeline is built by the first request */
+    pThis->snapSize = 0;
+    if ((pThis->snapshot == NULL) && (FireStreamer_gst_createSnapshot__(pThis) != TRUE)) {
+        return 0;
+    }
+
+    /* size and quality of this request, the branch renegotiates with the next frame */
+    caps = gst_caps_new_simple("video/x-raw", "width", G_TYPE_INT, (gint)width,
+                               "height", G_TYPE_INT, (gint)height, NULL);
+    g_object_set(G_OBJECT(pThis->snapFilter), "caps", caps, NULL);
+    gst_caps_unref(caps);
+    g_object_set(G_OBJECT(pThis->snapEnc), "quality", (gint)quality, NULL);
+
+    /* a JPEG of a request that timed out may still come, the PTS carries the request number and
+     * only the one of this request is taken. What is waiting in the appsink already is stale */
+    while ((sample = gst_app_sink_try_pull_sample(pThis->snapSink, 0)) != NULL) {
+        gst_sample_unref(sample);
+    }
+    pThis->snapSequence = (pThis->snapSequence < G_MAXINT) ? pThis->snapSequence + 1 : 1;
+    request = pThis->snapSequence;
+    g_atomic_int_set(&pThis->snapRequest, request);
+    while ((now = g_get_monotonic_time()) < deadline) {
+        sample = gst_app_sink_try_pull_sample(pThis->snapSink,
+                                              (GstClockTime)(deadline - now) * GST_USECOND);
+        if (sample == NULL) {
+            break;
+        }
+        if (GST_BUFFER_PTS(gst_sample_get_buffer(sample)) ==
+            (GstClockTime)request * GST_MSECOND) {
+            break;
+        }
+        gst_sample_unref(sample);
+        sample = NULL;
+    }
+    g_atomic_int_set(&pThis->snapRequest, 0);
+
+    if (sample != NULL) {
+        if (gst_buffer_map(gst_sample_get_buffer(sample), &map, GST_MAP_READ) == TRUE) {
+            if (map.size > pThis->snapCapacity) {
+                g_free(pThis->pSnapMemory);
+                pThis->pSnapMemory = g_try_malloc(map.size);
+                pThis->snapCapacity = (pThis->pSnapMemory != NULL) ? (uint32_t)map.size : 0;
+            }
+            if (pThis->pSnapMemory != NULL) {
+                memcpy(pThis->pSnapMemory, map.data, map.size);
+                pThis->snapSize = (uint32_t)map.size;
+            }
+            gst_buffer_unmap(gst_sample_get_buffer(sample), &map);
+        }
+        gst_sample_unref(sample);
+    } else {
+        g_printerr ("ERROR: no snapshot within %d ms, is the stream fed?\n",
+                    SNAPSHOT_TIMEOUT_US / 1000);
+    }
+
+    /* nobody watches the snapshot bus, empty it and report errors */
+    bus = gst_pipeline_get_bus(GST_PIPELINE(pThis->snapshot));
+    while ((msg = gst_bus_pop(bus)) != NULL) {
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+            gst_message_parse_error(msg, &error, &debug);
+            g_printerr ("ERROR: snapshot failed, %s: %s\n", GST_OBJECT_NAME(msg->src),
+                        error->message);
+            g_free(debug);
+            g_error_free(error);
+        }
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+
+    return pThis->snapSize;
+}
+
+
+static int32_t FireStreamer_gst_addOutput__ (FireStreamer_t *pThis, const char *pUrl) {
+    Output_t   *pOutput = NULL;
+    int32_t    index;
+
+    pthread_mutex_lock(&pThis->outMutex);
+    for (index = 0; index < FIRESTREAMER_MAX_OUTPUTS; index++) {
+        if ((pThis->outputs[index].inUse != TRUE) && (pThis->outputsClosed != TRUE)) {
+            pOutput = &pThis->outputs[index];
+            FireStreamer_gst_clearOutput__(pOutput);
+            pOutput->inUse = TRUE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pThis->outMutex);
+    if (pOutput == NULL) {
+        g_printerr ("ERROR: all %d outputs are in use, '%s' not added.\n",
+                    FIRESTREAMER_MAX_OUTPUTS, pUrl);
+        return -1;
+    }
+    pOutput->pThis = pThis;
+    pOutput->type = FireStreamer_gst_getSinkType__(pUrl);
+    snprintf(pOutput->url, sizeof(pOutput->url), "%s", pUrl);
+
+    if (FireStreamer_gst_buildOutput__(pOutput) != TRUE) {
+        pthread_mutex_lock(&pThis->outMutex);
+        FireStreamer_gst_clearOutput__(pOutput);
+        pthread_mutex_unlock(&pThis->outMutex);
+        return -1;
+    }
+    if (index != 0) {
+        printf("output %d '%s' added\n", index, pUrl);
     }
-    if (pThis->bus_watch_id != 0) {
-        g_source_remove(pThis->bus_watch_id);
-        pThis->bus_watch_id = 0;
+    return index;
+}
+
+static bool_t FireStreamer_gst_buildOutput__ (Output_t *pOutput) {
+    FireStreamer_t *pThis = pOutput->pThis;
+    const char     *pUrl = pOutput->url;
+    int32_t        index = (int32_t)(pOutput - pThis->outputs);
+    GstElement     *parser = NULL;
+    GstPad         *pad;
+    char           name[32];
+    bool_t         linked = FALSE;
+
+    /* output 0 keeps the element names the bus handler and the tools already know */
+    snprintf(name, sizeof(name), "output%d", index);
+    pOutput->bin = gst_bin_new(name);
+    if (index == 0) {
+        pOutput->queue = gst_element_factory_make("queue", "videoqueue");
+    } else {
+        snprintf(name, sizeof(name), "outputQueue%d", index);
+        pOutput->queue = gst_element_factory_make("queue", name);
+    }
+    if (index != 0) {
+        snprintf(name, sizeof(name), "outputSink%d", index);
+    } else {
+        snprintf(name, sizeof(name), "videosink");
+    }
+    switch (pOutput->type) {
+        case FIRESTREAMER_SINK_FILE:
+            pOutput->sink = gst_element_factory_make("filesink", name);
+            break;
+        case FIRESTREAMER_SINK_FAKE:
+            pOutput->sink = gst_element_factory_make("fakesink", name);
+            break;
+        case FIRESTREAMER_SINK_MP4:
+            parser = gst_element_factory_make("h264parse", NULL);        /* byte-stream to avc */
+            pOutput->sink = gst_element_factory_make("splitmuxsink", name);
+            break;
+        case FIRESTREAMER_SINK_SHM:
+            pOutput->sink = gst_element_factory_make("shmsink", name);
+            break;
+        default:
+            pOutput->sink = gst_element_factory_make("rtspclientsink", name);
+            break;
+    }
+    if (!pOutput->bin || !pOutput->queue || !pOutput->sink ||
+        ((pOutput->type == FIRESTREAMER_SINK_MP4) && !parser)) {
+        g_printerr ("ERROR: output elements for '%s' could not be created.\n", pUrl);
+        goto failed;
+    }
+
+    /* how much a slow or stalled output holds and what it drops is up to the latency profile */
+    FireStreamer_gst_setQueueLimits__(pThis, pOutput->queue);
+    switch (pOutput->type) {
+        case FIRESTREAMER_SINK_RTSP:
+            g_object_set(G_OBJECT(pOutput->sink), "latency",
+                         pThis->latencySettings.sinkLatencyMs, NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "location", pUrl, NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "user-id", pThis->username, NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "user-pw", pThis->password, NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "protocols",
+                         (pThis->latencySettings.transport == FIRESTREAMER_TRANSPORT_UDP) ?
+                         RTSP_PROTOCOLS_UDP : RTSP_PROTOCOLS_TCP, NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "tls-validation-flags", 0, NULL);
+            /* a server that is down fails the connect soon, the retry follows the backoff */
+            g_object_set(G_OBJECT(pOutput->sink), "tcp-timeout", (guint64)RECONNECT_TCP_TIMEOUT_US,
+                         NULL);
+            break;
+        case FIRESTREAMER_SINK_MP4:
+            /* a new file every segmentSeconds, cut on a key frame the muxer asks for */
+            g_object_set(G_OBJECT(pOutput->sink), "location", pUrl + strlen("mp4://"), NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "max-size-time",
+                         (guint64)pThis->segmentSeconds * GST_SECOND, NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "send-keyframe-requests", TRUE, NULL);
+            break;
+        case FIRESTREAMER_SINK_SHM:
+            g_object_set(G_OBJECT(pOutput->sink), "socket-path", pUrl + strlen("shm://"), NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "wait-for-connection", FALSE, NULL);
+            g_object_set(G_OBJECT(pOutput->sink), "sync", FALSE, NULL);
+            break;
+        default:
+            /* local sinks take frames as fast as they come, the appsrc is the only clock */
+            if (pOutput->type == FIRESTREAMER_SINK_FILE) {
+                g_object_set(G_OBJECT(pOutput->sink), "location", pUrl + strlen("file://"), NULL);
+            }
+            g_object_set(G_OBJECT(pOutput->sink), "sync", FALSE, NULL);
+            break;
+    }
+    /* the EOS of the sink reaches the bus thread only as a forwarded message */
+    g_object_set(G_OBJECT(pOutput->bin), "message-forward", TRUE, NULL);
+
+    gst_bin_add_many(GST_BIN(pOutput->bin), pOutput->queue, pOutput->sink, NULL);
+    if (parser != NULL) {
+        gst_bin_add(GST_BIN(pOutput->bin), parser);
+        linked = gst_element_link_many(pOutput->queue, parser, pOutput->sink, NULL);
+    } else {
+        linked = gst_element_link(pOutput->queue, pOutput->sink);
+    }
+    parser = NULL;                                                         /* owned by the bin */
+    if (!linked) {
+        g_printerr ("ERROR: output elements for '%s' could not be linked.\n", pUrl);
+        goto failed;
+    }
+    pad = gst_element_get_static_pad(pOutput->queue, "sink");
+    gst_element_add_pad(pOutput->bin, gst_ghost_pad_new("sink", pad));
+    gst_object_unref(pad);
+    pOutput->queuePad = gst_element_get_static_pad(pOutput->queue, "src");
+
+    /* the Abr and the tracing follow output 0, also when it is built again after an outage */
+    if (index == 0) {
+        pThis->videoqueue = pOutput->queue;
+        pThis->videoSink = pOutput->sink;
+        if (pThis->tracing == TRUE) {
+            FireStreamer_gst_addTraceProbe__(pThis, pThis->videoqueue);
+        }
+        if (pOutput->type == FIRESTREAMER_SINK_RTSP) {
+            g_signal_connect (pThis->videoSink, "new-manager",
+                              G_CALLBACK (FireStreamer_gst_newManager__), pThis);
+        }
+    }
+
+    /* from here on the pipeline owns the bin */
+    gst_bin_add(GST_BIN(pThis->pipeline), pOutput->bin);
+#if GST_CHECK_VERSION(1, 20, 0)
+    pOutput->teePad = gst_element_request_pad_simple(pThis->outputTee, "src_%u");
+#else
+    pOutput->teePad = gst_element_get_request_pad(pThis->outputTee, "src_%u");
+#endif
+    if (pOutput->teePad == NULL) {
+        g_printerr ("ERROR: no tee pad for output '%s'.\n", pUrl);
+        goto removed;
+    }
+    gst_pad_add_probe(pOutput->teePad, GST_PAD_PROBE_TYPE_BUFFER, FireStreamer_gst_outputProbe__,
+                      pOutput, NULL);
+    pad = gst_element_get_static_pad(pOutput->bin, "sink");
+    linked = (gst_pad_link(pOutput->teePad, pad) == GST_PAD_LINK_OK);
+    gst_object_unref(pad);
+    if (!linked) {
+        g_printerr ("ERROR: output '%s' could not be linked to the tee.\n", pUrl);
+        gst_element_release_request_pad(pThis->outputTee, pOutput->teePad);
+        gst_object_unref(pOutput->teePad);
+        pOutput->teePad = NULL;
+        goto removed;
     }
-    if (pThis->appsrc != NULL) {
-        gst_object_unref(pThis->appsrc);
+    gst_element_sync_state_with_parent(pOutput->bin);
+
+    /* a late output starts decoding at once */
+    if (index != 0) {
+        FireStreamer_gst_forceKeyUnit__(pOutput->teePad);
+    }
+    return TRUE;
+
+removed:
+    gst_element_set_state(pOutput->bin, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pThis->pipeline), pOutput->bin);           /* unreferences the bin */
+    pOutput->bin = NULL;
+    pOutput->queue = NULL;
+    pOutput->sink = NULL;
+failed:
+    if (pOutput->queuePad != NULL) {
+        gst_object_unref(pOutput->queuePad);
+        pOutput->queuePad = NULL;
+    }
+    FireStreamer_gst_unrefElement__(&parser);
+    FireStreamer_gst_unrefElement__(&pOutput->queue);
+    FireStreamer_gst_unrefElement__(&pOutput->sink);
+    FireStreamer_gst_unrefElement__(&pOutput->bin);
+    if (index == 0) {
+        pThis->videoqueue = NULL;
+        pThis->videoSink = NULL;
+    }
+    return FALSE;
+}
+
+static void FireStreamer_gst_forceKeyUnit__ (GstPad *pad) {
+    GstEvent *event;
+
+    /* travels up through the tee to the encoder, the next frame is an IDR with SPS and PPS */
+    event = gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM,
+                                 gst_structure_new("GstForceKeyUnit", "all-headers",
+                                                   G_TYPE_BOOLEAN, TRUE, NULL));
+    gst_pad_send_event(pad, event);
+}
+
+static Output_t* FireStreamer_gst_findOutput__ (FireStreamer_t *pThis, GstObject *object) {
+    uint32_t i;
+
+    /* the output bin or any element inside of it */
+    for (; object != NULL; object = GST_OBJECT_PARENT(object)) {
+        for (i = 0; i < FIRESTREAMER_MAX_OUTPUTS; i++) {
+            if ((pThis->outputs[i].inUse == TRUE) &&
+                (GST_OBJECT(pThis->outputs[i].bin) == object)) {
+                return &pThis->outputs[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static GstPadProbeReturn FireStreamer_gst_outputProbe__ (GstPad *pad, GstPadProbeInfo *info,
+                                                         gpointer pUserData) {
+    Output_t       *pOutput = pUserData;
+    FireStreamer_t *pThis = pOutput->pThis;
+    guint          level = 0;
+    UNUSED_ARGUMENT(pad);
+    UNUSED_ARGUMENT(info);
+
+    /* an error of the sink comes back through the queue, it must not reach the tee and stop the
+     * encoder. The bus thread removes the output, meanwhile its frames are dropped here */
+    if ((g_atomic_int_get(&pOutput->failed) == 0) &&
+        (gst_pad_get_last_flow_return(pOutput->queuePad) <= GST_FLOW_NOT_NEGOTIATED)) {
+        g_atomic_int_set(&pOutput->failed, 1);
+    }
+    if (g_atomic_int_get(&pOutput->failed) != 0) {
+        return GST_PAD_PROBE_DROP;
+    }
+    /* what the sink didn't take yet, the fullest output sets the mark of the profile */
+    g_object_get(G_OBJECT(pOutput->queue), "current-level-bytes", &level, NULL);
+    FireStreamer_gst_raiseMark__(&pThis->queueMark[g_atomic_int_get(&pThis->latencyProfile)],
+                                 level);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn FireStreamer_gst_unlinkOutput__ (GstPad *pad, GstPadProbeInfo *info,
+                                                          gpointer pUserData) {
+    Output_t       *pOutput = pUserData;
+    FireStreamer_t *pThis = pOutput->pThis;
+    GstPad         *sinkPad;
+    GSource        *eosTimer;
+    bool_t         reconnecting;
+    UNUSED_ARGUMENT(info);
+
+    pthread_mutex_lock(&pThis->outMutex);
+    if (pThis->outputsClosed == TRUE) {
+        pthread_mutex_unlock(&pThis->outMutex);
+        return GST_PAD_PROBE_REMOVE;                       /* free__ tears the pipeline down */
     }
-    if (pThis->sourceFilter != NULL) {
-        gst_object_unref(pThis->sourceFilter);
+    /* armed before the EOS is sent, the EOS may reach the bus thread at once. A failed RTSP sink
+     * can't drain, it is torn down from the bus thread right away */
+    reconnecting = pOutput->reconnecting;
+    eosTimer = g_timeout_source_new((reconnecting == TRUE) ? 0 : OUTPUT_EOS_TIMEOUT_MS);
+    g_source_set_callback(eosTimer, FireStreamer_gst_outputTimeout__, pOutput, NULL);
+    g_source_attach(eosTimer, l_shared.pContext);
+    pOutput->eosTimer = eosTimer;
+    pOutput->teePad = NULL;
+    pthread_mutex_unlock(&pThis->outMutex);
+
+    /* the tee is idle, the branch is taken off and drained with an EOS of its own */
+    sinkPad = gst_element_get_static_pad(pOutput->bin, "sink");
+    gst_pad_unlink(pad, sinkPad);
+    gst_element_release_request_pad(pThis->outputTee, pad);
+    gst_object_unref(pad);
+    if (reconnecting != TRUE) {
+        gst_pad_send_event(sinkPad, gst_event_new_eos());
     }
-    if (pThis->h264Enc != NULL) {
-        gst_object_unref(pThis->h264Enc);
-        pThis->h264Enc = NULL;
+    gst_object_unref(sinkPad);
+
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static gboolean FireStreamer_gst_outputTimeout__ (gpointer pUserData) {
+    Output_t *pOutput = pUserData;
+
+    /* a failed or stalled sink never posts its EOS */
+    if (pOutput->reconnecting != TRUE) {
+        printf("output '%s' did not drain in %d ms\n", pOutput->url, OUTPUT_EOS_TIMEOUT_MS);
     }
-    if (pThis->encFilter != NULL) {
-        gst_object_unref(pThis->encFilter);
-        pThis->encFilter = NULL;
+    FireStreamer_gst_finishOutput__(pOutput);
+    return G_SOURCE_REMOVE;
+}
+
+static void FireStreamer_gst_finishOutput__ (Output_t *pOutput) {
+    FireStreamer_t *pThis = pOutput->pThis;
+
+    /* bus thread only, under the lock so that free__ can't tear the pipeline down meanwhile */
+    pthread_mutex_lock(&pThis->outMutex);
+    if ((pThis->outputsClosed == TRUE) || (pOutput->inUse != TRUE) ||
+        (pOutput->removing != TRUE) || (pOutput->eosTimer == NULL)) {
+        pthread_mutex_unlock(&pThis->outMutex);
+        return;
     }
-    if (pThis->videoqueue != NULL) {
-        gst_object_unref(pThis->videoqueue);
+    g_source_destroy(pOutput->eosTimer);
+    g_source_unref(pOutput->eosTimer);
+    pOutput->eosTimer = NULL;
+    if (pOutput == &pThis->outputs[0]) {
+        /* the rtpbin goes with the sink, the Abr waits for the next one */
+        pthread_mutex_lock(&pThis->abrMutex);
+        g_atomic_pointer_set(&pThis->rtpManager, NULL);
+        pthread_mutex_unlock(&pThis->abrMutex);
         pThis->videoqueue = NULL;
+        pThis->videoSink = NULL;
     }
-    if (pThis->rtspClientSink != NULL) {
-        gst_object_unref(pThis->rtspClientSink);
-        pThis->rtspClientSink = NULL;
+    gst_element_set_state(pOutput->bin, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pThis->pipeline), pOutput->bin);           /* unreferences the bin */
+    gst_object_unref(pOutput->queuePad);
+    if (pOutput->reconnecting == TRUE) {
+        /* the slot, its url and its index stay, only the branch is built again */
+        pOutput->bin = NULL;
+        pOutput->queue = NULL;
+        pOutput->sink = NULL;
+        pOutput->queuePad = NULL;
+        pOutput->removing = FALSE;
+        pOutput->reconnecting = FALSE;
+        g_atomic_int_set(&pOutput->failed, 0);
+        FireStreamer_gst_scheduleRetry__(pOutput);
+    } else {
+        printf("output %d '%s' removed\n", (int)(pOutput - pThis->outputs), pOutput->url);
+        FireStreamer_gst_clearOutput__(pOutput);                /* slot can be taken again */
+    }
+    pthread_mutex_unlock(&pThis->outMutex);
+}
+
+static void FireStreamer_gst_clearOutput__ (Output_t *pOutput) {
+    FireStreamer_t *pThis = pOutput->pThis;
+
+    /* the owner stays, a timer of the slot may be dispatched while the slot is cleared */
+    memset(pOutput, 0, sizeof(*pOutput));
+    pOutput->pThis = pThis;
+}
+
+static void FireStreamer_gst_reconnectOutput__ (Output_t *pOutput, bool_t restart) {
+    FireStreamer_t *pThis = pOutput->pThis;
+
+    /* frames are dropped at the tee from now on, the capture and the encoder don't notice */
+    g_atomic_int_set(&pOutput->failed, 1);
+    pthread_mutex_lock(&pThis->outMutex);
+    if ((pThis->outputsClosed == TRUE) || (pOutput->inUse != TRUE) ||
+        (pOutput->removing == TRUE) || (pOutput->teePad == NULL)) {
+        pthread_mutex_unlock(&pThis->outMutex);
+        return;                                           /* already on its way down or out */
+    }
+    pOutput->removing = TRUE;
+    pOutput->reconnecting = TRUE;
+    pOutput->restarting = restart;
+    pthread_mutex_unlock(&pThis->outMutex);
+
+    gst_pad_add_probe(pOutput->teePad, GST_PAD_PROBE_TYPE_IDLE, FireStreamer_gst_unlinkOutput__,
+                      pOutput, NULL);
+}
+
+static void FireStreamer_gst_outputPlaying__ (FireStreamer_t *pThis, GstObject *object) {
+    Output_t *pOutput;
+    uint32_t i;
+
+    /* rtspclientsink is PLAYING once the server took the RECORD, the stream resumes on the very
+     * next frame when it is an IDR. A restart for a new profile is not counted as a reconnect */
+    pthread_mutex_lock(&pThis->outMutex);
+    for (i = 0; i < FIRESTREAMER_MAX_OUTPUTS; i++) {
+        pOutput = &pThis->outputs[i];
+        if ((pOutput->inUse != TRUE) || (pOutput->teePad == NULL) ||
+            (GST_OBJECT(pOutput->sink) != object)) {
+            continue;
+        }
+        if (pOutput->restarted == TRUE) {
+            pOutput->restarted = FALSE;
+            printf("output %u '%s' restarted\n", i, pOutput->url);
+            FireStreamer_gst_forceKeyUnit__(pOutput->teePad);
+        } else if ((pOutput->retries != 0) && (pOutput->connectedUs == 0)) {
+            printf("output %u '%s' connected again after %u attempts\n", i, pOutput->url,
+                   pOutput->retries);
+            pOutput->connectedUs = g_get_monotonic_time();
+            g_atomic_int_inc(&pThis->reconnects);
+            FireStreamer_gst_forceKeyUnit__(pOutput->teePad);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&pThis->outMutex);
+}
+
+static void FireStreamer_gst_scheduleRetry__ (Output_t *pOutput) {
+    uint32_t delayMs = RECONNECT_MIN_MS;
+    uint32_t i;
+
+    /* new sink settings, not an outage: connect again right away, the backoff is kept */
+    if (pOutput->restarting == TRUE) {
+        pOutput->restarting = FALSE;
+        pOutput->restarted = TRUE;
+        printf("output %d '%s' restarts with the new latency profile\n",
+               (int)(pOutput - pOutput->pThis->outputs), pOutput->url);
+        pOutput->retryTimer = g_timeout_source_new(0);
+        g_source_set_callback(pOutput->retryTimer, FireStreamer_gst_retryOutput__, pOutput, NULL);
+        g_source_attach(pOutput->retryTimer, l_shared.pContext);
+        return;
+    }
+    /* under outMutex, the backoff doubles with every failed connect. A sink that went PLAYING may
+     * still be refused by the server, only a connection that held resets it */
+    if ((pOutput->connectedUs != 0) &&
+        (g_get_monotonic_time() - pOutput->connectedUs >= RECONNECT_STABLE_US)) {
+        pOutput->retries = 0;
+    }
+    pOutput->connectedUs = 0;
+    pOutput->restarted = FALSE;                          /* an outage now, counted as a reconnect */
+    for (i = 0; (i < pOutput->retries) && (delayMs < RECONNECT_MAX_MS); i++) {
+        delayMs *= 2;
+    }
+    if (delayMs > RECONNECT_MAX_MS) {
+        delayMs = RECONNECT_MAX_MS;
+    }
+    pOutput->retries++;
+    printf("output %d '%s' lost, connect %u in %u ms\n",
+           (int)(pOutput - pOutput->pThis->outputs), pOutput->url, pOutput->retries, delayMs);
+    pOutput->retryTimer = g_timeout_source_new(delayMs);
+    g_source_set_callback(pOutput->retryTimer, FireStreamer_gst_retryOutput__, pOutput, NULL);
+    g_source_attach(pOutput->retryTimer, l_shared.pContext);
+}
+
+static gboolean FireStreamer_gst_retryOutput__ (gpointer pUserData) {
+    Output_t       *pOutput = pUserData;
+    FireStreamer_t *pThis = pOutput->pThis;
+
+    /* free__ and removeOutput() destroy the timer under the lock, a late tick quits */
+    pthread_mutex_lock(&pThis->outMutex);
+    if ((pThis->outputsClosed == TRUE) ||
+        (g_source_is_destroyed(g_main_current_source()) == TRUE)) {
+        pthread_mutex_unlock(&pThis->outMutex);
+        return G_SOURCE_REMOVE;
+    }
+    g_source_unref(pOutput->retryTimer);
+    pOutput->retryTimer = NULL;
+    if (FireStreamer_gst_buildOutput__(pOutput) != TRUE) {
+        FireStreamer_gst_scheduleRetry__(pOutput);
+    }
+    pthread_mutex_unlock(&pThis->outMutex);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void FireStreamer_gst_setReady__ (FireStreamer_t *pThis, guint flag) {
+    guint old;
+
+    /* the bus thread and the appsrc thread race, the one completing the flags reports */
+    old = g_atomic_int_or(&pThis->readyFlags, flag);
+    if (((old | flag) != READY_ALL) || (old == READY_ALL)) {
+        return;
     }
+    g_atomic_int_set(&pThis->readyUs, (guint)(g_get_monotonic_time() - pThis->createUs));
+    printf("ready after %u ms\n", g_atomic_int_get(&pThis->readyUs) / 1000);
+    if (pThis->ready != NULL) {
+        pThis->ready(pThis, pThis->pReadyData);
+    }
+}
+
+static GstPadProbeReturn FireStreamer_gst_firstFrameProbe__ (GstPad *pad, GstPadProbeInfo *info,
+                                                             gpointer pUserData) {
+    FireStreamer_t *pThis = pUserData;
+    UNUSED_ARGUMENT(pad);
+    UNUSED_ARGUMENT(info);
+
+    g_atomic_int_set(&pThis->firstFrameUs, (guint)(g_get_monotonic_time() - pThis->createUs));
+    printf("first frame after %u ms\n", g_atomic_int_get(&pThis->firstFrameUs) / 1000);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static GstPadProbeReturn FireStreamer_gst_wakeProbe__ (GstPad *pad, GstPadProbeInfo *info,
+                                                       gpointer pUserData) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    UNUSED_ARGUMENT(pad);
+    UNUSED_ARGUMENT(pUserData);
+
+    /* gst_app_src_push_buffer() to the appsrc thread, stamped by the push thread */
+    Threads_recordWake(THREADS_ROLE_STREAMING, FireStreamer_gst_getWakeLatency__(buffer));
+    return GST_PAD_PROBE_OK;
+}
+
+static void FireStreamer_gst_stampWake__ (GstBuffer *buffer) {
+    GstReferenceTimestampMeta  *pMeta;
+    GstClockTime                now = (GstClockTime)g_get_monotonic_time() * GST_USECOND;
+
+    /* a meta of our own, offsets and timestamps of the buffer belong to the elements */
+    pMeta = gst_buffer_get_reference_timestamp_meta(buffer, l_shared.pWakeCaps);
+    if (pMeta != NULL) {
+        pMeta->timestamp = now;
+    } else if (gst_buffer_is_writable(buffer)) {
+        gst_buffer_add_reference_timestamp_meta(buffer, l_shared.pWakeCaps, now,
+                                                GST_CLOCK_TIME_NONE);
+    }
+}
+
+static gint64 FireStreamer_gst_getWakeLatency__ (GstBuffer *buffer) {
+    GstReferenceTimestampMeta *pMeta;
+
+    /* -1 for a buffer without stamp, Threads_recordWake() skips it */
+    pMeta = gst_buffer_get_reference_timestamp_meta(buffer, l_shared.pWakeCaps);
+    if (pMeta == NULL) {
+        return -1;
+    }
+    return g_get_monotonic_time() - (gint64)(pMeta->timestamp / GST_USECOND);
+}
+
+static void FireStreamer_gst_getLatencySettings__ (FireStreamer_t *pThis,
+                                                   FireStreamerLatencyProfile_t profile,
+                                                   LatencySettings_t *pSettings) {
+
+    if (profile == FIRESTREAMER_LATENCY_CUSTOM) {
+        *pSettings = pThis->customLatency;
+        return;
+    }
+    *pSettings = l_latencyProfiles[profile];
+    pSettings->gop = MAX(pThis->fps * pSettings->gopMs / 1000, 1);
+}
+
+static void FireStreamer_gst_setQueueLimits__ (FireStreamer_t *pThis, GstElement *queue) {
+    LatencySettings_t *pSettings = &pThis->latencySettings;
+
+    /* under outMutex, a running queue takes new limits at once */
+    g_object_set(G_OBJECT(queue), "leaky", pSettings->leaky, NULL);
+    g_object_set(G_OBJECT(queue), "max-size-buffers", pSettings->queueFrames, NULL);
+    g_object_set(G_OBJECT(queue), "max-size-bytes", 0, NULL);
+    g_object_set(G_OBJECT(queue), "max-size-time", (guint64)pSettings->queueMs * GST_MSECOND, NULL);
+}
+
+static guint64 FireStreamer_gst_getAppsrcBytes__ (FireStreamer_t *pThis) {
+
+    /* enough-data fires above it, the back-pressure policy takes over from there */
+    if (pThis->latencySettings.appsrcFrames == 0) {
+        return pThis->appsrcDefaultBytes;
+    }
+    return (guint64)pThis->latencySettings.appsrcFrames * pThis->frameSize;
+}
+
+static void FireStreamer_gst_printLatency__ (FireStreamer_t *pThis) {
+    LatencySettings_t *pSettings = &pThis->latencySettings;
+
+    printf("latency profile %s: queue %u frames/%u ms%s, appsrc %llu bytes, %s %u ms, gop %u\n",
+           l_latencyProfileName[g_atomic_int_get(&pThis->latencyProfile)], pSettings->queueFrames,
+           pSettings->queueMs, (pSettings->leaky == 0) ? " no leak" : "",
+           (unsigned long long)FireStreamer_gst_getAppsrcBytes__(pThis),
+           (pSettings->transport == FIRESTREAMER_TRANSPORT_UDP) ? "udp" : "tcp",
+           pSettings->sinkLatencyMs, pSettings->gop);
 }
 
+static void FireStreamer_gst_raiseMark__ (_Atomic uint64_t *pMark, uint64_t value) {
+    uint64_t mark = atomic_load_explicit(pMark, memory_order_relaxed);
+
+    while ((value > mark) &&
+           !atomic_compare_exchange_weak_explicit(pMark, &mark, value, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+        /* another streaming thread raised it meanwhile, mark was reloaded */
+    }
+}
@@ -26,10 +26,277 @@ typedef enum {
 
 #define UNUSED_ARGUMENT(x_) (void)(x_)
 
-/* Fire Streamer - API */
-bool_t FireStreamer_initialize(char *url, char *username, char * password, uint32_t width,
-                               uint32_t height, bool_t grayscale);
-uint32_t FireStreamer_pushFrame(void *pData, uint32_t size);
+#define FIRESTREAMER_MAX_INSTANCES  64             /* FireStreamer objects in one process at most */
+#define FIRESTREAMER_MAX_OUTPUTS    8      /* outputs of one encoded stream, the url is the first */
+#define FIRESTREAMER_MAX_RENDITIONS 3                    /* scaled substreams of one FireStreamer */
+
+/* opaque FireStreamer object, one per stream */
+typedef struct FireStreamerTag FireStreamer_t;
+
+/* called (possibly from a GStreamer streaming thread) once the pipeline is done with a frame
+ * pushed by FireStreamer_pushFrameZeroCopy() or FireStreamer_pushFrameDmabuf(). Frames skipped
+ * because of back-pressure are released right away, from the pushing thread */
+typedef void (*FireStreamer_releaseFrame_t)(void *pUserData);
+
+/* called once from a GStreamer thread when the pipeline is PLAYING and the appsrc asked for the
+ * first frame, frames pushed before it are skipped. Must not block or destroy the FireStreamer */
+typedef void (*FireStreamer_ready_t)(FireStreamer_t *pThis, void *pUserData);
+
+/* optional capture information passed with every pushed frame, NULL when unknown */
+typedef struct FireStreamerFrameInfoTag {
+    int64_t                 dequeueUs;     /* CLOCK_MONOTONIC at VIDIOC_DQBUF, in us, 0 = unknown */
+    int64_t                 captureUs;          /* V4L2 buf.timestamp, monotonic, us, 0 = unknown */
+    uint32_t                sequence;           /* V4L2 buf.sequence, only used with captureUs */
+} FireStreamerFrameInfo_t;
+
+/* where the stream goes, picked by the url scheme */
+typedef enum {
+    FIRESTREAMER_SINK_RTSP = 0,                               /* rtsp:// or rtsps://, RTSP RECORD */
+    FIRESTREAMER_SINK_FILE,                               /* file:///path, h.264 byte-stream file */
+    FIRESTREAMER_SINK_FAKE,                                     /* fake://, discarded, benchmarks */
+    FIRESTREAMER_SINK_MP4,                 /* mp4:///path/name%05d.mp4, segmented MP4 files */
+    FIRESTREAMER_SINK_SHM                      /* shm:///socket, shmsink for local shmsrc readers */
+} FireStreamerSink_t;
+
+/* how captured frames reach the encoder */
+typedef enum {
+    FIRESTREAMER_MEMORY_SYSTEM = 0,                /* system memory (copy or wrapped mmap buffer) */
+    FIRESTREAMER_MEMORY_DMABUF                   /* exported dmabuf, encoder imports it (no copy) */
+} FireStreamerMemory_t;
+
+/* pixel format of the frames pushed to the FireStreamer */
+typedef enum {
+    FIRESTREAMER_FORMAT_YUY2 = 0,                                  /* pushed to the encoder as is */
+    FIRESTREAMER_FORMAT_SRGGB8                                  /* raw Bayer, demosaiced to YUY2 */
+} FireStreamerFormat_t;
+
+/* h.264 encoder backend */
+typedef enum {
+    FIRESTREAMER_ENCODER_AUTO = 0,        /* first installed of v4l2h264enc, x264enc, openh264enc */
+    FIRESTREAMER_ENCODER_V4L2,                                   /* v4l2h264enc, hardware (Pi) */
+    FIRESTREAMER_ENCODER_X264,                                                         /* x264enc */
+    FIRESTREAMER_ENCODER_OPENH264,                                                 /* openh264enc */
+    FIRESTREAMER_ENCODER_COUNT
+} FireStreamerEncoder_t;
+
+/* h.264 profile of the stream */
+typedef enum {
+    FIRESTREAMER_PROFILE_BASELINE = 0,                                    /* constrained-baseline */
+    FIRESTREAMER_PROFILE_MAIN,
+    FIRESTREAMER_PROFILE_HIGH,
+    FIRESTREAMER_PROFILE_COUNT
+} FireStreamerProfile_t;
+
+/* encoder rate control */
+typedef enum {
+    FIRESTREAMER_RATECONTROL_CBR = 0,                                         /* constant bitrate */
+    FIRESTREAMER_RATECONTROL_VBR,                               /* quality target, bitrate capped */
+    FIRESTREAMER_RATECONTROL_CQP                                    /* constant quantizer, no cap */
+} FireStreamerRateControl_t;
+
+/* what happens to a pushed frame when the push queue is full */
+typedef enum {
+    FIRESTREAMER_OVERFLOW_DROP_OLDEST = 0,           /* drop the oldest queued frame, low latency */
+    FIRESTREAMER_OVERFLOW_DROP_NEWEST,                             /* drop the frame being pushed */
+    FIRESTREAMER_OVERFLOW_BLOCK                  /* pushFrame() waits until the queue has space */
+} FireStreamerOverflow_t;
+
+/* what the FireStreamer does while the appsrc reports back-pressure (enough-data) */
+typedef enum {
+    FIRESTREAMER_BACKPRESSURE_DECIMATE = 0,     /* evenly halve the frame rate step by step, 2^-n */
+    FIRESTREAMER_BACKPRESSURE_GATE                /* skip every frame until need-data fires again */
+} FireStreamerBackpressure_t;
+
+/* latency profile, one consistent set of output queue, appsrc, sink and GOP settings */
+typedef enum {
+    FIRESTREAMER_LATENCY_CUSTOM = 0,               /* outputQueue, gop and the sink of the config */
+    FIRESTREAMER_LATENCY_ULTRA_LOW,                /* shallow queues, UDP, short GOP, drops first */
+    FIRESTREAMER_LATENCY_BALANCED,                                    /* some slack, TCP, 1 s GOP */
+    FIRESTREAMER_LATENCY_RESILIENT,          /* deep queues, TCP, long GOP, waits before dropping */
+    FIRESTREAMER_LATENCY_COUNT
+} FireStreamerLatencyProfile_t;
+
+/* RTP transport of RTSP outputs */
+typedef enum {
+    FIRESTREAMER_TRANSPORT_TCP = 0,                            /* interleaved in the RTSP session */
+    FIRESTREAMER_TRANSPORT_UDP                                         /* no retransmission delay */
+} FireStreamerTransport_t;
+
+#define FIRESTREAMER_DECIMATION_MAX 3                     /* 1 of 8 frames kept at most, 30->3.75 */
+#define FIRESTREAMER_MOTION_BLOCKS_X 16                          /* motion detector grid, columns */
+#define FIRESTREAMER_MOTION_BLOCKS_Y 12
+
+/* push queue counters, see FireStreamer_getQueueStats() */
+typedef struct FireStreamerQueueStatsTag {
+    uint32_t                enqueued;                         /* frames taken by the push queue */
+    uint32_t                pushed;                              /* frames accepted by the appsrc */
+    uint32_t                dropped;                     /* frames dropped by the overflow policy */
+    uint32_t                skipped;                 /* frames skipped because of back-pressure */
+    uint32_t                sensorDropped;           /* frames missing in the capture sequence */
+    uint32_t                ptsClamped;             /* timestamps moved forward to stay monotonic */
+} FireStreamerQueueStats_t;
+
+/* adaptive bitrate state and the last RTCP receiver report, see FireStreamer_getAbrStats() */
+typedef struct FireStreamerAbrStatsTag {
+    uint32_t                bitrate;                            /* current encoder target, kbit/s */
+    uint32_t                decimation;           /* frame rate floor, 1 of 2^decimation frames */
+    uint32_t                fractionLost;                        /* 0..255, of the last report */
+    uint32_t                jitter;                                                       /* us */
+    uint32_t                rtt;                                                          /* ms */
+    uint32_t                reports;                                 /* receiver reports handled */
+    uint32_t                decreases;                                   /* bitrate or rate cuts */
+    uint32_t                increases;
+} FireStreamerAbrStats_t;
+
+/* motion detector state, see FireStreamer_getMotion() */
+typedef struct FireStreamerMotionTag {
+    bool_t                  moving;                  /* the last compared frame had active blocks */
+    uint32_t                activeBlocks;             /* of the last frame, at or above threshold */
+    uint32_t                skipped;                /* static frames not encoded, only ever grows */
+    uint8_t                 scores[FIRESTREAMER_MOTION_BLOCKS_X * FIRESTREAMER_MOTION_BLOCKS_Y];
+} FireStreamerMotion_t;
+
+/* a substream scaled from the frames of the main stream, encoded by its own pipeline */
+typedef struct FireStreamerRenditionTag {
+    const char             *url;                                   /* own stream, NULL = not used */
+    uint32_t                scale;                  /* 2 or 4, width and height are divided by it */
+    uint32_t                bitrate;                      /* kbit/s, 0 = main bitrate by the area */
+    uint32_t                gop;                                   /* 0 = same as the main stream */
+    FireStreamerEncoder_t   encoder;
+    FireStreamerProfile_t   profile;
+} FireStreamerRendition_t;
+
+/* traced pipeline stages, each one ends where the next one starts */
+typedef enum {
+    FIRESTREAMER_STAGE_CAPTURE = 0,                   /* VIDIOC_DQBUF -> FireStreamer_pushFrame() */
+    FIRESTREAMER_STAGE_CONVERT,                    /* demosaic/copy/wrap -> queued for the appsrc */
+    FIRESTREAMER_STAGE_QUEUE,                              /* push queue and appsrc -> appsrc src */
+    FIRESTREAMER_STAGE_ENCODE,                             /* (videoconvert) and encoder -> h.264 */
+    FIRESTREAMER_STAGE_SEND,                         /* encoder queue -> handed to the video sink */
+    FIRESTREAMER_STAGE_TOTAL,                                   /* VIDIOC_DQBUF -> video sink */
+    FIRESTREAMER_STAGE_COUNT
+} FireStreamerStage_t;
+
+/* latency distribution of one stage, in us */
+typedef struct FireStreamerLatencyTag {
+    uint32_t                count;                                               /* frames traced */
+    uint32_t                p50;
+    uint32_t                p99;
+    uint32_t                max;
+} FireStreamerLatency_t;
+
+/* measured while a latency profile was in use, see FireStreamer_getProfileStats() */
+typedef struct FireStreamerProfileStatsTag {
+    FireStreamerLatency_t   latency;                                /* VIDIOC_DQBUF -> video sink */
+    uint32_t                activeMs;                              /* time the profile was in use */
+    uint64_t                appsrcBytes;                         /* high-water mark of the appsrc */
+    uint64_t                queueBytes;                  /* high-water mark of the fullest output */
+} FireStreamerProfileStats_t;
+
+/* latency and throughput counters since create, see FireStreamer_getStats() */
+typedef struct FireStreamerStatsTag {
+    FireStreamerLatency_t   latency[FIRESTREAMER_STAGE_COUNT];
+    uint32_t                framesPushed;                           /* frames taken by push calls */
+    uint32_t                framesEncoded;                     /* h.264 frames out of the encoder */
+    uint64_t                bytesEncoded;
+    uint32_t                framesSent;                       /* h.264 frames into the video sink */
+    uint32_t                reconnects;                 /* RTSP outputs connected after an outage */
+    uint32_t                readyUs;               /* create() to the ready callback, 0 = not yet */
+    uint32_t                firstFrameUs;      /* create() to the first frame into the video sink */
+} FireStreamerStats_t;
+
+/* FireStreamer configuration, start from FireStreamer_getDefaultConfig() */
+typedef struct FireStreamerConfigTag {
+    /* stream parameters */
+    const char             *url;                        /* see FireStreamerSink_t for the schemes */
+    const char             *username;                                                /* optional */
+    const char             *password;                                                /* optional */
+    /* video parameters */
+    uint32_t                width;                                      /* size of pushed frames */
+    uint32_t                height;
+    uint32_t                stride;                        /* bytes per line, 0 for packed frames */
+    FireStreamerFormat_t    format;
+    bool_t                  binning;             /* SRGGB8 only, 2x2 binning to half resolution */
+    bool_t                  grayscale;                              /* convert video to grayscale */
+    uint32_t                fps;                                 /* frame rate of pushed frames */
+    uint32_t                quality;                   /* 0..100, quantizer for VBR and CQP modes */
+    /* encoder */
+    FireStreamerEncoder_t   encoder;
+    uint32_t                bitrate;                                           /* kbit/s, CBR/VBR */
+    uint32_t                gop;                                     /* frames between key frames */
+    FireStreamerProfile_t   profile;
+    FireStreamerRateControl_t rateControl;
+    bool_t                  zeroLatency;                /* no look-ahead, no frame reordering */
+    /* adaptive bitrate, CBR and VBR only */
+    bool_t                  abr;                   /* follow RTCP receiver reports at runtime */
+    uint32_t                minBitrate;                   /* kbit/s, frame rate is cut below it */
+    uint32_t                maxBitrate;                                                 /* kbit/s */
+    FireStreamerMemory_t    memory;        /* DMABUF falls back to SYSTEM if encoder can't import */
+    /* copy path */
+    uint32_t                poolBuffers;        /* preallocated frame buffers used by pushFrame() */
+    /* push queue between the capture thread and the push thread */
+    uint32_t                queueSize;                                  /* frames, 2^n up to 64 */
+    FireStreamerOverflow_t  overflow;
+    FireStreamerBackpressure_t backpressure;
+    bool_t                  tracing;          /* per stage latency histograms, see getStats() */
+    /* outputs, see FireStreamer_addOutput() */
+    uint32_t                outputQueue;      /* h.264 frames buffered per output, oldest dropped */
+    uint32_t                segmentSeconds;                            /* length of MP4 segments */
+    uint32_t                sinkLatencyMs;                        /* RTSP outputs, rtpbin latency */
+    FireStreamerTransport_t transport;                                            /* RTSP outputs */
+    FireStreamerLatencyProfile_t latencyProfile;     /* others override outputQueue, gop and sink */
+    /* pre-event recording, see FireStreamer_triggerRecording() */
+    uint32_t                prebufferSeconds;          /* encoded seconds kept in memory, 0 = off */
+    uint32_t                prebufferSize;               /* KiB, 0 = sized for the max bitrate */
+    /* motion gating, system memory frames only, see FireStreamer_getMotion() */
+    bool_t                  motion;                       /* encode static scenes at idleFps only */
+    uint32_t                motionThreshold;          /* block score 1..255 that counts as motion */
+    uint32_t                motionHoldMs;      /* full frame rate this long after the last motion */
+    uint32_t                idleFps;                      /* keep-alive frame rate without motion */
+    /* simulcast, system memory frames only, see FireStreamer_getRendition() */
+    FireStreamerRendition_t renditions[FIRESTREAMER_MAX_RENDITIONS];
+    /* JPEG snapshots of the raw frames, see FireStreamer_getSnapshot() */
+    uint32_t                snapshotTtlMs;         /* a JPEG is served again this long, 0 = never */
+    /* live stats in POSIX shared memory, one slot per FireStreamer, see statsshm.h */
+    uint32_t                statsIntervalMs;                  /* period of the stats block writes */
+    /* startup, create() returns before the pipeline runs */
+    FireStreamer_ready_t    ready;                                                   /* optional */
+    void                   *pReadyData;
+    /* GStreamer initialization, taken from the first FireStreamer of the process only */
+    bool_t                  updateRegistry;        /* forced plugin rescan, slow, off by default */
+    const char             *registry;    /* prebuilt registry cache, used without checks, or NULL */
+    const char             *statsName;           /* stats segment, e.g. /firestreamer, NULL = off */
+} FireStreamerConfig_t;
+
+/* Fire Streamer - API, all FireStreamer objects share one GStreamer instance and bus thread */
+void FireStreamer_getDefaultConfig(FireStreamerConfig_t *pConfig);
+FireStreamer_t* FireStreamer_create(const FireStreamerConfig_t *pConfig);
+void FireStreamer_destroy(FireStreamer_t *pThis);
+uint32_t FireStreamer_pushFrame(FireStreamer_t *pThis, void *pData, uint32_t size,
+                                const FireStreamerFrameInfo_t *pInfo);
+uint32_t FireStreamer_pushFrameZeroCopy(FireStreamer_t *pThis, void *pData, uint32_t size,
+                                        FireStreamer_releaseFrame_t releaseFrame, void *pUserData,
+                                        const FireStreamerFrameInfo_t *pInfo);
+uint32_t FireStreamer_pushFrameDmabuf(FireStreamer_t *pThis, int dmabufFd, uint32_t size,
+                                      FireStreamer_releaseFrame_t releaseFrame, void *pUserData,
+                                      const FireStreamerFrameInfo_t *pInfo);
+uint32_t FireStreamer_getPoolExhaustedCount(FireStreamer_t *pThis);
+void FireStreamer_getQueueStats(FireStreamer_t *pThis, FireStreamerQueueStats_t *pStats);
+uint32_t FireStreamer_getDecimationLevel(FireStreamer_t *pThis);
+void FireStreamer_getAbrStats(FireStreamer_t *pThis, FireStreamerAbrStats_t *pStats);
+void FireStreamer_getStats(FireStreamer_t *pThis, FireStreamerStats_t *pStats);
+bool_t FireStreamer_triggerRecording(FireStreamer_t *pThis, const char *pPath,
+                                     uint32_t postSeconds);
+int32_t FireStreamer_addOutput(FireStreamer_t *pThis, const char *pUrl);
+bool_t FireStreamer_removeOutput(FireStreamer_t *pThis, int32_t output);
+void FireStreamer_getMotion(FireStreamer_t *pThis, FireStreamerMotion_t *pMotion);
+FireStreamer_t* FireStreamer_getRendition(FireStreamer_t *pThis, uint32_t rendition);
+void FireStreamer_setLatencyProfile(FireStreamer_t *pThis, FireStreamerLatencyProfile_t profile);
+FireStreamerLatencyProfile_t FireStreamer_getLatencyProfile(FireStreamer_t *pThis);
+void FireStreamer_getProfileStats(FireStreamer_t *pThis, FireStreamerLatencyProfile_t profile,
+                                  FireStreamerProfileStats_t *pStats);
+uint32_t FireStreamer_getSnapshot(FireStreamer_t *pThis, uint32_t width, uint32_t height,
+                                  uint32_t quality, void *pJpeg, uint32_t maxSize);
 
 
 #endif                                                                         /* FIRE_STREAMER_H */
@@ -0,0 +1,170 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     framering.c
+* \ingroup  g_applspec
+* \brief    Implementation of the FrameRing class, lock-free single producer single consumer queue.
+* \author   Milos Ladicorbic
+*
+* The capture thread pushes, the FireStreamer push thread pops. Indices are free running 32 bit
+* counters, the slot is index & mask. Dropping the oldest entry makes the producer consume too, so
+* both sides advance tail with a CAS: whoever wins the CAS owns the entry, the loser retries. The
+* semaphores are only touched to sleep and wake up, the fast path takes no lock.
+*/
+
+#include "framering.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+
+bool_t FrameRing_initialize (FrameRing_t *pThis, uint32_t size, FrameRingPolicy_t policy,
+                             FrameRing_dropEntry_t dropEntry) {
+    uint32_t i;
+
+    assert(pThis != NULL);
+    assert(dropEntry != NULL);
+
+    if ((size < 2) || (size > FRAMERING_MAX_SIZE) || ((size & (size - 1)) != 0)) {
+        return FALSE;                                          /* size must be 2^n, see the mask */
+    }
+
+    atomic_init(&pThis->head, 0);
+    atomic_init(&pThis->tail, 0);
+    for (i = 0; i < FRAMERING_MAX_SIZE; i++) {
+        atomic_init(&pThis->slots[i], NULL);
+    }
+    pThis->mask = size - 1;
+    pThis->policy = policy;
+    pThis->dropEntry = dropEntry;
+    atomic_init(&pThis->closed, FALSE);
+    atomic_init(&pThis->enqueued, 0);
+    atomic_init(&pThis->dequeued, 0);
+    atomic_init(&pThis->dropped, 0);
+    if (sem_init(&pThis->items, 0, 0) != 0) {
+        return FALSE;
+    }
+    if (sem_init(&pThis->spaces, 0, 0) != 0) {
+        sem_destroy(&pThis->items);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void FrameRing_destroy (FrameRing_t *pThis) {
+    void *pEntry;
+
+    assert(pThis != NULL);
+
+    /* no producer and no consumer any more, give back what is still queued */
+    while ((pEntry = FrameRing_pop(pThis)) != NULL) {
+        pThis->dropEntry(pEntry);
+    }
+    sem_destroy(&pThis->items);
+    sem_destroy(&pThis->spaces);
+}
+
+bool_t FrameRing_push (FrameRing_t *pThis, void *pEntry) {
+    uint32_t head = atomic_load_explicit(&pThis->head, memory_order_relaxed); /* only we write it */
+    uint32_t tail;
+    void *pOldest;
+
+    assert(pEntry != NULL);
+
+    tail = atomic_load_explicit(&pThis->tail, memory_order_acquire);
+    while (head - tail > pThis->mask) {                                                   /* full */
+        if (pThis->policy == FRAMERING_POLICY_DROP_NEWEST) {
+            atomic_fetch_add_explicit(&pThis->dropped, 1, memory_order_relaxed);
+            pThis->dropEntry(pEntry);
+            return FALSE;
+        }
+        if (pThis->policy == FRAMERING_POLICY_DROP_OLDEST) {
+            /* race the consumer for the oldest entry, a failed CAS reloads tail */
+            pOldest = atomic_load_explicit(&pThis->slots[tail & pThis->mask], memory_order_relaxed);
+            if (atomic_compare_exchange_strong_explicit(&pThis->tail, &tail, tail + 1,
+                                                        memory_order_acq_rel,
+                                                        memory_order_acquire)) {
+                atomic_fetch_add_explicit(&pThis->dropped, 1, memory_order_relaxed);
+                pThis->dropEntry(pOldest);
+                tail++;
+            }
+            continue;
+        }
+        /* FRAMERING_POLICY_BLOCK */
+        if (atomic_load_explicit(&pThis->closed, memory_order_acquire) == TRUE) {
+            atomic_fetch_add_explicit(&pThis->dropped, 1, memory_order_relaxed);
+            pThis->dropEntry(pEntry);
+            return FALSE;
+        }
+        sem_wait(&pThis->spaces);
+        tail = atomic_load_explicit(&pThis->tail, memory_order_acquire);
+    }
+
+    atomic_store_explicit(&pThis->slots[head & pThis->mask], pEntry, memory_order_relaxed);
+    atomic_store_explicit(&pThis->head, head + 1, memory_order_release);         /* publish entry */
+    atomic_fetch_add_explicit(&pThis->enqueued, 1, memory_order_relaxed);
+    sem_post(&pThis->items);
+
+    return TRUE;
+}
+
+void* FrameRing_pop (FrameRing_t *pThis) {
+    uint32_t tail = atomic_load_explicit(&pThis->tail, memory_order_acquire);
+    uint32_t head;
+    void *pEntry;
+
+    for (;;) {
+        head = atomic_load_explicit(&pThis->head, memory_order_acquire);
+        if (head == tail) {
+            return NULL;                                                                 /* empty */
+        }
+        /* the slot may be rewritten once the producer dropped it, then the CAS below fails */
+        pEntry = atomic_load_explicit(&pThis->slots[tail & pThis->mask], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&pThis->tail, &tail, tail + 1,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            break;
+        }
+    }
+    atomic_fetch_add_explicit(&pThis->dequeued, 1, memory_order_relaxed);
+    if (pThis->policy == FRAMERING_POLICY_BLOCK) {
+        sem_post(&pThis->spaces);
+    }
+
+    return pEntry;
+}
+
+void* FrameRing_wait (FrameRing_t *pThis) {
+    void *pEntry;
+
+    /* items counts pushes, entries dropped by the producer leave extra posts: just try again */
+    for (;;) {
+        pEntry = FrameRing_pop(pThis);
+        if (pEntry != NULL) {
+            return pEntry;
+        }
+        if (atomic_load_explicit(&pThis->closed, memory_order_acquire) == TRUE) {
+            return NULL;
+        }
+        sem_wait(&pThis->items);
+    }
+}
+
+void FrameRing_close (FrameRing_t *pThis) {
+
+    atomic_store_explicit(&pThis->closed, TRUE, memory_order_release);
+    sem_post(&pThis->items);                                         /* wake up FrameRing_wait() */
+    sem_post(&pThis->spaces);                                    /* wake up a blocked producer */
+}
+
+void FrameRing_getStats (FrameRing_t *pThis, FrameRingStats_t *pStats) {
+
+    assert(pThis != NULL && pStats != NULL);
+
+    pStats->enqueued = atomic_load_explicit(&pThis->enqueued, memory_order_relaxed);
+    pStats->dequeued = atomic_load_explicit(&pThis->dequeued, memory_order_relaxed);
+    pStats->dropped = atomic_load_explicit(&pThis->dropped, memory_order_relaxed);
+}
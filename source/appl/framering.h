@@ -0,0 +1,75 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+/**
+* \file     framering.h
+* \ingroup  g_applspec
+* \brief    API for the FrameRing class, lock-free single producer single consumer frame queue.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include "firestreamer.h"                                                               /* bool_t */
+
+#define FRAMERING_MAX_SIZE      64          /* NOTE: entries are stored inline, no dynamic memory */
+#define FRAMERING_CACHE_LINE    64
+
+/* what FrameRing_push() does when the ring is full */
+typedef enum {
+    FRAMERING_POLICY_DROP_OLDEST = 0,               /* drop the oldest queued entry, keep latency */
+    FRAMERING_POLICY_DROP_NEWEST,                               /* drop the entry being pushed */
+    FRAMERING_POLICY_BLOCK                                /* wait for the consumer to make space */
+} FrameRingPolicy_t;
+
+/* called for every entry dropped by the ring, from the thread that dropped it */
+typedef void (*FrameRing_dropEntry_t)(void *pEntry);
+
+/* FrameRing counters, every one of them only grows */
+typedef struct FrameRingStatsTag {
+    uint32_t                enqueued;                                   /* entries taken by push */
+    uint32_t                dequeued;                                  /* entries returned by pop */
+    uint32_t                dropped;                    /* entries dropped by the overflow policy */
+} FrameRingStats_t;
+
+/* the FrameRing object's data structure, embedded by the owner. head is written only by the
+ * producer, tail by the consumer and by the producer dropping the oldest entry (CAS) */
+typedef struct FrameRingTag {
+    _Alignas(FRAMERING_CACHE_LINE) _Atomic uint32_t head;                      /* next to write */
+    _Alignas(FRAMERING_CACHE_LINE) _Atomic uint32_t tail;                       /* next to read */
+    _Alignas(FRAMERING_CACHE_LINE) void * _Atomic slots[FRAMERING_MAX_SIZE];
+    uint32_t                mask;                                    /* size - 1, size is 2^n */
+    FrameRingPolicy_t       policy;
+    FrameRing_dropEntry_t   dropEntry;
+    _Atomic bool_t          closed;                               /* consumer wakes up and quits */
+    sem_t                   items;                     /* posted on push, consumer sleeps on it */
+    sem_t                   spaces;                /* posted on pop, BLOCK producer sleeps on it */
+    _Atomic uint32_t        enqueued;
+    _Atomic uint32_t        dequeued;
+    _Atomic uint32_t        dropped;
+} FrameRing_t;
+
+/* FrameRing - API */
+bool_t FrameRing_initialize(FrameRing_t *pThis, uint32_t size, FrameRingPolicy_t policy,
+                            FrameRing_dropEntry_t dropEntry);
+void FrameRing_destroy(FrameRing_t *pThis);
+bool_t FrameRing_push(FrameRing_t *pThis, void *pEntry);
+void* FrameRing_pop(FrameRing_t *pThis);
+void* FrameRing_wait(FrameRing_t *pThis);
+void FrameRing_close(FrameRing_t *pThis);
+void FrameRing_getStats(FrameRing_t *pThis, FrameRingStats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                           /* FRAME_RING_H */
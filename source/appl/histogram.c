@@ -0,0 +1,124 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     histogram.c
+* \ingroup  g_applspec
+* \brief    Implementation of the Histogram class, lock-free log-linear histogram.
+* \author   Milos Ladicorbic
+*
+* Values below 2^SUB_BITS get a bucket each, above that every power of two is split into 2^SUB_BITS
+* equal buckets, so the error of a percentile is at most 1/2^SUB_BITS of the value. Recording is a
+* couple of shifts and one relaxed atomic add, cheap enough to stay on in production.
+*/
+
+#include "histogram.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+/* private function declarations */
+static uint32_t Histogram_getIndex__(uint32_t value);
+static uint32_t Histogram_getValue__(uint32_t index);
+
+
+void Histogram_reset (Histogram_t *pThis) {
+    uint32_t i;
+
+    assert(pThis != NULL);
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        atomic_store_explicit(&pThis->buckets[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&pThis->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&pThis->max, 0, memory_order_relaxed);
+}
+
+void Histogram_record (Histogram_t *pThis, uint32_t value) {
+    uint32_t max;
+
+    if (value > HISTOGRAM_MAX_VALUE) {
+        value = HISTOGRAM_MAX_VALUE;
+    }
+    atomic_fetch_add_explicit(&pThis->buckets[Histogram_getIndex__(value)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&pThis->count, 1, memory_order_relaxed);
+    max = atomic_load_explicit(&pThis->max, memory_order_relaxed);
+    while ((value > max) &&
+           !atomic_compare_exchange_weak_explicit(&pThis->max, &max, value, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+        /* another recording thread raised it meanwhile, max was reloaded */
+    }
+}
+
+uint32_t Histogram_getCount (Histogram_t *pThis) {
+
+    assert(pThis != NULL);
+    return atomic_load_explicit(&pThis->count, memory_order_relaxed);
+}
+
+uint32_t Histogram_getMax (Histogram_t *pThis) {
+
+    assert(pThis != NULL);
+    return atomic_load_explicit(&pThis->max, memory_order_relaxed);
+}
+
+uint32_t Histogram_getPercentile (Histogram_t *pThis, uint32_t percent) {
+    uint64_t rank;
+    uint64_t seen = 0;
+    uint32_t count;
+    uint32_t value;
+    uint32_t max;
+    uint32_t i;
+
+    assert(pThis != NULL);
+    assert(percent <= 100);
+
+    /* the buckets keep changing while we read them, the count is only the target rank */
+    count = atomic_load_explicit(&pThis->count, memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+    rank = ((uint64_t)count * percent + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += atomic_load_explicit(&pThis->buckets[i], memory_order_relaxed);
+        if (seen >= rank) {
+            break;
+        }
+    }
+    value = Histogram_getValue__(i);
+    max = Histogram_getMax(pThis);
+
+    return (value < max) ? value : max;
+}
+
+
+/* private function definition */
+static uint32_t Histogram_getIndex__ (uint32_t value) {
+    uint32_t msb;
+
+    if (value < (1u << HISTOGRAM_SUB_BITS)) {
+        return value;
+    }
+    msb = 31 - (uint32_t)__builtin_clz(value);
+    return ((msb - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+           ((value >> (msb - HISTOGRAM_SUB_BITS)) & ((1u << HISTOGRAM_SUB_BITS) - 1));
+}
+
+static uint32_t Histogram_getValue__ (uint32_t index) {
+    uint32_t shift;
+    uint32_t lower;
+
+    if (index < (1u << HISTOGRAM_SUB_BITS)) {
+        return index;
+    }
+    /* middle of the bucket, the inverse of Histogram_getIndex__() */
+    shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    lower = ((1u << HISTOGRAM_SUB_BITS) + (index & ((1u << HISTOGRAM_SUB_BITS) - 1))) << shift;
+    return lower + ((1u << shift) >> 1);
+}
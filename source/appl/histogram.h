@@ -0,0 +1,45 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/**
+* \file     histogram.h
+* \ingroup  g_applspec
+* \brief    API for the Histogram class, lock-free log-linear histogram of microsecond values.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HISTOGRAM_SUB_BITS      3                      /* 8 buckets per power of two, 12.5 % wide */
+#define HISTOGRAM_MAX_VALUE     ((1u << 26) - 1)            /* ~67 s, larger values are clamped */
+#define HISTOGRAM_BUCKETS       ((26 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/* the Histogram object's data structure, embedded by the owner. Any thread records or reads, the
+ * buckets are stored inline */
+typedef struct HistogramTag {
+    _Atomic uint32_t        buckets[HISTOGRAM_BUCKETS];
+    _Atomic uint32_t        count;
+    _Atomic uint32_t        max;
+} Histogram_t;
+
+/* Histogram - API */
+void Histogram_reset(Histogram_t *pThis);
+void Histogram_record(Histogram_t *pThis, uint32_t value);
+uint32_t Histogram_getCount(Histogram_t *pThis);
+uint32_t Histogram_getMax(Histogram_t *pThis);
+uint32_t Histogram_getPercentile(Histogram_t *pThis, uint32_t percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                             /* HISTOGRAM_H */
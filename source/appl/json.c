@@ -0,0 +1,36 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     json.c
+* \ingroup  g_applspec
+* \brief    Implementation of the JSON output helpers.
+* \author   Milos Ladicorbic
+*
+* Names and urls come from the command line or from another process and may hold any byte but
+* NUL, they are quoted and escaped so that the line stays one valid JSON value.
+*/
+
+#include "json.h"
+
+#include <assert.h>
+
+
+void Json_printString (FILE *pFile, const char *pText) {
+
+    assert(pFile != NULL && pText != NULL);
+
+    fputc('"', pFile);
+    for (; *pText != '\0'; pText++) {
+        if ((*pText == '"') || (*pText == '\\')) {
+            fprintf(pFile, "\\%c", *pText);
+        } else if ((unsigned char)*pText < 0x20) {
+            fprintf(pFile, "\\u%04x", (unsigned char)*pText);
+        } else {
+            fputc(*pText, pFile);
+        }
+    }
+    fputc('"', pFile);
+}
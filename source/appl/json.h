@@ -0,0 +1,28 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef JSON_H
+#define JSON_H
+
+/**
+* \file     json.h
+* \ingroup  g_applspec
+* \brief    API of the JSON output helpers shared by the tools and the benchmarks.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+/* Json - API */
+void Json_printString(FILE *pFile, const char *pText);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                                  /* JSON_H */
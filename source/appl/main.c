@@ -9,179 +9,559 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <sys/ioctl.h>
-#include <sys/types.h>
-#include <sys/time.h>
-#include <sys/mman.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 #include <linux/videodev2.h>
-#include "libv4l2.h"
 
 #include "firestreamer.h"
+#include "capture.h"
+#include "threads.h"
+
+#define CAPTURE_BUFFERS     6  /* mmap buffers, some of them are held by the pipeline (zero-copy) */
+#define SEGMENT_SECONDS     60                                   /* length of mp4:// segments */
+#define STATS_NAME          "/firestreamer"                      /* live stats segment, fstr-stat */
+#define STATS_FRAMES        25                                  /* -v prints the stats this often */
+
+/* how frames are handed to the FireStreamer */
+typedef enum {
+    PUSH_COPY = 0,                                      /* copy frame, re-queue buffer right away */
+    PUSH_ZEROCOPY,                                    /* wrap mmap buffer, re-queue once released */
+    PUSH_DMABUF                                /* export buffer as dmabuf, fall back to ZEROCOPY */
+} pushMode_t;
+
+/* one capture device and the FireStreamer it feeds */
+typedef struct {
+    const char          *devName;
+    char                url[256];
+    CaptureDevice_t     *pCapture;
+    FireStreamer_t      *pStreamer;
+    CaptureFormat_t     format;
+    pushMode_t          pushMode;
+    uint32_t            frames;
+    uint32_t            index;
+    sig_atomic_t        triggers;                            /* recordings triggered so far */
+    sig_atomic_t        profileSwitches;                        /* latency profile changes so far */
+} stream_t;
+
+static stream_t         l_streams[CAPTURE_MAX_DEVICES];
+static volatile sig_atomic_t l_triggers;                               /* SIGUSR1 count */
+static volatile sig_atomic_t l_profileSwitches;                                  /* SIGUSR2 count */
+static const char * const l_profileNames[FIRESTREAMER_LATENCY_COUNT] = {
+    "custom", "ultra-low-latency", "balanced", "resilient-uplink"
+};
+static uint32_t         l_recordSeconds;                      /* before and after the trigger */
+static bool_t           l_verbose;                           /* stats on stdout, off the hot path */
 
-#define CLEAR(x) memset(&(x), 0, sizeof(x))
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "  -d <device>    capture device (default /dev/video0), repeat for more devices\n"
+           "  -f <format>    camera pixel format: bayer (default, SRGGB8) or yuyv. Size and\n"
+           "                 frame rate are the ones the driver agrees on\n"
+           "  -e <encoder>   h.264 encoder: auto (default), v4l2h264enc, x264enc or openh264enc\n"
+           "  -r <kbit/s>    encoder start bitrate (default 2000)\n"
+           "  -a             fixed bitrate, don't adapt it to RTCP receiver reports\n"
+           "  -u <url>       RTSP server url, one per device. Devices without their own url\n"
+           "                 stream to the last one suffixed with -<device index>\n"
+           "  -m <mode>      frame push mode: copy, zerocopy (default) or dmabuf\n"
+           "  -n <count>     mmap buffers per device, 2..%d (default %d)\n"
+           "  -b             2x2 binning, stream Bayer frames at half resolution\n"
+           "  -q <policy>    full push queue: drop-oldest (default), drop-newest or block\n"
+           "  -p <seconds>   keep the last seconds of h.264, SIGUSR1 records them and as many\n"
+           "                 seconds after it to firestreamer<device index>-<time>.mp4\n"
+           "  -o <url>       extra output of the first device, encoded once: rtsp://...,\n"
+           "                 mp4:///path/name%%05d.mp4 (%u s segments) or shm:///socket.\n"
+           "                 Repeat for more, up to %d\n"
+           "  -c <file>      GStreamer registry cache, written by the first start and then used\n"
+           "                 without plugin checks\n"
+           "  -s <n>:<url>   substream of the first device scaled down by n (2 or 4) to <url>,\n"
+           "                 repeat for up to %d of them\n"
+           "  -t <role>:<cpus>[:fifo|rr:<priority>]\n"
+           "                 thread layout of a role: capture, push, bus or streaming. <cpus>\n"
+           "                 is a CPU bit mask (0x3 = CPU 0 and 1), fifo and rr need\n"
+           "                 CAP_SYS_NICE\n"
+           "  -g <score>     motion gating, static scenes are encoded at 1 fps. Blocks with a\n"
+           "                 mean frame difference of at least <score> (1..255, e.g. 12) move\n"
+           "  -l <profile>   latency profile: custom (default), ultra-low-latency, balanced or\n"
+           "                 resilient-uplink, SIGUSR2 switches to the next one\n"
+           "  -S <name>      live stats segment in /dev/shm read by fstr-stat (default %s),\n"
+           "                 none turns it off\n"
+           "  -v             print the stats of every device each %u frames\n"
+           "  -h             display this help and exit\n", name, CAPTURE_MAX_BUFFERS,
+           CAPTURE_BUFFERS, SEGMENT_SECONDS, FIRESTREAMER_MAX_OUTPUTS - 1,
+           FIRESTREAMER_MAX_RENDITIONS, STATS_NAME, STATS_FRAMES);
+}
 
-struct buffer {
-    void   *start;
-    size_t length;
-};
+/* -t <role>:<cpus>[:fifo|rr:<priority>] */
+static bool_t parseThreads(const char *pArg)
+{
+    ThreadsConfig_t     config;
+    ThreadsRole_t       role;
+    const char          *pRole;
+    char                *pEnd;
+    size_t              length;
+
+    memset(&config, 0, sizeof(config));
+    pEnd = strchr(pArg, ':');
+    if (pEnd == NULL) {
+        return FALSE;
+    }
+    length = (size_t)(pEnd - pArg);
+    for (role = THREADS_ROLE_CAPTURE; role < THREADS_ROLE_COUNT; role++) {
+        pRole = Threads_getRoleName(role);
+        if ((strlen(pRole) == length) && (strncmp(pArg, pRole, length) == 0)) {
+            break;
+        }
+    }
+    if (role == THREADS_ROLE_COUNT) {
+        return FALSE;
+    }
+    config.cpus = (uint32_t)strtoul(pEnd + 1, &pEnd, 0);
+    if (strncmp(pEnd, ":fifo:", 6) == 0) {
+        config.policy = THREADS_POLICY_FIFO;
+    } else if (strncmp(pEnd, ":rr:", 4) == 0) {
+        config.policy = THREADS_POLICY_RR;
+    } else if (*pEnd != '\0') {
+        return FALSE;
+    }
+    if (config.policy != THREADS_POLICY_OTHER) {
+        config.priority = (uint32_t)strtoul(strchr(pEnd + 1, ':') + 1, &pEnd, 10);
+        if ((*pEnd != '\0') || (config.priority < 1) || (config.priority > 99)) {
+            return FALSE;
+        }
+    }
+    Threads_configure(role, &config);
+    return TRUE;
+}
+
+/* pixel format the driver agreed on, as pushed to the streamer */
+static bool_t toStreamerFormat(uint32_t pixelFormat, FireStreamerFormat_t *pFormat)
+{
+    switch (pixelFormat) {
+        case V4L2_PIX_FMT_SRGGB8: *pFormat = FIRESTREAMER_FORMAT_SRGGB8; return TRUE;
+        case V4L2_PIX_FMT_YUYV: *pFormat = FIRESTREAMER_FORMAT_YUY2; return TRUE;
+        default: return FALSE;
+    }
+}
 
-static void xioctl(int fh, int request, void *arg)
+/* FireStreamer_ready_t, runs in a GStreamer thread */
+static void onReady(FireStreamer_t *pStreamer, void *pUserData)
 {
-    int r;
+    stream_t *pStream = pUserData;
+    UNUSED_ARGUMENT(pStreamer);
 
-    do {
-        r = v4l2_ioctl(fh, request, arg);
-    } while (r == -1 && ((errno == EINTR) || (errno == EAGAIN)));
+    printf("%s: streaming to '%s'\n", pStream->devName, pStream->url);
+}
 
-    if (r == -1) {
-        fprintf(stderr, "error %d, %s\n", errno, strerror(errno));
-        exit(EXIT_FAILURE);
+/* SIGINT/SIGTERM, capture stops and the streams are torn down in main() */
+static void onSignal(int sig)
+{
+    if (sig == SIGUSR1) {
+        l_triggers++;                                  /* recorded from the capture thread */
+    } else if (sig == SIGUSR2) {
+        l_profileSwitches++;                                  /* switched from the capture thread */
+    } else {
+        Capture_stop();
     }
 }
 
-int main(void) {
+static void printStats(stream_t *pStream, const CaptureFrame_t *pFrame)
+{
+    FireStreamerQueueStats_t        queueStats;
+    FireStreamerAbrStats_t          abrStats;
+    FireStreamerStats_t             stats;
+    FireStreamerMotion_t            motion;
+    FireStreamerProfileStats_t      profileStats;
+    FireStreamer_t                  *pRendition;
+    ThreadsStats_t                  threadsStats;
+    CaptureStats_t                  captureStats;
+    uint32_t                        i;
+
+    Capture_getStats(pStream->pCapture, &captureStats);
+    printf("%s: Read Frame %dx%d - id_%d, size_%d bytes!\n", pStream->devName,
+           pStream->format.width, pStream->format.height, pStream->frames, pFrame->size);
+    printf("Capture frames %u, errors %u, restarts %u\n", captureStats.frames, captureStats.errors,
+           captureStats.restarts);
+    FireStreamer_getQueueStats(pStream->pStreamer, &queueStats);
+    printf("Queue enqueued %u, pushed %u, dropped %u, skipped %u, decimation 1/%u, "
+           "sensor dropped %u, pts clamped %u\n",
+           queueStats.enqueued, queueStats.pushed, queueStats.dropped, queueStats.skipped,
+           1u << FireStreamer_getDecimationLevel(pStream->pStreamer), queueStats.sensorDropped,
+           queueStats.ptsClamped);
+    FireStreamer_getAbrStats(pStream->pStreamer, &abrStats);
+    printf("Abr %u kbit/s, 1/%u frames, loss %u/256, rtt %u ms, jitter %u us, %u reports\n",
+           abrStats.bitrate, 1u << abrStats.decimation, abrStats.fractionLost, abrStats.rtt,
+           abrStats.jitter, abrStats.reports);
+    FireStreamer_getStats(pStream->pStreamer, &stats);
+    printf("Latency p50/p99/max us: capture %u/%u/%u, convert %u/%u/%u, queue %u/%u/%u, "
+           "encode %u/%u/%u, send %u/%u/%u, total %u/%u/%u\n",
+           stats.latency[FIRESTREAMER_STAGE_CAPTURE].p50,
+           stats.latency[FIRESTREAMER_STAGE_CAPTURE].p99,
+           stats.latency[FIRESTREAMER_STAGE_CAPTURE].max,
+           stats.latency[FIRESTREAMER_STAGE_CONVERT].p50,
+           stats.latency[FIRESTREAMER_STAGE_CONVERT].p99,
+           stats.latency[FIRESTREAMER_STAGE_CONVERT].max,
+           stats.latency[FIRESTREAMER_STAGE_QUEUE].p50,
+           stats.latency[FIRESTREAMER_STAGE_QUEUE].p99,
+           stats.latency[FIRESTREAMER_STAGE_QUEUE].max,
+           stats.latency[FIRESTREAMER_STAGE_ENCODE].p50,
+           stats.latency[FIRESTREAMER_STAGE_ENCODE].p99,
+           stats.latency[FIRESTREAMER_STAGE_ENCODE].max,
+           stats.latency[FIRESTREAMER_STAGE_SEND].p50,
+           stats.latency[FIRESTREAMER_STAGE_SEND].p99,
+           stats.latency[FIRESTREAMER_STAGE_SEND].max,
+           stats.latency[FIRESTREAMER_STAGE_TOTAL].p50,
+           stats.latency[FIRESTREAMER_STAGE_TOTAL].p99,
+           stats.latency[FIRESTREAMER_STAGE_TOTAL].max);
+    printf("Frames pushed %u, encoded %u (%llu bytes), sent %u, reconnects %u, "
+           "ready %u ms, first frame %u ms\n",
+           stats.framesPushed, stats.framesEncoded, (unsigned long long)stats.bytesEncoded,
+           stats.framesSent, stats.reconnects, stats.readyUs / 1000, stats.firstFrameUs / 1000);
+    printf("Wake-up p50/p99/max us:");
+    for (i = 0; i < THREADS_ROLE_COUNT; i++) {
+        Threads_getStats((ThreadsRole_t)i, &threadsStats);
+        printf("%s %s %u/%u/%u (%u threads, %u refused)", (i == 0) ? "" : ",",
+               Threads_getRoleName((ThreadsRole_t)i), threadsStats.p50, threadsStats.p99,
+               threadsStats.max, threadsStats.threads, threadsStats.failures);
+    }
+    printf("\n");
+    for (i = 0; i < FIRESTREAMER_LATENCY_COUNT; i++) {
+        FireStreamer_getProfileStats(pStream->pStreamer, (FireStreamerLatencyProfile_t)i,
+                                     &profileStats);
+        if (profileStats.activeMs == 0) {
+            continue;
+        }
+        printf("Profile %s%s %u s, total p50/p99/max us %u/%u/%u, high-water appsrc %llu bytes, "
+               "output queue %llu bytes\n", l_profileNames[i],
+               (FireStreamer_getLatencyProfile(pStream->pStreamer) == i) ? " (in use)" : "",
+               profileStats.activeMs / 1000, profileStats.latency.p50, profileStats.latency.p99,
+               profileStats.latency.max, (unsigned long long)profileStats.appsrcBytes,
+               (unsigned long long)profileStats.queueBytes);
+    }
+    FireStreamer_getMotion(pStream->pStreamer, &motion);
+    printf("Motion %s, active blocks %u of %u, static frames skipped %u\n",
+           (motion.moving == TRUE) ? "yes" : "no", motion.activeBlocks,
+           FIRESTREAMER_MOTION_BLOCKS_X * FIRESTREAMER_MOTION_BLOCKS_Y, motion.skipped);
+    for (i = 0; i < FIRESTREAMER_MAX_RENDITIONS; i++) {
+        pRendition = FireStreamer_getRendition(pStream->pStreamer, i);
+        if (pRendition != NULL) {
+            FireStreamer_getStats(pRendition, &stats);
+            printf("Rendition %u encoded %u (%llu bytes), sent %u\n", i, stats.framesEncoded,
+                   (unsigned long long)stats.bytesEncoded, stats.framesSent);
+        }
+    }
+}
 
-    struct v4l2_format              fmt;
-    struct v4l2_buffer              buf;
-    struct v4l2_requestbuffers      req;
-    enum v4l2_buf_type              type;
-    fd_set                          fds;
-    struct timeval                  tv;
-    int                             r, fd = -1;
-    unsigned int                    i, n_buffers;
-    char                            *dev_name = "/dev/video0";
-    char                            out_name[256];
-    FILE                            *fout;
-    struct buffer                   *buffers;
-
-    fd = v4l2_open(dev_name, O_RDWR | O_NONBLOCK, 0);
-    if (fd < 0) {
-        perror("Cannot open device");
-        exit(EXIT_FAILURE);
-    }
-
-    CLEAR(fmt);
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-//    fmt.fmt.pix.width       = 384;
-//    fmt.fmt.pix.height      = 288;
-//    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
-//    fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-    fmt.fmt.pix.width       = 768;
-    fmt.fmt.pix.height      = 288;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_SRGGB8;
-    fmt.fmt.pix.field       = V4L2_FIELD_NONE;
-
-    fmt.fmt.pix.colorspace  = V4L2_COLORSPACE_RAW;
-    xioctl(fd, VIDIOC_S_FMT, &fmt);
-    if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_SRGGB8) {
-        printf("Libv4l didn't accept V4L2_PIX_FMT_SRGGB8 format. Can't proceed.\n");
-        exit(EXIT_FAILURE);
-    }
-    if ((fmt.fmt.pix.width != 384) || (fmt.fmt.pix.height != 288)) {
-        printf("Warning: driver is sending image at %dx%d\n", fmt.fmt.pix.width, fmt.fmt.pix.height);
-    }
-
-    CLEAR(req);
-    req.count = 2;
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-    xioctl(fd, VIDIOC_REQBUFS, &req);
-
-    buffers = calloc(req.count, sizeof(*buffers));
-    for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
-        CLEAR(buf);
-
-        buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory      = V4L2_MEMORY_MMAP;
-        buf.index       = n_buffers;
-
-        xioctl(fd, VIDIOC_QUERYBUF, &buf);
-
-        buffers[n_buffers].length = buf.length;
-        buffers[n_buffers].start = v4l2_mmap(NULL, buf.length,
-                      PROT_READ | PROT_WRITE, MAP_SHARED,
-                      fd, buf.m.offset);
-
-        if (MAP_FAILED == buffers[n_buffers].start) {
-                perror("mmap");
-                exit(EXIT_FAILURE);
-        }
-    }
-
-    for (i = 0; i < n_buffers; ++i) {
-        CLEAR(buf);
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-        xioctl(fd, VIDIOC_QBUF, &buf);
-    }
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
-    xioctl(fd, VIDIOC_STREAMON, &type);
-
-    FireStreamer_initialize("rtsps://185.241.214.38:8322/project001/firestream1", "p001fsw1",
-                            "p001fsw1234", 384, 288, TRUE);
-
-    for (i = 0; i < 5000; i++) {
-        do {
-                FD_ZERO(&fds);
-                FD_SET(fd, &fds);
-
-                /* Timeout. */
-                tv.tv_sec = 2;
-                tv.tv_usec = 0;
-
-                r = select(fd + 1, &fds, NULL, NULL, &tv);
-        } while ((r == -1 && (errno = EINTR)));
-        if (r == -1) {
-                perror("select");
-                return errno;
-        }
-
-        CLEAR(buf);
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        xioctl(fd, VIDIOC_DQBUF, &buf);
-
-        if (i % 25 == 0) {
-            printf("Read Frame %dx%d - id_%d, size_%d bytes!\n", fmt.fmt.pix.width, fmt.fmt.pix.height, i, buf.bytesused);
-        }
-
-        /* write ppm image */
-//        sprintf(out_name, "out%03d.ppm", i);
-//        fout = fopen(out_name, "w");
-//        if (!fout) {
-//                perror("Cannot open image");
-//                exit(EXIT_FAILURE);
-//        }
-//        fprintf(fout, "P6\n%d %d 255\n",
-//                fmt.fmt.pix.width, fmt.fmt.pix.height);
-//        fwrite(buffers[buf.index].start, buf.bytesused, 1, fout);
-//        fclose(fout);
+/* Capture_frame_t callback, runs in the capture thread for every frame of every device */
+static void onFrame(CaptureDevice_t *pDevice, const CaptureFrame_t *pFrame, void *pUserData)
+{
+    stream_t    *pStream = (stream_t*)pUserData;
+    uint32_t    nPushed = 0;
+    char        path[64];
+    FireStreamerLatencyProfile_t profile;
 
-        /* write RAW image */
-//        sprintf(out_name, "out%03d.raw", i);
-//        fout = fopen(out_name, "w");
-//        if (!fout) {
-//                perror("Cannot open image");
-//                exit(EXIT_FAILURE);
-//        }
-//        fwrite(buffers[buf.index].start, buf.bytesused, 1, fout);
-//        fclose(fout);
+    (void)pDevice;
 
-        FireStreamer_pushFrame(buffers[buf.index].start, buf.bytesused);
+    if ((l_recordSeconds > 0) && (pStream->triggers != l_triggers)) {
+        pStream->triggers = l_triggers;
+        snprintf(path, sizeof(path), "firestreamer%u-%ld.mp4", pStream->index, (long)time(NULL));
+        FireStreamer_triggerRecording(pStream->pStreamer, path, l_recordSeconds);
+    }
+    if (pStream->profileSwitches != l_profileSwitches) {
+        pStream->profileSwitches = l_profileSwitches;
+        profile = FireStreamer_getLatencyProfile(pStream->pStreamer);
+        profile = (FireStreamerLatencyProfile_t)((profile + 1) % FIRESTREAMER_LATENCY_COUNT);
+        FireStreamer_setLatencyProfile(pStream->pStreamer, profile);
+    }
 
-        xioctl(fd, VIDIOC_QBUF, &buf);
+    if ((l_verbose == TRUE) && (pStream->frames % STATS_FRAMES == 0)) {
+        printStats(pStream, pFrame);
+    }
+    pStream->frames++;
+
+    /* hand the buffer to the pipeline, it is re-queued in Capture_releaseFrame(). FireStreamer does
+     * not take dmabuf frames once the encoder failed to import them, use the mmap buffer then */
+    if ((pStream->pushMode == PUSH_DMABUF) && (pFrame->dmabufFd >= 0)) {
+        nPushed = FireStreamer_pushFrameDmabuf(pStream->pStreamer, pFrame->dmabufFd, pFrame->size,
+                                               Capture_releaseFrame, pFrame->pBuffer,
+                                               &pFrame->info);
     }
+    if ((pStream->pushMode != PUSH_COPY) && (nPushed == 0)) {
+        nPushed = FireStreamer_pushFrameZeroCopy(pStream->pStreamer, pFrame->pData, pFrame->size,
+                                                 Capture_releaseFrame, pFrame->pBuffer,
+                                                 &pFrame->info);
+    }
+    if (pStream->pushMode == PUSH_COPY) {
+        FireStreamer_pushFrame(pStream->pStreamer, pFrame->pData, pFrame->size, &pFrame->info);
+    }
+    if ((pStream->pushMode == PUSH_COPY) || (nPushed == 0)) {
+        Capture_releaseFrame(pFrame->pBuffer);           /* frame copied or skipped, re-queue now */
+    }
+}
 
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    xioctl(fd, VIDIOC_STREAMOFF, &type);
-    for (i = 0; i < n_buffers; ++i)
-            v4l2_munmap(buffers[i].start, buffers[i].length);
-    v4l2_close(fd);
+int main(int argc, char *argv[]) {
+
+    int                             opt;
+    unsigned int                    i, nDevices = 0, nUrls = 0, nOutputs = 0, nRenditions = 0;
+    const char                      *devNames[CAPTURE_MAX_DEVICES];
+    const char                      *urls[CAPTURE_MAX_DEVICES];
+    const char                      *outputs[FIRESTREAMER_MAX_OUTPUTS];
+    FireStreamerRendition_t         *pRendition;
+    char                            *pEnd;
+    pushMode_t                      pushMode = PUSH_ZEROCOPY;
+    FireStreamerConfig_t            config;
+    FireStreamerConfig_t            streamConfig;                         /* config of one device */
+    CaptureConfig_t                 captureConfig;
+    stream_t                        *pStream;
+    struct sigaction                action;
+    bool_t                          success = TRUE;
+
+    FireStreamer_getDefaultConfig(&config);
+    config.url = "rtsps://185.241.214.38:8322/project001/firestream1";
+    config.username = "p001fsw1";
+    config.password = "p001fsw1234";
+    config.grayscale = TRUE;
+
+    memset(&captureConfig, 0, sizeof(captureConfig));
+    captureConfig.width = 768;
+    captureConfig.height = 288;
+    captureConfig.pixelFormat = V4L2_PIX_FMT_SRGGB8;
+    captureConfig.buffers = CAPTURE_BUFFERS;
+
+    config.segmentSeconds = SEGMENT_SECONDS;
+    config.statsName = STATS_NAME;
+
+    while ((opt = getopt(argc, argv, "d:f:e:r:au:m:n:bq:p:o:s:c:t:g:l:S:vh")) != -1) {
+        switch (opt) {
+            case 'd':
+                if (nDevices == CAPTURE_MAX_DEVICES) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                devNames[nDevices++] = optarg;
+                break;
+            case 'e':
+                if (strcmp(optarg, "auto") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_AUTO;
+                } else if (strcmp(optarg, "v4l2h264enc") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_V4L2;
+                } else if (strcmp(optarg, "x264enc") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_X264;
+                } else if (strcmp(optarg, "openh264enc") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_OPENH264;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'r': config.bitrate = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'a': config.abr = FALSE; break;
+            case 'u':
+                if (nUrls == CAPTURE_MAX_DEVICES) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                urls[nUrls++] = optarg;
+                break;
+            case 'm':
+                if (strcmp(optarg, "copy") == 0) {
+                    pushMode = PUSH_COPY;
+                } else if (strcmp(optarg, "zerocopy") == 0) {
+                    pushMode = PUSH_ZEROCOPY;
+                } else if (strcmp(optarg, "dmabuf") == 0) {
+                    pushMode = PUSH_DMABUF;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                captureConfig.buffers = (uint32_t)strtoul(optarg, NULL, 10);
+                if ((captureConfig.buffers < 2) || (captureConfig.buffers > CAPTURE_MAX_BUFFERS)) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b': config.binning = TRUE; break;
+            case 'q':
+                if (strcmp(optarg, "drop-oldest") == 0) {
+                    config.overflow = FIRESTREAMER_OVERFLOW_DROP_OLDEST;
+                } else if (strcmp(optarg, "drop-newest") == 0) {
+                    config.overflow = FIRESTREAMER_OVERFLOW_DROP_NEWEST;
+                } else if (strcmp(optarg, "block") == 0) {
+                    config.overflow = FIRESTREAMER_OVERFLOW_BLOCK;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                l_recordSeconds = (uint32_t)strtoul(optarg, NULL, 10);
+                config.prebufferSeconds = l_recordSeconds;
+                break;
+            case 'o':
+                if (nOutputs == FIRESTREAMER_MAX_OUTPUTS - 1) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                outputs[nOutputs++] = optarg;
+                break;
+            case 's':
+                if (nRenditions == FIRESTREAMER_MAX_RENDITIONS) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                pRendition = &config.renditions[nRenditions++];
+                pRendition->scale = (uint32_t)strtoul(optarg, &pEnd, 10);
+                if (((pRendition->scale != 2) && (pRendition->scale != 4)) || (*pEnd != ':')) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                pRendition->url = pEnd + 1;        /* bitrate 0, the main one divided by the area */
+                break;
+            case 'c': config.registry = optarg; break;
+            case 't':
+                if (parseThreads(optarg) != TRUE) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'g':
+                config.motion = TRUE;
+                config.motionThreshold = (uint32_t)strtoul(optarg, NULL, 10);
+                if ((config.motionThreshold < 1) || (config.motionThreshold > 255)) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'f':
+                if (strcmp(optarg, "bayer") == 0) {
+                    captureConfig.pixelFormat = V4L2_PIX_FMT_SRGGB8;
+                } else if (strcmp(optarg, "yuyv") == 0) {
+                    captureConfig.pixelFormat = V4L2_PIX_FMT_YUYV;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                for (i = 0; i < FIRESTREAMER_LATENCY_COUNT; i++) {
+                    if (strcmp(optarg, l_profileNames[i]) == 0) {
+                        config.latencyProfile = (FireStreamerLatencyProfile_t)i;
+                        break;
+                    }
+                }
+                if (i == FIRESTREAMER_LATENCY_COUNT) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'S': config.statsName = (strcmp(optarg, "none") == 0) ? NULL : optarg; break;
+            case 'v': l_verbose = TRUE; break;
+            case 'h': usage(argv[0]); exit(EXIT_SUCCESS);
+            default: usage(argv[0]); exit(EXIT_FAILURE);
+        }
+    }
+    if (nDevices == 0) {
+        devNames[nDevices++] = "/dev/video0";
+    }
+    if (nUrls == 0) {
+        urls[nUrls++] = config.url;
+    }
+    captureConfig.dmabuf = (pushMode == PUSH_DMABUF) ? TRUE : FALSE;
+
+    for (i = 0; i < nDevices; i++) {
+        pStream = &l_streams[i];
+        pStream->devName = devNames[i];
+        pStream->index = i;
+        pStream->pushMode = pushMode;
+        if (i < nUrls) {
+            snprintf(pStream->url, sizeof(pStream->url), "%s", urls[i]);
+        } else {
+            snprintf(pStream->url, sizeof(pStream->url), "%s-%u", urls[nUrls - 1], i);
+        }
 
-    return 0;
-}
+        captureConfig.path = pStream->devName;
+        pStream->pCapture = Capture_open(&captureConfig, onFrame, pStream);
+        if (pStream->pCapture == NULL) {
+            printf("%s: capture initialization failed. Can't proceed.\n", pStream->devName);
+            success = FALSE;
+            break;
+        }
+        Capture_getFormat(pStream->pCapture, &pStream->format);
+        if ((pStream->format.width != 768) || (pStream->format.height != 288)) {
+            printf("Warning: driver is sending image at %dx%d\n", pStream->format.width,
+                   pStream->format.height);
+        }
+        if ((pushMode == PUSH_DMABUF) && (pStream->format.dmabuf != TRUE)) {
+            pStream->pushMode = PUSH_ZEROCOPY;                 /* export failed, use mmap buffers */
+        }
 
+        /* the streamer takes the format as negotiated and picks its path to the encoder. Binning
+         * and fps are per device, every device starts again from the options */
+        streamConfig = config;
+        if (toStreamerFormat(pStream->format.pixelFormat, &streamConfig.format) != TRUE) {
+            printf("%s: pixel format 0x%08x can't be streamed.\n", pStream->devName,
+                   pStream->format.pixelFormat);
+            success = FALSE;
+            break;
+        }
+        if ((streamConfig.binning == TRUE) && (streamConfig.format != FIRESTREAMER_FORMAT_SRGGB8)) {
+            printf("%s: binning needs Bayer frames, streaming at full size\n", pStream->devName);
+            streamConfig.binning = FALSE;
+        }
+        if ((pStream->format.fps >= 1) && (pStream->format.fps <= 120)) {
+            streamConfig.fps = pStream->format.fps;
+        }
+        streamConfig.url = pStream->url;
+        streamConfig.width = pStream->format.width;
+        streamConfig.height = pStream->format.height;
+        streamConfig.stride = pStream->format.stride;
+        streamConfig.memory = (pStream->pushMode == PUSH_DMABUF) ? FIRESTREAMER_MEMORY_DMABUF :
+                                                                   FIRESTREAMER_MEMORY_SYSTEM;
+        streamConfig.ready = onReady;
+        streamConfig.pReadyData = pStream;
+        pStream->pStreamer = FireStreamer_create(&streamConfig);
+        if (pStream->pStreamer == NULL) {
+            printf("%s: FireStreamer initialization failed. Can't proceed.\n", pStream->devName);
+            success = FALSE;
+            break;
+        }
+        memset(config.renditions, 0, sizeof(config.renditions));             /* first device only */
+    }
+
+    /* the first stream also goes to the extra outputs, a failing one doesn't stop the others */
+    for (i = 0; (success == TRUE) && (i < nOutputs); i++) {
+        if (FireStreamer_addOutput(l_streams[0].pStreamer, outputs[i]) < 0) {
+            printf("%s: output '%s' could not be added.\n", l_streams[0].devName, outputs[i]);
+        }
+    }
+
+    if (success == TRUE) {
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onSignal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+        sigaction(SIGUSR1, &action, NULL);
+        sigaction(SIGUSR2, &action, NULL);
+
+        /* capture and stream until a signal arrives, failing devices are restarted meanwhile */
+        Threads_apply(THREADS_ROLE_CAPTURE, "capture");
+        success = Capture_run();
+    }
+
+    /* stopping the pipelines releases the frames they still hold, closing the devices waits for
+     * the releases before unmapping the buffers */
+    for (i = 0; i < nDevices; i++) {
+        if (l_streams[i].pStreamer != NULL) {
+            FireStreamer_destroy(l_streams[i].pStreamer);
+        }
+        if (l_streams[i].pCapture != NULL) {
+            Capture_close(l_streams[i].pCapture);
+        }
+    }
+
+    return (success == TRUE) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
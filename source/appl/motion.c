@@ -0,0 +1,210 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     motion.c
+* \ingroup  g_applspec
+* \brief    Implementation of the Motion class, block based frame difference with SIMD kernels.
+* \author   Milos Ladicorbic
+*
+* The frame is split into blocksX x blocksY blocks. Every rowStep-th line of a block is compared
+* with the same line of the previous frame, the score of a block is its mean absolute difference
+* (0..255) per compared byte. The comparison works on raw bytes, so Bayer and YUY2 frames are
+* treated alike: sensor noise gives low scores everywhere, a moving object high scores in its
+* blocks. Only the sampled lines are kept as reference, the kernels compare and copy in one pass.
+*/
+
+#include "motion.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__)                                             /* SSE2 is baseline on x86-64 */
+#define MOTION_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MOTION_NEON
+#include <arm_neon.h>
+#endif
+
+/* private function declarations */
+static uint32_t Motion_sadScalar__(const uint8_t *pCur, uint8_t *pRef, uint32_t bytes);
+#ifdef MOTION_X86
+static uint32_t Motion_sadSse2__(const uint8_t *pCur, uint8_t *pRef, uint32_t bytes);
+static uint32_t Motion_sadAvx2__(const uint8_t *pCur, uint8_t *pRef, uint32_t bytes);
+#endif
+#ifdef MOTION_NEON
+static uint32_t Motion_sadNeon__(const uint8_t *pCur, uint8_t *pRef, uint32_t bytes);
+#endif
+
+/* kernels compiled into this build, PixelConv_getKernel() tells which one the CPU runs */
+static const MotionSad_t l_sad[PIXELCONV_KERNEL_COUNT] = {
+    [PIXELCONV_KERNEL_SCALAR] = Motion_sadScalar__,
+#ifdef MOTION_X86
+    [PIXELCONV_KERNEL_SSE2]   = Motion_sadSse2__,
+    [PIXELCONV_KERNEL_AVX2]   = Motion_sadAvx2__,
+#endif
+#ifdef MOTION_NEON
+    [PIXELCONV_KERNEL_NEON]   = Motion_sadNeon__,
+#endif
+};
+
+
+uint32_t Motion_getMemorySize (uint32_t lineBytes, uint32_t height, uint32_t rowStep) {
+
+    assert(rowStep >= 1);
+    return lineBytes * ((height + rowStep - 1) / rowStep);
+}
+
+void Motion_initialize (Motion_t *pThis, void *pMemory, uint32_t lineBytes, uint32_t height,
+                        uint32_t rowStep, uint32_t blocksX, uint32_t blocksY, uint32_t threshold,
+                        PixelConvKernel_t kernel) {
+
+    assert(pThis != NULL && pMemory != NULL);
+    assert(blocksX >= 1 && blocksX <= MOTION_MAX_BLOCKS_X && lineBytes >= blocksX);
+    assert(blocksY >= 1 && blocksY <= MOTION_MAX_BLOCKS_Y && height >= blocksY * rowStep);
+    assert(threshold >= 1 && threshold <= 255);
+
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->pReference = (uint8_t*)pMemory;
+    pThis->lineBytes = lineBytes;
+    pThis->height = height;
+    pThis->rowStep = rowStep;
+    pThis->blocksX = blocksX;
+    pThis->blocksY = blocksY;
+    pThis->threshold = threshold;
+    kernel = PixelConv_getKernel(kernel);
+    pThis->sad = (l_sad[kernel] != NULL) ? l_sad[kernel] : Motion_sadScalar__;
+}
+
+bool_t Motion_update (Motion_t *pThis, const uint8_t *pFrame, uint32_t stride) {
+    uint32_t sums[MOTION_MAX_BLOCKS_X];
+    uint32_t bx, by, y, yEnd, lines, begin, end;
+    uint8_t  *pRef;
+    uint8_t  score;
+
+    assert(pThis != NULL && pFrame != NULL);
+    assert(stride >= pThis->lineBytes);
+
+    pThis->active = 0;
+    for (by = 0; by < pThis->blocksY; by++) {
+        memset(sums, 0, sizeof(sums));
+        lines = 0;
+        y = by * pThis->height / pThis->blocksY;
+        y = (y + pThis->rowStep - 1) / pThis->rowStep * pThis->rowStep;     /* first sampled line */
+        yEnd = (by + 1) * pThis->height / pThis->blocksY;
+        for (; y < yEnd; y += pThis->rowStep, lines++) {
+            pRef = &pThis->pReference[(size_t)(y / pThis->rowStep) * pThis->lineBytes];
+            for (bx = 0; bx < pThis->blocksX; bx++) {
+                begin = bx * pThis->lineBytes / pThis->blocksX;
+                end = (bx + 1) * pThis->lineBytes / pThis->blocksX;
+                sums[bx] += pThis->sad(pFrame + (size_t)y * stride + begin, pRef + begin,
+                                       end - begin);
+            }
+        }
+        for (bx = 0; bx < pThis->blocksX; bx++) {
+            begin = bx * pThis->lineBytes / pThis->blocksX;
+            end = (bx + 1) * pThis->lineBytes / pThis->blocksX;
+            score = (lines > 0) ? (uint8_t)(sums[bx] / (lines * (end - begin))) : 0;
+            pThis->scores[by * pThis->blocksX + bx] = score;
+            if (score >= pThis->threshold) {
+                pThis->active++;
+            }
+        }
+    }
+
+    /* the first frame only fills the reference, it is compared with nothing */
+    if (pThis->primed != TRUE) {
+        pThis->primed = TRUE;
+        memset(pThis->scores, 0, sizeof(pThis->scores));
+        pThis->active = 0;
+        return TRUE;
+    }
+    return (pThis->active > 0) ? TRUE : FALSE;
+}
+
+uint32_t Motion_getActiveBlocks (Motion_t *pThis) {
+
+    assert(pThis != NULL);
+    return pThis->active;
+}
+
+const uint8_t* Motion_getScores (Motion_t *pThis) {
+
+    assert(pThis != NULL);
+    return pThis->scores;
+}
+
+
+/* private function definition */
+static uint32_t Motion_sadScalar__ (const uint8_t *pCur, uint8_t *pRef, uint32_t bytes) {
+    uint32_t sum = 0;
+    uint32_t x;
+
+    for (x = 0; x < bytes; x++) {
+        sum += (pCur[x] > pRef[x]) ? (uint32_t)(pCur[x] - pRef[x]) : (uint32_t)(pRef[x] - pCur[x]);
+        pRef[x] = pCur[x];
+    }
+    return sum;
+}
+
+#ifdef MOTION_X86
+/* SSE2, psadbw sums 8 absolute differences into each 64 bit half, 16 bytes per iteration */
+static uint32_t Motion_sadSse2__ (const uint8_t *pCur, uint8_t *pRef, uint32_t bytes) {
+    __m128i         sum = _mm_setzero_si128();
+    __m128i         cur;
+    uint32_t        x;
+
+    for (x = 0; x + 16 <= bytes; x += 16) {
+        cur = _mm_loadu_si128((const __m128i*)(pCur + x));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(cur, _mm_loadu_si128((const __m128i*)(pRef + x))));
+        _mm_storeu_si128((__m128i*)(pRef + x), cur);
+    }
+    sum = _mm_add_epi64(sum, _mm_srli_si128(sum, 8));
+    return (uint32_t)_mm_cvtsi128_si32(sum) + Motion_sadScalar__(pCur + x, pRef + x, bytes - x);
+}
+
+/* AVX2, same as SSE2 with 32 bytes per iteration */
+__attribute__((target("avx2")))
+static uint32_t Motion_sadAvx2__ (const uint8_t *pCur, uint8_t *pRef, uint32_t bytes) {
+    __m256i         sum = _mm256_setzero_si256();
+    __m256i         cur;
+    __m256i         ref;
+    __m128i         half;
+    uint32_t        x;
+
+    for (x = 0; x + 32 <= bytes; x += 32) {
+        cur = _mm256_loadu_si256((const __m256i*)(pCur + x));
+        ref = _mm256_loadu_si256((const __m256i*)(pRef + x));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(cur, ref));
+        _mm256_storeu_si256((__m256i*)(pRef + x), cur);
+    }
+    half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi64(half, _mm_srli_si128(half, 8));
+    return (uint32_t)_mm_cvtsi128_si32(half) + Motion_sadScalar__(pCur + x, pRef + x, bytes - x);
+}
+#endif                                                                              /* MOTION_X86 */
+
+#ifdef MOTION_NEON
+/* NEON, vabd gives 16 absolute differences, widened pairwise into 32 bit lanes */
+static uint32_t Motion_sadNeon__ (const uint8_t *pCur, uint8_t *pRef, uint32_t bytes) {
+    uint32x4_t      sum = vdupq_n_u32(0);
+    uint64x2_t      total;
+    uint8x16_t      cur;
+    uint32_t        x;
+
+    for (x = 0; x + 16 <= bytes; x += 16) {
+        cur = vld1q_u8(pCur + x);
+        sum = vpadalq_u16(sum, vpaddlq_u8(vabdq_u8(cur, vld1q_u8(pRef + x))));
+        vst1q_u8(pRef + x, cur);
+    }
+    total = vpaddlq_u32(sum);
+    return (uint32_t)(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1)) +
+           Motion_sadScalar__(pCur + x, pRef + x, bytes - x);
+}
+#endif                                                                             /* MOTION_NEON */
@@ -0,0 +1,58 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef MOTION_H
+#define MOTION_H
+
+/**
+* \file     motion.h
+* \ingroup  g_applspec
+* \brief    API for the Motion class, block based frame difference with SIMD kernels.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "firestreamer.h"                                                               /* bool_t */
+#include "pixelconv.h"                                                       /* PixelConvKernel_t */
+
+#define MOTION_MAX_BLOCKS_X     32
+#define MOTION_MAX_BLOCKS_Y     24
+
+/* sum of absolute differences of one row segment, the current bytes are copied to the reference */
+typedef uint32_t (*MotionSad_t)(const uint8_t *pCur, uint8_t *pRef, uint32_t bytes);
+
+/* the Motion object's data structure, embedded by the owner. Memory for the reference rows is
+ * given to Motion_initialize() once. Not thread safe */
+typedef struct MotionTag {
+    uint8_t                 *pReference;                    /* sampled rows of the previous frame */
+    uint32_t                lineBytes;                        /* compared bytes of one frame line */
+    uint32_t                height;
+    uint32_t                rowStep;                             /* every rowStep-th line is used */
+    uint32_t                blocksX;
+    uint32_t                blocksY;
+    uint32_t                threshold;               /* block score that counts as motion, 1..255 */
+    MotionSad_t             sad;
+    bool_t                  primed;                                /* the reference holds a frame */
+    uint32_t                active;                           /* blocks at or above the threshold */
+    uint8_t                 scores[MOTION_MAX_BLOCKS_X * MOTION_MAX_BLOCKS_Y];  /* row major, MAD */
+} Motion_t;
+
+/* Motion - API */
+uint32_t Motion_getMemorySize(uint32_t lineBytes, uint32_t height, uint32_t rowStep);
+void Motion_initialize(Motion_t *pThis, void *pMemory, uint32_t lineBytes, uint32_t height,
+                       uint32_t rowStep, uint32_t blocksX, uint32_t blocksY, uint32_t threshold,
+                       PixelConvKernel_t kernel);
+bool_t Motion_update(Motion_t *pThis, const uint8_t *pFrame, uint32_t stride);
+uint32_t Motion_getActiveBlocks(Motion_t *pThis);
+const uint8_t* Motion_getScores(Motion_t *pThis);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                                /* MOTION_H */
@@ -0,0 +1,995 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     pixelconv.c
+* \ingroup  g_applspec
+* \brief    Implementation of the PixelConv module, SIMD pixel format conversion kernels.
+* \author   Milos Ladicorbic
+*
+* Bayer (SRGGB8) to YUY2 demosaic. Every output pixel takes its RGB from the 2x2 Bayer window that
+* starts at that pixel, the window always holds one R, two G and one B sample. Seen from the RG row
+* and the GB row of a window the math is the same for even and odd output rows, only the two row
+* pointers swap, so one row kernel serves the whole frame:
+*
+*      Y0 = (66*R  + 65*G1 + 64*G2  + 25*B + 128) >> 8 + 16        R  = rg[x]    G1 = rg[x+1]
+*      Y1 = (66*Rn + 65*G1 + 64*G2n + 25*B + 128) >> 8 + 16        G2 = gb[x]    B  = gb[x+1]
+*      U  = (-38*R - 37*(G1+G2) + 112*B + 128) >> 8 + 128          Rn = rg[x+2]  G2n = gb[x+2]
+*      V  = (112*R - 47*(G1+G2) -  18*B + 128) >> 8 + 128
+*
+* BT.601 limited range, G weight split 65/64 and 37/37, 47/47. All sums fit 16 bit lanes, so SIMD
+* kernels are bit exact with the scalar one. In binning mode each 2x2 quad gives one pixel, U is
+* taken from the even quad and V from the odd quad of an output pair.
+*
+* In grayscale mode the kernels skip the chroma math and write U = V = 128, so a gray YUY2 frame
+* costs less than a color one. YUY2 sources are made gray with a single masking pass that keeps
+* the luma bytes and overwrites the chroma bytes.
+*
+* YUY2 frames are halved in both directions by averaging: two lines are averaged first, then the
+* two lumas of each source pair give one output luma and the chroma of two source pairs one output
+* chroma. Both steps round like pavgb/vrhadd, (a + b + 1) >> 1, so the kernels are bit exact.
+*
+* YUY2 frames are split into the planar 4:2:0 layouts encoders take natively, NV12 (Y plane and
+* one interleaved UV plane) and I420 (Y, U and V planes). Lumas are copied, the chroma of two
+* lines is averaged with the same rounding. In grayscale mode the chroma planes are set to 128.
+*/
+
+#include "pixelconv.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#if defined(__x86_64__)                                          /* SSE2 is baseline on x86-64 */
+#define PIXELCONV_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXELCONV_NEON
+#include <arm_neon.h>
+#endif
+
+/* row kernel, converts one output row from an RG and a GB source row */
+typedef void (*PixelConvRow_t)(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                               uint32_t width, bool_t gray);
+/* gray kernel, copies luma and sets chroma to 128 for one row of 'bytes' YUY2 bytes */
+typedef void (*PixelConvGray_t)(const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes);
+typedef void (*PixelConvHalve_t)(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                 uint32_t width);
+/* planar kernel, splits two YUY2 rows into two luma rows and one chroma row, pV NULL for NV12 */
+typedef void (*PixelConvPlanar_t)(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                  uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                  bool_t gray);
+
+/* private function declarations */
+static void PixelConv_demosaicTail__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                     uint32_t x, uint32_t width, bool_t gray);
+static void PixelConv_binTail__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst, uint32_t x,
+                                uint32_t width, bool_t gray);
+static void PixelConv_demosaicRowScalar__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                          uint32_t width, bool_t gray);
+static void PixelConv_binRowScalar__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                     uint32_t width, bool_t gray);
+static void PixelConv_grayRowScalar__(const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes);
+static void PixelConv_halveTail__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                  uint32_t x, uint32_t width);
+static void PixelConv_halveRowScalar__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                       uint32_t width);
+static void PixelConv_planarTail__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                   uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t x,
+                                   uint32_t width, bool_t gray);
+static void PixelConv_planarRowScalar__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                        uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                        bool_t gray);
+static void PixelConv_yuy2ToPlanar__(PixelConvKernel_t kernel, const uint8_t *pSrc,
+                                     uint32_t srcStride, uint32_t width, uint32_t height,
+                                     uint8_t *pY, uint32_t yStride, uint8_t *pU, uint8_t *pV,
+                                     uint32_t uvStride, uint32_t flags);
+#ifdef PIXELCONV_X86
+static void PixelConv_demosaicRowSse2__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                        uint32_t width, bool_t gray);
+static void PixelConv_binRowSse2__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                   uint32_t width, bool_t gray);
+static void PixelConv_demosaicRowAvx2__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                        uint32_t width, bool_t gray);
+static void PixelConv_binRowAvx2__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                   uint32_t width, bool_t gray);
+static void PixelConv_grayRowSse2__(const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes);
+static void PixelConv_grayRowAvx2__(const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes);
+static void PixelConv_halveRowSse2__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                     uint32_t width);
+static void PixelConv_halveRowAvx2__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                     uint32_t width);
+static void PixelConv_planarRowSse2__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                      uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                      bool_t gray);
+static void PixelConv_planarRowAvx2__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                      uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                      bool_t gray);
+#endif
+#ifdef PIXELCONV_NEON
+static void PixelConv_demosaicRowNeon__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                        uint32_t width, bool_t gray);
+static void PixelConv_binRowNeon__(const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                   uint32_t width, bool_t gray);
+static void PixelConv_grayRowNeon__(const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes);
+static void PixelConv_halveRowNeon__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                     uint32_t width);
+static void PixelConv_planarRowNeon__(const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                      uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                      bool_t gray);
+#endif
+
+/* kernels compiled into this build, NULL if not available for the target */
+static const PixelConvRow_t l_demosaicRow[PIXELCONV_KERNEL_COUNT] = {
+    [PIXELCONV_KERNEL_SCALAR] = PixelConv_demosaicRowScalar__,
+#ifdef PIXELCONV_X86
+    [PIXELCONV_KERNEL_SSE2]   = PixelConv_demosaicRowSse2__,
+    [PIXELCONV_KERNEL_AVX2]   = PixelConv_demosaicRowAvx2__,
+#endif
+#ifdef PIXELCONV_NEON
+    [PIXELCONV_KERNEL_NEON]   = PixelConv_demosaicRowNeon__,
+#endif
+};
+static const PixelConvRow_t l_binRow[PIXELCONV_KERNEL_COUNT] = {
+    [PIXELCONV_KERNEL_SCALAR] = PixelConv_binRowScalar__,
+#ifdef PIXELCONV_X86
+    [PIXELCONV_KERNEL_SSE2]   = PixelConv_binRowSse2__,
+    [PIXELCONV_KERNEL_AVX2]   = PixelConv_binRowAvx2__,
+#endif
+#ifdef PIXELCONV_NEON
+    [PIXELCONV_KERNEL_NEON]   = PixelConv_binRowNeon__,
+#endif
+};
+static const PixelConvGray_t l_grayRow[PIXELCONV_KERNEL_COUNT] = {
+    [PIXELCONV_KERNEL_SCALAR] = PixelConv_grayRowScalar__,
+#ifdef PIXELCONV_X86
+    [PIXELCONV_KERNEL_SSE2]   = PixelConv_grayRowSse2__,
+    [PIXELCONV_KERNEL_AVX2]   = PixelConv_grayRowAvx2__,
+#endif
+#ifdef PIXELCONV_NEON
+    [PIXELCONV_KERNEL_NEON]   = PixelConv_grayRowNeon__,
+#endif
+};
+static const PixelConvHalve_t l_halveRow[PIXELCONV_KERNEL_COUNT] = {
+    [PIXELCONV_KERNEL_SCALAR] = PixelConv_halveRowScalar__,
+#ifdef PIXELCONV_X86
+    [PIXELCONV_KERNEL_SSE2]   = PixelConv_halveRowSse2__,
+    [PIXELCONV_KERNEL_AVX2]   = PixelConv_halveRowAvx2__,
+#endif
+#ifdef PIXELCONV_NEON
+    [PIXELCONV_KERNEL_NEON]   = PixelConv_halveRowNeon__,
+#endif
+};
+static const PixelConvPlanar_t l_planarRow[PIXELCONV_KERNEL_COUNT] = {
+    [PIXELCONV_KERNEL_SCALAR] = PixelConv_planarRowScalar__,
+#ifdef PIXELCONV_X86
+    [PIXELCONV_KERNEL_SSE2]   = PixelConv_planarRowSse2__,
+    [PIXELCONV_KERNEL_AVX2]   = PixelConv_planarRowAvx2__,
+#endif
+#ifdef PIXELCONV_NEON
+    [PIXELCONV_KERNEL_NEON]   = PixelConv_planarRowNeon__,
+#endif
+};
+static const char* const l_kernelName[PIXELCONV_KERNEL_COUNT] = {
+    "auto", "scalar", "sse2", "avx2", "neon"
+};
+
+
+bool_t PixelConv_isKernelSupported (PixelConvKernel_t kernel) {
+
+    assert(kernel < PIXELCONV_KERNEL_COUNT);
+
+    if (kernel == PIXELCONV_KERNEL_AUTO) {
+        return TRUE;
+    }
+    if (l_demosaicRow[kernel] == NULL) {
+        return FALSE;                                            /* not compiled for this target */
+    }
+#ifdef PIXELCONV_X86
+    if (kernel == PIXELCONV_KERNEL_SSE2) {
+        return __builtin_cpu_supports("sse2") ? TRUE : FALSE;
+    }
+    if (kernel == PIXELCONV_KERNEL_AVX2) {
+        return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+PixelConvKernel_t PixelConv_getKernel (PixelConvKernel_t kernel) {
+    static const PixelConvKernel_t preferred[] = {
+        PIXELCONV_KERNEL_AVX2, PIXELCONV_KERNEL_NEON, PIXELCONV_KERNEL_SSE2
+    };
+    uint32_t i;
+
+    assert(kernel < PIXELCONV_KERNEL_COUNT);
+
+    if (kernel != PIXELCONV_KERNEL_AUTO) {
+        return (PixelConv_isKernelSupported(kernel) == TRUE) ? kernel : PIXELCONV_KERNEL_SCALAR;
+    }
+    for (i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+        if (PixelConv_isKernelSupported(preferred[i]) == TRUE) {
+            return preferred[i];
+        }
+    }
+    return PIXELCONV_KERNEL_SCALAR;
+}
+
+const char* PixelConv_getKernelName (PixelConvKernel_t kernel) {
+
+    assert(kernel < PIXELCONV_KERNEL_COUNT);
+    return l_kernelName[kernel];
+}
+
+void PixelConv_srggb8ToYuy2 (PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                             uint32_t width, uint32_t height, uint8_t *pDst, uint32_t dstStride,
+                             uint32_t flags) {
+    const uint8_t  *pRg;
+    const uint8_t  *pGb;
+    PixelConvRow_t  row;
+    bool_t          gray = ((flags & PIXELCONV_FLAG_GRAYSCALE) != 0) ? TRUE : FALSE;
+    uint32_t        y;
+
+    assert(pSrc != NULL && pDst != NULL);
+    assert(width >= 4 && (width % 2) == 0);
+    assert(height >= 2 && (height % 2) == 0);
+    assert(srcStride >= width);
+
+    kernel = PixelConv_getKernel(kernel);
+
+    if ((flags & PIXELCONV_FLAG_BINNING) != 0) {
+        assert((width % 4) == 0);                          /* output pixels come in YUY2 pairs */
+        assert(dstStride >= width);
+        row = l_binRow[kernel];
+        for (y = 0; y < height / 2; y++) {
+            pRg = pSrc + (size_t)(2 * y) * srcStride;
+            row(pRg, pRg + srcStride, pDst + (size_t)y * dstStride, width, gray);
+        }
+        return;
+    }
+
+    assert(dstStride >= width * 2);
+    row = l_demosaicRow[kernel];
+    for (y = 0; y < height; y++) {
+        if ((y % 2) == 0) {
+            pRg = pSrc + (size_t)y * srcStride;                             /* RG row on top */
+            pGb = pRg + srcStride;
+        } else {
+            pGb = pSrc + (size_t)y * srcStride;                   /* GB row on top, RG below */
+            pRg = (y + 1 < height) ? pGb + srcStride : pGb - srcStride;      /* mirror last row */
+        }
+        row(pRg, pGb, pDst + (size_t)y * dstStride, width, gray);
+    }
+}
+
+void PixelConv_yuy2ToGray (PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                           uint32_t width, uint32_t height, uint8_t *pDst, uint32_t dstStride) {
+    PixelConvGray_t row;
+    uint32_t        y;
+
+    assert(pSrc != NULL && pDst != NULL);
+    assert((width % 2) == 0);
+    assert(srcStride >= width * 2 && dstStride >= width * 2);
+
+    row = l_grayRow[PixelConv_getKernel(kernel)];
+    for (y = 0; y < height; y++) {
+        row(pSrc + (size_t)y * srcStride, pDst + (size_t)y * dstStride, width * 2);
+    }
+}
+
+void PixelConv_yuy2Halve (PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                          uint32_t width, uint32_t height, uint8_t *pDst, uint32_t dstStride) {
+    PixelConvHalve_t row;
+    uint32_t         y;
+
+    assert(pSrc != NULL && pDst != NULL);
+    assert(width >= 4 && (width % 4) == 0);                   /* output pixels come in YUY2 pairs */
+    assert(height >= 2 && (height % 2) == 0);
+    assert(srcStride >= width * 2 && dstStride >= width);
+
+    row = l_halveRow[PixelConv_getKernel(kernel)];
+    for (y = 0; y < height / 2; y++) {
+        row(pSrc + (size_t)(2 * y) * srcStride, pSrc + (size_t)(2 * y + 1) * srcStride,
+            pDst + (size_t)y * dstStride, width);
+    }
+}
+
+void PixelConv_yuy2ToNv12 (PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                           uint32_t width, uint32_t height, uint8_t *pY, uint32_t yStride,
+                           uint8_t *pUv, uint32_t uvStride, uint32_t flags) {
+
+    assert(pUv != NULL && uvStride >= width);
+    PixelConv_yuy2ToPlanar__(kernel, pSrc, srcStride, width, height, pY, yStride, pUv, NULL,
+                             uvStride, flags);
+}
+
+void PixelConv_yuy2ToI420 (PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                           uint32_t width, uint32_t height, uint8_t *pY, uint32_t yStride,
+                           uint8_t *pU, uint8_t *pV, uint32_t uvStride, uint32_t flags) {
+
+    assert(pU != NULL && pV != NULL && uvStride >= width / 2);
+    PixelConv_yuy2ToPlanar__(kernel, pSrc, srcStride, width, height, pY, yStride, pU, pV,
+                             uvStride, flags);
+}
+
+
+/* private function definition */
+static void PixelConv_demosaicTail__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                      uint32_t x, uint32_t width, bool_t gray) {
+    int r, g1, g2, b, rn, g2n;
+
+    for (; x < width; x += 2) {
+        r = pRg[x];
+        g1 = pRg[x + 1];
+        g2 = pGb[x];
+        b = pGb[x + 1];
+        if (x + 2 < width) {
+            rn = pRg[x + 2];
+            g2n = pGb[x + 2];
+        } else {
+            rn = r;                                                   /* replicate last column */
+            g2n = g2;
+        }
+        pDst[2 * x + 0] = (uint8_t)(((66 * r + 65 * g1 + 64 * g2 + 25 * b + 128) >> 8) + 16);
+        pDst[2 * x + 2] = (uint8_t)(((66 * rn + 65 * g1 + 64 * g2n + 25 * b + 128) >> 8) + 16);
+        if (gray == TRUE) {
+            pDst[2 * x + 1] = 128;
+            pDst[2 * x + 3] = 128;
+        } else {
+            pDst[2 * x + 1] = (uint8_t)(((-38 * r - 37 * (g1 + g2) + 112 * b + 128) >> 8) + 128);
+            pDst[2 * x + 3] = (uint8_t)(((112 * r - 47 * (g1 + g2) - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+static void PixelConv_binTail__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst, uint32_t x,
+                                 uint32_t width, bool_t gray) {
+    int r0, g10, g20, b0, r1, g11, g21, b1;
+
+    for (; x < width; x += 4) {
+        r0 = pRg[x];                                                               /* even quad */
+        g10 = pRg[x + 1];
+        g20 = pGb[x];
+        b0 = pGb[x + 1];
+        r1 = pRg[x + 2];                                                            /* odd quad */
+        g11 = pRg[x + 3];
+        g21 = pGb[x + 2];
+        b1 = pGb[x + 3];
+        pDst[x + 0] = (uint8_t)(((66 * r0 + 65 * g10 + 64 * g20 + 25 * b0 + 128) >> 8) + 16);
+        pDst[x + 2] = (uint8_t)(((66 * r1 + 65 * g11 + 64 * g21 + 25 * b1 + 128) >> 8) + 16);
+        if (gray == TRUE) {
+            pDst[x + 1] = 128;
+            pDst[x + 3] = 128;
+        } else {
+            pDst[x + 1] = (uint8_t)(((-38 * r0 - 37 * (g10 + g20) + 112 * b0 + 128) >> 8) + 128);
+            pDst[x + 3] = (uint8_t)(((112 * r1 - 47 * (g11 + g21) - 18 * b1 + 128) >> 8) + 128);
+        }
+    }
+}
+
+static void PixelConv_demosaicRowScalar__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                           uint32_t width, bool_t gray) {
+
+    PixelConv_demosaicTail__(pRg, pGb, pDst, 0, width, gray);
+}
+
+static void PixelConv_binRowScalar__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                      uint32_t width, bool_t gray) {
+
+    PixelConv_binTail__(pRg, pGb, pDst, 0, width, gray);
+}
+
+static void PixelConv_grayRowScalar__ (const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes) {
+    uint32_t x;
+
+    for (x = 0; x < bytes; x += 2) {
+        pDst[x] = pSrc[x];
+        pDst[x + 1] = 128;
+    }
+}
+
+static void PixelConv_halveTail__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                   uint32_t x, uint32_t width) {
+    uint8_t  s[8];
+    uint32_t i;
+
+    /* 4 source pixels (2 pairs, 8 bytes) of both lines give one output pair at byte x */
+    for (; x < width; x += 4) {
+        for (i = 0; i < 8; i++) {
+            s[i] = (uint8_t)((pTop[2 * x + i] + pBottom[2 * x + i] + 1) >> 1);
+        }
+        pDst[x] = (uint8_t)((s[0] + s[2] + 1) >> 1);
+        pDst[x + 1] = (uint8_t)((s[1] + s[5] + 1) >> 1);
+        pDst[x + 2] = (uint8_t)((s[4] + s[6] + 1) >> 1);
+        pDst[x + 3] = (uint8_t)((s[3] + s[7] + 1) >> 1);
+    }
+}
+
+static void PixelConv_halveRowScalar__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                        uint32_t width) {
+
+    PixelConv_halveTail__(pTop, pBottom, pDst, 0, width);
+}
+
+static void PixelConv_planarTail__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                    uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t x,
+                                    uint32_t width, bool_t gray) {
+    uint8_t u, v;
+
+    /* one source pair of both lines gives 4 lumas and one U and V, x counts pixels */
+    for (; x < width; x += 2) {
+        pYTop[x] = pTop[2 * x];
+        pYTop[x + 1] = pTop[2 * x + 2];
+        pYBottom[x] = pBottom[2 * x];
+        pYBottom[x + 1] = pBottom[2 * x + 2];
+        u = (gray == TRUE) ? 128 : (uint8_t)((pTop[2 * x + 1] + pBottom[2 * x + 1] + 1) >> 1);
+        v = (gray == TRUE) ? 128 : (uint8_t)((pTop[2 * x + 3] + pBottom[2 * x + 3] + 1) >> 1);
+        if (pV == NULL) {
+            pU[x] = u;                                                       /* NV12, interleaved */
+            pU[x + 1] = v;
+        } else {
+            pU[x / 2] = u;
+            pV[x / 2] = v;
+        }
+    }
+}
+
+static void PixelConv_planarRowScalar__ (const uint8_t *pTop, const uint8_t *pBottom,
+                                         uint8_t *pYTop, uint8_t *pYBottom, uint8_t *pU,
+                                         uint8_t *pV, uint32_t width, bool_t gray) {
+
+    PixelConv_planarTail__(pTop, pBottom, pYTop, pYBottom, pU, pV, 0, width, gray);
+}
+
+static void PixelConv_yuy2ToPlanar__ (PixelConvKernel_t kernel, const uint8_t *pSrc,
+                                      uint32_t srcStride, uint32_t width, uint32_t height,
+                                      uint8_t *pY, uint32_t yStride, uint8_t *pU, uint8_t *pV,
+                                      uint32_t uvStride, uint32_t flags) {
+    PixelConvPlanar_t row;
+    bool_t            gray;
+    uint32_t          y;
+
+    assert(pSrc != NULL && pY != NULL);
+    assert(width >= 2 && (width % 2) == 0);
+    assert(height >= 2 && (height % 2) == 0);                         /* chroma is 2x2 subsampled */
+    assert(srcStride >= width * 2 && yStride >= width);
+
+    gray = ((flags & PIXELCONV_FLAG_GRAYSCALE) != 0) ? TRUE : FALSE;
+    row = l_planarRow[PixelConv_getKernel(kernel)];
+    for (y = 0; y < height / 2; y++) {
+        row(pSrc + (size_t)(2 * y) * srcStride, pSrc + (size_t)(2 * y + 1) * srcStride,
+            pY + (size_t)(2 * y) * yStride, pY + (size_t)(2 * y + 1) * yStride,
+            pU + (size_t)y * uvStride, (pV != NULL) ? pV + (size_t)y * uvStride : NULL, width,
+            gray);
+    }
+}
+
+#ifdef PIXELCONV_X86
+/* SSE2, 8 pixel pairs per iteration, one 16 bit lane per pair */
+static void PixelConv_demosaicRowSse2__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                         uint32_t width, bool_t gray) {
+    const __m128i   lowByte = _mm_set1_epi16(0x00FF);
+    const __m128i   c16 = _mm_set1_epi16(16), c128 = _mm_set1_epi16(128);
+    __m128i         rg, gb, r, g1, g2, b, rn, g2n, g, common, y0, y1, u, v, lo, hi;
+    uint32_t        x;
+
+    for (x = 0; x + 18 <= width; x += 16) {                 /* rn/g2n read 2 bytes ahead */
+        rg = _mm_loadu_si128((const __m128i*)(pRg + x));
+        gb = _mm_loadu_si128((const __m128i*)(pGb + x));
+        r = _mm_and_si128(rg, lowByte);
+        g1 = _mm_srli_epi16(rg, 8);
+        g2 = _mm_and_si128(gb, lowByte);
+        b = _mm_srli_epi16(gb, 8);
+        rn = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pRg + x + 2)), lowByte);
+        g2n = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pGb + x + 2)), lowByte);
+
+        /* luma, unsigned 16 bit sums */
+        common = _mm_add_epi16(_mm_mullo_epi16(g1, _mm_set1_epi16(65)),
+                               _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), c128));
+        y0 = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                           _mm_mullo_epi16(g2, _mm_set1_epi16(64)));
+        y0 = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y0, common), 8), c16);
+        y1 = _mm_add_epi16(_mm_mullo_epi16(rn, _mm_set1_epi16(66)),
+                           _mm_mullo_epi16(g2n, _mm_set1_epi16(64)));
+        y1 = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y1, common), 8), c16);
+
+        /* chroma, signed 16 bit sums */
+        if (gray == TRUE) {
+            u = c128;
+            v = c128;
+        } else {
+            g = _mm_add_epi16(g1, g2);
+            u = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(-38)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(-37)));
+            u = _mm_add_epi16(u, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)), c128));
+            u = _mm_add_epi16(_mm_srai_epi16(u, 8), c128);
+            v = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(-47)));
+            v = _mm_add_epi16(v, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(-18)), c128));
+            v = _mm_add_epi16(_mm_srai_epi16(v, 8), c128);
+        }
+
+        /* Y0 U | Y1 V words, interleaved into Y0 U Y1 V */
+        lo = _mm_or_si128(y0, _mm_slli_epi16(u, 8));
+        hi = _mm_or_si128(y1, _mm_slli_epi16(v, 8));
+        _mm_storeu_si128((__m128i*)(pDst + 2 * x), _mm_unpacklo_epi16(lo, hi));
+        _mm_storeu_si128((__m128i*)(pDst + 2 * x + 16), _mm_unpackhi_epi16(lo, hi));
+    }
+    PixelConv_demosaicTail__(pRg, pGb, pDst, x, width, gray);
+}
+
+/* SSE2, 8 quads per iteration, one 16 bit lane per quad, one 32 bit lane per output pair */
+static void PixelConv_binRowSse2__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                    uint32_t width, bool_t gray) {
+    const __m128i   lowByte = _mm_set1_epi16(0x00FF), lowWord = _mm_set1_epi32(0x0000FFFF);
+    const __m128i   c16 = _mm_set1_epi16(16), c128 = _mm_set1_epi16(128);
+    __m128i         rg, gb, r, g1, g2, b, g, y, u, v, yu, yv;
+    uint32_t        x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        rg = _mm_loadu_si128((const __m128i*)(pRg + x));
+        gb = _mm_loadu_si128((const __m128i*)(pGb + x));
+        r = _mm_and_si128(rg, lowByte);
+        g1 = _mm_srli_epi16(rg, 8);
+        g2 = _mm_and_si128(gb, lowByte);
+        b = _mm_srli_epi16(gb, 8);
+
+        y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                          _mm_mullo_epi16(g1, _mm_set1_epi16(65)));
+        y = _mm_add_epi16(y, _mm_add_epi16(_mm_mullo_epi16(g2, _mm_set1_epi16(64)),
+                                           _mm_mullo_epi16(b, _mm_set1_epi16(25))));
+        y = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y, c128), 8), c16);
+
+        if (gray == TRUE) {
+            u = c128;
+            v = c128;
+        } else {
+            g = _mm_add_epi16(g1, g2);
+            u = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(-38)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(-37)));
+            u = _mm_add_epi16(u, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)), c128));
+            u = _mm_add_epi16(_mm_srai_epi16(u, 8), c128);
+            v = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(-47)));
+            v = _mm_add_epi16(v, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(-18)), c128));
+            v = _mm_add_epi16(_mm_srai_epi16(v, 8), c128);
+        }
+
+        /* even quad gives Y0 U, odd quad gives Y1 V */
+        yu = _mm_or_si128(y, _mm_slli_epi16(u, 8));
+        yv = _mm_or_si128(y, _mm_slli_epi16(v, 8));
+        _mm_storeu_si128((__m128i*)(pDst + x), _mm_or_si128(_mm_and_si128(yu, lowWord),
+                                                            _mm_andnot_si128(lowWord, yv)));
+    }
+    PixelConv_binTail__(pRg, pGb, pDst, x, width, gray);
+}
+
+/* SSE2, keeps the low (luma) byte of every 16 bit lane and sets the high (chroma) byte to 128 */
+static void PixelConv_grayRowSse2__ (const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes) {
+    const __m128i   lowByte = _mm_set1_epi16(0x00FF), chroma = _mm_set1_epi16((short)0x8000);
+    __m128i         yuv;
+    uint32_t        x;
+
+    for (x = 0; x + 16 <= bytes; x += 16) {
+        yuv = _mm_loadu_si128((const __m128i*)(pSrc + x));
+        _mm_storeu_si128((__m128i*)(pDst + x), _mm_or_si128(_mm_and_si128(yuv, lowByte), chroma));
+    }
+    PixelConv_grayRowScalar__(pSrc + x, pDst + x, bytes - x);
+}
+
+/* SSE2, 16 source pixels per iteration. After the line average the 32 bit pairs are split into
+ * even and odd ones: chroma is the average of both, luma the average within each of them */
+static void PixelConv_halveRowSse2__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                      uint32_t width) {
+    const __m128i   lowByte = _mm_set1_epi32(0x000000FF), chroma = _mm_set1_epi32((int)0xFF00FF00);
+    __m128i         a, b, even, odd, uv, y0, y1;
+    uint32_t        x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(pTop + 2 * x)),
+                         _mm_loadu_si128((const __m128i*)(pBottom + 2 * x)));
+        b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(pTop + 2 * x + 16)),
+                         _mm_loadu_si128((const __m128i*)(pBottom + 2 * x + 16)));
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        even = _mm_unpacklo_epi64(a, b);
+        odd = _mm_unpackhi_epi64(a, b);
+        uv = _mm_and_si128(_mm_avg_epu8(even, odd), chroma);
+        y0 = _mm_and_si128(_mm_avg_epu8(even, _mm_srli_epi32(even, 16)), lowByte);
+        y1 = _mm_and_si128(_mm_avg_epu8(odd, _mm_srli_epi32(odd, 16)), lowByte);
+        _mm_storeu_si128((__m128i*)(pDst + x),
+                         _mm_or_si128(_mm_or_si128(y0, uv), _mm_slli_epi32(y1, 16)));
+    }
+    PixelConv_halveTail__(pTop, pBottom, pDst, x, width);
+}
+
+/* SSE2, 16 source pixels per iteration. Lumas are the low bytes of the 16 bit lanes, the chroma
+ * average the high ones, both packed with packus. I420 splits the UV bytes once more */
+static void PixelConv_planarRowSse2__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                       uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                       bool_t gray) {
+    const __m128i   lowByte = _mm_set1_epi16(0x00FF), zero = _mm_setzero_si128();
+    __m128i         t0, t1, b0, b1, uv;
+    uint32_t        x;
+
+    uv = _mm_set1_epi8((char)128);
+    for (x = 0; x + 16 <= width; x += 16) {
+        t0 = _mm_loadu_si128((const __m128i*)(pTop + 2 * x));
+        t1 = _mm_loadu_si128((const __m128i*)(pTop + 2 * x + 16));
+        b0 = _mm_loadu_si128((const __m128i*)(pBottom + 2 * x));
+        b1 = _mm_loadu_si128((const __m128i*)(pBottom + 2 * x + 16));
+        _mm_storeu_si128((__m128i*)(pYTop + x),
+                         _mm_packus_epi16(_mm_and_si128(t0, lowByte), _mm_and_si128(t1, lowByte)));
+        _mm_storeu_si128((__m128i*)(pYBottom + x),
+                         _mm_packus_epi16(_mm_and_si128(b0, lowByte), _mm_and_si128(b1, lowByte)));
+        if (gray != TRUE) {
+            uv = _mm_packus_epi16(_mm_srli_epi16(_mm_avg_epu8(t0, b0), 8),
+                                  _mm_srli_epi16(_mm_avg_epu8(t1, b1), 8));
+        }
+        if (pV == NULL) {
+            _mm_storeu_si128((__m128i*)(pU + x), uv);
+        } else {
+            _mm_storel_epi64((__m128i*)(pU + x / 2),
+                             _mm_packus_epi16(_mm_and_si128(uv, lowByte), zero));
+            _mm_storel_epi64((__m128i*)(pV + x / 2), _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+        }
+    }
+    PixelConv_planarTail__(pTop, pBottom, pYTop, pYBottom, pU, pV, x, width, gray);
+}
+
+/* AVX2, same as SSE2 with 32 bytes per iteration */
+__attribute__((target("avx2")))
+static void PixelConv_demosaicRowAvx2__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                         uint32_t width, bool_t gray) {
+    const __m256i   lowByte = _mm256_set1_epi16(0x00FF);
+    const __m256i   c16 = _mm256_set1_epi16(16), c128 = _mm256_set1_epi16(128);
+    __m256i         rg, gb, r, g1, g2, b, rn, g2n, g, common, y0, y1, u, v, lo, hi, a0, a1;
+    uint32_t        x;
+
+    for (x = 0; x + 34 <= width; x += 32) {                 /* rn/g2n read 2 bytes ahead */
+        rg = _mm256_loadu_si256((const __m256i*)(pRg + x));
+        gb = _mm256_loadu_si256((const __m256i*)(pGb + x));
+        r = _mm256_and_si256(rg, lowByte);
+        g1 = _mm256_srli_epi16(rg, 8);
+        g2 = _mm256_and_si256(gb, lowByte);
+        b = _mm256_srli_epi16(gb, 8);
+        rn = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pRg + x + 2)), lowByte);
+        g2n = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(pGb + x + 2)), lowByte);
+
+        common = _mm256_add_epi16(_mm256_mullo_epi16(g1, _mm256_set1_epi16(65)),
+                                  _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(25)),
+                                                   c128));
+        y0 = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+                              _mm256_mullo_epi16(g2, _mm256_set1_epi16(64)));
+        y0 = _mm256_add_epi16(_mm256_srli_epi16(_mm256_add_epi16(y0, common), 8), c16);
+        y1 = _mm256_add_epi16(_mm256_mullo_epi16(rn, _mm256_set1_epi16(66)),
+                              _mm256_mullo_epi16(g2n, _mm256_set1_epi16(64)));
+        y1 = _mm256_add_epi16(_mm256_srli_epi16(_mm256_add_epi16(y1, common), 8), c16);
+
+        if (gray == TRUE) {
+            u = c128;
+            v = c128;
+        } else {
+            g = _mm256_add_epi16(g1, g2);
+            u = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(-38)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(-37)));
+            u = _mm256_add_epi16(u, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(112)),
+                                                     c128));
+            u = _mm256_add_epi16(_mm256_srai_epi16(u, 8), c128);
+            v = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(112)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(-47)));
+            v = _mm256_add_epi16(v, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(-18)),
+                                                     c128));
+            v = _mm256_add_epi16(_mm256_srai_epi16(v, 8), c128);
+        }
+
+        /* unpack works per 128 bit lane, put the lanes back in pixel order */
+        lo = _mm256_or_si256(y0, _mm256_slli_epi16(u, 8));
+        hi = _mm256_or_si256(y1, _mm256_slli_epi16(v, 8));
+        a0 = _mm256_unpacklo_epi16(lo, hi);
+        a1 = _mm256_unpackhi_epi16(lo, hi);
+        _mm256_storeu_si256((__m256i*)(pDst + 2 * x), _mm256_permute2x128_si256(a0, a1, 0x20));
+        _mm256_storeu_si256((__m256i*)(pDst + 2 * x + 32),
+                            _mm256_permute2x128_si256(a0, a1, 0x31));
+    }
+    PixelConv_demosaicTail__(pRg, pGb, pDst, x, width, gray);
+}
+
+__attribute__((target("avx2")))
+static void PixelConv_binRowAvx2__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                    uint32_t width, bool_t gray) {
+    const __m256i   lowByte = _mm256_set1_epi16(0x00FF), lowWord = _mm256_set1_epi32(0x0000FFFF);
+    const __m256i   c16 = _mm256_set1_epi16(16), c128 = _mm256_set1_epi16(128);
+    __m256i         rg, gb, r, g1, g2, b, g, y, u, v, yu, yv;
+    uint32_t        x;
+
+    for (x = 0; x + 32 <= width; x += 32) {
+        rg = _mm256_loadu_si256((const __m256i*)(pRg + x));
+        gb = _mm256_loadu_si256((const __m256i*)(pGb + x));
+        r = _mm256_and_si256(rg, lowByte);
+        g1 = _mm256_srli_epi16(rg, 8);
+        g2 = _mm256_and_si256(gb, lowByte);
+        b = _mm256_srli_epi16(gb, 8);
+
+        y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+                             _mm256_mullo_epi16(g1, _mm256_set1_epi16(65)));
+        y = _mm256_add_epi16(y, _mm256_add_epi16(_mm256_mullo_epi16(g2, _mm256_set1_epi16(64)),
+                                                 _mm256_mullo_epi16(b, _mm256_set1_epi16(25))));
+        y = _mm256_add_epi16(_mm256_srli_epi16(_mm256_add_epi16(y, c128), 8), c16);
+
+        if (gray == TRUE) {
+            u = c128;
+            v = c128;
+        } else {
+            g = _mm256_add_epi16(g1, g2);
+            u = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(-38)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(-37)));
+            u = _mm256_add_epi16(u, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(112)),
+                                                     c128));
+            u = _mm256_add_epi16(_mm256_srai_epi16(u, 8), c128);
+            v = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(112)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(-47)));
+            v = _mm256_add_epi16(v, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(-18)),
+                                                     c128));
+            v = _mm256_add_epi16(_mm256_srai_epi16(v, 8), c128);
+        }
+
+        /* no lane crossing, each 32 bit lane is one output pair */
+        yu = _mm256_or_si256(y, _mm256_slli_epi16(u, 8));
+        yv = _mm256_or_si256(y, _mm256_slli_epi16(v, 8));
+        _mm256_storeu_si256((__m256i*)(pDst + x),
+                            _mm256_or_si256(_mm256_and_si256(yu, lowWord),
+                                            _mm256_andnot_si256(lowWord, yv)));
+    }
+    PixelConv_binTail__(pRg, pGb, pDst, x, width, gray);
+}
+
+__attribute__((target("avx2")))
+static void PixelConv_grayRowAvx2__ (const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes) {
+    const __m256i   lowByte = _mm256_set1_epi16(0x00FF);
+    const __m256i   chroma = _mm256_set1_epi16((short)0x8000);
+    __m256i         yuv;
+    uint32_t        x;
+
+    for (x = 0; x + 32 <= bytes; x += 32) {
+        yuv = _mm256_loadu_si256((const __m256i*)(pSrc + x));
+        _mm256_storeu_si256((__m256i*)(pDst + x),
+                            _mm256_or_si256(_mm256_and_si256(yuv, lowByte), chroma));
+    }
+    PixelConv_grayRowScalar__(pSrc + x, pDst + x, bytes - x);
+}
+
+__attribute__((target("avx2")))
+static void PixelConv_halveRowAvx2__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                      uint32_t width) {
+    const __m256i   lowByte = _mm256_set1_epi32(0x000000FF);
+    const __m256i   chroma = _mm256_set1_epi32((int)0xFF00FF00);
+    __m256i         a, b, even, odd, uv, y0, y1, out;
+    uint32_t        x;
+
+    for (x = 0; x + 32 <= width; x += 32) {
+        a = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(pTop + 2 * x)),
+                            _mm256_loadu_si256((const __m256i*)(pBottom + 2 * x)));
+        b = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(pTop + 2 * x + 32)),
+                            _mm256_loadu_si256((const __m256i*)(pBottom + 2 * x + 32)));
+        a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        even = _mm256_unpacklo_epi64(a, b);
+        odd = _mm256_unpackhi_epi64(a, b);
+        uv = _mm256_and_si256(_mm256_avg_epu8(even, odd), chroma);
+        y0 = _mm256_and_si256(_mm256_avg_epu8(even, _mm256_srli_epi32(even, 16)), lowByte);
+        y1 = _mm256_and_si256(_mm256_avg_epu8(odd, _mm256_srli_epi32(odd, 16)), lowByte);
+        out = _mm256_or_si256(_mm256_or_si256(y0, uv), _mm256_slli_epi32(y1, 16));
+        /* unpack works per 128 bit lane, put the output pairs back in order */
+        _mm256_storeu_si256((__m256i*)(pDst + x),
+                            _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    PixelConv_halveTail__(pTop, pBottom, pDst, x, width);
+}
+
+/* AVX2, same as SSE2 with 32 source pixels per iteration, packus works per 128 bit lane so every
+ * packed result is put back in order with a permute */
+__attribute__((target("avx2")))
+static void PixelConv_planarRowAvx2__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                       uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                       bool_t gray) {
+    const __m256i   lowByte = _mm256_set1_epi16(0x00FF), zero = _mm256_setzero_si256();
+    __m256i         t0, t1, b0, b1, uv, out;
+    uint32_t        x;
+
+    uv = _mm256_set1_epi8((char)128);
+    for (x = 0; x + 32 <= width; x += 32) {
+        t0 = _mm256_loadu_si256((const __m256i*)(pTop + 2 * x));
+        t1 = _mm256_loadu_si256((const __m256i*)(pTop + 2 * x + 32));
+        b0 = _mm256_loadu_si256((const __m256i*)(pBottom + 2 * x));
+        b1 = _mm256_loadu_si256((const __m256i*)(pBottom + 2 * x + 32));
+        out = _mm256_packus_epi16(_mm256_and_si256(t0, lowByte), _mm256_and_si256(t1, lowByte));
+        _mm256_storeu_si256((__m256i*)(pYTop + x),
+                            _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0)));
+        out = _mm256_packus_epi16(_mm256_and_si256(b0, lowByte), _mm256_and_si256(b1, lowByte));
+        _mm256_storeu_si256((__m256i*)(pYBottom + x),
+                            _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0)));
+        if (gray != TRUE) {
+            uv = _mm256_packus_epi16(_mm256_srli_epi16(_mm256_avg_epu8(t0, b0), 8),
+                                     _mm256_srli_epi16(_mm256_avg_epu8(t1, b1), 8));
+            uv = _mm256_permute4x64_epi64(uv, _MM_SHUFFLE(3, 1, 2, 0));
+        }
+        if (pV == NULL) {
+            _mm256_storeu_si256((__m256i*)(pU + x), uv);
+        } else {
+            out = _mm256_packus_epi16(_mm256_and_si256(uv, lowByte), zero);
+            out = _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)(pU + x / 2), _mm256_castsi256_si128(out));
+            out = _mm256_packus_epi16(_mm256_srli_epi16(uv, 8), zero);
+            out = _mm256_permute4x64_epi64(out, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)(pV + x / 2), _mm256_castsi256_si128(out));
+        }
+    }
+    PixelConv_planarTail__(pTop, pBottom, pYTop, pYBottom, pU, pV, x, width, gray);
+}
+#endif                                                                         /* PIXELCONV_X86 */
+
+#ifdef PIXELCONV_NEON
+/* NEON, vld2 splits R/G1 and G2/B, vst4 writes interleaved Y0 U Y1 V, 8 pairs per iteration */
+static void PixelConv_demosaicRowNeon__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                         uint32_t width, bool_t gray) {
+    const uint16x8_t    c128 = vdupq_n_u16(128);
+    const int16x8_t     s128 = vdupq_n_s16(128);
+    const uint8x8_t     c16 = vdup_n_u8(16);
+    uint8x8x2_t         rg, gb;
+    uint8x8_t           rn, g2n;
+    uint16x8_t          common, y0, y1;
+    int16x8_t           r, g, b, u, v;
+    uint8x8x4_t         out;
+    uint32_t            x;
+
+    for (x = 0; x + 18 <= width; x += 16) {                 /* rn/g2n read 2 bytes ahead */
+        rg = vld2_u8(pRg + x);                                          /* val[0] R, val[1] G1 */
+        gb = vld2_u8(pGb + x);                                          /* val[0] G2, val[1] B */
+        rn = vld2_u8(pRg + x + 2).val[0];
+        g2n = vld2_u8(pGb + x + 2).val[0];
+
+        common = vmlal_u8(vmlal_u8(c128, rg.val[1], vdup_n_u8(65)), gb.val[1], vdup_n_u8(25));
+        y0 = vmlal_u8(vmlal_u8(common, rg.val[0], vdup_n_u8(66)), gb.val[0], vdup_n_u8(64));
+        y1 = vmlal_u8(vmlal_u8(common, rn, vdup_n_u8(66)), g2n, vdup_n_u8(64));
+        out.val[0] = vadd_u8(vshrn_n_u16(y0, 8), c16);
+        out.val[2] = vadd_u8(vshrn_n_u16(y1, 8), c16);
+
+        if (gray == TRUE) {
+            out.val[1] = vdup_n_u8(128);
+            out.val[3] = out.val[1];
+        } else {
+            r = vreinterpretq_s16_u16(vmovl_u8(rg.val[0]));
+            g = vreinterpretq_s16_u16(vaddl_u8(rg.val[1], gb.val[0]));
+            b = vreinterpretq_s16_u16(vmovl_u8(gb.val[1]));
+            u = vmlaq_n_s16(vmlaq_n_s16(vmlaq_n_s16(s128, r, -38), g, -37), b, 112);
+            v = vmlaq_n_s16(vmlaq_n_s16(vmlaq_n_s16(s128, r, 112), g, -47), b, -18);
+            out.val[1] = vmovn_u16(vreinterpretq_u16_s16(vaddq_s16(vshrq_n_s16(u, 8), s128)));
+            out.val[3] = vmovn_u16(vreinterpretq_u16_s16(vaddq_s16(vshrq_n_s16(v, 8), s128)));
+        }
+
+        vst4_u8(pDst + 2 * x, out);
+    }
+    PixelConv_demosaicTail__(pRg, pGb, pDst, x, width, gray);
+}
+
+/* NEON, vld4 splits even and odd quads, 8 output pairs per iteration */
+static void PixelConv_binRowNeon__ (const uint8_t *pRg, const uint8_t *pGb, uint8_t *pDst,
+                                    uint32_t width, bool_t gray) {
+    const uint16x8_t    c128 = vdupq_n_u16(128);
+    const int16x8_t     s128 = vdupq_n_s16(128);
+    const uint8x8_t     c16 = vdup_n_u8(16);
+    uint8x8x4_t         rg, gb, out;
+    uint16x8_t          y0, y1;
+    int16x8_t           r, g, b, u, v;
+    uint32_t            x;
+
+    for (x = 0; x + 32 <= width; x += 32) {
+        rg = vld4_u8(pRg + x);                       /* R even, G1 even, R odd, G1 odd quads */
+        gb = vld4_u8(pGb + x);                       /* G2 even, B even, G2 odd, B odd quads */
+
+        y0 = vmlal_u8(vmlal_u8(c128, rg.val[0], vdup_n_u8(66)), rg.val[1], vdup_n_u8(65));
+        y0 = vmlal_u8(vmlal_u8(y0, gb.val[0], vdup_n_u8(64)), gb.val[1], vdup_n_u8(25));
+        y1 = vmlal_u8(vmlal_u8(c128, rg.val[2], vdup_n_u8(66)), rg.val[3], vdup_n_u8(65));
+        y1 = vmlal_u8(vmlal_u8(y1, gb.val[2], vdup_n_u8(64)), gb.val[3], vdup_n_u8(25));
+        out.val[0] = vadd_u8(vshrn_n_u16(y0, 8), c16);
+        out.val[2] = vadd_u8(vshrn_n_u16(y1, 8), c16);
+
+        if (gray == TRUE) {
+            out.val[1] = vdup_n_u8(128);
+            out.val[3] = out.val[1];
+        } else {
+            r = vreinterpretq_s16_u16(vmovl_u8(rg.val[0]));                          /* even quad */
+            g = vreinterpretq_s16_u16(vaddl_u8(rg.val[1], gb.val[0]));
+            b = vreinterpretq_s16_u16(vmovl_u8(gb.val[1]));
+            u = vmlaq_n_s16(vmlaq_n_s16(vmlaq_n_s16(s128, r, -38), g, -37), b, 112);
+            r = vreinterpretq_s16_u16(vmovl_u8(rg.val[2]));                           /* odd quad */
+            g = vreinterpretq_s16_u16(vaddl_u8(rg.val[3], gb.val[2]));
+            b = vreinterpretq_s16_u16(vmovl_u8(gb.val[3]));
+            v = vmlaq_n_s16(vmlaq_n_s16(vmlaq_n_s16(s128, r, 112), g, -47), b, -18);
+            out.val[1] = vmovn_u16(vreinterpretq_u16_s16(vaddq_s16(vshrq_n_s16(u, 8), s128)));
+            out.val[3] = vmovn_u16(vreinterpretq_u16_s16(vaddq_s16(vshrq_n_s16(v, 8), s128)));
+        }
+
+        vst4_u8(pDst + x, out);
+    }
+    PixelConv_binTail__(pRg, pGb, pDst, x, width, gray);
+}
+
+/* NEON, vld2 splits luma and chroma bytes, chroma is replaced before vst2 */
+static void PixelConv_grayRowNeon__ (const uint8_t *pSrc, uint8_t *pDst, uint32_t bytes) {
+    uint8x16x2_t    yuv;
+    uint32_t        x;
+
+    for (x = 0; x + 32 <= bytes; x += 32) {
+        yuv = vld2q_u8(pSrc + x);
+        yuv.val[1] = vdupq_n_u8(128);
+        vst2q_u8(pDst + x, yuv);
+    }
+    PixelConv_grayRowScalar__(pSrc + x, pDst + x, bytes - x);
+}
+
+/* NEON, vld4 splits the 4 bytes of every source pair, 32 source pixels per iteration */
+static void PixelConv_halveRowNeon__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pDst,
+                                      uint32_t width) {
+    uint8x16x4_t    top, bottom;
+    uint8x16_t      line;
+    uint8x8x2_t     pairs;
+    uint8x8x4_t     out;
+    uint32_t        x;
+
+    for (x = 0; x + 32 <= width; x += 32) {
+        top = vld4q_u8(pTop + 2 * x);
+        bottom = vld4q_u8(pBottom + 2 * x);
+        line = vrhaddq_u8(vrhaddq_u8(top.val[0], bottom.val[0]),
+                          vrhaddq_u8(top.val[2], bottom.val[2]));
+        pairs = vuzp_u8(vget_low_u8(line), vget_high_u8(line));      /* even and odd source pairs */
+        out.val[0] = pairs.val[0];
+        out.val[2] = pairs.val[1];
+        line = vrhaddq_u8(top.val[1], bottom.val[1]);
+        pairs = vuzp_u8(vget_low_u8(line), vget_high_u8(line));
+        out.val[1] = vrhadd_u8(pairs.val[0], pairs.val[1]);
+        line = vrhaddq_u8(top.val[3], bottom.val[3]);
+        pairs = vuzp_u8(vget_low_u8(line), vget_high_u8(line));
+        out.val[3] = vrhadd_u8(pairs.val[0], pairs.val[1]);
+        vst4_u8(pDst + x, out);
+    }
+    PixelConv_halveTail__(pTop, pBottom, pDst, x, width);
+}
+
+/* NEON, vld4 splits even lumas, U, odd lumas and V of 32 source pixels per iteration */
+static void PixelConv_planarRowNeon__ (const uint8_t *pTop, const uint8_t *pBottom, uint8_t *pYTop,
+                                       uint8_t *pYBottom, uint8_t *pU, uint8_t *pV, uint32_t width,
+                                       bool_t gray) {
+    uint8x16x4_t    top, bottom;
+    uint8x16x2_t    luma, uv;
+    uint32_t        x;
+
+    uv.val[0] = vdupq_n_u8(128);
+    uv.val[1] = uv.val[0];
+    for (x = 0; x + 32 <= width; x += 32) {
+        top = vld4q_u8(pTop + 2 * x);
+        bottom = vld4q_u8(pBottom + 2 * x);
+        luma.val[0] = top.val[0];
+        luma.val[1] = top.val[2];
+        vst2q_u8(pYTop + x, luma);
+        luma.val[0] = bottom.val[0];
+        luma.val[1] = bottom.val[2];
+        vst2q_u8(pYBottom + x, luma);
+        if (gray != TRUE) {
+            uv.val[0] = vrhaddq_u8(top.val[1], bottom.val[1]);
+            uv.val[1] = vrhaddq_u8(top.val[3], bottom.val[3]);
+        }
+        if (pV == NULL) {
+            vst2q_u8(pU + x, uv);
+        } else {
+            vst1q_u8(pU + x / 2, uv.val[0]);
+            vst1q_u8(pV + x / 2, uv.val[1]);
+        }
+    }
+    PixelConv_planarTail__(pTop, pBottom, pYTop, pYBottom, pU, pV, x, width, gray);
+}
+#endif                                                                        /* PIXELCONV_NEON */
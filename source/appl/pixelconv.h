@@ -0,0 +1,58 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef PIXEL_CONV_H
+#define PIXEL_CONV_H
+
+/**
+* \file     pixelconv.h
+* \ingroup  g_applspec
+* \brief    API for the PixelConv module, SIMD pixel format conversion kernels.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "firestreamer.h"                                                               /* bool_t */
+
+/* conversion kernel implementations */
+typedef enum {
+    PIXELCONV_KERNEL_AUTO = 0,                          /* fastest kernel supported by this CPU */
+    PIXELCONV_KERNEL_SCALAR,
+    PIXELCONV_KERNEL_SSE2,
+    PIXELCONV_KERNEL_AVX2,
+    PIXELCONV_KERNEL_NEON,
+    PIXELCONV_KERNEL_COUNT
+} PixelConvKernel_t;
+
+/* conversion flags */
+#define PIXELCONV_FLAG_BINNING      0x00000001          /* 2x2 binning, output is half resolution */
+#define PIXELCONV_FLAG_GRAYSCALE    0x00000002                  /* luma only, chroma set to 128 */
+
+/* PixelConv - API */
+bool_t PixelConv_isKernelSupported(PixelConvKernel_t kernel);
+PixelConvKernel_t PixelConv_getKernel(PixelConvKernel_t kernel);
+const char* PixelConv_getKernelName(PixelConvKernel_t kernel);
+void PixelConv_srggb8ToYuy2(PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                            uint32_t width, uint32_t height, uint8_t *pDst, uint32_t dstStride,
+                            uint32_t flags);
+void PixelConv_yuy2ToGray(PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                          uint32_t width, uint32_t height, uint8_t *pDst, uint32_t dstStride);
+void PixelConv_yuy2Halve(PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                         uint32_t width, uint32_t height, uint8_t *pDst, uint32_t dstStride);
+void PixelConv_yuy2ToNv12(PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                          uint32_t width, uint32_t height, uint8_t *pY, uint32_t yStride,
+                          uint8_t *pUv, uint32_t uvStride, uint32_t flags);
+void PixelConv_yuy2ToI420(PixelConvKernel_t kernel, const uint8_t *pSrc, uint32_t srcStride,
+                          uint32_t width, uint32_t height, uint8_t *pY, uint32_t yStride,
+                          uint8_t *pU, uint8_t *pV, uint32_t uvStride, uint32_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                           /* PIXEL_CONV_H */
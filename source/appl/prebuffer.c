@@ -0,0 +1,301 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     prebuffer.c
+* \ingroup  g_applspec
+* \brief    Implementation of the Prebuffer class, GOP aligned ring of encoded h.264.
+* \author   Milos Ladicorbic
+*
+* Access units are copied back to back into one byte ring, a unit never wraps, the tail of the ring
+* is left unused instead. Space is made by dropping whole GOPs from the old end, so the ring always
+* starts on a key frame and can be written to a file as is. Besides the space, a GOP is dropped as
+* soon as the next one alone still covers the window.
+*
+* A reader that keeps the bytes of a unit beyond the lock of the owner pins it, e.g. a GstBuffer
+* wrapping them. The GOP of a pinned unit is never dropped, a unit that finds no space because of
+* it is dropped instead and the ring waits for the next key frame. Unpinning is lock free.
+*/
+
+#include "prebuffer.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PREBUFFER_NAL_SPS       7
+#define PREBUFFER_NAL_PPS       8
+
+/* private function declarations */
+static PrebufferUnit_t* Prebuffer_getUnit__(Prebuffer_t *pThis, uint32_t index);
+static uint32_t Prebuffer_findNextKey__(Prebuffer_t *pThis);
+static bool_t Prebuffer_dropGop__(Prebuffer_t *pThis);
+static bool_t Prebuffer_isPinned__(Prebuffer_t *pThis, uint32_t n);
+static bool_t Prebuffer_drop__(Prebuffer_t *pThis);
+static bool_t Prebuffer_place__(Prebuffer_t *pThis, uint32_t size, uint32_t *pOffset);
+static uint32_t Prebuffer_findStartCode__(const uint8_t *pData, uint32_t size, uint32_t from);
+static bool_t Prebuffer_scanHeader__(Prebuffer_t *pThis, const uint8_t *pData, uint32_t size);
+
+
+uint32_t Prebuffer_getMemorySize (uint32_t dataSize, uint32_t maxUnits) {
+
+    return maxUnits * (uint32_t)sizeof(PrebufferUnit_t) + dataSize;
+}
+
+void Prebuffer_initialize (Prebuffer_t *pThis, void *pMemory, uint32_t dataSize, uint32_t maxUnits,
+                           uint64_t window) {
+
+    assert(pThis != NULL && pMemory != NULL);
+    assert(dataSize > 0 && maxUnits >= 2);
+
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->pUnits = (PrebufferUnit_t*)pMemory;                 /* index first, it is aligned */
+    pThis->maxUnits = maxUnits;
+    pThis->pData = (uint8_t*)pMemory + maxUnits * sizeof(PrebufferUnit_t);
+    pThis->dataSize = dataSize;
+    pThis->window = window;
+}
+
+bool_t Prebuffer_write (Prebuffer_t *pThis, const uint8_t *pData, uint32_t size, uint64_t pts,
+                        uint64_t dts, uint64_t duration, bool_t keyframe) {
+    PrebufferUnit_t *pUnit;
+    uint32_t        offset;
+    uint32_t        next;
+
+    assert(pThis != NULL && pData != NULL);
+
+    if (((pThis->count == 0) || (pThis->waitKey == TRUE)) && (keyframe != TRUE)) {
+        pThis->dropped++;                                /* waiting for a key frame to start on */
+        return FALSE;
+    }
+    if (size > pThis->dataSize) {
+        return Prebuffer_drop__(pThis);
+    }
+
+    if (keyframe == TRUE) {
+        /* the oldest GOP is not needed once the next one alone covers the window */
+        while ((pts != PREBUFFER_TIME_NONE) && ((next = Prebuffer_findNextKey__(pThis)) != 0) &&
+               (Prebuffer_getUnit__(pThis, next)->pts != PREBUFFER_TIME_NONE) &&
+               (Prebuffer_getUnit__(pThis, next)->pts + pThis->window <= pts) &&
+               (Prebuffer_dropGop__(pThis) == TRUE)) {
+        }
+    }
+
+    while ((pThis->count == pThis->maxUnits) || (Prebuffer_place__(pThis, size, &offset) != TRUE)) {
+        if ((keyframe != TRUE) && (Prebuffer_findNextKey__(pThis) == 0) &&
+            (Prebuffer_isPinned__(pThis, pThis->count) != TRUE)) {
+            /* the current GOP alone is larger than the ring, start over with the next key frame */
+            pThis->dropped += pThis->count + 1;
+            pThis->count = 0;
+            return FALSE;
+        }
+        if (Prebuffer_dropGop__(pThis) != TRUE) {
+            return Prebuffer_drop__(pThis);                /* a reader still holds the oldest GOP */
+        }
+    }
+
+    pUnit = Prebuffer_getUnit__(pThis, pThis->count);
+    pUnit->offset = offset;
+    pUnit->size = size;
+    pUnit->pts = pts;
+    pUnit->dts = dts;
+    pUnit->duration = duration;
+    pUnit->keyframe = keyframe;
+    pUnit->hasHeader = (keyframe == TRUE) ? Prebuffer_scanHeader__(pThis, pData, size) : FALSE;
+    atomic_store_explicit(&pUnit->pins, 0, memory_order_relaxed);
+    memcpy(&pThis->pData[offset], pData, size);
+    pThis->count++;
+    pThis->waitKey = FALSE;
+
+    return TRUE;
+}
+
+uint32_t Prebuffer_getCount (Prebuffer_t *pThis) {
+
+    assert(pThis != NULL);
+    return pThis->count;
+}
+
+const PrebufferUnit_t* Prebuffer_getUnit (Prebuffer_t *pThis, uint32_t index,
+                                          const uint8_t **ppData) {
+    PrebufferUnit_t *pUnit;
+
+    assert(pThis != NULL && ppData != NULL);
+    assert(index < pThis->count);
+
+    pUnit = Prebuffer_getUnit__(pThis, index);                             /* 0 is the oldest */
+    *ppData = &pThis->pData[pUnit->offset];
+    return pUnit;
+}
+
+uint32_t Prebuffer_getHeader (Prebuffer_t *pThis, const uint8_t **ppHeader) {
+
+    assert(pThis != NULL && ppHeader != NULL);
+
+    *ppHeader = pThis->header;
+    return pThis->headerSize;
+}
+
+uint32_t Prebuffer_getDataSize (Prebuffer_t *pThis) {
+
+    assert(pThis != NULL);
+    return pThis->dataSize;
+}
+
+PrebufferUnit_t* Prebuffer_pin (Prebuffer_t *pThis, uint32_t index, const uint8_t **ppData) {
+    PrebufferUnit_t *pUnit;
+
+    assert(pThis != NULL && ppData != NULL);
+    assert(index < pThis->count);
+
+    /* the unit and its bytes stay where they are until Prebuffer_unpin() */
+    pUnit = Prebuffer_getUnit__(pThis, index);
+    atomic_fetch_add_explicit(&pUnit->pins, 1, memory_order_relaxed);
+    *ppData = &pThis->pData[pUnit->offset];
+    return pUnit;
+}
+
+void Prebuffer_unpin (PrebufferUnit_t *pUnit) {
+
+    assert(pUnit != NULL);
+
+    /* any thread, the bytes are not read after it */
+    atomic_fetch_sub_explicit(&pUnit->pins, 1, memory_order_release);
+}
+
+
+/* private function definition */
+static PrebufferUnit_t* Prebuffer_getUnit__ (Prebuffer_t *pThis, uint32_t index) {
+
+    return &pThis->pUnits[(pThis->first + index) % pThis->maxUnits];
+}
+
+static uint32_t Prebuffer_findNextKey__ (Prebuffer_t *pThis) {
+    uint32_t i;
+
+    /* index of the second GOP, 0 if the ring holds one GOP only */
+    for (i = 1; i < pThis->count; i++) {
+        if (Prebuffer_getUnit__(pThis, i)->keyframe == TRUE) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static bool_t Prebuffer_dropGop__ (Prebuffer_t *pThis) {
+    uint32_t n;
+
+    n = Prebuffer_findNextKey__(pThis);
+    if (n == 0) {
+        n = pThis->count;
+    }
+    if (Prebuffer_isPinned__(pThis, n) == TRUE) {
+        return FALSE;
+    }
+    pThis->first = (pThis->first + n) % pThis->maxUnits;
+    pThis->count -= n;
+    return TRUE;
+}
+
+static bool_t Prebuffer_isPinned__ (Prebuffer_t *pThis, uint32_t n) {
+    uint32_t i;
+
+    /* any of the n oldest units, the acquire pairs with the release of Prebuffer_unpin() */
+    for (i = 0; i < n; i++) {
+        if (atomic_load_explicit(&Prebuffer_getUnit__(pThis, i)->pins, memory_order_acquire) != 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static bool_t Prebuffer_drop__ (Prebuffer_t *pThis) {
+
+    /* the unit doesn't fit, the rest of its GOP can't be decoded without it */
+    pThis->dropped++;
+    pThis->waitKey = TRUE;
+    return FALSE;
+}
+
+static bool_t Prebuffer_place__ (Prebuffer_t *pThis, uint32_t size, uint32_t *pOffset) {
+    PrebufferUnit_t *pNewest;
+    uint32_t        tail;
+    uint32_t        head;
+
+    if (pThis->count == 0) {
+        *pOffset = 0;
+        return TRUE;
+    }
+    tail = Prebuffer_getUnit__(pThis, 0)->offset;
+    pNewest = Prebuffer_getUnit__(pThis, pThis->count - 1);
+    head = pNewest->offset + pNewest->size;
+
+    if (head > tail) {
+        /* used space is [tail, head), free are the end and the start of the ring */
+        if (pThis->dataSize - head >= size) {
+            *pOffset = head;
+            return TRUE;
+        }
+        if (tail >= size) {
+            *pOffset = 0;
+            return TRUE;
+        }
+        return FALSE;
+    }
+    /* wrapped, free is [head, tail). head == tail means the ring is full */
+    if ((head != tail) && (tail - head >= size)) {
+        *pOffset = head;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static uint32_t Prebuffer_findStartCode__ (const uint8_t *pData, uint32_t size, uint32_t from) {
+    uint32_t i;
+
+    for (i = from; i + 3 <= size; i++) {
+        if ((pData[i] == 0) && (pData[i + 1] == 0) && (pData[i + 2] == 1)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+static bool_t Prebuffer_scanHeader__ (Prebuffer_t *pThis, const uint8_t *pData, uint32_t size) {
+    static const uint8_t startCode[4] = { 0, 0, 0, 1 };
+    uint32_t    nal;
+    uint32_t    begin;
+    uint32_t    end;
+    uint32_t    type;
+    bool_t      found = FALSE;
+
+    /* keep the SPS and PPS of the newest key frame that has them, Annex B byte-stream */
+    nal = Prebuffer_findStartCode__(pData, size, 0);
+    while (nal < size) {
+        begin = nal + 3;
+        nal = Prebuffer_findStartCode__(pData, size, begin);
+        end = nal;
+        while ((end > begin) && (pData[end - 1] == 0)) {
+            end--;                                 /* zero byte of a 4 byte start code, padding */
+        }
+        if (end == begin) {
+            continue;
+        }
+        type = pData[begin] & 0x1f;
+        if ((type == PREBUFFER_NAL_SPS) && (found != TRUE)) {
+            found = TRUE;
+            pThis->headerSize = 0;
+        }
+        if ((found == TRUE) && ((type == PREBUFFER_NAL_SPS) || (type == PREBUFFER_NAL_PPS)) &&
+            (pThis->headerSize + sizeof(startCode) + (end - begin) <= PREBUFFER_HEADER_MAX)) {
+            memcpy(&pThis->header[pThis->headerSize], startCode, sizeof(startCode));
+            memcpy(&pThis->header[pThis->headerSize + sizeof(startCode)], &pData[begin],
+                   end - begin);
+            pThis->headerSize += sizeof(startCode) + (end - begin);
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,73 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef PREBUFFER_H
+#define PREBUFFER_H
+
+/**
+* \file     prebuffer.h
+* \ingroup  g_applspec
+* \brief    API for the Prebuffer class, GOP aligned ring of the last seconds of encoded h.264.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "firestreamer.h"                                                               /* bool_t */
+
+#define PREBUFFER_TIME_NONE     UINT64_MAX                   /* same value as GST_CLOCK_TIME_NONE */
+#define PREBUFFER_HEADER_MAX    256                       /* bytes of SPS and PPS NAL units kept */
+
+/* one access unit, its bytes are in the data ring */
+typedef struct PrebufferUnitTag {
+    uint32_t                offset;                                        /* into the data ring */
+    uint32_t                size;
+    uint64_t                pts;                                     /* ns or PREBUFFER_TIME_NONE */
+    uint64_t                dts;
+    uint64_t                duration;
+    bool_t                  keyframe;                                           /* IDR, GOP start */
+    bool_t                  hasHeader;                             /* carries its own SPS and PPS */
+    _Atomic uint32_t        pins;                /* readers of the bytes, its GOP is kept till 0 */
+} PrebufferUnit_t;
+
+/* the Prebuffer object's data structure, embedded by the owner. Memory is given to
+ * Prebuffer_initialize() once, the first unit is always a key frame. Not thread safe, but for
+ * Prebuffer_unpin() */
+typedef struct PrebufferTag {
+    uint8_t                 *pData;                                                 /* data ring */
+    uint32_t                dataSize;
+    PrebufferUnit_t         *pUnits;                                                /* unit ring */
+    uint32_t                maxUnits;
+    uint32_t                first;                                    /* oldest unit, a key frame */
+    uint32_t                count;
+    uint64_t                window;                      /* ns kept before the newest key frame */
+    uint8_t                 header[PREBUFFER_HEADER_MAX];           /* last SPS and PPS, Annex B */
+    uint32_t                headerSize;
+    uint32_t                dropped;           /* units discarded because their GOP didn't fit */
+    bool_t                  waitKey;                  /* a unit was dropped, the GOP is broken */
+} Prebuffer_t;
+
+/* Prebuffer - API */
+uint32_t Prebuffer_getMemorySize(uint32_t dataSize, uint32_t maxUnits);
+void Prebuffer_initialize(Prebuffer_t *pThis, void *pMemory, uint32_t dataSize, uint32_t maxUnits,
+                          uint64_t window);
+bool_t Prebuffer_write(Prebuffer_t *pThis, const uint8_t *pData, uint32_t size, uint64_t pts,
+                       uint64_t dts, uint64_t duration, bool_t keyframe);
+uint32_t Prebuffer_getCount(Prebuffer_t *pThis);
+const PrebufferUnit_t* Prebuffer_getUnit(Prebuffer_t *pThis, uint32_t index,
+                                         const uint8_t **ppData);
+uint32_t Prebuffer_getHeader(Prebuffer_t *pThis, const uint8_t **ppHeader);
+uint32_t Prebuffer_getDataSize(Prebuffer_t *pThis);
+PrebufferUnit_t* Prebuffer_pin(Prebuffer_t *pThis, uint32_t index, const uint8_t **ppData);
+void Prebuffer_unpin(PrebufferUnit_t *pUnit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                             /* PREBUFFER_H */
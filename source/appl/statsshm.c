@@ -0,0 +1,267 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     statsshm.c
+* \ingroup  g_applspec
+* \brief    Implementation of the StatsShm class, live stream counters in POSIX shared memory.
+* \author   Milos Ladicorbic
+*
+* Every stream has a slot of its own, written by one thread with a sequence lock: seq is made odd,
+* the values are copied and seq is made even again. A reader copies the values between two loads
+* of seq and takes the copy only if both are the same even number, so it never blocks the writer
+* and needs no system call once the segment is mapped. The segment is created by the streamer and
+* unlinked by it on close, a reader that still has it mapped sees the writer pid going to 0.
+*/
+
+#include "statsshm.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STATSSHM_READ_TRIES     16             /* a write takes well below 1 us, retries are rare */
+
+/* private function declarations */
+static bool_t StatsShm_isValidName__(const char *pName);
+static bool_t StatsShm_isWriterAlive__(StatsShmBlock_t *pBlock);
+
+
+bool_t StatsShm_create (StatsShm_t *pThis, const char *pName) {
+    StatsShmBlock_t *pBlock;
+    struct stat     st;
+    size_t          size;
+    bool_t          alive = FALSE;
+    int             fd;
+
+    assert(pThis != NULL && pName != NULL);
+
+    memset(pThis, 0, sizeof(*pThis));
+    if (StatsShm_isValidName__(pName) != TRUE) {
+        fprintf(stderr, "ERROR: stats segment '%s', the name must be /<name>\n", pName);
+        return FALSE;
+    }
+    fd = shm_open(pName, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: stats segment '%s', shm_open, %s\n", pName, strerror(errno));
+        return FALSE;
+    }
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "ERROR: stats segment '%s', fstat, %s\n", pName, strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    /* a segment left behind by a crashed streamer is taken over, one of a running one is not. It
+     * is checked before the truncate, a size change under a live mapping raises SIGBUS there */
+    size = ((size_t)st.st_size < sizeof(StatsShmBlock_t)) ? (size_t)st.st_size :
+                                                           sizeof(StatsShmBlock_t);
+    if (size >= offsetof(StatsShmBlock_t, stream)) {
+        pBlock = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (pBlock != MAP_FAILED) {
+            alive = StatsShm_isWriterAlive__(pBlock);
+            if (alive == TRUE) {
+                fprintf(stderr, "ERROR: stats segment '%s' is written by process %u\n", pName,
+                        atomic_load_explicit(&pBlock->pid, memory_order_relaxed));
+            }
+            munmap(pBlock, size);
+        }
+    }
+    if (alive == TRUE) {
+        close(fd);
+        return FALSE;
+    }
+
+    /* new or abandoned, nobody else has it mapped for writing */
+    if (ftruncate(fd, sizeof(StatsShmBlock_t)) != 0) {
+        fprintf(stderr, "ERROR: stats segment '%s', ftruncate, %s\n", pName, strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+    pBlock = mmap(NULL, sizeof(StatsShmBlock_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);                                                   /* the mapping keeps the segment */
+    if (pBlock == MAP_FAILED) {
+        fprintf(stderr, "ERROR: stats segment '%s', mmap, %s\n", pName, strerror(errno));
+        return FALSE;
+    }
+
+    /* readers check the magic first, it is set once the rest of the header is valid */
+    atomic_store_explicit(&pBlock->magic, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memset(pBlock->stream, 0, sizeof(pBlock->stream));
+    pBlock->version = STATSSHM_VERSION;
+    pBlock->size = sizeof(StatsShmBlock_t);
+    pBlock->streams = STATSSHM_STREAMS;
+    pBlock->reserved = 0;
+    atomic_store_explicit(&pBlock->pid, (uint32_t)getpid(), memory_order_relaxed);
+    atomic_store_explicit(&pBlock->magic, STATSSHM_MAGIC, memory_order_release);
+
+    pThis->pBlock = pBlock;
+    pThis->writer = TRUE;
+    snprintf(pThis->name, sizeof(pThis->name), "%s", pName);
+    return TRUE;
+}
+
+bool_t StatsShm_open (StatsShm_t *pThis, const char *pName) {
+    StatsShmBlock_t *pBlock;
+    struct stat     st;
+    int             fd;
+
+    assert(pThis != NULL && pName != NULL);
+
+    memset(pThis, 0, sizeof(*pThis));
+    if (StatsShm_isValidName__(pName) != TRUE) {
+        fprintf(stderr, "ERROR: stats segment '%s', the name must be /<name>\n", pName);
+        return FALSE;
+    }
+    fd = shm_open(pName, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: stats segment '%s', shm_open, %s\n", pName, strerror(errno));
+        return FALSE;
+    }
+    if (fstat(fd, &st) != 0) {
+        st.st_size = 0;
+    }
+    if (st.st_size != (off_t)sizeof(StatsShmBlock_t)) {
+        fprintf(stderr, "ERROR: stats segment '%s' has %lld bytes, expected %zu\n", pName,
+                (long long)st.st_size, sizeof(StatsShmBlock_t));
+        close(fd);
+        return FALSE;
+    }
+    pBlock = mmap(NULL, sizeof(StatsShmBlock_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pBlock == MAP_FAILED) {
+        fprintf(stderr, "ERROR: stats segment '%s', mmap, %s\n", pName, strerror(errno));
+        return FALSE;
+    }
+    if ((atomic_load_explicit(&pBlock->magic, memory_order_acquire) != STATSSHM_MAGIC) ||
+        (pBlock->version != STATSSHM_VERSION) || (pBlock->size != sizeof(StatsShmBlock_t)) ||
+        (pBlock->streams != STATSSHM_STREAMS)) {
+        fprintf(stderr, "ERROR: stats segment '%s' is not a version %d block\n", pName,
+                STATSSHM_VERSION);
+        munmap(pBlock, sizeof(StatsShmBlock_t));
+        return FALSE;
+    }
+
+    pThis->pBlock = pBlock;
+    pThis->writer = FALSE;
+    snprintf(pThis->name, sizeof(pThis->name), "%s", pName);
+    return TRUE;
+}
+
+void StatsShm_close (StatsShm_t *pThis) {
+
+    assert(pThis != NULL);
+
+    if (pThis->pBlock == NULL) {
+        return;
+    }
+    if (pThis->writer == TRUE) {
+        atomic_store_explicit(&pThis->pBlock->pid, 0, memory_order_release);
+        shm_unlink(pThis->name);
+    }
+    munmap(pThis->pBlock, sizeof(StatsShmBlock_t));
+    pThis->pBlock = NULL;
+}
+
+bool_t StatsShm_isOpen (StatsShm_t *pThis) {
+
+    assert(pThis != NULL);
+    return (pThis->pBlock != NULL) ? TRUE : FALSE;
+}
+
+void StatsShm_publish (StatsShm_t *pThis, uint32_t slot, const StatsShmValues_t *pValues) {
+    StatsShmStream_t *pStream;
+    uint32_t        seq;
+
+    assert(pThis != NULL && pThis->writer == TRUE && pValues != NULL);
+    assert(slot < STATSSHM_STREAMS);
+
+    pStream = &pThis->pBlock->stream[slot];
+    seq = atomic_load_explicit(&pStream->seq, memory_order_relaxed);
+    atomic_store_explicit(&pStream->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);               /* odd seq is seen before the values */
+    pStream->values = *pValues;
+    pStream->inUse = 1;
+    atomic_store_explicit(&pStream->seq, seq + 2, memory_order_release);
+}
+
+void StatsShm_release (StatsShm_t *pThis, uint32_t slot) {
+    StatsShmStream_t *pStream;
+    uint32_t        seq;
+
+    assert(pThis != NULL && pThis->writer == TRUE);
+    assert(slot < STATSSHM_STREAMS);
+
+    pStream = &pThis->pBlock->stream[slot];
+    seq = atomic_load_explicit(&pStream->seq, memory_order_relaxed);
+    atomic_store_explicit(&pStream->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memset(&pStream->values, 0, sizeof(pStream->values));
+    pStream->inUse = 0;
+    atomic_store_explicit(&pStream->seq, seq + 2, memory_order_release);
+}
+
+bool_t StatsShm_read (StatsShm_t *pThis, uint32_t slot, StatsShmValues_t *pValues) {
+    StatsShmStream_t *pStream;
+    uint32_t        begin;
+    uint32_t        inUse;
+    uint32_t        i;
+
+    assert(pThis != NULL && pThis->pBlock != NULL && pValues != NULL);
+    assert(slot < STATSSHM_STREAMS);
+
+    /* FALSE for a free slot and for one that was rewritten during every try */
+    pStream = &pThis->pBlock->stream[slot];
+    for (i = 0; i < STATSSHM_READ_TRIES; i++) {
+        begin = atomic_load_explicit(&pStream->seq, memory_order_acquire);
+        if ((begin & 1) != 0) {
+            continue;                                                        /* write in progress */
+        }
+        inUse = pStream->inUse;
+        *pValues = pStream->values;
+        atomic_thread_fence(memory_order_acquire);           /* the copy is done before the check */
+        if (atomic_load_explicit(&pStream->seq, memory_order_relaxed) == begin) {
+            pValues->name[STATSSHM_NAME_MAX - 1] = '\0';
+            return (inUse == 1) ? TRUE : FALSE;
+        }
+    }
+    return FALSE;
+}
+
+uint32_t StatsShm_getWriterPid (StatsShm_t *pThis) {
+
+    assert(pThis != NULL && pThis->pBlock != NULL);
+    return atomic_load_explicit(&pThis->pBlock->pid, memory_order_acquire);
+}
+
+
+/* private function definition */
+static bool_t StatsShm_isValidName__ (const char *pName) {
+
+    /* one path component, see shm_overview(7) */
+    return ((pName[0] == '/') && (pName[1] != '\0') && (strchr(pName + 1, '/') == NULL) &&
+            (strlen(pName) < STATSSHM_NAME_MAX)) ? TRUE : FALSE;
+}
+
+static bool_t StatsShm_isWriterAlive__ (StatsShmBlock_t *pBlock) {
+    uint32_t pid;
+
+    if (atomic_load_explicit(&pBlock->magic, memory_order_acquire) != STATSSHM_MAGIC) {
+        return FALSE;                                                   /* new or not initialized */
+    }
+    pid = atomic_load_explicit(&pBlock->pid, memory_order_relaxed);
+    if ((pid == 0) || (pid == (uint32_t)getpid())) {
+        return FALSE;
+    }
+    return ((kill((pid_t)pid, 0) == 0) || (errno == EPERM)) ? TRUE : FALSE;
+}
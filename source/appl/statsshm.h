@@ -0,0 +1,89 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef STATSSHM_H
+#define STATSSHM_H
+
+/**
+* \file     statsshm.h
+* \ingroup  g_applspec
+* \brief    API for the StatsShm class, live stream counters in POSIX shared memory.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "firestreamer.h"                                   /* bool_t, FIRESTREAMER_MAX_INSTANCES */
+
+#define STATSSHM_MAGIC          0x53545346u                               /* "FSTS" in memory, LE */
+#define STATSSHM_VERSION        1                 /* bumped with every change of the block layout */
+#define STATSSHM_NAME_MAX       64
+#define STATSSHM_STREAMS        FIRESTREAMER_MAX_INSTANCES               /* one slot per instance */
+
+/* counters of one stream. Fixed size fields only, 8 byte aligned, the layout is the ABI */
+typedef struct StatsShmValuesTag {
+    char                    name[STATSSHM_NAME_MAX];                       /* url, NUL terminated */
+    uint64_t                updatedNs;                            /* CLOCK_MONOTONIC of the write */
+    uint64_t                captured;                             /* frames offered by push calls */
+    uint64_t                pushed;                              /* frames accepted by the appsrc */
+    uint64_t                dropped;                    /* push queue overflow and pool exhausted */
+    uint64_t                skipped;                                  /* back-pressure and motion */
+    uint64_t                sensorDropped;                      /* frames missing in the sequence */
+    uint64_t                encoded;                           /* h.264 frames out of the encoder */
+    uint64_t                sent;                             /* h.264 frames into the video sink */
+    uint64_t                bytesEncoded;
+    uint32_t                bitrate;                       /* kbit/s encoded since the last write */
+    uint32_t                targetBitrate;                             /* encoder setting, kbit/s */
+    uint32_t                fpsMilli;           /* encoded frames per 1000 s since the last write */
+    uint32_t                state;                               /* GstState of the main pipeline */
+    uint32_t                feeding;                           /* 1 while the appsrc takes frames */
+    uint32_t                reconnects;                 /* RTSP outputs connected after an outage */
+    uint32_t                decimation;                       /* 1 of 2^decimation frames is kept */
+    uint32_t                reserved;                                         /* 8 byte alignment */
+} StatsShmValues_t;
+
+/* one slot, written by one thread. seq is odd while a write is in progress */
+typedef struct StatsShmStreamTag {
+    _Atomic uint32_t        seq;
+    uint32_t                inUse;                              /* 1 while a stream owns the slot */
+    StatsShmValues_t        values;
+} StatsShmStream_t;
+
+/* the whole segment, magic is written last by the creator */
+typedef struct StatsShmBlockTag {
+    _Atomic uint32_t        magic;                             /* STATSSHM_MAGIC once initialized */
+    uint32_t                version;                                          /* STATSSHM_VERSION */
+    uint32_t                size;                                      /* sizeof(StatsShmBlock_t) */
+    uint32_t                streams;                                          /* STATSSHM_STREAMS */
+    _Atomic uint32_t        pid;                           /* of the writer, 0 once it has closed */
+    uint32_t                reserved;
+    StatsShmStream_t        stream[STATSSHM_STREAMS];
+} StatsShmBlock_t;
+
+/* the StatsShm object's data structure, embedded by the owner. One writer process per name */
+typedef struct StatsShmTag {
+    StatsShmBlock_t         *pBlock;                                  /* mapping or NULL (closed) */
+    bool_t                  writer;                          /* created it, unlinked by the close */
+    char                    name[STATSSHM_NAME_MAX];                        /* e.g. /firestreamer */
+} StatsShm_t;
+
+/* StatsShm - API */
+bool_t StatsShm_create(StatsShm_t *pThis, const char *pName);
+bool_t StatsShm_open(StatsShm_t *pThis, const char *pName);
+void StatsShm_close(StatsShm_t *pThis);
+bool_t StatsShm_isOpen(StatsShm_t *pThis);
+void StatsShm_publish(StatsShm_t *pThis, uint32_t slot, const StatsShmValues_t *pValues);
+void StatsShm_release(StatsShm_t *pThis, uint32_t slot);
+bool_t StatsShm_read(StatsShm_t *pThis, uint32_t slot, StatsShmValues_t *pValues);
+uint32_t StatsShm_getWriterPid(StatsShm_t *pThis);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                              /* STATSSHM_H */
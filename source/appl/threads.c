@@ -0,0 +1,157 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     threads.c
+* \ingroup  g_applspec
+* \brief    Implementation of the Threads module, thread layout by role and wake-up latency.
+* \author   Milos Ladicorbic
+*
+* A role is applied by the thread itself, right after it started: Threads_apply() names the calling
+* thread and sets its CPU affinity and scheduling policy. A role left at the default gets all CPUs
+* and SCHED_OTHER explicitly, a new thread keeps the RT policy and pinning of its creator otherwise.
+* A refused setting (no CAP_SYS_NICE, CPU not online) is reported once per role and the thread keeps
+* running with what it had.
+*
+* The wake-up latency of a role is the time from the event a thread waited for to the moment it
+* runs: V4L2 buffer timestamp to dequeue for capture, ring push to pop for push threads, message
+* post to dispatch for the bus and push_buffer() to the appsrc pad for streaming threads.
+*/
+
+#define _GNU_SOURCE                                                 /* See feature_test_macros(7) */
+#include "threads.h"
+#include "histogram.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define THREADS_NAME_MAX        16                              /* pthread_setname_np() limit + 1 */
+
+/* one role, the config is written before the threads start and only read afterwards */
+typedef struct ThreadsSlotTag {
+    ThreadsConfig_t         config;
+    _Atomic uint32_t        threads;
+    _Atomic uint32_t        failures;
+    Histogram_t             wake;                                          /* wake-up latency, us */
+} ThreadsSlot_t;
+
+static ThreadsSlot_t l_roles[THREADS_ROLE_COUNT];                          /* zero is the default */
+static const char* const l_roleName[THREADS_ROLE_COUNT] = {
+    "capture", "push", "bus", "streaming"
+};
+
+
+void Threads_configure (ThreadsRole_t role, const ThreadsConfig_t *pConfig) {
+
+    assert(role < THREADS_ROLE_COUNT && pConfig != NULL);
+    assert((pConfig->policy == THREADS_POLICY_OTHER) ||
+           (pConfig->priority >= 1 && pConfig->priority <= 99));
+
+    l_roles[role].config = *pConfig;
+}
+
+bool_t Threads_apply (ThreadsRole_t role, const char *pName) {
+    ThreadsSlot_t       *pRole;
+    struct sched_param  param;
+    cpu_set_t           cpus;
+    char                name[THREADS_NAME_MAX];
+    int                 policy;
+    int                 ret;
+    long                nCpus;
+    uint32_t            i;
+    bool_t              success = TRUE;
+    bool_t              quiet;
+
+    assert(role < THREADS_ROLE_COUNT);
+    pRole = &l_roles[role];
+    quiet = (atomic_load(&pRole->failures) != 0) ? TRUE : FALSE;        /* reported once per role */
+
+    if (pName != NULL) {
+        snprintf(name, sizeof(name), "%s", pName);                             /* cut to 15 chars */
+        pthread_setname_np(pthread_self(), name);
+    }
+
+    CPU_ZERO(&cpus);
+    if (pRole->config.cpus != 0) {
+        for (i = 0; i < 32; i++) {
+            if ((pRole->config.cpus & (1u << i)) != 0) {
+                CPU_SET(i, &cpus);
+            }
+        }
+    } else {
+        nCpus = sysconf(_SC_NPROCESSORS_CONF);              /* the kernel leaves out offline ones */
+        for (i = 0; (i < (uint32_t)nCpus) && (i < CPU_SETSIZE); i++) {
+            CPU_SET(i, &cpus);
+        }
+    }
+    ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (ret != 0) {
+        if (quiet != TRUE) {
+            fprintf(stderr, "ERROR: %s threads, CPU mask 0x%x, %s\n", l_roleName[role],
+                    pRole->config.cpus, strerror(ret));
+        }
+        success = FALSE;
+    }
+
+    memset(&param, 0, sizeof(param));
+    if (pRole->config.policy == THREADS_POLICY_OTHER) {
+        policy = SCHED_OTHER;                                         /* priority 0, the only one */
+    } else {
+        policy = (pRole->config.policy == THREADS_POLICY_FIFO) ? SCHED_FIFO : SCHED_RR;
+        param.sched_priority = (int)pRole->config.priority;
+    }
+    ret = pthread_setschedparam(pthread_self(), policy, &param);
+    if (ret != 0) {
+        if (quiet != TRUE) {
+            fprintf(stderr, "ERROR: %s threads, %s priority %d, %s\n", l_roleName[role],
+                    (policy == SCHED_FIFO) ? "SCHED_FIFO" :
+                    (policy == SCHED_RR) ? "SCHED_RR" : "SCHED_OTHER",
+                    param.sched_priority, strerror(ret));
+        }
+        success = FALSE;
+    }
+
+    atomic_fetch_add(&pRole->threads, 1);
+    if (success != TRUE) {
+        atomic_fetch_add(&pRole->failures, 1);
+    }
+    return success;
+}
+
+void Threads_recordWake (ThreadsRole_t role, int64_t latencyUs) {
+
+    assert(role < THREADS_ROLE_COUNT);
+
+    if (latencyUs >= 0) {                                       /* clocks of unknown origin, skip */
+        Histogram_record(&l_roles[role].wake, (latencyUs > UINT32_MAX) ? UINT32_MAX :
+                                                                         (uint32_t)latencyUs);
+    }
+}
+
+void Threads_getStats (ThreadsRole_t role, ThreadsStats_t *pStats) {
+    ThreadsSlot_t *pRole;
+
+    assert(role < THREADS_ROLE_COUNT && pStats != NULL);
+    pRole = &l_roles[role];
+
+    pStats->threads = atomic_load(&pRole->threads);
+    pStats->failures = atomic_load(&pRole->failures);
+    pStats->count = Histogram_getCount(&pRole->wake);
+    pStats->p50 = Histogram_getPercentile(&pRole->wake, 50);
+    pStats->p99 = Histogram_getPercentile(&pRole->wake, 99);
+    pStats->max = Histogram_getMax(&pRole->wake);
+}
+
+const char* Threads_getRoleName (ThreadsRole_t role) {
+
+    assert(role < THREADS_ROLE_COUNT);
+    return l_roleName[role];
+}
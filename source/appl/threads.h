@@ -0,0 +1,66 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+#ifndef THREADS_H
+#define THREADS_H
+
+/**
+* \file     threads.h
+* \ingroup  g_applspec
+* \brief    API for the Threads module, thread layout (names, CPU affinity, scheduling) by role.
+* \author   Milos Ladicorbic
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "firestreamer.h"                                                               /* bool_t */
+
+/* every thread of the process belongs to one role, all threads of a role share its layout */
+typedef enum {
+    THREADS_ROLE_CAPTURE = 0,                       /* Capture_run(), a thread of the application */
+    THREADS_ROLE_PUSH,                                       /* push thread of every FireStreamer */
+    THREADS_ROLE_BUS,                                              /* shared GStreamer bus thread */
+    THREADS_ROLE_STREAMING,                 /* GStreamer streaming threads, appsrc, queues, sinks */
+    THREADS_ROLE_COUNT
+} ThreadsRole_t;
+
+/* scheduling policy of a role */
+typedef enum {
+    THREADS_POLICY_OTHER = 0,                                 /* SCHED_OTHER, normal time sharing */
+    THREADS_POLICY_FIFO,                                        /* SCHED_FIFO, needs CAP_SYS_NICE */
+    THREADS_POLICY_RR                                             /* SCHED_RR, needs CAP_SYS_NICE */
+} ThreadsPolicy_t;
+
+/* layout of a role, all zero is the default: any CPU, SCHED_OTHER */
+typedef struct ThreadsConfigTag {
+    uint32_t                cpus;                        /* affinity, bit n = CPU n, 0 = all CPUs */
+    ThreadsPolicy_t         policy;
+    uint32_t                priority;                                  /* 1..99, FIFO and RR only */
+} ThreadsConfig_t;
+
+/* threads placed and their wake-up latency, us, see Threads_recordWake() */
+typedef struct ThreadsStatsTag {
+    uint32_t                threads;                           /* threads the role was applied to */
+    uint32_t                failures;          /* affinity or policy refused, thread kept running */
+    uint32_t                count;                                           /* wake-ups recorded */
+    uint32_t                p50;
+    uint32_t                p99;
+    uint32_t                max;
+} ThreadsStats_t;
+
+/* Threads - API, configure the roles before the threads are started */
+void Threads_configure(ThreadsRole_t role, const ThreadsConfig_t *pConfig);
+bool_t Threads_apply(ThreadsRole_t role, const char *pName);
+void Threads_recordWake(ThreadsRole_t role, int64_t latencyUs);
+void Threads_getStats(ThreadsRole_t role, ThreadsStats_t *pStats);
+const char* Threads_getRoleName(ThreadsRole_t role);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                                                                               /* THREADS_H */
@@ -0,0 +1,143 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     demosaic_bench.c
+* \ingroup  g_applspec
+* \brief    Micro-benchmark of the PixelConv SRGGB8 to YUY2 and of the YUY2 kernels.
+* \author   Milos Ladicorbic
+*
+* Runs every kernel supported by the CPU on the same random Bayer frame, checks the output against
+* the scalar kernel and reports throughput in source MPix/s. The YUY2 modes (grayscale, halving,
+* NV12 and I420 split, the split in color and in grayscale) take half of the random frame as their
+* source.
+*
+*   demosaic_bench [width] [height] [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "appl/pixelconv.h"
+
+static const char* const l_modeName[] = {
+    "full", "binning", "fullgray", "bingray", "yuy2gray", "yuy2half", "yuy2nv12", "yuy2i420",
+    "nv12gray", "i420gray"
+};
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void convert(PixelConvKernel_t kernel, uint32_t mode, const uint8_t *pSrc, uint32_t width,
+                    uint32_t height, uint8_t *pDst, uint32_t dstStride, uint32_t flags)
+{
+    if ((mode == 7) || (mode == 9)) {
+        PixelConv_yuy2ToI420(kernel, pSrc, width * 2, width, height, pDst, width,
+                             pDst + width * height, pDst + width * height * 5 / 4, width / 2,
+                             flags & PIXELCONV_FLAG_GRAYSCALE);
+    } else if ((mode == 6) || (mode == 8)) {
+        PixelConv_yuy2ToNv12(kernel, pSrc, width * 2, width, height, pDst, width,
+                             pDst + width * height, width, flags & PIXELCONV_FLAG_GRAYSCALE);
+    } else if (mode == 5) {
+        PixelConv_yuy2Halve(kernel, pSrc, width * 2, width, height, pDst, dstStride);
+    } else if (mode == 4) {
+        PixelConv_yuy2ToGray(kernel, pSrc, width * 2, width, height, pDst, dstStride);
+    } else {
+        PixelConv_srggb8ToYuy2(kernel, pSrc, width, width, height, pDst, dstStride, flags);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    uint32_t            width = (argc > 1) ? (uint32_t)atoi(argv[1]) : 768;
+    uint32_t            height = (argc > 2) ? (uint32_t)atoi(argv[2]) : 288;
+    uint32_t            iterations = (argc > 3) ? (uint32_t)atoi(argv[3]) : 500;
+    uint32_t            mode, i, dstStride, dstSize, flags;
+    PixelConvKernel_t   kernel;
+    uint8_t             *pSrc, *pDst, *pRef;
+    double              start, seconds;
+    int                 failed = 0;
+
+    if ((width < 4) || (width % 4 != 0) || (height < 2) || (height % 2 != 0) || (iterations == 0)) {
+        printf("Usage: %s [width, multiple of 4] [height, even] [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    pSrc = malloc((size_t)width * height);
+    pDst = malloc((size_t)width * height * 2);
+    pRef = malloc((size_t)width * height * 2);
+    if (!pSrc || !pDst || !pRef) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for (i = 0; i < width * height; i++) {
+        pSrc[i] = (uint8_t)rand();
+    }
+
+    printf("SRGGB8 -> YUY2, %ux%u, %u iterations\n", width, height, iterations);
+    for (mode = 0; mode < 10; mode++) {
+        flags = ((mode % 2) == 0) ? 0 : PIXELCONV_FLAG_BINNING;
+        flags |= ((mode >= 2) && (mode != 6) && (mode != 7)) ? PIXELCONV_FLAG_GRAYSCALE : 0;
+        dstStride = ((mode % 2) == 0) ? width * 2 : width;
+        dstSize = ((mode % 2) == 0) ? width * height * 2 : width * height / 2;
+
+        if (mode == 4) {
+            /* YUY2 to gray, the first half of the random frame serves as YUY2 source */
+            height /= 2;
+            dstSize = width * height * 2;
+        }
+        if (mode == 5) {
+            /* YUY2 halved in both directions, same source as above */
+            if (height < 2) {
+                break;
+            }
+            height &= ~1u;
+            dstStride = width;
+            dstSize = width * height / 2;
+        }
+        if (mode >= 6) {
+            /* YUY2 split into planar 4:2:0, same source and height as above, in grayscale from 8 */
+            dstSize = width * height * 3 / 2;
+        }
+        convert(PIXELCONV_KERNEL_SCALAR, mode, pSrc, width, height, pRef, dstStride, flags);
+
+        for (kernel = PIXELCONV_KERNEL_SCALAR; kernel < PIXELCONV_KERNEL_COUNT; kernel++) {
+            if (PixelConv_isKernelSupported(kernel) != TRUE) {
+                continue;
+            }
+            memset(pDst, 0, dstSize);
+            convert(kernel, mode, pSrc, width, height, pDst, dstStride, flags);
+            if (memcmp(pDst, pRef, dstSize) != 0) {
+                printf("%-8s %-8s output differs from scalar kernel!\n", l_modeName[mode],
+                       PixelConv_getKernelName(kernel));
+                failed = 1;
+                continue;
+            }
+
+            start = nowSeconds();
+            for (i = 0; i < iterations; i++) {
+                convert(kernel, mode, pSrc, width, height, pDst, dstStride, flags);
+            }
+            seconds = nowSeconds() - start;
+            printf("%-8s %-8s %10.1f MPix/s %8.3f ms/frame\n", l_modeName[mode],
+                   PixelConv_getKernelName(kernel),
+                   (double)width * height * iterations / seconds / 1e6,
+                   seconds * 1e3 / iterations);
+        }
+    }
+
+    free(pSrc);
+    free(pDst);
+    free(pRef);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,367 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     firestreamer_bench.c
+* \ingroup  g_applspec
+* \brief    Camera-less benchmark of the whole FireStreamer pipeline, prints one JSON object.
+* \author   Milos Ladicorbic
+*
+* Synthetic frames (color bars, noise or a moving box over bars) are generated up front and pushed
+* through FireStreamer_pushFrame() at a fixed rate, or as fast as the pipeline takes them with -r 0.
+* The stream goes to fake://, file:///path or a local RTSP server. Reported are the sustained rate
+* of frames out of the pipeline, CPU time and heap allocations per frame and the end-to-end
+* latency of the FireStreamer tracing.
+*
+*   firestreamer_bench [-w width] [-h height] [-f yuy2|srggb8] [-p bars|noise|motion] [-r fps]
+*                      [-n frames] [-u url] [-e encoder] [-g]
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "appl/firestreamer.h"
+#include "appl/json.h"
+
+#ifndef GIT_COMMIT
+#define GIT_COMMIT "unknown"
+#endif
+
+#define FRAME_SET       16                      /* generated frames, pushed round robin */
+#define BOX_SIZE        64                                  /* moving box of the motion pattern */
+#define DRAIN_IDLE_US   300000            /* no frame out for this long, the pipeline is drained */
+#define READY_WAIT_US   10000000        /* create() returns at once, the run starts when ready */
+
+static const char* const l_patternName[] = { "bars", "noise", "motion" };
+static const char* const l_stageName[FIRESTREAMER_STAGE_COUNT] = {
+    "capture", "convert", "queue", "encode", "send", "total"
+};
+/* 75 % color bars, RGB */
+static const uint8_t l_bars[8][3] = {
+    { 191, 191, 191 }, { 191, 191, 0 }, { 0, 191, 191 }, { 0, 191, 0 },
+    { 191, 0, 191 }, { 191, 0, 0 }, { 0, 0, 191 }, { 0, 0, 0 }
+};
+
+static atomic_uint l_ready;                                  /* set by the FireStreamer callback */
+
+#ifdef __GLIBC__
+/* count heap allocations of the whole process (GLib and GStreamer too) by interposing malloc,
+ * the aligned variants as well since GstMemory and the encoders allocate through them */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static atomic_uint l_allocations;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&l_allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    atomic_fetch_add_explicit(&l_allocations, 1, memory_order_relaxed);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&l_allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&l_allocations, 1, memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&l_allocations, 1, memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+
+    /* glibc has no __libc_posix_memalign, check the alignment the way it does */
+    if ((alignment % sizeof(void*) != 0) || ((alignment & (alignment - 1)) != 0) ||
+        (alignment == 0)) {
+        return EINVAL;
+    }
+    atomic_fetch_add_explicit(&l_allocations, 1, memory_order_relaxed);
+    ptr = __libc_memalign(alignment, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+static uint32_t getAllocations(void)
+{
+    return atomic_load_explicit(&l_allocations, memory_order_relaxed);
+}
+#else
+static uint32_t getAllocations(void)
+{
+    return 0;                                             /* not counted without glibc malloc */
+}
+#endif
+
+/* FireStreamer_ready_t, frames pushed before it would be skipped */
+static void onReady(FireStreamer_t *pThis, void *pUserData)
+{
+    (void)pThis;
+    (void)pUserData;
+    atomic_store(&l_ready, 1);
+}
+
+static int64_t nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t cpuUs(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "  -w <width>     frame width (default 768)\n"
+           "  -h <height>    frame height (default 288)\n"
+           "  -f <format>    yuy2 (default) or srggb8\n"
+           "  -p <pattern>   bars, noise or motion (default)\n"
+           "  -r <fps>       push rate, 0 is as fast as the pipeline takes frames (default 30)\n"
+           "  -n <frames>    frames to push (default 600)\n"
+           "  -u <url>       fake:// (default), file:///path.h264 or rtsp://host:port/path\n"
+           "  -e <encoder>   auto (default), v4l2h264enc, x264enc or openh264enc\n"
+           "  -g             grayscale\n", name);
+}
+
+/* RGB to one YUY2 pixel pair of the same color, BT.601 limited range */
+static void putYuy2(uint8_t *pDst, const uint8_t *pRgb)
+{
+    int r = pRgb[0], g = pRgb[1], b = pRgb[2];
+    uint8_t y = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+
+    pDst[0] = y;
+    pDst[1] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    pDst[2] = y;
+    pDst[3] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/* one frame of the pattern, the box of the motion pattern moves with the frame number */
+static void generate(uint8_t *pFrame, FireStreamerFormat_t format, uint32_t pattern,
+                     uint32_t width, uint32_t height, uint32_t n)
+{
+    static const uint8_t white[3] = { 235, 235, 235 };
+    uint32_t x, y, boxX, boxY;
+    const uint8_t *pRgb;
+    bool_t inBox;
+
+    if (pattern == 1) {
+        for (x = 0; x < width * height * ((format == FIRESTREAMER_FORMAT_YUY2) ? 2 : 1); x++) {
+            pFrame[x] = (uint8_t)rand();
+        }
+        return;
+    }
+
+    boxX = (n * 8) % (width - BOX_SIZE);
+    boxY = (n * 4) % (height - BOX_SIZE);
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x += 2) {
+            inBox = ((pattern == 2) && (x >= boxX) && (x < boxX + BOX_SIZE) && (y >= boxY) &&
+                     (y < boxY + BOX_SIZE)) ? TRUE : FALSE;
+            pRgb = (inBox == TRUE) ? white : l_bars[(x * 8) / width];
+            if (format == FIRESTREAMER_FORMAT_YUY2) {
+                putYuy2(&pFrame[(y * width + x) * 2], pRgb);
+            } else {
+                /* RGGB: R G on even lines, G B on odd lines */
+                pFrame[y * width + x] = ((y & 1) == 0) ? pRgb[0] : pRgb[1];
+                pFrame[y * width + x + 1] = ((y & 1) == 0) ? pRgb[1] : pRgb[2];
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    FireStreamerConfig_t    config;
+    FireStreamer_t          *pStreamer;
+    FireStreamerStats_t     stats;
+    FireStreamerQueueStats_t queueStats;
+    FireStreamerFrameInfo_t frameInfo;
+    uint32_t                rate = 30, frames = 600, pattern = 2;
+    uint32_t                i, frameSize, lastSent, allocStart, allocations;
+    int64_t                 start, next, lastChange, elapsed, cpuStart, cpu;
+    uint8_t                 *pFrames;
+    int                     opt;
+
+    FireStreamer_getDefaultConfig(&config);
+    config.url = "fake://";
+    config.width = 768;
+    config.height = 288;
+    config.abr = FALSE;
+
+    while ((opt = getopt(argc, argv, "w:h:f:p:r:n:u:e:g")) != -1) {
+        switch (opt) {
+            case 'w': config.width = (uint32_t)atoi(optarg); break;
+            case 'h': config.height = (uint32_t)atoi(optarg); break;
+            case 'f':
+                if (strcmp(optarg, "yuy2") == 0) {
+                    config.format = FIRESTREAMER_FORMAT_YUY2;
+                } else if (strcmp(optarg, "srggb8") == 0) {
+                    config.format = FIRESTREAMER_FORMAT_SRGGB8;
+                } else {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p':
+                for (pattern = 0; pattern < 3; pattern++) {
+                    if (strcmp(optarg, l_patternName[pattern]) == 0) {
+                        break;
+                    }
+                }
+                if (pattern == 3) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r': rate = (uint32_t)atoi(optarg); break;
+            case 'n': frames = (uint32_t)atoi(optarg); break;
+            case 'u': config.url = optarg; break;
+            case 'e':
+                if (strcmp(optarg, "auto") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_AUTO;
+                } else if (strcmp(optarg, "v4l2h264enc") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_V4L2;
+                } else if (strcmp(optarg, "x264enc") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_X264;
+                } else if (strcmp(optarg, "openh264enc") == 0) {
+                    config.encoder = FIRESTREAMER_ENCODER_OPENH264;
+                } else {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'g': config.grayscale = TRUE; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if ((config.width < 2 * BOX_SIZE) || (config.width % 4 != 0) ||
+        (config.height < 2 * BOX_SIZE) || (config.height % 2 != 0) || (frames == 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    config.fps = (rate != 0) ? rate : 30;
+    config.gop = config.fps;
+
+    /* frames are generated before the clock starts, pushing them costs a copy at most */
+    frameSize = config.width * config.height;
+    frameSize *= (config.format == FIRESTREAMER_FORMAT_YUY2) ? 2 : 1;
+    pFrames = malloc((size_t)frameSize * FRAME_SET);
+    if (pFrames == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for (i = 0; i < FRAME_SET; i++) {
+        generate(&pFrames[(size_t)frameSize * i], config.format, pattern, config.width,
+                 config.height, i);
+    }
+
+    config.ready = onReady;
+    pStreamer = FireStreamer_create(&config);
+    if (pStreamer == NULL) {
+        free(pFrames);
+        return EXIT_FAILURE;
+    }
+    start = nowUs();
+    while ((atomic_load(&l_ready) == 0) && (nowUs() - start < READY_WAIT_US)) {
+        usleep(1000);
+    }
+
+    cpuStart = cpuUs();
+    allocStart = getAllocations();
+    start = nowUs();
+    next = start;
+    for (i = 0; i < frames; i++) {
+        if (rate != 0) {
+            while (nowUs() < next) {
+                usleep((useconds_t)(next - nowUs()));
+            }
+            next += 1000000 / rate;
+        }
+        frameInfo.dequeueUs = nowUs();
+        frameInfo.captureUs = frameInfo.dequeueUs;
+        frameInfo.sequence = i;
+        FireStreamer_pushFrame(pStreamer, &pFrames[(size_t)frameSize * (i % FRAME_SET)],
+                               frameSize, &frameInfo);
+    }
+
+    /* let the pipeline drain, the run ends with the last frame out of it */
+    FireStreamer_getStats(pStreamer, &stats);
+    lastSent = stats.framesSent;
+    lastChange = nowUs();
+    while (nowUs() - lastChange < DRAIN_IDLE_US) {
+        usleep(10000);
+        FireStreamer_getStats(pStreamer, &stats);
+        if (stats.framesSent != lastSent) {
+            lastSent = stats.framesSent;
+            lastChange = nowUs();
+        }
+    }
+    elapsed = lastChange - start;
+    cpu = cpuUs() - cpuStart;
+    allocations = getAllocations() - allocStart;
+    FireStreamer_getQueueStats(pStreamer, &queueStats);
+
+    printf("{\"version\": \"%s\", \"width\": %u, \"height\": %u, \"format\": \"%s\", "
+           "\"grayscale\": %s, \"pattern\": \"%s\", \"rate\": %u, \"url\": ",
+           GIT_COMMIT, config.width, config.height,
+           (config.format == FIRESTREAMER_FORMAT_YUY2) ? "yuy2" : "srggb8",
+           (config.grayscale == TRUE) ? "true" : "false", l_patternName[pattern], rate);
+    Json_printString(stdout, config.url);
+    printf(", \"frames\": %u, \"pushed\": %u, \"skipped\": %u, \"dropped\": %u, \"sent\": %u, "
+           "\"bytes\": %llu, \"seconds\": %.3f, \"fps\": %.2f, \"cpuUsPerFrame\": %.1f, "
+           "\"allocsPerFrame\": %.2f, \"readyUs\": %u, \"firstFrameUs\": %u, \"latencyUs\": {",
+           frames, stats.framesPushed, queueStats.skipped, queueStats.dropped, stats.framesSent,
+           (unsigned long long)stats.bytesEncoded, (double)elapsed / 1e6,
+           (elapsed > 0) ? (double)stats.framesSent * 1e6 / (double)elapsed : 0.0,
+           (stats.framesSent > 0) ? (double)cpu / stats.framesSent : 0.0,
+           (double)allocations / frames, stats.readyUs, stats.firstFrameUs);
+    for (i = 0; i < FIRESTREAMER_STAGE_COUNT; i++) {
+        printf("%s\"%s\": {\"p50\": %u, \"p99\": %u, \"max\": %u}", (i == 0) ? "" : ", ",
+               l_stageName[i], stats.latency[i].p50, stats.latency[i].p99, stats.latency[i].max);
+    }
+    printf("}}\n");
+    fflush(stdout);
+
+    FireStreamer_destroy(pStreamer);
+    free(pFrames);
+
+    return EXIT_SUCCESS;
+}
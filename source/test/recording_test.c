@@ -0,0 +1,156 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     recording_test.c
+* \ingroup  g_applspec
+* \brief    Camera-less test of the pre-event recording, a trigger while a file is being finished.
+* \author   Milos Ladicorbic
+*
+* A first trigger with no post-event time ends its file with the next encoded frame. A second
+* trigger comes a few frames later, while that file is draining or right after it is done, and
+* must get a file of its own either way. Both files must exist and hold data. Exits with 0 on
+* success and prints one line per check.
+*
+*   recording_test [-d directory]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "appl/firestreamer.h"
+
+#define WIDTH           320
+#define HEIGHT          240
+#define FPS             30
+#define PREBUFFER_S     2
+#define POST_S          1                                   /* of the second trigger, seconds */
+#define DRAIN_FRAMES    3                     /* pushed after the first trigger, its EOS is sent */
+#define READY_WAIT_US   10000000
+#define FILE_WAIT_US    5000000              /* the second file is done well within this time */
+
+static atomic_uint l_ready;
+
+static void onReady(FireStreamer_t *pThis, void *pUserData)
+{
+    (void)pThis;
+    (void)pUserData;
+    atomic_store(&l_ready, 1);
+}
+
+static int64_t nowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* one frame at the stream rate, the gray level moves so that every frame is encoded */
+static void pushFrame(FireStreamer_t *pStreamer, uint8_t *pFrame, uint32_t n)
+{
+    FireStreamerFrameInfo_t info;
+
+    memset(pFrame, (int)(16 + (n * 4) % 200), WIDTH * HEIGHT * 2);
+    info.dequeueUs = nowUs();
+    info.captureUs = info.dequeueUs;
+    info.sequence = n;
+    FireStreamer_pushFrame(pStreamer, pFrame, WIDTH * HEIGHT * 2, &info);
+    usleep(1000000 / FPS);
+}
+
+static off_t fileSize(const char *pPath)
+{
+    struct stat st;
+
+    return (stat(pPath, &st) == 0) ? st.st_size : -1;
+}
+
+static void check(const char *pWhat, bool_t ok, bool_t *pSuccess)
+{
+    printf("%s: %s\n", (ok == TRUE) ? "PASS" : "FAIL", pWhat);
+    if (ok != TRUE) {
+        *pSuccess = FALSE;
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    FireStreamerConfig_t    config;
+    FireStreamer_t          *pStreamer;
+    const char              *pDirectory = "/tmp";
+    char                    first[256];
+    char                    second[256];
+    uint8_t                 *pFrame;
+    uint32_t                n = 0;
+    int64_t                 start;
+    bool_t                  success = TRUE;
+    int                     opt;
+
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+            case 'd': pDirectory = optarg; break;
+            default:
+                printf("Usage: %s [-d directory]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    snprintf(first, sizeof(first), "%s/fstr_recording_first.mkv", pDirectory);
+    snprintf(second, sizeof(second), "%s/fstr_recording_second.mkv", pDirectory);
+    unlink(first);
+    unlink(second);
+
+    FireStreamer_getDefaultConfig(&config);
+    config.url = "fake://";
+    config.width = WIDTH;
+    config.height = HEIGHT;
+    config.format = FIRESTREAMER_FORMAT_YUY2;
+    config.fps = FPS;
+    config.gop = FPS / 2;
+    config.prebufferSeconds = PREBUFFER_S;
+    config.statsName = NULL;
+    config.ready = onReady;
+    pFrame = malloc(WIDTH * HEIGHT * 2);
+    pStreamer = (pFrame != NULL) ? FireStreamer_create(&config) : NULL;
+    if (pStreamer == NULL) {
+        free(pFrame);
+        return EXIT_FAILURE;
+    }
+    start = nowUs();
+    while ((atomic_load(&l_ready) == 0) && (nowUs() - start < READY_WAIT_US)) {
+        usleep(1000);
+    }
+
+    /* fill the prebuffer, then end the first file with the next frame */
+    while (n < PREBUFFER_S * FPS) {
+        pushFrame(pStreamer, pFrame, n++);
+    }
+    check("first trigger", FireStreamer_triggerRecording(pStreamer, first, 0), &success);
+    while (n < PREBUFFER_S * FPS + DRAIN_FRAMES) {
+        pushFrame(pStreamer, pFrame, n++);
+    }
+    check("trigger while the first file is finished",
+          FireStreamer_triggerRecording(pStreamer, second, POST_S), &success);
+
+    /* the second file starts once the first is done and ends POST_S later */
+    start = nowUs();
+    while (nowUs() - start < FILE_WAIT_US) {
+        pushFrame(pStreamer, pFrame, n++);
+    }
+    FireStreamer_destroy(pStreamer);
+    free(pFrame);
+
+    check("first file written", (fileSize(first) > 0) ? TRUE : FALSE, &success);
+    check("second file written", (fileSize(second) > 0) ? TRUE : FALSE, &success);
+    unlink(first);
+    unlink(second);
+
+    return (success == TRUE) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,154 @@
+/***************************************************************************************************
+*                                    FSTR - FireStreamer
+*                                    www.firestreamer.rs
+***************************************************************************************************/
+
+/**
+* \file     fstr_stat.c
+* \ingroup  g_applspec
+* \brief    Prints the live stats a running FireStreamer publishes in shared memory.
+* \author   Milos Ladicorbic
+*
+* The stats segment is mapped read-only, samples are plain memory reads of the sequence locked
+* slots, the streamer is never blocked or signalled. One line per stream and sample, or one JSON
+* object with -j. A streamer that exits unlinks the segment, it is opened again once it is back.
+*
+*   fstr-stat [-s name] [-i ms] [-n samples] [-j]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "appl/json.h"
+#include "appl/statsshm.h"
+
+#define DEFAULT_NAME        "/firestreamer"
+#define DEFAULT_INTERVAL_MS 1000
+
+/* GstState, the streamer publishes it as a number */
+static const char* const l_stateName[] = { "void", "null", "ready", "paused", "playing" };
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "  -s <name>      stats segment of the streamer (default %s)\n"
+           "  -i <ms>        sample period (default %d)\n"
+           "  -n <samples>   samples to print, 0 is until killed (default 0)\n"
+           "  -j             one JSON object per stream and sample\n"
+           "  -h             display this help and exit\n", name, DEFAULT_NAME,
+           DEFAULT_INTERVAL_MS);
+}
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void sleepMs(uint32_t ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000 };
+
+    nanosleep(&ts, NULL);
+}
+
+static void printValues(uint32_t slot, const StatsShmValues_t *pValues, bool_t json)
+{
+    const char  *pState = (pValues->state < sizeof(l_stateName) / sizeof(l_stateName[0])) ?
+                          l_stateName[pValues->state] : "unknown";
+    uint64_t    now = nowNs();
+    uint32_t    ageMs = (now > pValues->updatedNs) ?
+                        (uint32_t)((now - pValues->updatedNs) / 1000000) : 0;
+
+    if (json == TRUE) {
+        printf("{\"slot\":%u,\"name\":", slot);
+        Json_printString(stdout, pValues->name);
+        printf(",\"ageMs\":%u,\"state\":\"%s\",\"feeding\":%u,\"captured\":%llu,"
+               "\"pushed\":%llu,\"dropped\":%llu,\"skipped\":%llu,\"sensorDropped\":%llu,"
+               "\"encoded\":%llu,\"sent\":%llu,\"bytesEncoded\":%llu,\"bitrate\":%u,"
+               "\"targetBitrate\":%u,\"fps\":%u.%03u,\"reconnects\":%u,\"decimation\":%u}\n",
+               ageMs, pState, pValues->feeding,
+               (unsigned long long)pValues->captured, (unsigned long long)pValues->pushed,
+               (unsigned long long)pValues->dropped, (unsigned long long)pValues->skipped,
+               (unsigned long long)pValues->sensorDropped, (unsigned long long)pValues->encoded,
+               (unsigned long long)pValues->sent, (unsigned long long)pValues->bytesEncoded,
+               pValues->bitrate, pValues->targetBitrate, pValues->fpsMilli / 1000,
+               pValues->fpsMilli % 1000, pValues->reconnects, pValues->decimation);
+        return;
+    }
+    printf("%2u %-7s %-4s %6u.%02u fps %6u/%-6u kbit/s captured %llu pushed %llu dropped %llu "
+           "skipped %llu encoded %llu sent %llu reconnects %u age %u ms %s\n", slot, pState,
+           (pValues->feeding != 0) ? "feed" : "wait", pValues->fpsMilli / 1000,
+           (pValues->fpsMilli % 1000) / 10, pValues->bitrate, pValues->targetBitrate,
+           (unsigned long long)pValues->captured, (unsigned long long)pValues->pushed,
+           (unsigned long long)pValues->dropped, (unsigned long long)pValues->skipped,
+           (unsigned long long)pValues->encoded, (unsigned long long)pValues->sent,
+           pValues->reconnects, ageMs, pValues->name);
+}
+
+int main(int argc, char *argv[]) {
+
+    int                 opt;
+    const char          *pName = DEFAULT_NAME;
+    uint32_t            intervalMs = DEFAULT_INTERVAL_MS;
+    uint32_t            samples = 0;
+    uint32_t            sample;
+    uint32_t            slot;
+    bool_t              json = FALSE;
+    bool_t              opened = FALSE;
+    StatsShm_t          stats;
+    StatsShmValues_t    values;
+
+    while ((opt = getopt(argc, argv, "s:i:n:jh")) != -1) {
+        switch (opt) {
+            case 's': pName = optarg; break;
+            case 'i': intervalMs = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'n': samples = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'j': json = TRUE; break;
+            case 'h': usage(argv[0]); return EXIT_SUCCESS;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (intervalMs == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    for (sample = 0; (samples == 0) || (sample < samples); sample++) {
+        if (sample > 0) {
+            sleepMs(intervalMs);
+        }
+
+        /* the first open must work, later ones wait for a restarted streamer */
+        if (StatsShm_isOpen(&stats) != TRUE) {
+            if ((StatsShm_open(&stats, pName) != TRUE) && (opened != TRUE)) {
+                return EXIT_FAILURE;
+            }
+            opened = TRUE;
+            if (StatsShm_isOpen(&stats) != TRUE) {
+                continue;
+            }
+        }
+        if (StatsShm_getWriterPid(&stats) == 0) {
+            fprintf(stderr, "%s: the streamer has exited\n", pName);
+            StatsShm_close(&stats);
+            continue;
+        }
+
+        for (slot = 0; slot < STATSSHM_STREAMS; slot++) {
+            if (StatsShm_read(&stats, slot, &values) == TRUE) {
+                printValues(slot, &values, json);
+            }
+        }
+        fflush(stdout);
+    }
+
+    StatsShm_close(&stats);
+    return EXIT_SUCCESS;
+}